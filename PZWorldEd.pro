@@ -10,4 +10,4 @@ contains(QT_VERSION, ^4\\.[0-5]\\..*) {
 TEMPLATE  = subdirs
 CONFIG   += ordered
 
-SUBDIRS = initvars.pro src
+SUBDIRS = initvars.pro src tests
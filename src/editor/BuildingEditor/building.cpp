@@ -174,27 +174,28 @@ QStringList Building::tilesetNames() const
     }
 
     QSet<QString> ret;
+    QSet<int> userTiles;
 
     foreach (BuildingFloor *floor, floors()) {
         foreach (BuildingObject *object, floor->objects())
             btiles |= object->buildingTiles();
-        foreach (QString layerName, floor->grimeLayers()) {
+        foreach (FloorTileGrid *grid, floor->grime()) {
             for (int y = 0; y < floor->height(); y++) {
                 for (int x = 0; x < floor->width(); x++) {
-                    QString tileName = floor->grime()[layerName]->at(x, y);
-                    if (tileName.isEmpty())
-                        continue;
-                    QString tilesetName;
-                    int index;
-                    if (BuildingTilesMgr::instance()->parseTileName(tileName,
-                                                                    tilesetName,
-                                                                    index))
-                        ret += tilesetName;
+                    if (int tile = grid->at(x, y))
+                        userTiles += tile;
                 }
             }
         }
     }
 
+    foreach (int tile, userTiles) {
+        QString tilesetName;
+        int index;
+        if (TileNameTable::instance()->parse(tile, tilesetName, index))
+            ret += tilesetName;
+    }
+
     foreach (BuildingTile *btile, btiles) {
         if (!btile->mTilesetName.isEmpty())
             ret += btile->mTilesetName;
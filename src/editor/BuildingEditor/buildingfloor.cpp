@@ -50,14 +50,11 @@ FloorTileGrid::FloorTileGrid(int width, int height) :
 {
 }
 
-const QString &FloorTileGrid::at(int index) const
+int FloorTileGrid::at(int index) const
 {
     if (mUseVector)
         return mCellsVector[index];
-    QHash<int,QString>::const_iterator it = mCells.find(index);
-    if (it != mCells.end())
-        return *it;
-    return mEmptyCell;
+    return mCells.value(index);
 }
 
 // Return true if the area of this object matches that of the other object placed at x,y.
@@ -79,23 +76,22 @@ bool FloorTileGrid::matches(int x, int y, const FloorTileGrid &other) const
     return true;
 }
 
-void FloorTileGrid::replace(int index, const QString &tile)
+void FloorTileGrid::replace(int index, int tile)
 {
     if (mUseVector) {
-        if (!mCellsVector[index].isEmpty() && tile.isEmpty()) mCount--;
-        if (mCellsVector[index].isEmpty() && !tile.isEmpty()) mCount++;
+        if (mCellsVector[index] && !tile) mCount--;
+        if (!mCellsVector[index] && tile) mCount++;
         mCellsVector[index] = tile;
         return;
     }
-    QHash<int,QString>::iterator it = mCells.find(index);
+    QHash<int,int>::iterator it = mCells.find(index);
     if (it == mCells.end()) {
-        if (tile.isEmpty())
+        if (!tile)
             return;
         mCells.insert(index, tile);
         mCount++;
-    } else if (!tile.isEmpty()) {
+    } else if (tile) {
         (*it) = tile;
-        mCount++;
     } else {
         mCells.erase(it);
         mCount--;
@@ -104,13 +100,13 @@ void FloorTileGrid::replace(int index, const QString &tile)
         swapToVector();
 }
 
-void FloorTileGrid::replace(int x, int y, const QString &tile)
+void FloorTileGrid::replace(int x, int y, int tile)
 {
     Q_ASSERT(contains(x, y));
     replace(y * mWidth + x, tile);
 }
 
-bool FloorTileGrid::replace(const QString &tile)
+bool FloorTileGrid::replace(int tile)
 {
     bool changed = false;
     for (int x = 0; x < mWidth; x++) {
@@ -124,7 +120,7 @@ bool FloorTileGrid::replace(const QString &tile)
     return changed;
 }
 
-bool FloorTileGrid::replace(const QRegion &rgn, const QString &tile)
+bool FloorTileGrid::replace(const QRegion &rgn, int tile)
 {
     bool changed = false;
     for (QRect r2 : rgn) {
@@ -150,7 +146,7 @@ bool FloorTileGrid::replace(const QRegion &rgn, const QPoint &p,
         r2 &= bounds();
         for (int x = r2.left(); x <= r2.right(); x++) {
             for (int y = r2.top(); y <= r2.bottom(); y++) {
-                QString tile = other->at(x - p.x(), y - p.y());
+                int tile = other->at(x - p.x(), y - p.y());
                 if (at(x, y) != tile) {
                     replace(x, y, tile);
                     changed = true;
@@ -161,7 +157,7 @@ bool FloorTileGrid::replace(const QRegion &rgn, const QPoint &p,
     return changed;
 }
 
-bool FloorTileGrid::replace(const QRect &r, const QString &tile)
+bool FloorTileGrid::replace(const QRect &r, int tile)
 {
     bool changed = false;
     for (int x = r.left(); x <= r.right(); x++) {
@@ -181,7 +177,7 @@ bool FloorTileGrid::replace(const QPoint &p, const FloorTileGrid *other)
     bool changed = false;
     for (int x = r.left(); x <= r.right(); x++) {
         for (int y = r.top(); y <= r.bottom(); y++) {
-            QString tile = other->at(x - p.x(), y - p.y());
+            int tile = other->at(x - p.x(), y - p.y());
             if (at(x, y) != tile) {
                 replace(x, y, tile);
                 changed = true;
@@ -194,7 +190,7 @@ bool FloorTileGrid::replace(const QPoint &p, const FloorTileGrid *other)
 void FloorTileGrid::clear()
 {
     if (mUseVector)
-        mCellsVector.fill(mEmptyCell);
+        mCellsVector.fill(0);
     else
         mCells.clear();
     mCount = 0;
@@ -235,7 +231,7 @@ void FloorTileGrid::swapToVector()
 {
     Q_ASSERT(!mUseVector);
     mCellsVector.resize(size());
-    QHash<int,QString>::const_iterator it = mCells.begin();
+    QHash<int,int>::const_iterator it = mCells.begin();
     while (it != mCells.end()) {
         mCellsVector[it.key()] = (*it);
         ++it;
@@ -1661,8 +1657,8 @@ void BuildingFloor::LayoutToSquares()
                 // Place exterior wall grime on level 0 only.
                 if (level() > 0)
                     continue;
-                QString userTileWalls = userTilesWalls ? userTilesWalls->at(x, y) : QString();
-                QString userTileWalls2 = userTilesWalls2 ? userTilesWalls2->at(x, y) : QString();
+                int userTileWalls = userTilesWalls ? userTilesWalls->at(x, y) : 0;
+                int userTileWalls2 = userTilesWalls2 ? userTilesWalls2->at(x, y) : 0;
                 BuildingTileEntry *grimeTile = building()->tile(Building::GrimeWall);
                 sq.ReplaceWallGrime(grimeTile, userTileWalls, userTileWalls2);
 
@@ -1671,8 +1667,8 @@ void BuildingFloor::LayoutToSquares()
                 BuildingTileEntry *grimeTile = room ? room->tile(Room::GrimeFloor) : 0;
                 sq.ReplaceFloorGrime(grimeTile);
 
-                QString userTileWalls = userTilesWalls ? userTilesWalls->at(x, y) : QString();
-                QString userTileWalls2 = userTilesWalls2 ? userTilesWalls2->at(x, y) : QString();
+                int userTileWalls = userTilesWalls ? userTilesWalls->at(x, y) : 0;
+                int userTileWalls2 = userTilesWalls2 ? userTilesWalls2->at(x, y) : 0;
                 grimeTile = room ? room->tile(Room::GrimeWall) : 0;
                 sq.ReplaceWallGrime(grimeTile, userTileWalls, userTileWalls2);
             }
@@ -1889,11 +1885,11 @@ BuildingFloor *BuildingFloor::clone()
     return klone;
 }
 
-QString BuildingFloor::grimeAt(const QString &layerName, int x, int y) const
+int BuildingFloor::grimeAt(const QString &layerName, int x, int y) const
 {
-    if (mGrimeGrid.contains(layerName))
-        return mGrimeGrid[layerName]->at(x, y);
-    return QString();
+    if (FloorTileGrid *grid = mGrimeGrid.value(layerName))
+        return grid->at(x, y);
+    return 0;
 }
 
 FloorTileGrid *BuildingFloor::grimeAt(const QString &layerName, const QRect &r)
@@ -1928,12 +1924,11 @@ QMap<QString, FloorTileGrid *> BuildingFloor::setGrime(const QMap<QString,
     return old;
 }
 
-void BuildingFloor::setGrime(const QString &layerName, int x, int y,
-                             const QString &tileName)
+void BuildingFloor::setGrime(const QString &layerName, int x, int y, int tile)
 {
     if (!mGrimeGrid.contains(layerName))
         mGrimeGrid[layerName] = new FloorTileGrid(width() + 1, height() + 1);
-    mGrimeGrid[layerName]->replace(x, y, tileName);
+    mGrimeGrid[layerName]->replace(x, y, tile);
 }
 
 
@@ -1946,14 +1941,14 @@ void BuildingFloor::setGrime(const QString &layerName, const QPoint &p,
 }
 
 void BuildingFloor::setGrime(const QString &layerName, const QRegion &rgn,
-                             const QString &tileName)
+                             int tile)
 {
     if (!mGrimeGrid.contains(layerName)) {
-        if (tileName.isEmpty())
+        if (!tile)
             return;
         mGrimeGrid[layerName] = new FloorTileGrid(width() + 1, height() + 1);
     }
-    mGrimeGrid[layerName]->replace(rgn, tileName);
+    mGrimeGrid[layerName]->replace(rgn, tile);
 }
 
 void BuildingFloor::setGrime(const QString &layerName, const QRegion &rgn,
@@ -2323,6 +2318,7 @@ void BuildingFloor::Square::ReplaceFloorGrime(BuildingTileEntry *grimeTile)
 #include "tilemetainfomgr.h"
 #include <QDebug>
 #include <QFileInfo>
+#include <QMutexLocker>
 
 #if defined(Q_OS_WIN) && (_MSC_VER >= 1600)
 // Hmmmm.  libtiled.dll defines the Properties class as so:
@@ -2333,6 +2329,12 @@ void BuildingFloor::Square::ReplaceFloorGrime(BuildingTileEntry *grimeTile)
 template class __declspec(dllimport) QMap<QString, QString>;
 #endif
 
+namespace BuildingEditor {
+// LayoutToSquares() may run in a map-reader thread (see BuildingLayers).
+static QMutex gTileDefMutex;
+static int gTileDefRevision = 0;
+}
+
 namespace Tiled {
 namespace Internal {
 
@@ -2370,7 +2372,9 @@ void TileDefWatcher::check()
 void TileDefWatcher::fileChanged(const QString &path)
 {
     qDebug() << "TileDefWatcher.fileChanged() " << path;
+    QMutexLocker locker(&BuildingEditor::gTileDefMutex);
     tileDefFileChecked = false;
+    ++BuildingEditor::gTileDefRevision;
     //        removePath(path);
     //        addPath(path);
 }
@@ -2391,6 +2395,18 @@ Tiled::Internal::TileDefWatcher *getTileDefWatcher()
     return tileDefWatcher;
 }
 
+void checkTileDefWatcher()
+{
+    QMutexLocker locker(&gTileDefMutex);
+    getTileDefWatcher()->check();
+}
+
+int tileDefRevision()
+{
+    QMutexLocker locker(&gTileDefMutex);
+    return gTileDefRevision;
+}
+
 } // namespace BuildingEditor
 
 struct GrimeProperties
@@ -2404,10 +2420,9 @@ struct GrimeProperties
     bool DoubleRight;
 };
 
-static bool tileHasGrimeProperties(BuildingTile *btile, GrimeProperties *props)
+static bool tileHasGrimeProperties(const QString &tilesetName, int index, GrimeProperties *props)
 {
-    if (btile == nullptr)
-        return false;
+    QMutexLocker locker(&gTileDefMutex);
 
     Tiled::Internal::TileDefWatcher *tileDefWatcher = getTileDefWatcher();
     tileDefWatcher->check();
@@ -2418,8 +2433,8 @@ static bool tileHasGrimeProperties(BuildingTile *btile, GrimeProperties *props)
         props->DoubleLeft = props->DoubleRight = false;
     }
 
-    if (TileDefTileset *tdts = tileDefWatcher->mTileDefFile->tileset(btile->mTilesetName)) {
-        if (TileDefTile *tdt = tdts->tileAt(btile->mIndex)) {
+    if (TileDefTileset *tdts = tileDefWatcher->mTileDefFile->tileset(tilesetName)) {
+        if (TileDefTile *tdt = tdts->tileAt(index)) {
             if (tdt->mProperties.contains(QString::fromLatin1("GrimeType"))) {
                 if (props) {
                     if (tdt->mProperties.contains(QString::fromLatin1("DoorWallW")) ||
@@ -2463,8 +2478,26 @@ static bool tileHasGrimeProperties(BuildingTile *btile, GrimeProperties *props)
     return false;
 }
 
+static bool tileHasGrimeProperties(BuildingTile *btile, GrimeProperties *props)
+{
+    if (btile == nullptr)
+        return false;
+    return tileHasGrimeProperties(btile->mTilesetName, btile->mIndex, props);
+}
+
+// A user-drawn tile is looked up by its TileNameTable ID rather than through
+// BuildingTilesMgr::get(), which would add a BuildingTile for it.
+static bool userTileHasGrimeProperties(int tile, GrimeProperties *props)
+{
+    QString tilesetName;
+    int index;
+    if (!TileNameTable::instance()->parse(tile, tilesetName, index))
+        return false;
+    return tileHasGrimeProperties(tilesetName, index, props);
+}
+
 #if 1
-void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, const QString &userTileWalls, const QString &userTileWalls2)
+void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, int userTileWalls, int userTileWalls2)
 {
     if (!grimeTile || grimeTile->isNone())
         return;
@@ -2599,65 +2632,61 @@ void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, const
             grimeEnumN = BTC_GrimeWall::NorthDoubleRight;
     }
 
-    if (!userTileWalls.isEmpty()) {
-        if (BuildingTile *btile = BuildingTilesMgr::instance()->get(userTileWalls)) {
-            if (tileHasGrimeProperties(btile, &props)) {
-                if (props.FullWindow) {
-                    if (props.West) grimeEnumW = -1;
-                    if (props.North) grimeEnumN = -1;
-                } else if (props.Trim) {
-                    if (props.West && props.North) {
-                        grimeEnumW = BTC_GrimeWall::NorthWestTrim;
-                        grimeEnumN = -1;
-                    } else if (props.West) {
-                        grimeEnumW = BTC_GrimeWall::WestTrim;
-                    } else if (props.North) {
-                        grimeEnumN = BTC_GrimeWall::NorthTrim;
-                    } else if (props.SouthEast) {
-                        grimeEnumW = BTC_GrimeWall::SouthEastTrim;
-                    }
-                } else if (props.DoubleLeft) {
-                    if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleLeft;
-                    else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleLeft;
-                } else if (props.DoubleRight) {
-                    if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleRight;
-                    else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleRight;
+    if (userTileWalls) {
+        if (userTileHasGrimeProperties(userTileWalls, &props)) {
+            if (props.FullWindow) {
+                if (props.West) grimeEnumW = -1;
+                if (props.North) grimeEnumN = -1;
+            } else if (props.Trim) {
+                if (props.West && props.North) {
+                    grimeEnumW = BTC_GrimeWall::NorthWestTrim;
+                    grimeEnumN = -1;
                 } else if (props.West) {
-                    grimeEnumW = BTC_GrimeWall::West;
+                    grimeEnumW = BTC_GrimeWall::WestTrim;
                 } else if (props.North) {
-                    grimeEnumN = BTC_GrimeWall::North;
+                    grimeEnumN = BTC_GrimeWall::NorthTrim;
+                } else if (props.SouthEast) {
+                    grimeEnumW = BTC_GrimeWall::SouthEastTrim;
                 }
+            } else if (props.DoubleLeft) {
+                if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleLeft;
+                else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleLeft;
+            } else if (props.DoubleRight) {
+                if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleRight;
+                else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleRight;
+            } else if (props.West) {
+                grimeEnumW = BTC_GrimeWall::West;
+            } else if (props.North) {
+                grimeEnumN = BTC_GrimeWall::North;
             }
         }
     }
-    if (!userTileWalls2.isEmpty()) {
-        if (BuildingTile *btile = BuildingTilesMgr::instance()->get(userTileWalls2)) {
-            if (tileHasGrimeProperties(btile, &props)) {
-                if (props.FullWindow) {
-                    if (props.West) grimeEnumW = -1;
-                    if (props.North) grimeEnumN = -1;
-                } else if (props.Trim) {
-                    if (props.West && props.North) {
-                        grimeEnumW = BTC_GrimeWall::NorthWestTrim;
-                        grimeEnumN = -1;
-                    } else if (props.West) {
-                        grimeEnumW = BTC_GrimeWall::WestTrim;
-                    } else if (props.North) {
-                        grimeEnumN = BTC_GrimeWall::NorthTrim;
-                    } else if (props.SouthEast) {
-                        grimeEnumW = BTC_GrimeWall::SouthEastTrim;
-                    }
-                } else if (props.DoubleLeft) {
-                    if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleLeft;
-                    else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleLeft;
-                } else if (props.DoubleRight) {
-                    if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleRight;
-                    else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleRight;
+    if (userTileWalls2) {
+        if (userTileHasGrimeProperties(userTileWalls2, &props)) {
+            if (props.FullWindow) {
+                if (props.West) grimeEnumW = -1;
+                if (props.North) grimeEnumN = -1;
+            } else if (props.Trim) {
+                if (props.West && props.North) {
+                    grimeEnumW = BTC_GrimeWall::NorthWestTrim;
+                    grimeEnumN = -1;
                 } else if (props.West) {
-                    grimeEnumW = BTC_GrimeWall::West;
+                    grimeEnumW = BTC_GrimeWall::WestTrim;
                 } else if (props.North) {
-                    grimeEnumN = BTC_GrimeWall::North;
+                    grimeEnumN = BTC_GrimeWall::NorthTrim;
+                } else if (props.SouthEast) {
+                    grimeEnumW = BTC_GrimeWall::SouthEastTrim;
                 }
+            } else if (props.DoubleLeft) {
+                if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleLeft;
+                else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleLeft;
+            } else if (props.DoubleRight) {
+                if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleRight;
+                else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleRight;
+            } else if (props.West) {
+                grimeEnumW = BTC_GrimeWall::West;
+            } else if (props.North) {
+                grimeEnumN = BTC_GrimeWall::North;
             }
         }
     }
@@ -2680,7 +2709,7 @@ void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, const
     }
 }
 #else
-void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, const QString &userTileWalls, const QString &userTileWalls2)
+void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, int userTileWalls, int userTileWalls2)
 {
     if (!grimeTile || grimeTile->isNone())
         return;
@@ -2818,57 +2847,53 @@ void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, const
         }
     }
 
-    if (!userTileWalls.isEmpty()) {
-        if (BuildingTile *btile = BuildingTilesMgr::instance()->get(userTileWalls)) {
-            if (tileHasGrimeProperties(btile, &props)) {
-                if (props.FullWindow) {
-                    if (props.West) grimeEnumW = -1;
-                    if (props.North) grimeEnumN = -1;
-                } else if (props.Trim) {
-                    if (props.West && props.North) {
-                        grimeEnumW = BTC_GrimeWall::NorthWestTrim;
-                        grimeEnumN = -1;
-                    } else if (props.West) {
-                        grimeEnumW = BTC_GrimeWall::WestTrim;
-                    } else if (props.North) {
-                        grimeEnumN = BTC_GrimeWall::NorthTrim;
-                    } else if (props.SouthEast) {
-                        grimeEnumW = BTC_GrimeWall::SouthEastTrim;
-                    }
-                } else if (props.DoubleLeft) {
-                    if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleLeft;
-                    else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleLeft;
-                } else if (props.DoubleRight) {
-                    if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleRight;
-                    else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleRight;
+    if (userTileWalls) {
+        if (userTileHasGrimeProperties(userTileWalls, &props)) {
+            if (props.FullWindow) {
+                if (props.West) grimeEnumW = -1;
+                if (props.North) grimeEnumN = -1;
+            } else if (props.Trim) {
+                if (props.West && props.North) {
+                    grimeEnumW = BTC_GrimeWall::NorthWestTrim;
+                    grimeEnumN = -1;
+                } else if (props.West) {
+                    grimeEnumW = BTC_GrimeWall::WestTrim;
+                } else if (props.North) {
+                    grimeEnumN = BTC_GrimeWall::NorthTrim;
+                } else if (props.SouthEast) {
+                    grimeEnumW = BTC_GrimeWall::SouthEastTrim;
                 }
+            } else if (props.DoubleLeft) {
+                if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleLeft;
+                else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleLeft;
+            } else if (props.DoubleRight) {
+                if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleRight;
+                else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleRight;
             }
         }
     }
-    if (!userTileWalls2.isEmpty()) {
-        if (BuildingTile *btile = BuildingTilesMgr::instance()->get(userTileWalls2)) {
-            if (tileHasGrimeProperties(btile, &props)) {
-                if (props.FullWindow) {
-                    if (props.West) grimeEnumW = -1;
-                    if (props.North) grimeEnumN = -1;
-                } else if (props.Trim) {
-                    if (props.West && props.North) {
-                        grimeEnumW = BTC_GrimeWall::NorthWestTrim;
-                        grimeEnumN = -1;
-                    } else if (props.West) {
-                        grimeEnumW = BTC_GrimeWall::WestTrim;
-                    } else if (props.North) {
-                        grimeEnumN = BTC_GrimeWall::NorthTrim;
-                    } else if (props.SouthEast) {
-                        grimeEnumW = BTC_GrimeWall::SouthEastTrim;
-                    }
-                } else if (props.DoubleLeft) {
-                    if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleLeft;
-                    else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleLeft;
-                } else if (props.DoubleRight) {
-                    if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleRight;
-                    else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleRight;
+    if (userTileWalls2) {
+        if (userTileHasGrimeProperties(userTileWalls2, &props)) {
+            if (props.FullWindow) {
+                if (props.West) grimeEnumW = -1;
+                if (props.North) grimeEnumN = -1;
+            } else if (props.Trim) {
+                if (props.West && props.North) {
+                    grimeEnumW = BTC_GrimeWall::NorthWestTrim;
+                    grimeEnumN = -1;
+                } else if (props.West) {
+                    grimeEnumW = BTC_GrimeWall::WestTrim;
+                } else if (props.North) {
+                    grimeEnumN = BTC_GrimeWall::NorthTrim;
+                } else if (props.SouthEast) {
+                    grimeEnumW = BTC_GrimeWall::SouthEastTrim;
                 }
+            } else if (props.DoubleLeft) {
+                if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleLeft;
+                else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleLeft;
+            } else if (props.DoubleRight) {
+                if (props.West) grimeEnumW = BTC_GrimeWall::WestDoubleRight;
+                else if (props.North) grimeEnumN = BTC_GrimeWall::NorthDoubleRight;
             }
         }
     }
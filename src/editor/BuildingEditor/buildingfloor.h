@@ -56,9 +56,10 @@ public:
     QRect bounds() const
     { return QRect(0, 0, mWidth, mHeight); }
 
-    const QString &at(int index) const;
+    // Tiles are TileNameTable IDs, 0 for no tile.
+    int at(int index) const;
 
-    const QString &at(int x, int y) const
+    int at(int x, int y) const
     {
         Q_ASSERT(contains(x, y));
         return at(x + y * mWidth);
@@ -66,12 +67,12 @@ public:
 
     bool matches(int x, int y, const FloorTileGrid &other) const;
 
-    void replace(int index, const QString &tile);
-    void replace(int x, int y, const QString &tile);
-    bool replace(const QString &tile);
-    bool replace(const QRegion &rgn, const QString &tile);
+    void replace(int index, int tile);
+    void replace(int x, int y, int tile);
+    bool replace(int tile);
+    bool replace(const QRegion &rgn, int tile);
     bool replace(const QRegion &rgn, const QPoint &p, const FloorTileGrid *other);
-    bool replace(const QRect &r, const QString &tile);
+    bool replace(const QRect &r, int tile);
     bool replace(const QPoint &p, const FloorTileGrid *other);
 
     bool isEmpty() const
@@ -91,10 +92,9 @@ private:
 
     int mWidth, mHeight;
     int mCount;
-    QHash<int,QString> mCells;
-    QVector<QString> mCellsVector;
+    QHash<int,int> mCells;
+    QVector<int> mCellsVector;
     bool mUseVector;
-    QString mEmptyCell;
 };
 
 class BuildingFloor
@@ -194,7 +194,7 @@ public:
         void ReplaceRoofCap(BuildingTileEntry *tile, int offset = 0);
         void ReplaceRoofTop(BuildingTileEntry *tile, int offset);
         void ReplaceFloorGrime(BuildingTileEntry *grimeTile);
-        void ReplaceWallGrime(BuildingTileEntry *grimeTile, const QString &userTileWalls, const QString &userTileWalls2);
+        void ReplaceWallGrime(BuildingTileEntry *grimeTile, int userTileWalls, int userTileWalls2);
         void ReplaceWallTrim();
 
         int getWallOffset();
@@ -285,16 +285,16 @@ public:
     QStringList grimeLayers() const
     { return mGrimeGrid.keys(); }
 
-    QString grimeAt(const QString &layerName, int x, int y) const;
+    int grimeAt(const QString &layerName, int x, int y) const;
     FloorTileGrid *grimeAt(const QString &layerName, const QRect &r);
     FloorTileGrid *grimeAt(const QString &layerName, const QRect &r, const QRegion &rgn);
 
     QMap<QString,FloorTileGrid*> grimeClone() const;
 
     QMap<QString,FloorTileGrid*> setGrime(const QMap<QString,FloorTileGrid*> &grime);
-    void setGrime(const QString &layerName, int x, int y, const QString &tileName);
+    void setGrime(const QString &layerName, int x, int y, int tile);
     void setGrime(const QString &layerName, const QPoint &p, const FloorTileGrid *other);
-    void setGrime(const QString &layerName, const QRegion &rgn, const QString &tileName);
+    void setGrime(const QString &layerName, const QRegion &rgn, int tile);
     void setGrime(const QString &layerName, const QRegion &rgn, const QPoint &pos, const FloorTileGrid *other);
 
     bool hasUserTiles() const;
@@ -364,6 +364,13 @@ public:
 
 namespace BuildingEditor {
 extern Tiled::Internal::TileDefWatcher *getTileDefWatcher();
+
+// Creates the watcher and reads newtiledefinitions.tiles if needed.  Call
+// this on the GUI thread before LayoutToSquares() runs in another thread.
+extern void checkTileDefWatcher();
+
+// Incremented each time newtiledefinitions.tiles changes on disk.
+extern int tileDefRevision();
 }
 
 #endif // BUILDINGFLOOR_H
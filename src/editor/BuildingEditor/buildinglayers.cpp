@@ -0,0 +1,216 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "buildinglayers.h"
+
+#include "building.h"
+#include "buildingfloor.h"
+#include "buildingmap.h"
+#include "buildingtiles.h"
+
+#include "tilemetainfomgr.h"
+#include "tilesetmanager.h"
+
+#include "objectgroup.h"
+#include "tile.h"
+#include "tilelayer.h"
+#include "tileset.h"
+
+using namespace BuildingEditor;
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+BuildingLayers::BuildingLayers() :
+    mOrientation(Map::Unknown)
+{
+}
+
+BuildingLayers::~BuildingLayers()
+{
+    qDeleteAll(mRoomDefs);
+}
+
+QVector<QStringList> BuildingLayers::prepare(const Building *building)
+{
+    // LayoutToSquares() reads the grime properties of wall tiles.  The
+    // watcher is a QObject, so create it and read the .tiles file here rather
+    // than in a reader thread.
+    checkTileDefWatcher();
+
+    // TMXConfig.txt is only read at startup, but don't depend on that.
+    QVector<QStringList> layerNames;
+    for (int level = 0; level < building->floorCount(); level++)
+        layerNames += BuildingMap::layerNames(level);
+    return layerNames;
+}
+
+BuildingLayers *BuildingLayers::convert(Building *building,
+                                        const QVector<QStringList> &layerNames)
+{
+    BuildingLayers *layers = new BuildingLayers;
+
+    // See BuildingMap::BuildingToMap()
+    Map::Orientation orient = static_cast<Map::Orientation>(BuildingMap::defaultOrientation());
+    int maxLevel =  building->floorCount() - 1;
+    int extraForWalls = 1;
+    int extra = (orient == Map::LevelIsometric)
+            ? extraForWalls : maxLevel * 3 + extraForWalls;
+    layers->mOrientation = orient;
+    layers->mSize = QSize(building->width() + extra, building->height() + extra);
+
+    const QStringList sectionNames = BuildingMap::requiredLayerNames();
+
+    foreach (BuildingFloor *floor, building->floors()) {
+        const QStringList &names = layerNames.at(floor->level());
+        const int firstLayer = layers->mLayers.size();
+        foreach (QString name, names) {
+            Layer layer;
+            layer.name = QString::fromLatin1("%1_%2").arg(floor->level()).arg(name);
+            layers->mLayers += layer;
+        }
+
+        // BuildingMap reads the squares of its ShadowBuilding, whose floors
+        // are laid out from the bottom up just like this.
+        floor->LayoutToSquares();
+
+        // See BuildingMap::BuildingSquaresToTileLayers()
+        int offset = (orient == Map::LevelIsometric)
+                ? 0 : (maxLevel - floor->level()) * 3;
+        QRect area = floor->bounds(1, 1);
+        for (int i = 0; i < names.size(); i++) {
+            int section = sectionNames.indexOf(names[i]);
+            if (section == -1) // Skip user-added layers.
+                continue;
+            Layer &layer = layers->mLayers[firstLayer + i];
+            for (int x = area.x(); x <= area.right(); x++) {
+                for (int y = area.y(); y <= area.bottom(); y++) {
+                    const BuildingFloor::Square &square = floor->squares[x][y];
+                    if (BuildingTile *btile = square.mTiles[section]) {
+                        if (!btile->isNone())
+                            layer.cells += LayerCell(x + offset, y + offset,
+                                                     layers->tileRef(btile));
+                        continue;
+                    }
+                    if (BuildingTileEntry *entry = square.mEntries[section]) {
+                        int tileOffset = square.mEntryEnum[section];
+                        if (entry->isNone() || entry->tile(tileOffset)->isNone())
+                            continue;
+                        layer.cells += LayerCell(x + offset, y + offset,
+                                                 layers->tileRef(entry->tile(tileOffset)));
+                    }
+                }
+            }
+        }
+
+        // See BuildingMap::userTilesToLayer()
+        foreach (QString layerName, floor->grimeLayers()) {
+            int index = names.indexOf(layerName);
+            if (index == -1) // Not in TMXConfig.txt.
+                continue;
+            Layer &layer = layers->mLayers[firstLayer + index];
+            const FloorTileGrid *grid = floor->grime()[layerName];
+            for (int x = area.left(); x <= area.right(); x++) {
+                for (int y = area.top(); y <= area.bottom(); y++) {
+                    if (int tile = grid->at(x, y))
+                        layer.userCells += LayerCell(x, y, layers->tileRef(tile));
+                }
+            }
+        }
+    }
+
+    // See BuildingMap::addRoomDefObjects()
+    Map roomDefs(orient, layers->mSize.width(), layers->mSize.height(), 64, 32);
+    foreach (BuildingFloor *floor, building->floors())
+        BuildingMap::addRoomDefObjects(&roomDefs, floor);
+    while (roomDefs.layerCount())
+        layers->mRoomDefs += roomDefs.takeLayerAt(0)->asObjectGroup();
+
+    layers->mProperties = building->properties();
+    layers->mTilesetNames = building->tilesetNames();
+
+    layers->mTileRefByTile.clear();
+    layers->mTileRefByNameID.clear();
+
+    return layers;
+}
+
+Map *BuildingLayers::toMap() const
+{
+    Map *map = new Map(mOrientation, mSize.width(), mSize.height(), 64, 32);
+
+    // Add tilesets from Tilesets.txt
+    map->addTileset(TilesetManager::instance()->missingTileset());
+    foreach (Tileset *ts, TileMetaInfoMgr::instance()->tilesets())
+        map->addTileset(ts);
+    TilesetManager::instance()->addReferences(map->tilesets());
+
+    QVector<Tile*> tiles(mTileRefs.size());
+    for (int i = 0; i < mTileRefs.size(); i++) {
+        const TileRef &ref = mTileRefs[i];
+        if (ref.btile)
+            tiles[i] = BuildingTilesMgr::instance()->tileFor(ref.btile);
+        else
+            tiles[i] = BuildingTilesMgr::instance()->tileForNameID(ref.nameID);
+    }
+
+    foreach (const Layer &layer, mLayers) {
+        TileLayer *tl = new TileLayer(layer.name, 0, 0, mSize.width(), mSize.height());
+        foreach (const LayerCell &cell, layer.cells) {
+            if (Tile *tile = tiles[cell.tile])
+                tl->setCell(cell.x, cell.y, Cell(tile));
+        }
+        // User-drawn tiles are merged over the building's tiles.
+        foreach (const LayerCell &cell, layer.userCells) {
+            if (Tile *tile = tiles[cell.tile])
+                tl->setCell(cell.x, cell.y, Cell(tile));
+        }
+        map->addLayer(tl);
+    }
+
+    foreach (ObjectGroup *objectGroup, mRoomDefs)
+        map->addLayer(objectGroup->clone());
+
+    map->setProperties(mProperties);
+
+    return map;
+}
+
+int BuildingLayers::tileRef(BuildingTile *btile)
+{
+    auto it = mTileRefByTile.find(btile);
+    if (it != mTileRefByTile.end())
+        return it.value();
+    TileRef ref;
+    ref.btile = btile;
+    ref.nameID = 0;
+    mTileRefs += ref;
+    mTileRefByTile.insert(btile, mTileRefs.size() - 1);
+    return mTileRefs.size() - 1;
+}
+
+int BuildingLayers::tileRef(int nameID)
+{
+    auto it = mTileRefByNameID.find(nameID);
+    if (it != mTileRefByNameID.end())
+        return it.value();
+    TileRef ref;
+    ref.btile = nullptr;
+    ref.nameID = nameID;
+    mTileRefs += ref;
+    mTileRefByNameID.insert(nameID, mTileRefs.size() - 1);
+    return mTileRefs.size() - 1;
+}
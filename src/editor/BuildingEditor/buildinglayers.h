@@ -0,0 +1,123 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BUILDINGLAYERS_H
+#define BUILDINGLAYERS_H
+
+#include "map.h"
+#include "properties.h"
+
+#include <QHash>
+#include <QList>
+#include <QSize>
+#include <QStringList>
+#include <QVector>
+
+namespace Tiled {
+class ObjectGroup;
+}
+
+namespace BuildingEditor {
+
+class Building;
+class BuildingTile;
+
+/**
+  * The tile layers and RoomDefs object layers of a building, as
+  * BuildingMap::mergedMap() and BuildingMap::addRoomDefObjects() create them.
+  *
+  * convert() doesn't create a BuildingMap, MapComposite or MapInfo and only
+  * reads editor state, so it can run in a map-reader thread.  Tiles are
+  * recorded as BuildingTiles and user-tile name IDs and are only resolved to
+  * Tiled tiles by toMap(), which must be called on the GUI thread.
+  *
+  * A BuildingLayers is never changed after convert(), so it can be shared
+  * by MapManager's cache.
+  */
+class BuildingLayers
+{
+public:
+    ~BuildingLayers();
+
+    /**
+      * GUI thread.  Returns the tile-layer names for each floor of the
+      * building and sets up what convert() needs from the GUI thread.
+      */
+    static QVector<QStringList> prepare(const Building *building);
+
+    /**
+      * Any thread.  Lays out the squares of each floor of \a building, which
+      * must already have been fixed by BuildingReader::fix().  The building
+      * isn't deleted.
+      */
+    static BuildingLayers *convert(Building *building,
+                                   const QVector<QStringList> &layerNames);
+
+    /**
+      * GUI thread.  Returns a new map identical to the one
+      * BuildingMap::mergedMap() returns after addRoomDefObjects() and
+      * setProperties().  Like mergedMap(), a reference is added to each of
+      * the map's tilesets.
+      */
+    Tiled::Map *toMap() const;
+
+    const QStringList &tilesetNames() const
+    { return mTilesetNames; }
+
+private:
+    BuildingLayers();
+
+    int tileRef(BuildingTile *btile);
+    int tileRef(int nameID);
+
+    struct TileRef
+    {
+        BuildingTile *btile; // nullptr for a user-drawn tile
+        int nameID; // TileNameTable ID of a user-drawn tile
+    };
+
+    struct LayerCell
+    {
+        LayerCell() {}
+        LayerCell(int x, int y, int tile) : x(x), y(y), tile(tile) {}
+
+        qint16 x;
+        qint16 y;
+        int tile; // index into mTileRefs
+    };
+
+    struct Layer
+    {
+        QString name;
+        QVector<LayerCell> cells; // building-generated tiles
+        QVector<LayerCell> userCells; // user-drawn tiles, drawn over cells
+    };
+
+    Tiled::Map::Orientation mOrientation;
+    QSize mSize;
+    QVector<TileRef> mTileRefs;
+    QHash<BuildingTile*,int> mTileRefByTile;
+    QHash<int,int> mTileRefByNameID;
+    QList<Layer> mLayers;
+    QList<Tiled::ObjectGroup*> mRoomDefs;
+    Tiled::Properties mProperties;
+    QStringList mTilesetNames;
+};
+
+} // namespace BuildingEditor
+
+#endif // BUILDINGLAYERS_H
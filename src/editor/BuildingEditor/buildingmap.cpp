@@ -323,10 +323,15 @@ Map *BuildingMap::mergedMap() const
 }
 
 void BuildingMap::loadNeededTilesets(Building *building)
+{
+    loadNeededTilesets(building->tilesetNames());
+}
+
+void BuildingMap::loadNeededTilesets(const QStringList &tilesetNames)
 {
     // If the building uses any tilesets that aren't in Tilesets.txt, then
     // try to load them in now.
-    foreach (QString tilesetName, building->tilesetNames()) {
+    foreach (QString tilesetName, tilesetNames) {
         if (!TileMetaInfoMgr::instance()->tileset(tilesetName)) {
             QString source = TileMetaInfoMgr::instance()->tilesDirectory() +
                     QLatin1Char('/') + tilesetName + QLatin1String(".png");
@@ -556,7 +561,7 @@ void BuildingMap::BuildingToMap()
 }
 
 void BuildingMap::BuildingSquaresToTileLayers(BuildingFloor *floor,
-                                              const QRect &area,
+                                              const QRegion &rgn,
                                               CompositeLayerGroup *layerGroup)
 {
     BuildingFloor *shadowFloor = mShadowBuilding->floor(floor->level());
@@ -569,36 +574,41 @@ void BuildingMap::BuildingSquaresToTileLayers(BuildingFloor *floor,
     if (mSuppressTiles.contains(floor))
         suppress = mSuppressTiles[floor];
 
+    const bool eraseAll = (rgn.rectCount() == 1)
+            && (rgn.boundingRect() == floor->bounds(1, 1));
+
     int layerIndex = 0;
     foreach (TileLayer *tl, layerGroup->layers()) {
         int section = mLayerToSection[tl->name()];
         if (section == -1) // Skip user-added layers.
             continue;
-        if (area == floor->bounds(1, 1))
+        if (eraseAll)
             tl->erase();
-        else
-            tl->erase(area/*.adjusted(0,0,1,1)*/);
-        for (int x = area.x(); x <= area.right(); x++) {
-            for (int y = area.y(); y <= area.bottom(); y++) {
-                if (section != BuildingFloor::Square::SectionFloor
-                        && suppress.contains(QPoint(x, y)))
-                    continue;
-                const BuildingFloor::Square &square = shadowFloor->squares[x][y];
-                if (BuildingTile *btile = square.mTiles[section]) {
-                    if (!btile->isNone()) {
-                        if (Tiled::Tile *tile = BuildingTilesMgr::instance()->tileFor(btile))
+        for (const QRect &area : rgn) {
+            if (!eraseAll)
+                tl->erase(area/*.adjusted(0,0,1,1)*/);
+            for (int x = area.x(); x <= area.right(); x++) {
+                for (int y = area.y(); y <= area.bottom(); y++) {
+                    if (section != BuildingFloor::Square::SectionFloor
+                            && suppress.contains(QPoint(x, y)))
+                        continue;
+                    const BuildingFloor::Square &square = shadowFloor->squares[x][y];
+                    if (BuildingTile *btile = square.mTiles[section]) {
+                        if (!btile->isNone()) {
+                            if (Tiled::Tile *tile = BuildingTilesMgr::instance()->tileFor(btile))
+                                tl->setCell(x + offset, y + offset, Cell(tile));
+                        }
+                        continue;
+                    }
+                    if (BuildingTileEntry *entry = square.mEntries[section]) {
+                        int tileOffset = square.mEntryEnum[section];
+                        if (entry->isNone() || entry->tile(tileOffset)->isNone())
+                            continue;
+                        if (Tiled::Tile *tile = BuildingTilesMgr::instance()->tileFor(entry->tile(tileOffset)))
                             tl->setCell(x + offset, y + offset, Cell(tile));
                     }
-                    continue;
-                }
-                if (BuildingTileEntry *entry = square.mEntries[section]) {
-                    int tileOffset = square.mEntryEnum[section];
-                    if (entry->isNone() || entry->tile(tileOffset)->isNone())
-                        continue;
-                    if (Tiled::Tile *tile = BuildingTilesMgr::instance()->tileFor(entry->tile(tileOffset)))
-                        tl->setCell(x + offset, y + offset, Cell(tile));
-                }
 
+                }
             }
         }
         layerGroup->regionAltered(tl); // possibly set mNeedsSynch
@@ -606,6 +616,55 @@ void BuildingMap::BuildingSquaresToTileLayers(BuildingFloor *floor,
     }
 }
 
+// Returns the squares whose tiles differ between two layouts of a floor.
+// A diff of the whole floor is far cheaper than setting the cells of every
+// tile layer and repainting the floor in the scene, so after an edit only
+// the squares that really changed are copied to the tile layers.
+static QRegion changedSquares(const QVector<QVector<BuildingFloor::Square> > &oldSquares,
+                              const QVector<QVector<BuildingFloor::Square> > &squares)
+{
+    int w = squares.size();
+    int h = w ? squares[0].size() : 0;
+    if (oldSquares.size() != w || (w && oldSquares[0].size() != h))
+        return QRect(0, 0, w, h);
+
+    // One rect per run of changed squares in a row.  Past a few dozen the
+    // union costs more than it saves, so use the bounding rect instead.
+    const int MaxRects = 64;
+    QVector<QRect> rects;
+    QRect bounds;
+    for (int y = 0; y < h; y++) {
+        int runStart = -1;
+        for (int x = 0; x <= w; x++) {
+            bool changed = false;
+            if (x < w) {
+                const BuildingFloor::Square &a = oldSquares[x][y];
+                const BuildingFloor::Square &b = squares[x][y];
+                changed = (a.mTiles != b.mTiles) || (a.mEntries != b.mEntries)
+                        || (a.mEntryEnum != b.mEntryEnum);
+            }
+            if (changed && runStart == -1) {
+                runStart = x;
+            } else if (!changed && runStart != -1) {
+                QRect r(runStart, y, x - runStart, 1);
+                if (rects.size() < MaxRects)
+                    rects += r;
+                bounds |= r;
+                runStart = -1;
+            }
+        }
+    }
+
+    if (bounds.isEmpty())
+        return QRegion();
+    if (rects.size() >= MaxRects)
+        return bounds;
+    QRegion rgn;
+    foreach (const QRect &r, rects)
+        rgn |= r;
+    return rgn;
+}
+
 void BuildingMap::userTilesToLayer(BuildingFloor *floor,
                                    const QString &layerName,
                                    const QRect &bounds)
@@ -625,35 +684,21 @@ void BuildingMap::userTilesToLayer(BuildingFloor *floor,
         return;
     }
 
-    QMap<QString,Tileset*> tilesetByName;
-    foreach (Tileset *ts, mMap->tilesets())
-        tilesetByName[ts->name()] = ts;
-
     QRegion suppress;
     if (mSuppressTiles.contains(floor))
         suppress = mSuppressTiles[floor];
 
     BuildingFloor *shadowFloor = mShadowBuilding->floor(floor->level());
+    const FloorTileGrid *grid = shadowFloor->grime().value(layerName);
 
     for (int x = bounds.left(); x <= bounds.right(); x++) {
         for (int y = bounds.top(); y <= bounds.bottom(); y++) {
-            if (suppress.contains(QPoint(x, y))) {
+            if (suppress.contains(QPoint(x, y)) || !grid) {
                 layer->setCell(x, y, Cell());
                 continue;
             }
-            QString tileName = shadowFloor->grimeAt(layerName, x, y);
-            Tile *tile = nullptr;
-            if (!tileName.isEmpty()) {
-                tile = TilesetManager::instance()->missingTile();
-                QString tilesetName;
-                int index;
-                if (BuildingTilesMgr::parseTileName(tileName, tilesetName, index)) {
-                    if (tilesetByName.contains(tilesetName)) {
-                        tile = tilesetByName[tilesetName]->tileAt(index);
-                    }
-                }
-            }
-            layer->setCell(x, y, Cell(tile));
+            int tile = grid->at(x, y);
+            layer->setCell(x, y, Cell(BuildingTilesMgr::instance()->tileForNameID(tile)));
         }
     }
 
@@ -899,18 +944,36 @@ void BuildingMap::handlePending()
     }
 
     if (!pendingLayoutToSquares.isEmpty()) {
-        foreach (BuildingFloor *floor, pendingLayoutToSquares) {
-            floor->LayoutToSquares(); // not sure this belongs in this class
-            pendingSquaresToTileLayers[floor] = floor->bounds(1, 1);
-
-            mShadowBuilding->floor(floor->level())->LayoutToSquares();
+        // Only the shadow floors' squares are copied to the tile layers.
+        // Lay them out from the bottom up since a floor reads the stairs and
+        // flat roofs of the floor below it.
+        const bool layoutAll = pendingRecreateAll || pendingBuildingResized;
+        foreach (BuildingFloor *floor, mBuilding->floors()) {
+            if (!pendingLayoutToSquares.contains(floor))
+                continue;
+            BuildingFloor *shadowFloor = mShadowBuilding->floor(floor->level());
+            if (layoutAll) {
+                shadowFloor->LayoutToSquares();
+                pendingSquaresToTileLayers[floor] = floor->bounds(1, 1);
+                continue;
+            }
+            // LayoutToSquares() refills every square, so keep the old ones
+            // to see which squares the change affected.
+            QVector<QVector<BuildingFloor::Square> > oldSquares;
+            oldSquares.swap(shadowFloor->squares);
+            shadowFloor->LayoutToSquares();
+            QRegion changed = changedSquares(oldSquares, shadowFloor->squares);
+            if (!changed.isEmpty())
+                pendingSquaresToTileLayers[floor] |= changed;
         }
     }
 
     if (!pendingSquaresToTileLayers.isEmpty()) {
         foreach (BuildingFloor *floor, pendingSquaresToTileLayers.keys()) {
             CompositeLayerGroup *layerGroup = mBlendMapComposite->layerGroupForLevel(floor->level());
-            QRect area = pendingSquaresToTileLayers[floor].boundingRect(); // TODO: only affected region
+            QRegion area = pendingSquaresToTileLayers[floor] & floor->bounds(1, 1);
+            if (area.isEmpty())
+                continue;
             BuildingSquaresToTileLayers(floor, area, layerGroup);
             if (layerGroup->needsSynch()) {
                 mMapComposite->layerGroupForLevel(floor->level())->setNeedsSynch(true);
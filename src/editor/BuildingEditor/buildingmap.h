@@ -153,9 +153,10 @@ public:
     Tiled::Map *mergedMap() const;
 
     static void loadNeededTilesets(Building *building);
+    static void loadNeededTilesets(const QStringList &tilesetNames);
 
     void addRoomDefObjects(Tiled::Map *map);
-    void addRoomDefObjects(Tiled::Map *map, BuildingFloor *floor);
+    static void addRoomDefObjects(Tiled::Map *map, BuildingFloor *floor);
 
     static int defaultOrientation();
 
@@ -199,7 +200,7 @@ private slots:
 
 private:
     void BuildingToMap();
-    void BuildingSquaresToTileLayers(BuildingFloor *floor, const QRect &area,
+    void BuildingSquaresToTileLayers(BuildingFloor *floor, const QRegion &rgn,
                                      CompositeLayerGroup *layerGroup);
 
     void userTilesToLayer(BuildingFloor *floor, const QString &layerName,
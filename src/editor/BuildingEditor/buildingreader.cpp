@@ -27,6 +27,7 @@
 #include "qtlockedfile.h"
 using namespace SharedTools;
 
+#include <QBuffer>
 #include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
@@ -204,7 +205,7 @@ public:
         // columns.
         if (offset > 0) {
             if (Tileset *ts = TileMetaInfoMgr::instance()->tileset(tilesetName)) {
-                TileMetaInfoMgr::instance()->loadTilesets(QList<Tileset*>() << ts);
+                TileMetaInfoMgr::instance()->sizeTilesets(QList<Tileset*>() << ts);
                 int rows = offset / 8;
                 offset = rows * ts->columnCount() + offset % 8;
             }
@@ -328,7 +329,7 @@ private:
     Room *getRoom(BuildingFloor *floor, int x, int y, int index);
 
     void decodeCSVTileData(BuildingFloor *floor, const QString &layerName, const QString &text);
-    QString getUserTile(BuildingFloor *floor, int x, int y, int index);
+    int getUserTile(BuildingFloor *floor, int x, int y, int index);
 
     BuildingObject *readObject(BuildingFloor *floor);
 
@@ -352,7 +353,7 @@ private:
     QList<FurnitureTiles*> mFurnitureTiles;
     QList<BuildingTileEntry*> mEntries;
     QMap<QString,BuildingTileEntry*> mEntryMap;
-    QStringList mUserTiles;
+    QVector<int> mUserTiles; // TileNameTable IDs
     int mVersion;
 
     FakeBuildingTilesMgr mFakeBuildingTilesMgr;
@@ -671,7 +672,7 @@ void BuildingReaderPrivate::readUserTiles()
                                .arg(tileName));
                 return;
             }
-            mUserTiles += tileName;
+            mUserTiles += TileNameTable::instance()->id(tileName);
             xml.skipCurrentElement();
         } else
             readUnknownElement();
@@ -1184,15 +1185,15 @@ void BuildingReaderPrivate::decodeCSVTileData(BuildingFloor *floor,
     }
 }
 
-QString BuildingReaderPrivate::getUserTile(BuildingFloor *floor, int x, int y, int index)
+int BuildingReaderPrivate::getUserTile(BuildingFloor *floor, int x, int y, int index)
 {
     if (!index)
-        return QString();
+        return 0;
     if (index > 0 && index - 1 < mUserTiles.size())
         return mUserTiles.at(index - 1);
     xml.raiseError(tr("Invalid tile index at (%1,%2) on floor %3")
                    .arg(x).arg(y).arg(floor->level()));
-    return QString();
+    return 0;
 }
 
 void BuildingReaderPrivate::readUnknownElement()
@@ -1227,6 +1228,25 @@ Building *BuildingReader::read(const QString &fileName)
     return read(&file, QFileInfo(fileName).absolutePath());
 }
 
+bool BuildingReader::readFile(const QString &fileName, QByteArray &contents)
+{
+    QtLockedFile file(fileName);
+    if (!d->openFile(&file))
+        return false;
+
+    contents = file.readAll();
+    return true;
+}
+
+Building *BuildingReader::read(const QByteArray &contents, const QString &fileName)
+{
+    QBuffer buffer;
+    buffer.setData(contents);
+    buffer.open(QIODevice::ReadOnly | QIODevice::Text);
+
+    return read(&buffer, QFileInfo(fileName).absolutePath());
+}
+
 QString BuildingReader::errorString() const
 {
     return d->errorString();
@@ -18,6 +18,7 @@
 #ifndef BUILDINGREADER_H
 #define BUILDINGREADER_H
 
+#include <QByteArray>
 #include <QString>
 
 class QIODevice;
@@ -35,6 +36,13 @@ public:
 
     Building *read(const QString &fileName);
 
+    /**
+      * Reads the whole file into \a contents, so it can be hashed before
+      * being parsed with read(contents, fileName).
+      */
+    bool readFile(const QString &fileName, QByteArray &contents);
+    Building *read(const QByteArray &contents, const QString &fileName);
+
     QString errorString() const;
 
     void fix(Building *building);
@@ -30,6 +30,8 @@
 #include <QCoreApplication>
 #include <QDebug>
 #include <QMessageBox>
+#include <QReadLocker>
+#include <QWriteLocker>
 
 using namespace BuildingEditor;
 using namespace Tiled;
@@ -39,6 +41,74 @@ static const char *TXT_FILE = "BuildingTiles.txt";
 
 /////
 
+TileNameTable *TileNameTable::instance()
+{
+    // A function-local static because the reader threads may be first.
+    static TileNameTable table;
+    return &table;
+}
+
+TileNameTable::TileNameTable()
+{
+    Entry empty;
+    empty.index = -1;
+    mEntries += empty;
+    mIDByName.insert(QString(), 0);
+}
+
+int TileNameTable::id(const QString &tileName)
+{
+    if (tileName.isEmpty())
+        return 0;
+
+    {
+        QReadLocker locker(&mLock);
+        auto it = mIDByName.constFind(tileName);
+        if (it != mIDByName.constEnd())
+            return it.value();
+    }
+
+    Entry entry;
+    entry.name = tileName;
+    if (BuildingTilesMgr::parseTileName(tileName, entry.tilesetName, entry.index))
+        entry.name = BuildingTilesMgr::nameForTile(entry.tilesetName, entry.index);
+    else {
+        entry.tilesetName.clear();
+        entry.index = -1;
+    }
+
+    QWriteLocker locker(&mLock);
+    int id = mIDByName.value(entry.name, -1);
+    if (id == -1) {
+        mEntries += entry;
+        id = mEntries.size() - 1;
+        mIDByName.insert(entry.name, id);
+    }
+    if (tileName != entry.name)
+        mIDByName.insert(tileName, id);
+    return id;
+}
+
+QString TileNameTable::name(int id) const
+{
+    QReadLocker locker(&mLock);
+    if (id < 0 || id >= mEntries.size())
+        return QString();
+    return mEntries[id].name;
+}
+
+bool TileNameTable::parse(int id, QString &tilesetName, int &index) const
+{
+    QReadLocker locker(&mLock);
+    if (id <= 0 || id >= mEntries.size() || mEntries[id].index < 0)
+        return false;
+    tilesetName = mEntries[id].tilesetName;
+    index = mEntries[id].index;
+    return true;
+}
+
+/////
+
 BuildingTilesMgr *BuildingTilesMgr::mInstance = 0;
 
 BuildingTilesMgr *BuildingTilesMgr::instance()
@@ -59,7 +129,8 @@ BuildingTilesMgr::BuildingTilesMgr() :
     mNoneTiledTile(0),
     mNoneBuildingTile(0),
     mNoneCategory(0),
-    mNoneTileEntry(0)
+    mNoneTileEntry(0),
+    mTiledTileGeneration(0)
 {
     mCatCurtains = new BTC_Curtains(QLatin1String("Curtains"));
     mCatDoors = new BTC_Doors(QLatin1String("Doors"));
@@ -130,6 +201,15 @@ BuildingTilesMgr::BuildingTilesMgr() :
             this, &BuildingTilesMgr::tilesetAboutToBeRemoved);
     connect(TileMetaInfoMgr::instance(), &TileMetaInfoMgr::tilesetRemoved,
              this, &BuildingTilesMgr::tilesetRemoved);
+
+    connect(TileMetaInfoMgr::instance(), &TileMetaInfoMgr::tilesetAdded,
+            this, &BuildingTilesMgr::tilesetsChanged);
+    connect(TileMetaInfoMgr::instance(), &TileMetaInfoMgr::tilesetRemoved,
+            this, &BuildingTilesMgr::tilesetsChanged);
+    connect(TileMetaInfoMgr::instance(), &TileMetaInfoMgr::tilesetResized,
+            this, &BuildingTilesMgr::tilesetsChanged);
+    connect(TilesetManager::instance(), &TilesetManager::tilesetChanged,
+            this, &BuildingTilesMgr::tilesetsChanged);
 }
 
 BuildingTilesMgr::~BuildingTilesMgr()
@@ -148,7 +228,6 @@ BuildingTile *BuildingTilesMgr::add(const QString &tileName)
     BuildingTile *btile = new BuildingTile(tilesetName, tileIndex);
     Q_ASSERT(!mTileByName.contains(btile->name()));
     mTileByName[btile->name()] = btile;
-    mTiles = mTileByName.values(); // sorted by increasing tileset name and tile index!
     return btile;
 }
 
@@ -157,11 +236,21 @@ BuildingTile *BuildingTilesMgr::get(const QString &tileName, int offset)
     if (tileName.isEmpty())
         return noneTile();
 
+    // Interning the name normalizes it without formatting a new string on
+    // every call.
+    int id = TileNameTable::instance()->id(offset ? adjustTileNameIndex(tileName, offset)
+                                                  : tileName);
+    if (id < mTileByNameID.size() && mTileByNameID[id])
+        return mTileByNameID[id];
+
     QString adjustedName = adjustTileNameIndex(tileName, offset); // also normalized
 
     if (!mTileByName.contains(adjustedName))
         add(adjustedName);
-    return mTileByName[adjustedName];
+    if (id >= mTileByNameID.size())
+        mTileByNameID.resize(id + 1);
+    mTileByNameID[id] = mTileByName[adjustedName];
+    return mTileByNameID[id];
 }
 
 QString BuildingTilesMgr::nameForTile(const QString &tilesetName, int index)
@@ -222,7 +311,7 @@ QString BuildingTilesMgr::adjustTileNameIndex(const QString &tileName, int offse
     // columns.
     if (offset > 0) {
         if (Tileset *ts = TileMetaInfoMgr::instance()->tileset(tilesetName)) {
-            TileMetaInfoMgr::instance()->loadTilesets(QList<Tileset*>() << ts);
+            TileMetaInfoMgr::instance()->sizeTilesets(QList<Tileset*>() << ts);
             int rows = offset / 8;
             offset = rows * ts->columnCount() + offset % 8;
         }
@@ -642,12 +731,57 @@ Tile *BuildingTilesMgr::tileFor(BuildingTile *tile, int offset)
 {
     if (tile->isNone())
         return mNoneTiledTile;
+    if (!offset && tile->mTiledTileGeneration == mTiledTileGeneration)
+        return tile->mTiledTile;
+    Tile *result;
     Tileset *tileset = TileMetaInfoMgr::instance()->tileset(tile->mTilesetName);
     if (!tileset)
-        return mMissingTile;
-    if (tile->mIndex + offset >= tileset->tileCount())
-        return tileset->isMissing() ? tileset->tileAt(0) : mMissingTile;
-    return tileset->tileAt(tile->mIndex + offset);
+        result = mMissingTile;
+    else if (tile->mIndex + offset >= tileset->tileCount())
+        result = tileset->isMissing() ? tileset->tileAt(0) : mMissingTile;
+    else
+        result = tileset->tileAt(tile->mIndex + offset);
+    // A missing tileset may still be resized or loaded, so don't cache it.
+    if (!offset && !(tileset && tileset->isMissing())) {
+        tile->mTiledTile = result;
+        tile->mTiledTileGeneration = mTiledTileGeneration;
+    }
+    return result;
+}
+
+Tile *BuildingTilesMgr::tileForNameID(int id)
+{
+    if (id <= 0)
+        return nullptr;
+    if (id < mTiledTileByNameIDValid.size() && mTiledTileByNameIDValid[id])
+        return mTiledTileByNameID[id];
+
+    Tile *tile = mMissingTile;
+    QString tilesetName;
+    int index;
+    if (TileNameTable::instance()->parse(id, tilesetName, index)) {
+        if (Tileset *tileset = TileMetaInfoMgr::instance()->tileset(tilesetName)) {
+            if (index >= 0 && index < tileset->tileCount())
+                tile = tileset->tileAt(index);
+            if (tileset->isMissing())
+                return tile;
+        }
+    }
+
+    if (id >= mTiledTileByNameID.size()) {
+        mTiledTileByNameID.resize(id + 1);
+        mTiledTileByNameIDValid.resize(id + 1);
+    }
+    mTiledTileByNameID[id] = tile;
+    mTiledTileByNameIDValid[id] = true;
+    return tile;
+}
+
+void BuildingTilesMgr::tilesetsChanged()
+{
+    mTiledTileByNameID.clear();
+    mTiledTileByNameIDValid.clear();
+    ++mTiledTileGeneration;
 }
 
 BuildingTile *BuildingTilesMgr::fromTiledTile(Tile *tile)
@@ -18,9 +18,11 @@
 #ifndef BUILDINGTILES_H
 #define BUILDINGTILES_H
 
+#include <QHash>
 #include <QImage>
 #include <QMap>
 #include <QObject>
+#include <QReadWriteLock>
 #include <QRect>
 #include <QString>
 #include <QStringList>
@@ -40,7 +42,9 @@ class BuildingTile
 public:
     BuildingTile(const QString &tilesetName, int index) :
         mTilesetName(tilesetName),
-        mIndex(index)
+        mIndex(index),
+        mTiledTile(nullptr),
+        mTiledTileGeneration(-1)
     {}
     virtual ~BuildingTile() {}
 
@@ -51,6 +55,10 @@ public:
 
     QString mTilesetName;
     int mIndex;
+
+    // Cached by BuildingTilesMgr::tileFor().
+    Tiled::Tile *mTiledTile;
+    int mTiledTileGeneration;
 };
 
 class NoneBuildingTile : public BuildingTile
@@ -658,6 +666,44 @@ public:
     int shadowToEnum(int shadowIndex);
 };
 
+/**
+  * Gives each distinct tile name a small integer ID, so grids of user-drawn
+  * tiles store an int per square instead of a QString.  Names are normalized
+  * the way BuildingTilesMgr::normalizeTileName() does it, so "walls_1" and
+  * "walls_001" get the same ID.  ID 0 is the empty name.  IDs are never
+  * reused; they are turned back into names only when a building is written.
+  *
+  * Buildings are read in the map-reader threads, so this is thread-safe.
+  */
+class TileNameTable
+{
+public:
+    static TileNameTable *instance();
+
+    int id(const QString &tileName);
+
+    QString name(int id) const;
+
+    /**
+      * Like BuildingTilesMgr::parseTileName() but without parsing anything.
+      */
+    bool parse(int id, QString &tilesetName, int &index) const;
+
+private:
+    TileNameTable();
+
+    struct Entry
+    {
+        QString name;
+        QString tilesetName;
+        int index; // -1 if the name couldn't be parsed
+    };
+
+    mutable QReadWriteLock mLock;
+    QVector<Entry> mEntries;
+    QHash<QString,int> mIDByName; // includes unnormalized spellings
+};
+
 class BuildingTilesMgr : public QObject
 {
     Q_OBJECT
@@ -733,6 +779,12 @@ public:
     Tiled::Tile *tileFor(const QString &tileName);
     Tiled::Tile *tileFor(BuildingTile *tile, int offset = 0);
 
+    /**
+      * Returns the tile for a TileNameTable ID, nullptr for the empty name,
+      * or the missing tile if the name or its tileset is unknown.
+      */
+    Tiled::Tile *tileForNameID(int id);
+
     BuildingTile *fromTiledTile(Tiled::Tile *tile);
 
     BuildingTile *noneTile() const
@@ -792,6 +844,9 @@ private:
     bool upgradeTxt();
     bool mergeTxt();
 
+private slots:
+    void tilesetsChanged();
+
 signals:
     void tilesetAdded(Tiled::Tileset *tileset);
     void tilesetAboutToBeRemoved(Tiled::Tileset *tileset);
@@ -805,8 +860,13 @@ private:
     QList<BuildingTileCategory*> mCategories;
     QMap<QString,BuildingTileCategory*> mCategoryByName;
 
-    QList<BuildingTile*> mTiles;
     QMap<QString,BuildingTile*> mTileByName;
+    QVector<BuildingTile*> mTileByNameID; // indexed by TileNameTable ID
+
+    // Tiled::Tile lookups, thrown away when Tilesets.txt changes.
+    QVector<Tiled::Tile*> mTiledTileByNameID;
+    QVector<bool> mTiledTileByNameIDValid;
+    int mTiledTileGeneration;
 
     Tiled::Tile *mMissingTile;
     Tiled::Tile *mNoneTiledTile;
@@ -28,6 +28,8 @@
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QHash>
+#include <QSet>
 #include <QTemporaryFile>
 #include <QXmlStreamWriter>
 
@@ -254,24 +256,30 @@ public:
 
     void writeUserTiles(QXmlStreamWriter &w)
     {
+        QSet<int> tiles;
         foreach (BuildingFloor *floor, mBuilding->floors()) {
-            foreach (QString layerName, floor->grimeLayers()) {
+            foreach (FloorTileGrid *grid, floor->grime()) {
                 for (int x = 0; x <= floor->width(); x++) {
                     for (int y = 0; y <= floor->height(); y++) {
-                        QString tileName = floor->grimeAt(layerName, x, y);
-                        if (!tileName.isEmpty() && !mUserTilesMap.contains(tileName))
-                            mUserTilesMap[tileName] = tileName;
+                        if (int tile = grid->at(x, y))
+                            tiles += tile;
                     }
                 }
             }
         }
 
+        QMap<QString,int> tileByName; // sorted
+        foreach (int tile, tiles)
+            tileByName[TileNameTable::instance()->name(tile)] = tile;
+
         w.writeStartElement(QLatin1String("user_tiles"));
-        foreach (QString tileName, mUserTilesMap.values()) { // sorted
+        int index = 0;
+        foreach (QString tileName, tileByName.keys()) {
             w.writeStartElement(QLatin1String("tile"));
             w.writeAttribute(QLatin1String("tile"), tileName);
             w.writeEndElement(); // </tile>
 
+            mUserTileIndex[tileByName[tileName]] = ++index;
         }
         w.writeEndElement(); // </user_tiles>
     }
@@ -306,18 +314,19 @@ public:
 
         // Write user tile indices.
         foreach (QString layerName, floor->grimeLayers()) {
-            if (floor->grime()[layerName]->isEmpty())
+            const FloorTileGrid *grid = floor->grime()[layerName];
+            if (grid->isEmpty())
                 continue;
             text.clear();
             text += newline;
             count = 0, max = (floor->height() + 1) * (floor->width() + 1);
             for (int y = 0; y <= floor->height(); y++) {
                 for (int x = 0; x <= floor->width(); x++) {
-                    QString tileName = floor->grimeAt(layerName, x, y);
-                    if (tileName.isEmpty())
+                    int tile = grid->at(x, y);
+                    if (!tile)
                         text += zero;
                     else
-                        text += QString::number(mUserTilesMap.values().indexOf(tileName) + 1);
+                        text += QString::number(mUserTileIndex[tile]);
                     if (++count < max)
                         text += comma;
                 }
@@ -470,7 +479,7 @@ public:
     QList<FurnitureTiles*> mFurnitureTiles;
     QList<BuildingTileEntry*> mTileEntries;
     QMap<QString,BuildingTileEntry*> mEntriesByCategoryName;
-    QMap<QString,QString> mUserTilesMap;
+    QHash<int,int> mUserTileIndex; // TileNameTable ID -> index in <user_tiles>
 };
 
 /////
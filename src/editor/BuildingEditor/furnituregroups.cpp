@@ -664,7 +664,7 @@ FloorTileGrid *FurnitureTile::toFloorTileGrid(QRegion &rgn)
         for (int y = 0; y < height(); y++) {
             if (BuildingTile *btile = tile(x, y)) {
                 if (!btile->isNone()) {
-                    tiles->replace(x, y, btile->name());
+                    tiles->replace(x, y, TileNameTable::instance()->id(btile->name()));
                     rgn += QRect(x, y, 1, 1);
                 }
             }
@@ -0,0 +1,373 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "imagepyramidbuilder.h"
+
+#include <quazip.h>
+#include <quazipfile.h>
+
+#include <QBuffer>
+#include <QRunnable>
+#include <QTextStream>
+
+#include <zlib.h>
+
+#include <cmath>
+#include <cstring>
+
+/**
+  * PNG-encodes one tile and deflates it the way QuaZipFile would.
+  */
+class PyramidTileTask : public QRunnable
+{
+public:
+    PyramidTileTask(ImagePyramidBuilder *builder, const QImage &image, const QString &fileName) :
+        mBuilder(builder),
+        mImage(image),
+        mFileName(fileName)
+    {
+    }
+
+    void run() override
+    {
+        ImagePyramidBuilder::EncodedTile tile;
+        tile.fileName = mFileName;
+        tile.crc = 0;
+        tile.size = 0;
+        tile.ok = false;
+
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        if (mImage.save(&buffer, "PNG")) {
+            const QByteArray &png = buffer.data();
+            tile.size = png.size();
+            tile.crc = quint32(crc32(crc32(0L, Z_NULL, 0),
+                                     reinterpret_cast<const Bytef*>(png.constData()),
+                                     uInt(png.size())));
+            tile.ok = deflateRaw(png, tile.deflated);
+        }
+
+        mBuilder->tileEncoded(tile);
+    }
+
+private:
+    static bool deflateRaw(const QByteArray &data, QByteArray &out)
+    {
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                         8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        out.resize(int(deflateBound(&strm, uLong(data.size()))));
+        strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+        strm.avail_in = uInt(data.size());
+        strm.next_out = reinterpret_cast<Bytef*>(out.data());
+        strm.avail_out = uInt(out.size());
+        const int ret = deflate(&strm, Z_FINISH);
+        out.resize(out.size() - int(strm.avail_out));
+        deflateEnd(&strm);
+        return ret == Z_STREAM_END;
+    }
+
+    ImagePyramidBuilder *mBuilder;
+    QImage mImage;
+    QString mFileName;
+};
+
+/////
+
+ImagePyramidBuilder::ImagePyramidBuilder(QuaZip &zip, int width, int height) :
+    mZip(zip),
+    mWidth(width),
+    mBandRow(0),
+    mRowInBand(0),
+    mPending(0),
+    mTilesWritten(0)
+{
+    // Same number and size of levels as scaling the whole image each time.
+    for (int level = 0; level < MaxLevels; level++) {
+        const float scaledWidth = float(width) / (1 << level);
+        const float scaledHeight = float(height) / (1 << level);
+        Level l;
+        l.width = int(scaledWidth);
+        l.height = int(scaledHeight);
+        l.columns = int(std::ceil(scaledWidth / TileSize));
+        l.rows = int(std::ceil(scaledHeight / TileSize));
+        l.pendingRow = -1;
+        mLevels += l;
+        if (scaledWidth <= TileSize && scaledHeight <= TileSize) {
+            break;
+        }
+    }
+
+    mBand = newBand(0);
+}
+
+ImagePyramidBuilder::~ImagePyramidBuilder()
+{
+    cancel();
+}
+
+bool ImagePyramidBuilder::addRows(const QImage &rows)
+{
+    const QImage src = rows.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const int columns = mLevels[0].columns;
+
+    for (int y = 0; y < src.height(); y++) {
+        const uchar *srcLine = src.constScanLine(y);
+        for (int col = 0; col < columns; col++) {
+            const int x = col * TileSize;
+            const int count = qMin(TileSize, mWidth - x);
+            if (count <= 0) {
+                break;
+            }
+            std::memcpy(mBand[col].scanLine(mRowInBand), srcLine + x * 4, count * 4);
+        }
+        if (++mRowInBand == TileSize) {
+            if (!finishBand(0, mBand, mBandRow)) {
+                return false;
+            }
+            mBand = newBand(0);
+            mRowInBand = 0;
+            ++mBandRow;
+        }
+    }
+
+    return writeEncodedTiles(false);
+}
+
+bool ImagePyramidBuilder::finish()
+{
+    if (mRowInBand > 0 && mBandRow < mLevels[0].rows) {
+        if (!finishBand(0, mBand, mBandRow)) {
+            return false;
+        }
+        mRowInBand = 0;
+        ++mBandRow;
+    }
+
+    // A level with an odd number of rows has its last row still waiting.
+    for (int level = 0; level < mLevels.size() - 1; level++) {
+        Level &l = mLevels[level];
+        if (l.pendingRow != -1) {
+            const QVector<QImage> band = l.pendingBand;
+            const int row = l.pendingRow;
+            l.pendingBand.clear();
+            l.pendingRow = -1;
+            QVector<QImage> parent = newBand(level + 1);
+            for (int col = 0; col < band.size(); col++) {
+                downsample(band[col], parent[col / 2], (col % 2) * TileSize / 2, 0);
+            }
+            for (int col = 0; col < parent.size(); col++) {
+                clearOutside(parent[col], level + 1, col, row / 2);
+            }
+            if (!finishBand(level + 1, parent, row / 2)) {
+                return false;
+            }
+        }
+    }
+
+    return writeEncodedTiles(true);
+}
+
+void ImagePyramidBuilder::cancel()
+{
+    mThreadPool.clear();
+    mThreadPool.waitForDone();
+    QMutexLocker locker(&mMutex);
+    mEncoded.clear();
+    mPending = 0;
+}
+
+bool ImagePyramidBuilder::writePyramidTxt(QuaZip &zip, int xMin, int yMin, int xMax, int yMax)
+{
+    QuaZipFile file(&zip);
+    QuaZipNewInfo newInfo(QStringLiteral("pyramid.txt"));
+    if (file.open(QIODevice::WriteOnly, newInfo) == false) {
+        return false;
+    }
+    QTextStream ts(&file);
+    ts << "VERSION=1\n";
+    ts << QStringLiteral("bounds=%1 %2 %3 %4\n").arg(xMin).arg(yMin).arg(xMax).arg(yMax);
+    ts.flush();
+    file.close();
+    return true;
+}
+
+QVector<QImage> ImagePyramidBuilder::newBand(int level) const
+{
+    QVector<QImage> band(mLevels[level].columns);
+    for (QImage &tile : band) {
+        tile = QImage(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+        tile.fill(Qt::transparent);
+    }
+    return band;
+}
+
+bool ImagePyramidBuilder::finishBand(int level, const QVector<QImage> &band, int row)
+{
+    for (int col = 0; col < band.size(); col++) {
+        submitTile(band[col], level, col, row);
+        if (!writeEncodedTiles(false)) {
+            return false;
+        }
+    }
+
+    if (level + 1 >= mLevels.size()) {
+        return true;
+    }
+
+    Level &l = mLevels[level];
+    if (row % 2 == 0) {
+        // Wait for the row below.  If this is the last row of the level,
+        // finish() downsamples it alone.
+        l.pendingBand = band;
+        l.pendingRow = row;
+        return true;
+    }
+
+    Q_ASSERT(l.pendingRow == row - 1);
+    QVector<QImage> parent = newBand(level + 1);
+    for (int col = 0; col < band.size(); col++) {
+        const int destX = (col % 2) * TileSize / 2;
+        downsample(l.pendingBand[col], parent[col / 2], destX, 0);
+        downsample(band[col], parent[col / 2], destX, TileSize / 2);
+    }
+    l.pendingBand.clear();
+    l.pendingRow = -1;
+
+    for (int col = 0; col < parent.size(); col++) {
+        clearOutside(parent[col], level + 1, col, row / 2);
+    }
+
+    return finishBand(level + 1, parent, row / 2);
+}
+
+/**
+  * Box-filters \a src to half size into one quadrant of \a dest.
+  * Both images are premultiplied, so the channels can be averaged directly.
+  */
+void ImagePyramidBuilder::downsample(const QImage &src, QImage &dest, int destX, int destY)
+{
+    for (int y = 0; y < TileSize / 2; y++) {
+        const quint32 *s0 = reinterpret_cast<const quint32*>(src.constScanLine(y * 2));
+        const quint32 *s1 = reinterpret_cast<const quint32*>(src.constScanLine(y * 2 + 1));
+        quint32 *d = reinterpret_cast<quint32*>(dest.scanLine(destY + y)) + destX;
+        for (int x = 0; x < TileSize / 2; x++) {
+            const quint32 p0 = s0[x * 2], p1 = s0[x * 2 + 1];
+            const quint32 p2 = s1[x * 2], p3 = s1[x * 2 + 1];
+            quint32 pixel = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                const quint32 sum = ((p0 >> shift) & 0xFF) + ((p1 >> shift) & 0xFF)
+                        + ((p2 >> shift) & 0xFF) + ((p3 >> shift) & 0xFF);
+                pixel |= ((sum + 2) >> 2) << shift;
+            }
+            d[x] = pixel;
+        }
+    }
+}
+
+/**
+  * Makes the part of the tile beyond the edge of the scaled image transparent,
+  * as QImage::copy() did for tiles that extended past the scaled image.
+  */
+void ImagePyramidBuilder::clearOutside(QImage &tile, int level, int col, int row)
+{
+    const Level &l = mLevels[level];
+    const int validWidth = qBound(0, l.width - col * TileSize, int(TileSize));
+    const int validHeight = qBound(0, l.height - row * TileSize, int(TileSize));
+    if (validWidth == TileSize && validHeight == TileSize) {
+        return;
+    }
+    for (int y = 0; y < TileSize; y++) {
+        quint32 *line = reinterpret_cast<quint32*>(tile.scanLine(y));
+        const int first = (y < validHeight) ? validWidth : 0;
+        for (int x = first; x < TileSize; x++) {
+            line[x] = 0;
+        }
+    }
+}
+
+void ImagePyramidBuilder::submitTile(const QImage &tile, int level, int col, int row)
+{
+    const QString fileName = QStringLiteral("%1/tile%2x%3.png").arg(level).arg(col).arg(row);
+    {
+        QMutexLocker locker(&mMutex);
+        ++mPending;
+    }
+    mThreadPool.start(new PyramidTileTask(this, tile, fileName));
+}
+
+void ImagePyramidBuilder::tileEncoded(const EncodedTile &tile)
+{
+    QMutexLocker locker(&mMutex);
+    mEncoded += tile;
+    mEncodedCondition.wakeAll();
+}
+
+/**
+  * Adds encoded tiles to the ZIP.  If \a wait is true, waits for every tile
+  * that was submitted.  Otherwise this only blocks to keep the number of
+  * tiles in flight bounded.
+  */
+bool ImagePyramidBuilder::writeEncodedTiles(bool wait)
+{
+    const int maxPending = qMax(4, mThreadPool.maxThreadCount() * 4);
+
+    for (;;) {
+        QList<EncodedTile> encoded;
+        {
+            QMutexLocker locker(&mMutex);
+            const bool mustWait = wait ? (mPending > 0) : (mPending >= maxPending);
+            if (mustWait && mEncoded.isEmpty()) {
+                mEncodedCondition.wait(&mMutex);
+            }
+            encoded.swap(mEncoded);
+            mPending -= encoded.size();
+        }
+
+        for (const EncodedTile &tile : qAsConst(encoded)) {
+            if (!tile.ok) {
+                mError = QStringLiteral("Error encoding %1").arg(tile.fileName);
+                return false;
+            }
+            QuaZipFile file(&mZip);
+            QuaZipNewInfo newInfo(tile.fileName);
+            newInfo.uncompressedSize = ulong(tile.size);
+            if (file.open(QIODevice::WriteOnly, newInfo, nullptr, tile.crc,
+                          Z_DEFLATED, Z_DEFAULT_COMPRESSION, true) == false) {
+                mError = QStringLiteral("Error opening %1 in ZIP file").arg(tile.fileName);
+                return false;
+            }
+            if (file.write(tile.deflated) != tile.deflated.size()) {
+                mError = QStringLiteral("Error writing %1 to ZIP file").arg(tile.fileName);
+                file.close();
+                return false;
+            }
+            file.close();
+            ++mTilesWritten;
+        }
+
+        QMutexLocker locker(&mMutex);
+        const bool done = wait ? (mPending == 0) : (mPending < maxPending);
+        if (done) {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEPYRAMIDBUILDER_H
+#define IMAGEPYRAMIDBUILDER_H
+
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+
+class QuaZip;
+
+/**
+  * Writes the tiles of the in-game map image pyramid to a ZIP file.
+  *
+  * The full-size image is fed in a few rows at a time.  Each completed row of
+  * 256x256 tiles is written as level 0 and box-filtered 2:1 into the next
+  * level, and so on, so only two rows of tiles per level are ever in memory.
+  * The tiles are PNG-encoded and deflated on a thread pool; only adding them
+  * to the ZIP happens on the calling thread.
+  *
+  * The ZIP contains "<level>/tile<col>x<row>.png" for each tile, the same
+  * layout InGameMapImagePyramidWindow always produced.
+  */
+class ImagePyramidBuilder
+{
+public:
+    static const int TileSize = 256;
+    static const int MaxLevels = 5;
+
+    ImagePyramidBuilder(QuaZip &zip, int width, int height);
+    ~ImagePyramidBuilder();
+
+    int levelCount() const { return mLevels.size(); }
+    int columns(int level) const { return mLevels[level].columns; }
+    int rows(int level) const { return mLevels[level].rows; }
+
+    /**
+      * Adds the next rows of the full-size image, top to bottom.
+      */
+    bool addRows(const QImage &rows);
+
+    /**
+      * Writes the partially-filled bottom rows of tiles and waits for every
+      * tile to be added to the ZIP.
+      */
+    bool finish();
+
+    /**
+      * Stops encoding.  Tiles not yet added to the ZIP are discarded.
+      */
+    void cancel();
+
+    int tilesWritten() const { return mTilesWritten; }
+
+    QString errorString() const { return mError; }
+
+    static bool writePyramidTxt(QuaZip &zip, int xMin, int yMin, int xMax, int yMax);
+
+private:
+    friend class PyramidTileTask;
+
+    struct Level
+    {
+        int width; // pixels in the scaled image
+        int height;
+        int columns;
+        int rows;
+        QVector<QImage> pendingBand; // even row waiting for the odd row below
+        int pendingRow;
+    };
+
+    struct EncodedTile
+    {
+        QString fileName;
+        QByteArray deflated;
+        quint32 crc;
+        int size;
+        bool ok;
+    };
+
+    QVector<QImage> newBand(int level) const;
+    bool finishBand(int level, const QVector<QImage> &band, int row);
+    void downsample(const QImage &src, QImage &dest, int destX, int destY);
+    void clearOutside(QImage &tile, int level, int col, int row);
+    void submitTile(const QImage &tile, int level, int col, int row);
+    void tileEncoded(const EncodedTile &tile);
+    bool writeEncodedTiles(bool wait);
+
+    QuaZip &mZip;
+    int mWidth;
+    QVector<Level> mLevels;
+    QVector<QImage> mBand;
+    int mBandRow;
+    int mRowInBand;
+
+    QThreadPool mThreadPool;
+    QMutex mMutex;
+    QWaitCondition mEncodedCondition;
+    QList<EncodedTile> mEncoded;
+    int mPending;
+    int mTilesWritten;
+    QString mError;
+};
+
+#endif // IMAGEPYRAMIDBUILDER_H
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ingamemapcellimage.h"
+
+#include "lotpackreader.h"
+
+#include <QImage>
+#include <QString>
+
+#include <cstring>
+
+namespace {
+
+enum MatchType
+{
+    TilesetNameContains,
+    TilesetNameStartsWith
+};
+
+struct TileColorRule
+{
+    MatchType match;
+    const char *pattern;
+    int firstIndex; // -1 for any tile in the tileset
+    int lastIndex;
+    QRgb color;
+};
+
+// When several rules match a tile, the last one wins.
+const TileColorRule TileColorRules[] = {
+    { TilesetNameContains, "_trees", -1, -1, qRgb(38, 53, 22) }, // normaltree
+    { TilesetNameContains, "jumbo", -1, -1, qRgb(38, 53, 22) }, // jumbotree
+    { TilesetNameContains, "_railroad", -1, -1, qRgb(73, 58, 43) }, // rails
+    { TilesetNameStartsWith, "vegetation", -1, -1, qRgb(48, 73, 32) }, // vegetation
+    { TilesetNameStartsWith, "blends_natural_01", 0, 15, qRgb(217, 207, 183) }, // sand
+    { TilesetNameStartsWith, "blends_natural_01", 16, 31, qRgb(75, 88, 27) }, // darkgrass
+    { TilesetNameStartsWith, "blends_natural_01", 32, 47, qRgb(97, 103, 36) }, // medgrass
+    { TilesetNameStartsWith, "blends_natural_01", 48, 63, qRgb(127, 120, 45) }, // litegrass
+    { TilesetNameStartsWith, "blends_natural_01", 64, 79, qRgb(91, 63, 21) }, // dirt
+    { TilesetNameStartsWith, "blends_natural_02", -1, -1, qRgb(108, 127, 131) }, // water
+    { TilesetNameStartsWith, "blends_street_01", -1, -1, qRgb(128, 128, 128) }, // street
+    { TilesetNameStartsWith, "floors_exterior_tilesandstone", -1, -1, qRgb(132, 81, 76) }, // tilesand
+    { TilesetNameStartsWith, "floors_exterior_tilesandwood", -1, -1, qRgb(132, 81, 76) }, // tilesand
+    { TilesetNameStartsWith, "location_", -1, -1, qRgb(132, 81, 76) }, // tilesand
+    { TilesetNameStartsWith, "vegetation_farm", -1, -1, qRgb(218, 165, 32) }, // Corn
+    { TilesetNameStartsWith, "walls_", -1, -1, qRgb(93, 44, 39) }, // walls
+};
+
+// Returns the color in the byte order of QImage::Format_RGBA8888.
+quint32 toRGBA8888(QRgb rgb)
+{
+    const uchar bytes[4] = { uchar(qRed(rgb)), uchar(qGreen(rgb)), uchar(qBlue(rgb)), uchar(qAlpha(rgb)) };
+    quint32 color;
+    std::memcpy(&color, bytes, 4);
+    return color;
+}
+
+} // namespace
+
+quint32 InGameMapCellImage::tileColor(const QString &tilesetName, int tileIndex)
+{
+    if (tileIndex == -1) {
+        return 0; // failed to parse the tile name
+    }
+    quint32 color = 0;
+    for (const TileColorRule &rule : TileColorRules) {
+        const QLatin1String pattern(rule.pattern);
+        bool matches = (rule.match == TilesetNameContains)
+                ? tilesetName.contains(pattern)
+                : tilesetName.startsWith(pattern);
+        if (matches && rule.firstIndex != -1) {
+            matches = (tileIndex >= rule.firstIndex) && (tileIndex <= rule.lastIndex);
+        }
+        if (matches) {
+            color = toRGBA8888(rule.color);
+        }
+    }
+    return color;
+}
+
+void InGameMapCellImage::draw(const LotPackReader &reader, const QVector<quint32> &tileColors,
+                              int levels, bool upperFloors, QImage &image, QImage *footprint)
+{
+    const int chunksPerCell = CellSize / LotPackSquareIterator::SquaresPerWidth;
+    uchar *bits = image.bits();
+    const int bytesPerLine = image.bytesPerLine();
+
+    // Each chunk is decoded once with all its levels.  Squares come out one
+    // level after another, so a classified tile on a higher level simply
+    // replaces the color from the levels below it.
+    static const uchar footprintColor[4] = { 0, 0, 0, 255 };
+
+    for (int chunkY = 0; chunkY < chunksPerCell; chunkY++) {
+        for (int chunkX = 0; chunkX < chunksPerCell; chunkX++) {
+            int index = chunkX * chunksPerCell + chunkY;
+            LotPackSquareIterator it = reader.chunk(index, levels);
+            while (it.next()) {
+                int pixelX = chunkX * LotPackSquareIterator::SquaresPerWidth + it.x();
+                int pixelY = chunkY * LotPackSquareIterator::SquaresPerWidth + it.y();
+                // A square is part of a building if it is inside a room or
+                // has anything above the ground floor.
+                if (footprint != nullptr && (it.roomID() != -1 || it.z() > 0)) {
+                    std::memcpy(footprint->scanLine(pixelY) + pixelX * 4, footprintColor, 4);
+                }
+                if (it.z() > 0 && !upperFloors) {
+                    continue;
+                }
+                for (int n = 0; n < it.tileCount(); ++n) {
+                    const int tileNameIndex = it.tile(n);
+                    if (tileNameIndex < 0 || tileNameIndex >= tileColors.size()) {
+                        continue;
+                    }
+                    const quint32 color = tileColors[tileNameIndex];
+                    if (color == 0) {
+                        continue;
+                    }
+                    std::memcpy(bits + pixelY * bytesPerLine + pixelX * 4, &color, 4);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INGAMEMAPCELLIMAGE_H
+#define INGAMEMAPCELLIMAGE_H
+
+#include <QtGlobal>
+#include <QVector>
+
+class LotPackReader;
+
+class QImage;
+class QString;
+
+/**
+  * Draws one 300x300 cell of the in-game map image from the cell's .lotpack.
+  */
+class InGameMapCellImage
+{
+public:
+    /**
+      * Returns the color of a tile in the byte order of
+      * QImage::Format_RGBA8888, or 0 if the tile doesn't change the map
+      * image.  Colors are never 0 because alpha is 255.
+      */
+    static quint32 tileColor(const QString &tilesetName, int tileIndex);
+
+    /**
+      * Draws the squares of every chunk into \a image, which must be
+      * QImage::Format_RGBA8888.  \a tileColors holds tileColor() for each
+      * tile name in the cell's .lotheader.  Only the first \a levels levels
+      * are decoded; levels above the ground are drawn only if \a upperFloors
+      * is true.  When \a footprint isn't null, squares that belong to
+      * buildings are drawn into it in black.
+      */
+    static void draw(const LotPackReader &reader, const QVector<quint32> &tileColors,
+                     int levels, bool upperFloors, QImage &image, QImage *footprint);
+
+    static const int CellSize = 300;
+};
+
+#endif // INGAMEMAPCELLIMAGE_H
@@ -22,6 +22,7 @@
 #include "mainwindow.h"
 #include "mapcomposite.h"
 #include "mapmanager.h"
+#include "mapprefetcher.h"
 #include "progress.h"
 #include "world.h"
 #include "worldcell.h"
@@ -35,23 +36,72 @@
 #include "tilelayer.h"
 
 #include <qmath.h>
+#include <QAtomicInt>
+#include <QCoreApplication>
 #include <QDebug>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QUndoStack>
 
 #include "clipper.hpp"
+#include "ingamemapmasktracer.h"
 
 using namespace Tiled;
 
-namespace
+/**
+  * Everything needed to generate the features for one cell, read from the
+  * cell's maps on the GUI thread.  The features are then built on a worker
+  * thread without touching the maps or the document.
+  */
+struct InGameMapFeatureGenerator::CellJob
 {
-struct pzPolygon
+    struct Building
+    {
+        QRect bounds;
+        QVector<QRect> rects;
+        InGameMapProperties properties;
+    };
+
+    CellJob(WorldCell *cell, FeatureType type)
+        : cell(cell)
+        , type(type)
+    {
+    }
+
+    ~CellJob()
+    {
+        qDeleteAll(features);
+    }
+
+    WorldCell *cell;
+    FeatureType type;
+    bool generate = false; // false if this cell is left alone
+    QSize size;
+    std::vector<char> mask; // FeatureTree, FeatureWater
+    QList<Building> buildings; // FeatureBuilding
+    QList<InGameMapFeature*> features;
+    QAtomicInt done;
+};
+
+class CellFeatureTask : public QRunnable
 {
-    ClipperLib::Path outer;
-    ClipperLib::Paths inner; // holes
+public:
+    CellFeatureTask(InGameMapFeatureGenerator::CellJob *job)
+        : mJob(job)
+    {
+    }
+
+    void run() override
+    {
+        InGameMapFeatureGenerator::buildFeatures(*mJob);
+        mJob->done.storeRelease(1);
+    }
+
+private:
+    InGameMapFeatureGenerator::CellJob *mJob;
 };
-}
 
 InGameMapFeatureGenerator::InGameMapFeatureGenerator(QObject *parent) :
     QObject(parent)
@@ -79,20 +129,63 @@ bool InGameMapFeatureGenerator::generateWorld(WorldDocument *worldDoc, InGameMap
 
     mWorldDoc->undoStack()->beginMacro(QStringLiteral("Generate InGameMap %1 Features").arg(typeStr));
 
-    if (mode == GenerateSelected) {
-        for (WorldCell *cell : worldDoc->selectedCells())
-            if (!generateCell(cell)) {
-                mWorldDoc->undoStack()->endMacro();
-                goto errorExit;
+    {
+        QList<WorldCell*> cells;
+        const QList<WorldCell*> candidates = (mode == GenerateSelected)
+                ? worldDoc->selectedCells()
+                : MapPrefetcher::allCells(world);
+        for (WorldCell *cell : candidates) {
+            if (shouldGenerateCell(cell))
+                cells += cell;
+        }
+
+        // Read the maps for the next cells while this one is being generated.
+        MapPrefetcher prefetcher(cells, mWorldDoc->fileName());
+
+        // The maps are read on this thread and the outlines are traced on
+        // the thread pool.  The features are added to the document in cell
+        // order, so the undo stack is the same as generating one at a time.
+        QVector<CellJob*> jobs(cells.size(), nullptr);
+        QThreadPool threadPool;
+        const int maxPending = qMax(1, threadPool.maxThreadCount());
+        int nextCommit = 0;
+        bool ok = true;
+
+        for (int i = 0; i < cells.size(); i++) {
+            prefetcher.cellStarted(i);
+            jobs[i] = new CellJob(cells[i], mFeatureType);
+            if (!prepareCell(*jobs[i])) {
+                ok = false;
+                break;
             }
-    } else {
-        for (int y = 0; y < world->height(); y++) {
-            for (int x = 0; x < world->width(); x++) {
-                if (!generateCell(world->cellAt(x, y))) {
-                    mWorldDoc->undoStack()->endMacro();
-                    goto errorExit;
-                }
+            prefetcher.cellFinished(i);
+            if (jobs[i]->generate) {
+                threadPool.start(new CellFeatureTask(jobs[i]));
+            } else {
+                jobs[i]->done.storeRelease(1);
             }
+            commitFinishedCells(jobs, nextCommit);
+
+            // Each prepared cell holds its mask or buildings until it is
+            // committed, so don't get further ahead of the thread pool.
+            while (i + 1 - nextCommit > maxPending) {
+                threadPool.waitForDone(10);
+                commitFinishedCells(jobs, nextCommit);
+                qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+            }
+        }
+
+        // If a cell failed, the cells before it are still added.
+        while (!threadPool.waitForDone(100)) {
+            commitFinishedCells(jobs, nextCommit);
+            qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        }
+        commitFinishedCells(jobs, nextCommit);
+        qDeleteAll(jobs);
+
+        if (!ok) {
+            mWorldDoc->undoStack()->endMacro();
+            goto errorExit;
         }
     }
 
@@ -137,8 +230,9 @@ bool InGameMapFeatureGenerator::shouldGenerateCell(WorldCell *cell)
     }
 }
 
-bool InGameMapFeatureGenerator::generateCell(WorldCell *cell)
+bool InGameMapFeatureGenerator::prepareCell(CellJob &job)
 {
+    WorldCell *cell = job.cell;
     if (!shouldGenerateCell(cell))
         return true;
 
@@ -155,16 +249,18 @@ bool InGameMapFeatureGenerator::generateCell(WorldCell *cell)
 
     MapManager::instance()->addReferenceToMap(mapInfo);
 
-    bool ok;
+    job.generate = true;
+
+    bool ok = false;
     switch (mFeatureType) {
     case FeatureBuilding:
-        ok = doBuildings(cell, mapInfo);
+        ok = readBuildings(job, mapInfo);
         break;
     case FeatureTree:
-        ok = doTrees(cell, mapInfo);
+        ok = readMask(job, mapInfo, QStringLiteral("vegetation_trees_01"), 8, 15);
         break;
     case FeatureWater:
-        ok = doWater(cell, mapInfo);
+        ok = readMask(job, mapInfo, QStringLiteral("blends_natural_02"), 0, 7);
         break;
     }
 
@@ -173,19 +269,69 @@ bool InGameMapFeatureGenerator::generateCell(WorldCell *cell)
     return ok;
 }
 
-bool InGameMapFeatureGenerator::doBuildings(WorldCell *cell, MapInfo *mapInfo)
+void InGameMapFeatureGenerator::buildFeatures(CellJob &job)
+{
+    switch (job.type) {
+    case FeatureBuilding:
+        buildBuildingFeatures(job);
+        break;
+    case FeatureTree:
+        buildTreeFeatures(job);
+        break;
+    case FeatureWater:
+        buildWaterFeatures(job);
+        break;
+    }
+}
+
+void InGameMapFeatureGenerator::commitFinishedCells(QVector<CellJob*> &jobs, int &next)
+{
+    while (next < jobs.size() && jobs[next] != nullptr && jobs[next]->done.loadAcquire()) {
+        commitCell(*jobs[next]);
+        delete jobs[next];
+        jobs[next] = nullptr;
+        ++next;
+    }
+}
+
+void InGameMapFeatureGenerator::commitCell(CellJob &job)
 {
-    // Remove all "building=" features
+    if (!job.generate)
+        return;
+
+    WorldCell *cell = job.cell;
+
+    // Remove the features that were generated last time.
     auto& features = cell->inGameMap().features();
     for (int i = features.size() - 1; i >= 0; i--) {
         auto* feature = features[i];
-        for (auto& property : feature->properties()) {
-            if (property.mKey == QStringLiteral("building")) {
-                mWorldDoc->removeInGameMapFeature(cell, feature->index());
-            }
+        bool remove = false;
+        switch (job.type) {
+        case FeatureBuilding:
+            remove = feature->properties().containsKey(QStringLiteral("building"));
+            break;
+        case FeatureTree:
+            remove = feature->properties().contains(QStringLiteral("natural"), QStringLiteral("forest"));
+            break;
+        case FeatureWater:
+            remove = feature->properties().containsKey(QStringLiteral("water"));
+            break;
+        }
+        if (remove) {
+            mWorldDoc->removeInGameMapFeature(cell, feature->index());
         }
     }
 
+    for (InGameMapFeature *feature : qAsConst(job.features)) {
+        mWorldDoc->addInGameMapFeature(cell, cell->inGameMap().features().size(), feature);
+    }
+    job.features.clear();
+}
+
+bool InGameMapFeatureGenerator::readBuildings(CellJob &job, MapInfo *mapInfo)
+{
+    WorldCell *cell = job.cell;
+
     DelayedMapLoader mapLoader;
     mapLoader.addMap(mapInfo);
 
@@ -203,264 +349,241 @@ bool InGameMapFeatureGenerator::doBuildings(WorldCell *cell, MapInfo *mapInfo)
         }
     }
 
-#if 1
     while (mapLoader.isLoading()) {
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        MapManager::instance()->waitForThreadResults();
     }
 
     // This method won't work for buildings in the TMX, it only works for separate building files.
+    const QString LEGEND = QStringLiteral("Legend");
     for (WorldCellLot *lot : lots) {
         MapInfo *info = MapManager::instance()->mapInfo(lot->mapName());
         if (info != nullptr && info->map() != nullptr) {
-            QRect bounds;
-            QVector<QRect> rects;
+            CellJob::Building building;
             for (ObjectGroup *og : info->map()->objectGroups()) {
-                if (processObjectGroup(cell, info, og, lot->level(), lot->pos(), bounds, rects) == false) {
+                if (processObjectGroup(cell, info, og, lot->level(), lot->pos(), building.bounds, building.rects) == false) {
                     return false;
                 }
             }
-            if (traceBuildingOutline(cell, info, bounds, rects) == false) {
-                return false;
-            }
-        }
-    }
-
-    return true;
-#else
-    // The cell map must be loaded before creating the MapComposite, which will
-    // possibly load embedded lots.
-    while (mapInfo->isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
-
-    MapComposite staticMapComposite(mapInfo);
-    MapComposite *mapComposite = &staticMapComposite;
-    while (mapComposite->waitingForMapsToLoad() || mapLoader.isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
-    if (!mapLoader.errorString().isEmpty()) {
-        mError = mapLoader.errorString();
-        return false;
-    }
-
-    foreach (WorldCellLot *lot, cell->lots()) {
-        MapInfo *info = MapManager::instance()->mapInfo(lot->mapName());
-        Q_ASSERT(info && info->map());
-        mapComposite->addMap(info, lot->pos(), lot->level());
-    }
+            if (building.bounds.isEmpty())
+                continue;
 
-    return processObjectGroups(cell, mapComposite);
-#endif
-}
+            InGameMapProperty property;
+            property.mKey = QStringLiteral("building");
+            if (info->map()->properties().contains(LEGEND)) {
+                property.mValue = info->map()->property(LEGEND);
+            } else {
+                property.mValue = QStringLiteral("yes");
+            }
+            building.properties += property;
+            for (auto it = info->map()->properties().cbegin(); it != info->map()->properties().cend(); it++) {
+                if (it.key() == LEGEND) {
+                    continue;
+                }
+                property.mKey = it.key();
+                property.mValue = it.value();
+                building.properties += property;
+            }
 
-bool InGameMapFeatureGenerator::processObjectGroups(WorldCell *cell, MapComposite *mapComposite)
-{
-    foreach (Layer *layer, mapComposite->map()->layers()) {
-        if (ObjectGroup *og = layer->asObjectGroup()) {
-            if (!processObjectGroup(cell, og, mapComposite->levelRecursive(),
-                                    mapComposite->originRecursive()))
-                return false;
+            job.buildings += building;
         }
     }
 
-    foreach (MapComposite *subMap, mapComposite->subMaps())
-        if (!processObjectGroups(cell, subMap))
-            return false;
-
     return true;
 }
 
 namespace {
 
-class OutlineCell {
-public:
-    OutlineCell(int x, int y)
-        : x(x)
-        , y(y)
-    {
-    }
-
-    int x = -1, y = -1;
-    bool w = false, n = false, e = false, s = false; // true if no cell in this direction
-    bool tw = false, tn = false, te = false, ts = false; // true if traced the given edge
-    bool inner = false;
-    bool start = false;
-};
-
-typedef std::shared_ptr<OutlineCell> OutlineCellPtr;
-
+/**
+  * Traces the outlines of groups of squares.  Each square holds the label of
+  * the building it belongs to, so the buildings of a whole cell can be
+  * rasterized into one grid and traced in one pass.  Only squares with the
+  * same label are connected.
+  */
 class OutlineGrid {
 public:
-    std::vector<OutlineCellPtr> elements;
-    int W, H;
+    struct OutlineCell {
+        int label = -1;
+        bool w = false, n = false, e = false, s = false; // true if no cell in this direction
+        bool tw = false, tn = false, te = false, ts = false; // true if traced the given edge
+    };
+
+    std::vector<OutlineCell> elements;
+    int W = 0, H = 0;
     bool EXTEND = true;
+    int mLabel = -1; // label being traced
 
     void setSize(int w, int h) {
-        elements.resize(size_t(w * h));
+        elements.assign(size_t(w * h), OutlineCell());
         W = w;
         H = h;
     }
 
-    void setInner(int x, int y) {
-        OutlineCellPtr f1 = get(x, y);
-        if (f1) {
-            f1->inner = true;
+    // Returns false if the square already belongs to a different label.
+    bool setLabel(int x, int y, int label) {
+        OutlineCell* cell = get(x, y);
+        if (cell == nullptr)
+            return true;
+        if (cell->label != -1 && cell->label != label)
+            return false;
+        cell->label = label;
+        return true;
+    }
+
+    void clearLabel(const QRect& rect, int label) {
+        for (int y = rect.top(); y <= rect.bottom(); y++) {
+            for (int x = rect.left(); x <= rect.right(); x++) {
+                OutlineCell* cell = get(x, y);
+                if (cell && cell->label == label)
+                    cell->label = -1;
+            }
         }
     }
 
-    bool isInner(int x, int y) {
-        OutlineCellPtr f1 = get(x, y);
-        return f1 && (f1->start || f1->inner);
+    bool isInner(int x, int y, int label) {
+        OutlineCell* cell = get(x, y);
+        return cell && cell->label == label;
     }
 
     bool canTrace_W(int x, int y) {
-        OutlineCellPtr cell = get(x, y);
-        return cell && cell->inner && cell->w && !cell->tw;
+        OutlineCell* cell = get(x, y);
+        return cell && cell->label == mLabel && cell->w && !cell->tw;
     }
 
     bool canTrace_N(int x, int y) {
-        OutlineCellPtr cell = get(x, y);
-        return cell && cell->inner && cell->n && !cell->tn;
+        OutlineCell* cell = get(x, y);
+        return cell && cell->label == mLabel && cell->n && !cell->tn;
     }
 
     bool canTrace_E(int x, int y) {
-        OutlineCellPtr cell = get(x, y);
-        return cell && cell->inner && cell->e && !cell->te;
+        OutlineCell* cell = get(x, y);
+        return cell && cell->label == mLabel && cell->e && !cell->te;
     }
 
     bool canTrace_S(int x, int y) {
-        OutlineCellPtr cell = get(x, y);
-        return cell && cell->inner && cell->s && !cell->ts;
+        OutlineCell* cell = get(x, y);
+        return cell && cell->label == mLabel && cell->s && !cell->ts;
     }
 
-    OutlineCellPtr& elementAt(int x, int y) {
-        return elements[size_t(x + y * W)];
-    }
-
-    OutlineCellPtr get(int x, int y) {
+    OutlineCell* get(int x, int y) {
         if (x < 0 || x >= W)
             return nullptr;
         if (y < 0 || y >= H)
             return nullptr;
-        if (!elementAt(x, y))
-            elementAt(x, y) = std::make_shared<OutlineCell>(x, y);
-        return elementAt(x, y);
-    }
-
-    void trace_W(OutlineCell& cell, QPolygon& nodes, int extend) {
-        const int x = cell.x, y = cell.y;
-        if (EXTEND && extend != -1) {
-            nodes[extend] = { x, y };
-        } else {
-            nodes += { x, y };
-        }
-        cell.tw = true; // done
-
-        // turn w, continue n, turn e
-        if (canTrace_S(x - 1, y - 1)) {
-            trace_S(*get(x - 1, y - 1), nodes, -1);
-        } else if (canTrace_W(x, y - 1)) {
-            trace_W(*get(x, y - 1), nodes, nodes.size()-1);
-        } else if (canTrace_N(x, y)) {
-            trace_N(cell, nodes, -1);
-        }
-    }
-
-    void trace_N(OutlineCell& cell, QPolygon& nodes, int extend) {
-        const int x = cell.x, y = cell.y;
-        if (EXTEND && extend != -1) {
-            nodes[extend] = { x + 1, y };
-        } else {
-            nodes += { x + 1, y };
-        }
-        cell.tn = true; // done
-
-        // turn n, continue e, turn s
-        if (canTrace_W(x + 1, y - 1)) {
-            trace_W(*get(x + 1, y - 1), nodes, -1);
-        } else if (canTrace_N(x + 1, y)) {
-            trace_N(*get(x + 1, y), nodes, nodes.size()-1);
-        } else if (canTrace_E(x, y)) {
-            trace_E(cell, nodes, -1);
-        }
-    }
-
-    void trace_E(OutlineCell& cell, QPolygon& nodes, int extend) {
-        const int x = cell.x, y = cell.y;
-        if (EXTEND && extend != -1) {
-            nodes[extend] = { x + 1, y + 1 };
-        } else {
-            nodes += { x + 1, y + 1 };
-        }
-        cell.te = true; // done
-
-        // turn e, continue s, turn w
-        if (canTrace_N(x + 1, y + 1)) {
-            trace_N(*get(x + 1, y + 1), nodes, -1);
-        } else if (canTrace_E(x, y + 1)) {
-            trace_E(*get(x, y + 1), nodes, nodes.size()-1);
-        } else if (canTrace_S(x, y)) {
-            trace_S(cell, nodes, -1);
-        }
+        return &elements[size_t(x + y * W)];
     }
 
-    void trace_S(OutlineCell& cell, QPolygon& nodes, int extend) {
-        const int x = cell.x, y = cell.y;
+    void addNode(QPolygon& nodes, const QPoint& node, int extend) {
         if (EXTEND && extend != -1) {
-            nodes[extend] = { x, y + 1 };
+            nodes[extend] = node;
         } else {
-            nodes += { x, y + 1 };
-        }
-        cell.ts = true; // done
-
-        // turn s, continue w, turn n
-        if (canTrace_E(x - 1, y + 1)) {
-            trace_E(*get(x - 1, y + 1), nodes, -1);
-        } else if (canTrace_S(x - 1, y)) {
-            trace_S(*get(x - 1, y), nodes, nodes.size()-1);
-        } else if (canTrace_W(x, y)) {
-            trace_W(cell, nodes, -1);
+            nodes += node;
         }
     }
 
-    QPolygon trace(OutlineCell& cell) {
-        const int x = cell.x, y = cell.y;
+    // Follows the edges clockwise from the north edge of the square at x,y
+    // until no untraced edge continues the outline.  When EXTEND is true,
+    // a straight run of edges moves its end node instead of adding nodes.
+    QPolygon trace(int x, int y) {
+        enum { West, North, East, South } dir = North;
         QPolygon nodes;
-        QPoint node1(x, y);
-        nodes += node1;
-        cell.start = true;
-        trace_N(cell, nodes, -1);
+        nodes += QPoint(x, y);
+        int extend = -1;
+        for (;;) {
+            OutlineCell& cell = *get(x, y);
+            switch (dir) {
+            case West:
+                addNode(nodes, { x, y }, extend);
+                cell.tw = true; // done
+                // turn w, continue n, turn e
+                if (canTrace_S(x - 1, y - 1)) {
+                    x--, y--, dir = South, extend = -1;
+                } else if (canTrace_W(x, y - 1)) {
+                    y--, extend = nodes.size() - 1;
+                } else if (canTrace_N(x, y)) {
+                    dir = North, extend = -1;
+                } else {
+                    goto done;
+                }
+                break;
+            case North:
+                addNode(nodes, { x + 1, y }, extend);
+                cell.tn = true; // done
+                // turn n, continue e, turn s
+                if (canTrace_W(x + 1, y - 1)) {
+                    x++, y--, dir = West, extend = -1;
+                } else if (canTrace_N(x + 1, y)) {
+                    x++, extend = nodes.size() - 1;
+                } else if (canTrace_E(x, y)) {
+                    dir = East, extend = -1;
+                } else {
+                    goto done;
+                }
+                break;
+            case East:
+                addNode(nodes, { x + 1, y + 1 }, extend);
+                cell.te = true; // done
+                // turn e, continue s, turn w
+                if (canTrace_N(x + 1, y + 1)) {
+                    x++, y++, dir = North, extend = -1;
+                } else if (canTrace_E(x, y + 1)) {
+                    y++, extend = nodes.size() - 1;
+                } else if (canTrace_S(x, y)) {
+                    dir = South, extend = -1;
+                } else {
+                    goto done;
+                }
+                break;
+            case South:
+                addNode(nodes, { x, y + 1 }, extend);
+                cell.ts = true; // done
+                // turn s, continue w, turn n
+                if (canTrace_E(x - 1, y + 1)) {
+                    x--, y++, dir = East, extend = -1;
+                } else if (canTrace_S(x - 1, y)) {
+                    x--, extend = nodes.size() - 1;
+                } else if (canTrace_W(x, y)) {
+                    dir = West, extend = -1;
+                } else {
+                    goto done;
+                }
+                break;
+            }
+        }
+done:
         if (nodes.back() == nodes.first())
             nodes.pop_back();
         return nodes;
     }
 
-    void trace(bool extend, std::function<void(QPolygon&)> callback) {
+    void trace(bool extend, std::function<void(int, QPolygon&)> callback) {
         EXTEND = extend;
         for (int y = 0; y < H; y++) {
             for (int x = 0; x < W; x++) {
                 OutlineCell& cell = *get(x, y);
-                if (!cell.inner)
+                if (cell.label == -1)
                     continue;
-                if (!isInner(x - 1, y))
+                if (!isInner(x - 1, y, cell.label))
                     cell.w = true;
-                if (!isInner(x, y - 1))
+                if (!isInner(x, y - 1, cell.label))
                     cell.n = true;
-                if (!isInner(x + 1, y))
+                if (!isInner(x + 1, y, cell.label))
                     cell.e = true;
-                if (!isInner(x, y + 1))
+                if (!isInner(x, y + 1, cell.label))
                     cell.s = true;
             }
         }
 
         for (int y = 0; y < H; y++) {
             for (int x = 0; x < W; x++) {
-                OutlineCellPtr cell = get(x, y);
+                OutlineCell& cell = *get(x, y);
                 // every poly must have a nw corner.
                 // this should only happen once.
-                if (cell && cell->n && cell->w && cell->inner && !(cell->tw || cell->tn || cell->te || cell->ts)) {
-                    QPolygon nodes = trace(*cell);
+                if (cell.label != -1 && cell.n && cell.w && !(cell.tw || cell.tn || cell.te || cell.ts)) {
+                    mLabel = cell.label;
+                    QPolygon nodes = trace(x, y);
                     if (nodes.isEmpty())
                         continue;
-                    callback(nodes);
+                    callback(mLabel, nodes);
                 }
             }
         }
@@ -469,93 +592,6 @@ public:
 
 } // namespace
 
-bool InGameMapFeatureGenerator::processObjectGroup(WorldCell *cell, ObjectGroup *objectGroup, int levelOffset, const QPoint &offset)
-{
-    if (objectGroup->name().contains(QLatin1String("RoomDefs")) == false) {
-        return true;
-    }
-
-    int level;
-    if (!MapComposite::levelForLayer(objectGroup, &level))
-        return true;
-    level += levelOffset;
-
-    if (level != 0)
-        return true;
-
-    QRect bounds;
-    QVector<QRect> rects;
-
-    foreach (const MapObject *mapObject, objectGroup->objects()) {
-#if 0
-        if (mapObject->name().isEmpty() || mapObject->type().isEmpty())
-            continue;
-#endif
-        if (mapObject->width() * mapObject->height() <= 0)
-            continue;
-
-        int x = qFloor(mapObject->x());
-        int y = qFloor(mapObject->y());
-        int w = qCeil(mapObject->x() + mapObject->width()) - x;
-        int h = qCeil(mapObject->y() + mapObject->height()) - y;
-
-        if (objectGroup->map()->orientation() == Map::Isometric) {
-            x += 3 * level;
-            y += 3 * level;
-        }
-
-        // Apply the MapComposite offset in the top-level map.
-        x += offset.x();
-        y += offset.y();
-
-        if (x < 0 || y < 0 || x + w > 300 || y + h > 300) {
-            x = qBound(0, x, 300);
-            y = qBound(0, y, 300);
-            mError = tr("A RoomDef in cell %1,%2 overlaps cell boundaries.\nNear x,y=%3,%4")
-                    .arg(cell->x()).arg(cell->y()).arg(x).arg(y);
-            return false;
-        }
-        if (bounds.isEmpty())
-            bounds = { x, y, w, h };
-        else
-            bounds |= { x, y, w, h };
-        rects += { x, y, w, h };
-    }
-
-    if (bounds.isEmpty())
-        return true;
-
-    OutlineGrid grid;
-    grid.setSize(bounds.width(), bounds.height());
-    for (auto& rect : rects) {
-        for (int y = 0; y < rect.height(); y++)
-            for (int x = 0; x < rect.width(); x++)
-                grid.setInner(rect.x() - bounds.x() + x, rect.y() - bounds.y() + y);
-    }
-
-    grid.trace(true, [&](QPolygon& nodes) {
-        nodes.translate(bounds.left(), bounds.top());
-
-        InGameMapFeature* feature = new InGameMapFeature(&cell->inGameMap());
-
-        InGameMapProperty property;
-        property.mKey = QStringLiteral("building");
-        property.mValue = QStringLiteral("yes");
-        feature->properties() += property;
-
-        feature->mGeometry.mType = QStringLiteral("Polygon");
-        InGameMapCoordinates coords;
-        for (auto& point : nodes) {
-            coords += InGameMapPoint(point.x(), point.y());
-        }
-        feature->mGeometry.mCoordinates += coords;
-
-        mWorldDoc->addInGameMapFeature(cell, cell->inGameMap().features().size(), feature);
-    });
-
-    return true;
-}
-
 bool InGameMapFeatureGenerator::processObjectGroup(WorldCell *cell, MapInfo *mapInfo, ObjectGroup *objectGroup, int levelOffset,
                                                    const QPoint &offset, QRect &bounds, QVector<QRect> &rects)
 {
@@ -607,57 +643,73 @@ bool InGameMapFeatureGenerator::processObjectGroup(WorldCell *cell, MapInfo *map
     return true;
 }
 
-bool InGameMapFeatureGenerator::traceBuildingOutline(WorldCell *cell, MapInfo *mapInfo, QRect &bounds, QVector<QRect> &rects)
+void InGameMapFeatureGenerator::buildBuildingFeatures(CellJob &job)
 {
-    if (bounds.isEmpty())
-        return true;
+    if (job.buildings.isEmpty())
+        return;
 
-    OutlineGrid grid;
-    grid.setSize(bounds.width(), bounds.height());
-    for (auto& rect : rects) {
-        for (int y = 0; y < rect.height(); y++)
-            for (int x = 0; x < rect.width(); x++)
-                grid.setInner(rect.x() - bounds.x() + x, rect.y() - bounds.y() + y);
+    QRect bounds;
+    for (const CellJob::Building &building : qAsConst(job.buildings)) {
+        bounds |= building.bounds;
     }
 
-    grid.trace(true, [&](QPolygon& nodes) {
-        nodes.translate(bounds.left(), bounds.top());
+    auto rasterize = [](OutlineGrid& grid, const QRect& origin, const CellJob::Building& building, int label) {
+        bool ok = true;
+        for (auto& rect : building.rects) {
+            for (int y = 0; y < rect.height(); y++)
+                for (int x = 0; x < rect.width(); x++)
+                    ok &= grid.setLabel(rect.x() - origin.x() + x, rect.y() - origin.y() + y, label);
+        }
+        return ok;
+    };
 
-        if (isInvalidBuildingPolygon(nodes)) {
-            return;
+    // All the buildings share one grid, labelled by their index in the job.
+    // A building overlapping an earlier one can't share squares with it, so
+    // it is traced on its own grid afterwards.
+    OutlineGrid grid;
+    grid.setSize(bounds.width(), bounds.height());
+    QVector<int> overlapping;
+    for (int i = 0; i < job.buildings.size(); i++) {
+        if (!rasterize(grid, bounds, job.buildings[i], i)) {
+            grid.clearLabel(job.buildings[i].bounds.translated(-bounds.topLeft()), i);
+            overlapping += i;
         }
+    }
 
-        InGameMapFeature* feature = new InGameMapFeature(&cell->inGameMap());
+    QVector<QList<QPolygon>> outlines(job.buildings.size());
+    grid.trace(true, [&](int label, QPolygon& nodes) {
+        outlines[label] += nodes.translated(bounds.topLeft());
+    });
 
-        InGameMapProperty property;
-        property.mKey = QStringLiteral("building");
-        QString LEGEND = QStringLiteral("Legend");
-        if (mapInfo->map()->properties().contains(LEGEND)) {
-            property.mValue = mapInfo->map()->property(LEGEND);
-        } else {
-            property.mValue = QStringLiteral("yes");
-        }
-        feature->properties() += property;
-        for (auto it = mapInfo->map()->properties().cbegin(); it != mapInfo->map()->properties().cend(); it++) {
-            if (it.key() == LEGEND) {
+    for (int i : qAsConst(overlapping)) {
+        const CellJob::Building &building = job.buildings[i];
+        grid.setSize(building.bounds.width(), building.bounds.height());
+        rasterize(grid, building.bounds, building, 0);
+        grid.trace(true, [&](int, QPolygon& nodes) {
+            outlines[i] += nodes.translated(building.bounds.topLeft());
+        });
+    }
+
+    // Add the features in the same order as tracing each building separately.
+    for (int i = 0; i < job.buildings.size(); i++) {
+        for (const QPolygon &nodes : qAsConst(outlines[i])) {
+            if (isInvalidBuildingPolygon(nodes)) {
                 continue;
             }
-            property.mKey = it.key();
-            property.mValue = it.value();
-            feature->properties() += property;
-        }
 
-        feature->mGeometry.mType = QStringLiteral("Polygon");
-        InGameMapCoordinates coords;
-        for (auto& point : nodes) {
-            coords += InGameMapPoint(point.x(), point.y());
-        }
-        feature->mGeometry.mCoordinates += coords;
+            InGameMapFeature* feature = new InGameMapFeature(&job.cell->inGameMap());
+            feature->properties() = job.buildings[i].properties;
 
-        mWorldDoc->addInGameMapFeature(cell, cell->inGameMap().features().size(), feature);
-    });
+            feature->mGeometry.mType = QStringLiteral("Polygon");
+            InGameMapCoordinates coords;
+            for (auto& point : nodes) {
+                coords += InGameMapPoint(point.x(), point.y());
+            }
+            feature->mGeometry.mCoordinates += coords;
 
-    return true;
+            job.features += feature;
+        }
+    }
 }
 
 bool InGameMapFeatureGenerator::isInvalidBuildingPolygon(const QPolygon &poly)
@@ -666,6 +718,7 @@ bool InGameMapFeatureGenerator::isInvalidBuildingPolygon(const QPolygon &poly)
     return (bounds.width() == 2) && (bounds.height() == 2);
 }
 
+#include <algorithm>
 #include <stack>
 
 struct DPPoint {
@@ -818,101 +871,69 @@ static void simplifyPolygon(ClipperLib::Path& nodes)
     }
 }
 
-bool InGameMapFeatureGenerator::doWater(WorldCell *cell, MapInfo *mapInfo)
+/**
+  * Marks the squares on level 0 with a tile from \a tilesetName between
+  * \a firstID and \a lastID.
+  */
+bool InGameMapFeatureGenerator::readMask(CellJob &job, MapInfo *mapInfo, const QString &tilesetName, int firstID, int lastID)
 {
-    // Remove all "water=" features
-    auto& features = cell->inGameMap().features();
-    for (int i = features.size() - 1; i >= 0; i--) {
-        auto* feature = features[i];
-        if (feature->properties().containsKey(QStringLiteral("water"))) {
-            mWorldDoc->removeInGameMapFeature(cell, feature->index());
-        }
-    }
-
     DelayedMapLoader mapLoader;
     mapLoader.addMap(mapInfo);
 
-    while (mapInfo->isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+    MapManager::instance()->waitForMap(mapInfo);
 
     MapComposite staticMapComposite(mapInfo);
     MapComposite *mapComposite = &staticMapComposite;
     while (mapComposite->waitingForMapsToLoad() || mapLoader.isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        MapManager::instance()->waitForThreadResults();
 
     const QRect bounds(QPoint(), mapInfo->map()->size());
 
     auto* layerGroup = mapComposite->layerGroupForLevel(0);
     layerGroup->prepareDrawing2();
 
-    ClipperLib::Clipper clipper;
-    ClipperLib::Path path;
-
     static QVector<const Tiled::Cell*> cells(40);
 
-    auto isWaterAt = [&](int x, int y) {
+    // Compare the tileset name once per tileset, not once per square.
+    const Tileset *lastTileset = nullptr;
+    bool lastTilesetMatches = false;
+
+    auto isMatchAt = [&](int x, int y) {
         cells.resize(0);
         layerGroup->orderedCellsAt2({x, y}, cells);
         for (auto* cell : qAsConst(cells)) {
             if (cell->isEmpty())
                 continue;
-            if ((cell->tile->id() < 8) && (cell->tile->tileset()->name() == QStringLiteral("blends_natural_02"))) {
+            if (cell->tile->id() < firstID || cell->tile->id() > lastID)
+                continue;
+            if (cell->tile->tileset() != lastTileset) {
+                lastTileset = cell->tile->tileset();
+                lastTilesetMatches = (lastTileset->name() == tilesetName);
+            }
+            if (lastTilesetMatches) {
                 return true;
             }
         }
         return false;
     };
 
+    job.size = bounds.size();
+    job.mask.assign(size_t(bounds.width() * bounds.height()), 0);
     for (int y = 0; y < bounds.height(); y++) {
         for (int x = 0; x < bounds.width(); x++) {
-            if (isWaterAt(x, y)) {
-#if 1
-                path.clear();
-                path << ClipperLib::IntPoint(x, y);
-                path << ClipperLib::IntPoint(x + 1, y);
-                path << ClipperLib::IntPoint(x + 1, y + 1);
-                path << ClipperLib::IntPoint(x, y + 1);
-                clipper.AddPath(path, ClipperLib::ptSubject, true);
-#else
-                // This should work...
-                int end = x + 1;
-                for (; end < bounds.width(); end++) {
-                    if (isWaterAt(end, y) == false)
-                        break;
-                }
-                path.clear();
-                path << ClipperLib::IntPoint(x, y);
-                path << ClipperLib::IntPoint(end, y);
-                path << ClipperLib::IntPoint(end, y + 1);
-                path << ClipperLib::IntPoint(x, y + 1);
-                clipper.AddPath(path, ClipperLib::ptSubject, true);
-                x = end - 1;
-#endif
-            }
+            job.mask[x + y * bounds.width()] = isMatchAt(x, y);
         }
     }
 
-    ClipperLib::PolyTree polyTree;
-    if (clipper.Execute(ClipperLib::ctDifference, polyTree, ClipperLib::PolyFillType::pftPositive) == false) {
-        return true;
-    }
+    return true;
+}
 
-    std::map<ClipperLib::PolyNode*,pzPolygon*> polyMap;
-    std::vector<pzPolygon*> allPolygons;
-    for (ClipperLib::PolyNode* node = polyTree.GetFirst(); node != nullptr; node = node->GetNext()) {
-        if (node->IsHole()) {
-            pzPolygon *outer = polyMap[node->Parent];
-            outer->inner.push_back(node->Contour);
-        } else {
-            pzPolygon* poly = new pzPolygon();
-            poly->outer = node->Contour;
-            polyMap[node] = poly;
-            allPolygons.push_back(poly);
-        }
-    }
+void InGameMapFeatureGenerator::buildWaterFeatures(CellJob &job)
+{
+    std::vector<pzPolygon*> allPolygons = traceMask(job.mask, job.size.width(), job.size.height());
 
     for (pzPolygon *poly : allPolygons) {
-        InGameMapFeature* feature = new InGameMapFeature(&cell->inGameMap());
+        InGameMapFeature* feature = new InGameMapFeature(&job.cell->inGameMap());
         feature->properties().set(QStringLiteral("water"), QStringLiteral("river"));
         ClipperLib::Path simple = poly->outer;
         simplifyPolygon(simple);
@@ -935,63 +956,16 @@ bool InGameMapFeatureGenerator::doWater(WorldCell *cell, MapInfo *mapInfo)
             }
         }
 
-        mWorldDoc->addInGameMapFeature(cell, cell->inGameMap().features().size(), feature);
+        job.features += feature;
     }
 
     qDeleteAll(allPolygons);
-    return true;
 }
 
-#include <array>
-
-bool InGameMapFeatureGenerator::doTrees(WorldCell *cell, MapInfo *mapInfo)
+void InGameMapFeatureGenerator::buildTreeFeatures(CellJob &job)
 {
-    // Remove all "natural=forest" features
-    auto& features = cell->inGameMap().features();
-    for (int i = features.size() - 1; i >= 0; i--) {
-        auto* feature = features[i];
-        if (feature->properties().contains(QStringLiteral("natural"), QStringLiteral("forest"))) {
-            mWorldDoc->removeInGameMapFeature(cell, feature->index());
-        }
-    }
-
-    DelayedMapLoader mapLoader;
-    mapLoader.addMap(mapInfo);
-
-    while (mapInfo->isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
-
-    MapComposite staticMapComposite(mapInfo);
-    MapComposite *mapComposite = &staticMapComposite;
-    while (mapComposite->waitingForMapsToLoad() || mapLoader.isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
-
-    const QRect bounds(QPoint(), mapInfo->map()->size());
-
-    auto* layerGroup = mapComposite->layerGroupForLevel(0);
-    layerGroup->prepareDrawing2();
-
-    static QVector<const Tiled::Cell*> cells(40);
-
-    auto isTreeAt = [&](int _x, int _y) {
-        cells.resize(0);
-        layerGroup->orderedCellsAt2({_x, _y}, cells);
-        for (auto* cell : qAsConst(cells)) {
-            if (cell->isEmpty())
-                continue;
-            if (cell->tile->id() >= 8 && cell->tile->id() <= 15 && cell->tile->tileset()->name() == QStringLiteral("vegetation_trees_01")) {
-                return true;
-            }
-        }
-        return false;
-    };
-
-    std::array<bool, 300 * 300> trees;
-    for (int y = 0; y < bounds.height(); y++) {
-        for (int x = 0; x < bounds.width(); x++) {
-            trees[x + y * 300] = isTreeAt(x, y);
-        }
-    }
+    const QRect bounds(QPoint(), job.size);
+    const std::vector<char> &trees = job.mask;
 
     auto getTreesNear = [&](int _x, int _y) {
         QRect box = { _x, _y, 1, 1 };
@@ -999,7 +973,7 @@ bool InGameMapFeatureGenerator::doTrees(WorldCell *cell, MapInfo *mapInfo)
             for (int x = _x - 4; x < _x + 4; x++) {
                 if (x == _x && y == _y)
                     continue;
-                if (bounds.contains(x, y) && trees[x + y * 300]) {
+                if (bounds.contains(x, y) && trees[x + y * bounds.width()]) {
                     box |= { x, y, 1, 1 };
                 }
             }
@@ -1008,49 +982,27 @@ bool InGameMapFeatureGenerator::doTrees(WorldCell *cell, MapInfo *mapInfo)
 
     };
 
-    ClipperLib::Clipper clipper;
-    ClipperLib::Path path;
-
+    std::vector<char> forest(bounds.width() * bounds.height());
     for (int y = 0; y < bounds.height(); y++) {
         for (int x = 0; x < bounds.width(); x++) {
-            if (trees[x + y * 300]) {
+            if (trees[x + y * bounds.width()]) {
                 QRect box = getTreesNear(x, y);
                 if (box.size() != QSize(1, 1)) {
-                    path.clear();
                     box.adjust(-1, -1, 1, 1);
                     box &= bounds;
-                    path << ClipperLib::IntPoint(box.left(), box.top());
-                    path << ClipperLib::IntPoint(box.right() + 1, box.top());
-                    path << ClipperLib::IntPoint(box.right() + 1, box.bottom() + 1);
-                    path << ClipperLib::IntPoint(box.left(), box.bottom() + 1);
-                    clipper.AddPath(path, ClipperLib::ptSubject, true);
+                    for (int by = box.top(); by <= box.bottom(); by++) {
+                        std::fill_n(forest.begin() + box.left() + by * bounds.width(), box.width(), 1);
+                    }
                 }
             }
         }
     }
 
-    ClipperLib::PolyTree polyTree;
-    if (clipper.Execute(ClipperLib::ctDifference, polyTree, ClipperLib::PolyFillType::pftPositive) == false) {
-        return true;
-    }
-
-    std::map<ClipperLib::PolyNode*,pzPolygon*> polyMap;
-    std::vector<pzPolygon*> allPolygons;
-    for (ClipperLib::PolyNode* node = polyTree.GetFirst(); node != nullptr; node = node->GetNext()) {
-        if (node->IsHole()) {
-            pzPolygon *outer = polyMap[node->Parent];
-            outer->inner.push_back(node->Contour);
-        } else {
-            pzPolygon* poly = new pzPolygon();
-            poly->outer = node->Contour;
-            polyMap[node] = poly;
-            allPolygons.push_back(poly);
-        }
-    }
+    std::vector<pzPolygon*> allPolygons = traceMask(forest, bounds.width(), bounds.height());
 
 #if 0
     int nextID = 0;
-    for (auto *feature : cell->inGameMap().features()) {
+    for (auto *feature : job.cell->inGameMap().features()) {
         nextID = std::max(nextID, feature->mProperties.getInt(QStringLiteral("id"), 0));
     }
 #endif
@@ -1077,7 +1029,7 @@ bool InGameMapFeatureGenerator::doTrees(WorldCell *cell, MapInfo *mapInfo)
         }
 #endif
 
-        InGameMapFeature* feature = new InGameMapFeature(&cell->inGameMap());
+        InGameMapFeature* feature = new InGameMapFeature(&job.cell->inGameMap());
         feature->properties().set(QStringLiteral("natural"), QStringLiteral("forest"));
         feature->mGeometry.mType = QStringLiteral("Polygon");
         InGameMapCoordinates coords;
@@ -1107,11 +1059,11 @@ bool InGameMapFeatureGenerator::doTrees(WorldCell *cell, MapInfo *mapInfo)
 #endif
         }
 
-        mWorldDoc->addInGameMapFeature(cell, cell->inGameMap().features().size(), feature);
+        job.features += feature;
 
 #if 0
         for (auto& hole : poly->inner) {
-            InGameMapFeature* feature = new InGameMapFeature(&cell->inGameMap());
+            InGameMapFeature* feature = new InGameMapFeature(&job.cell->inGameMap());
             feature->properties().set(QStringLiteral("natural"), QStringLiteral("forest"));
             feature->properties().set(QStringLiteral("hole"), nextID);
             feature->mGeometry.mType = QStringLiteral("Polygon");
@@ -1122,11 +1074,10 @@ bool InGameMapFeatureGenerator::doTrees(WorldCell *cell, MapInfo *mapInfo)
                 coords += InGameMapPoint(point.X, point.Y);
             }
             feature->mGeometry.mCoordinates += coords;
-            mWorldDoc->addInGameMapFeature(cell, cell->inGameMap().features().size(), feature);
+            job.features += feature;
         }
 #endif
     }
 
     qDeleteAll(allPolygons);
-    return true;
 }
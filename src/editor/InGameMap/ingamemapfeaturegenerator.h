@@ -22,8 +22,8 @@
 #include <QObject>
 #include <QPainter>
 #include <QSet>
+#include <QVector>
 
-class MapComposite;
 class MapInfo;
 class WorldCell;
 class WorldDocument;
@@ -65,16 +65,23 @@ public:
     QString errorString() const { return mError; }
 
 private:
+    struct CellJob;
+    friend class CellFeatureTask;
+
     bool shouldGenerateCell(WorldCell *cell);
-    bool generateCell(WorldCell *cell);
-    bool doBuildings(WorldCell *cell, MapInfo *mapInfo);
-    bool processObjectGroups(WorldCell *cell, MapComposite *mapComposite);
-    bool processObjectGroup(WorldCell *cell, Tiled::ObjectGroup *objectGroup, int levelOffset, const QPoint &offset);
+    bool prepareCell(CellJob &job);
+    void commitFinishedCells(QVector<CellJob*> &jobs, int &next);
+    void commitCell(CellJob &job);
+    bool readBuildings(CellJob &job, MapInfo *mapInfo);
     bool processObjectGroup(WorldCell *cell, MapInfo *mapInfo, Tiled::ObjectGroup *objectGroup, int levelOffset, const QPoint &offset, QRect &bounds, QVector<QRect> &rects);
-    bool traceBuildingOutline(WorldCell *cell, MapInfo *mapInfo, QRect &bounds, QVector<QRect> &rects);
-    bool isInvalidBuildingPolygon(const QPolygon &poly);
-    bool doWater(WorldCell* cell, MapInfo* mapInfo);
-    bool doTrees(WorldCell* cell, MapInfo *mapInfo);
+    bool readMask(CellJob &job, MapInfo *mapInfo, const QString &tilesetName, int firstID, int lastID);
+
+    // These run on worker threads.
+    static void buildFeatures(CellJob &job);
+    static void buildBuildingFeatures(CellJob &job);
+    static void buildWaterFeatures(CellJob &job);
+    static void buildTreeFeatures(CellJob &job);
+    static bool isInvalidBuildingPolygon(const QPolygon &poly);
 
 private:
     WorldDocument *mWorldDoc;
@@ -21,15 +21,27 @@
 #include "celldocument.h"
 #include "chunkmap.h"
 #include "documentmanager.h"
+#include "imagepyramidbuilder.h"
+#include "ingamemapcellimage.h"
+#include "lotpackreader.h"
+#include "pngstreamwriter.h"
 #include "world.h"
 #include "worlddocument.h"
 
 #include "BuildingEditor/buildingtiles.h"
 
-#include <QBuffer>
+#include <quazip.h>
+
 #include <QDebug>
+#include <QFile>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QImage>
+#include <QRunnable>
+#include <QScopedPointer>
+#include <QThreadPool>
+
+#include <cstring>
 
 InGameMapImageDialog::InGameMapImageDialog(QWidget *parent) :
     QDialog(parent),
@@ -67,7 +79,7 @@ void InGameMapImageDialog::chooseMapDirectory()
 void InGameMapImageDialog::chooseOutputFile()
 {
     QString f = QFileDialog::getSaveFileName(this, tr("Save PNG As..."),
-                                             ui->outputImagePath->text(), QLatin1String("PNG Files (*.png)"));
+                                             ui->outputImagePath->text(), QLatin1String("PNG Files (*.png);;ZIP Files (*.zip)"));
     if (f.isEmpty()) {
         return;
     }
@@ -86,7 +98,10 @@ void InGameMapImageDialog::clickedTheButton()
     if (inputPath.isEmpty() || !QDir(inputPath).exists()) {
         return;
     }
-    if (outputPath.isEmpty() || !outputPath.toLower().endsWith(QStringLiteral(".png"))) {
+    if (outputPath.isEmpty()) {
+        return;
+    }
+    if (!outputPath.toLower().endsWith(QStringLiteral(".png")) && !outputPath.toLower().endsWith(QStringLiteral(".zip"))) {
         return;
     }
 
@@ -99,6 +114,39 @@ void InGameMapImageDialog::clickedTheButton()
     mStop = false;
 }
 
+/**
+  * Renders one cell into its own 300x300 image on a worker thread.
+  */
+class CellImageTask : public QRunnable
+{
+public:
+    CellImageTask(QImage *image, QImage *footprint, const LotHeader *header, const QString &mapDirectory,
+                  int cellX, int cellY, bool upperFloors) :
+        mImage(image),
+        mFootprint(footprint),
+        mHeader(header),
+        mMapDirectory(mapDirectory),
+        mCellX(cellX),
+        mCellY(cellY),
+        mUpperFloors(upperFloors)
+    {
+    }
+
+    void run() override
+    {
+        InGameMapImageDialog::cellToImage(*mImage, mFootprint, mHeader, mMapDirectory, mCellX, mCellY, mUpperFloors);
+    }
+
+private:
+    QImage *mImage;
+    QImage *mFootprint;
+    const LotHeader *mHeader;
+    QString mMapDirectory;
+    int mCellX;
+    int mCellY;
+    bool mUpperFloors;
+};
+
 void InGameMapImageDialog::createImage()
 {
     ui->statusLabel->setText(QStringLiteral("Loading .lotheader files"));
@@ -106,6 +154,7 @@ void InGameMapImageDialog::createImage()
 
     QString inputPath = ui->inputMapPath->text();
     QString outputPath = ui->outputImagePath->text();
+    const bool upperFloors = ui->checkUpperFloors->isChecked();
 
     qDeleteAll(IsoLot::InfoHeaders);
     IsoLot::InfoHeaders.clear();
@@ -114,147 +163,180 @@ void InGameMapImageDialog::createImage()
     metaGrid.Create(inputPath);
     QSize worldSize(metaGrid.maxx - metaGrid.minx + 1, metaGrid.maxy - metaGrid.miny + 1);
 
-    QImage image(worldSize * 300, QImage::Format_RGBA8888);
-    image.fill(Qt::gray);
+    // The image is written one row of cells at a time, so only one row of
+    // 300x300 cell images is in memory no matter how big the world is.
+    // A .zip output gets the tile pyramid for the in-game map directly,
+    // without writing the full-size image first.
+    const bool writeZip = outputPath.toLower().endsWith(QStringLiteral(".zip"));
+    PngStreamWriter png;
+    // The optional building footprints go in a second PNG next to the output.
+    PngStreamWriter footprintPng;
+    const bool writeFootprint = ui->checkBuildingFootprint->isChecked();
+    if (writeFootprint) {
+        QFileInfo info(outputPath);
+        QString footprintPath = info.dir().filePath(info.completeBaseName() + QStringLiteral("_buildings.png"));
+        if (!footprintPng.open(footprintPath, worldSize.width() * 300, worldSize.height() * 300)) {
+            ui->statusLabel->setText(QStringLiteral("Error writing PNG: %1").arg(footprintPng.errorString()));
+            return;
+        }
+    }
+    QScopedPointer<QuaZip> zip;
+    QScopedPointer<ImagePyramidBuilder> pyramid;
+    if (writeZip) {
+        zip.reset(new QuaZip(outputPath));
+        if (zip->open(QuaZip::Mode::mdCreate) == false) {
+            ui->statusLabel->setText(QStringLiteral("Error creating %1").arg(outputPath));
+            footprintPng.abort();
+            return;
+        }
+        pyramid.reset(new ImagePyramidBuilder(*zip, worldSize.width() * 300, worldSize.height() * 300));
+    } else if (!png.open(outputPath, worldSize.width() * 300, worldSize.height() * 300)) {
+        ui->statusLabel->setText(QStringLiteral("Error writing PNG: %1").arg(png.errorString()));
+        footprintPng.abort();
+        return;
+    }
+
+    QVector<QImage> cellImages(worldSize.width());
+    QVector<QImage> footprintImages(writeFootprint ? worldSize.width() : 0);
+    QByteArray row(worldSize.width() * 300 * 4, 0);
+    QByteArray footprintRow(writeFootprint ? row.size() : 0, 0);
+    QThreadPool threadPool;
 
     for (int cy = metaGrid.miny; cy <= metaGrid.maxy; cy++) {
+        ui->statusLabel->setText(QStringLiteral("Creating Image (row %1 of %2)")
+                                 .arg(cy - metaGrid.miny + 1).arg(worldSize.height()));
+        qApp->processEvents();
+
         for (int cx = metaGrid.minx; cx <= metaGrid.maxx; cx++) {
-            ui->statusLabel->setText(QStringLiteral("Creating Image (cell %1,%2)").arg(cx).arg(cy));
+            QImage &cellImage = cellImages[cx - metaGrid.minx];
+            if (cellImage.isNull())
+                cellImage = QImage(300, 300, QImage::Format_RGBA8888);
+            cellImage.fill(Qt::gray);
+            QImage *footprint = nullptr;
+            if (writeFootprint) {
+                footprint = &footprintImages[cx - metaGrid.minx];
+                if (footprint->isNull())
+                    *footprint = QImage(300, 300, QImage::Format_RGBA8888);
+                footprint->fill(Qt::transparent);
+            }
+            // IsoLot::InfoHeaders isn't safe to use from the worker threads.
+            QString filenameheader = QStringLiteral("%1/%2_%3.lotheader").arg(inputPath).arg(cx).arg(cy);
+            const LotHeader *header = IsoLot::InfoHeaders.value(filenameheader);
+            if (header == nullptr)
+                continue;
+            threadPool.start(new CellImageTask(&cellImage, footprint, header, inputPath, cx, cy, upperFloors));
+        }
+
+        while (!threadPool.waitForDone(100)) {
             qApp->processEvents();
-            if (mStop) {
-                qDeleteAll(IsoLot::InfoHeaders);
-                IsoLot::InfoHeaders.clear();
-                mStop = false;
+            if (mStop)
+                threadPool.clear();
+        }
+
+        if (mStop) {
+            if (writeZip) {
+                pyramid.reset();
+                zip->close();
+                QFile::remove(outputPath);
+            } else {
+                png.abort();
+            }
+            footprintPng.abort();
+            qDeleteAll(IsoLot::InfoHeaders);
+            IsoLot::InfoHeaders.clear();
+            mStop = false;
+            return;
+        }
+
+        for (int y = 0; y < 300; y++) {
+            char *dest = row.data();
+            for (const QImage &cellImage : qAsConst(cellImages)) {
+                std::memcpy(dest, cellImage.constScanLine(y), 300 * 4);
+                dest += 300 * 4;
+            }
+            if (writeFootprint) {
+                dest = footprintRow.data();
+                for (const QImage &footprint : qAsConst(footprintImages)) {
+                    std::memcpy(dest, footprint.constScanLine(y), 300 * 4);
+                    dest += 300 * 4;
+                }
+                if (!footprintPng.writeRow(reinterpret_cast<const uchar*>(footprintRow.constData()))) {
+                    ui->statusLabel->setText(QStringLiteral("Error writing PNG: %1").arg(footprintPng.errorString()));
+                    footprintPng.abort();
+                    if (!writeZip)
+                        png.abort();
+                    return;
+                }
+            }
+            if (writeZip) {
+                QImage rowImage(reinterpret_cast<const uchar*>(row.constData()), worldSize.width() * 300, 1, QImage::Format_RGBA8888);
+                if (!pyramid->addRows(rowImage)) {
+                    ui->statusLabel->setText(QStringLiteral("Error writing ZIP: %1").arg(pyramid->errorString()));
+                    footprintPng.abort();
+                    return;
+                }
+                continue;
+            }
+            if (!png.writeRow(reinterpret_cast<const uchar*>(row.constData()))) {
+                ui->statusLabel->setText(QStringLiteral("Error writing PNG: %1").arg(png.errorString()));
+                png.abort();
+                footprintPng.abort();
                 return;
             }
-            cellToImage(image, inputPath, metaGrid, cx, cy);
         }
     }
 
-    ui->statusLabel->setText(QStringLiteral("Writing PNG"));
-    qApp->processEvents();
-    image.save(outputPath);
+    if (writeZip) {
+        ui->statusLabel->setText(QStringLiteral("Writing ZIP"));
+        qApp->processEvents();
+        if (!pyramid->finish()) {
+            ui->statusLabel->setText(QStringLiteral("Error writing ZIP: %1").arg(pyramid->errorString()));
+            footprintPng.abort();
+            return;
+        }
+        ImagePyramidBuilder::writePyramidTxt(*zip, metaGrid.minx * 300, metaGrid.miny * 300,
+                                             (metaGrid.maxx + 1) * 300, (metaGrid.maxy + 1) * 300);
+        zip->close();
+    } else {
+        ui->statusLabel->setText(QStringLiteral("Writing PNG"));
+        qApp->processEvents();
+        if (!png.close()) {
+            ui->statusLabel->setText(QStringLiteral("Error writing PNG: %1").arg(png.errorString()));
+            footprintPng.abort();
+            return;
+        }
+    }
+
+    if (writeFootprint && !footprintPng.close())
+        ui->statusLabel->setText(QStringLiteral("Error writing PNG: %1").arg(footprintPng.errorString()));
 }
 
-void InGameMapImageDialog::cellToImage(QImage &image, const QString &mapDirectory, IsoMetaGrid& metaGrid, int cellX, int cellY)
+void InGameMapImageDialog::cellToImage(QImage &image, QImage *footprint, const LotHeader *header,
+                                       const QString &mapDirectory, int cellX, int cellY, bool upperFloors)
 {
-    QString filenameheader = QStringLiteral("%1/%2_%3.lotheader").arg(mapDirectory).arg(cellX).arg(cellY);
-    if (!IsoLot::InfoHeaders.contains(filenameheader)) {
-        return;
-    }
-    LotHeader* header = IsoLot::InfoHeaders[filenameheader];
     QString filenamepack = QStringLiteral("%1/world_%2_%3.lotpack").arg(mapDirectory).arg(cellX).arg(cellY);
-    QFile file(filenamepack);
-    if (!file.open(QFile::ReadOnly)) {
+    LotPackReader reader;
+    if (!reader.open(filenamepack)) {
         return;
     }
 
-    QBuffer buffer;
-    buffer.open(QBuffer::ReadWrite);
-    buffer.write(file.readAll());
-    file.close();
-    buffer.seek(0);
-
-    QDataStream in(&buffer);
-    in.setByteOrder(QDataStream::LittleEndian);
-
-    for (int chunkY = 0; chunkY < 300 / 10; chunkY++) {
-        for (int chunkX = 0; chunkX < 300 / 10; chunkX++) {
-            int index = chunkX * IsoChunkMap::ChunkGridWidth + chunkY;
-            buffer.seek(4 + index * 8);
-            qint64 pos;
-            in >> pos;
-            buffer.seek(pos);
-            int skip = 0;
-            for (int z = 0; z < header->levels; ++z) {
-                for (int x = 0; x < IsoChunkMap::ChunksPerWidth; ++x) {
-                    for (int y = 0; y < IsoChunkMap::ChunksPerWidth; ++y) {
-                        if (skip > 0) {
-                            --skip;
-                            continue;
-                        }
-                        int count = IsoLot::readInt(in);
-                        if (count == -1) {
-                            skip = IsoLot::readInt(in);
-                            if (skip > 0) {
-                                --skip;
-                            }
-                            continue;
-                        }
-                        int roomID = IsoLot::readInt(in);
-//                        roomIDs[x][y][z] = roomID;
-                        Q_ASSERT(count > 1 && count < 30);
-                        for (int n = 1; n < count; ++n) {
-                            int tileNameIndex = IsoLot::readInt(in);
-//                            this->data[x][y][z] += d;
-                            QString tileName = header->tilesUsed[tileNameIndex];
-                            BuildingEditor::BuildingTile buildingTile = header->buildingTiles[tileNameIndex];
-                            int pixelX = (cellX - metaGrid.minx) * 300 + chunkX * 10 + x;
-                            int pixelY = (cellY - metaGrid.miny) * 300 + chunkY * 10 + y;
-                            tileToImage(image, buildingTile, pixelX, pixelY);
-                        }
-                    }
-                }
-                break; // z=0 only
-            }
-        }
-    }
+    // Classify each tile used by this cell once, instead of matching its
+    // name against every rule for every square it appears in.
+    const QVector<quint32> tileColors = classifyTiles(header->buildingTiles);
+    const int levels = (upperFloors || footprint != nullptr) ? header->levels : 1;
+    InGameMapCellImage::draw(reader, tileColors, levels, upperFloors, image, footprint);
 }
 
-void InGameMapImageDialog::tileToImage(QImage &image, const BuildingEditor::BuildingTile &buildingTile, int pixelX, int pixelY)
+/**
+  * Returns the color of each tile in a .lotheader's list of used tiles, or 0
+  * if the tile doesn't change the map image.  See InGameMapCellImage::tileColor().
+  */
+QVector<quint32> InGameMapImageDialog::classifyTiles(const QList<BuildingEditor::BuildingTile> &buildingTiles)
 {
-    if (buildingTile.mIndex == -1) {
-        return; // failed to parse the tile name
-    }
-    int tileIndex = buildingTile.mIndex;
-    if (buildingTile.mTilesetName.contains(QStringLiteral("_trees"))) {
-        image.setPixel(pixelX, pixelY, qRgb(38, 53, 22)); // normaltree
-    }
-    if (buildingTile.mTilesetName.contains(QStringLiteral("jumbo"))) {
-        image.setPixel(pixelX, pixelY, qRgb(38, 53, 22)); // jumbotree
-    }
-    if (buildingTile.mTilesetName.contains(QStringLiteral("_railroad"))) {
-        image.setPixel(pixelX, pixelY, qRgb(73, 58, 43)); // rails
-    }
-    if (buildingTile.mTilesetName.startsWith(QStringLiteral("vegetation"))) {
-        image.setPixel(pixelX, pixelY, qRgb(48, 73, 32)); // vegetation
-    }
-    if (buildingTile.mTilesetName.startsWith(QStringLiteral("blends_natural_01"))) {
-        if (tileIndex >= 0 && tileIndex <= 15) {
-            image.setPixel(pixelX, pixelY, qRgb(217, 207, 183)); // sand
-        }
-        if (tileIndex >= 16 && tileIndex <= 31) {
-            image.setPixel(pixelX, pixelY, qRgb(75, 88, 27)); // darkgrass
-        }
-        if (tileIndex >= 32 && tileIndex <= 47) {
-            image.setPixel(pixelX, pixelY, qRgb(97, 103, 36)); // medgrass
-        }
-        if (tileIndex >= 48 && tileIndex <= 63) {
-            image.setPixel(pixelX, pixelY, qRgb(127, 120, 45)); // litegrass
-        }
-        if (tileIndex >= 64 && tileIndex <= 79) {
-            image.setPixel(pixelX, pixelY, qRgb(91, 63, 21)); // dirt
-        }
-    }
-    if (buildingTile.mTilesetName.startsWith(QStringLiteral("blends_natural_02"))) {
-        image.setPixel(pixelX, pixelY, qRgb(108, 127, 131)); // water
-    }
-    if (buildingTile.mTilesetName.startsWith(QStringLiteral("blends_street_01"))) {
-        image.setPixel(pixelX, pixelY, qRgb(128, 128, 128)); // street
-    }
-    if (buildingTile.mTilesetName.startsWith(QStringLiteral("floors_exterior_tilesandstone"))) {
-        image.setPixel(pixelX, pixelY, qRgb(132, 81, 76)); // tilesand
-    }
-    if (buildingTile.mTilesetName.startsWith(QStringLiteral("floors_exterior_tilesandwood"))) {
-        image.setPixel(pixelX, pixelY, qRgb(132, 81, 76)); // tilesand
-    }
-    if (buildingTile.mTilesetName.startsWith(QStringLiteral("location_"))) {
-        image.setPixel(pixelX, pixelY, qRgb(132, 81, 76)); // tilesand
-    }
-    if (buildingTile.mTilesetName.startsWith(QStringLiteral("vegetation_farm"))) {
-        image.setPixel(pixelX, pixelY, qRgb(218, 165, 32)); // Corn
-    }
-    if (buildingTile.mTilesetName.startsWith(QStringLiteral("walls_"))) {
-        image.setPixel(pixelX, pixelY, qRgb(93, 44, 39)); // walls
+    QVector<quint32> colors(buildingTiles.size(), 0);
+    for (int i = 0; i < buildingTiles.size(); i++) {
+        const BuildingEditor::BuildingTile &buildingTile = buildingTiles[i];
+        colors[i] = InGameMapCellImage::tileColor(buildingTile.mTilesetName, buildingTile.mIndex);
     }
+    return colors;
 }
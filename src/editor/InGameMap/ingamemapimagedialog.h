@@ -19,8 +19,9 @@
 #define INGAMEMAPIMAGEDIALOG_H
 
 #include <QDialog>
+#include <QVector>
 
-class IsoMetaGrid;
+class LotHeader;
 
 namespace BuildingEditor {
 class BuildingTile;
@@ -44,9 +45,12 @@ private slots:
     void clickedTheButton();
 
 private:
+    friend class CellImageTask;
+
     void createImage();
-    void cellToImage(QImage& image, const QString &mapDirectory, IsoMetaGrid &metaGrid, int cellX, int cellY);
-    void tileToImage(QImage& image, const BuildingEditor::BuildingTile &buildingTile, int pixelX, int pixelY);
+    static void cellToImage(QImage& image, QImage *footprint, const LotHeader *header,
+                            const QString &mapDirectory, int cellX, int cellY, bool upperFloors);
+    static QVector<quint32> classifyTiles(const QList<BuildingEditor::BuildingTile> &buildingTiles);
 
     Ui::InGameMapImageDialog *ui;
     bool mRunning = false;
@@ -18,18 +18,17 @@
 #include "ingamemapimagepyramidwindow.h"
 #include "ui_ingamemapimagepyramidwindow.h"
 
+#include "imagepyramidbuilder.h"
+
 #include "celldocument.h"
 #include "documentmanager.h"
 #include "worlddocument.h"
 #include "world.h"
 
 #include <quazip.h>
-#include <quazipfile.h>
 
 #include <QFileDialog>
 
-#include <cmath>
-
 InGameMapImagePyramidWindow::InGameMapImagePyramidWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::InGameMapImagePyramidWindow)
@@ -101,25 +100,26 @@ void InGameMapImagePyramidWindow::createZip()
         return;
     }
 
-    int tileSize = 256;
-    int levels = 5;
-    for (int level = 0; level < levels; level++) {
-        float width = float(image.width()) / (1 << level);
-        float height = float(image.height()) / (1 << level);
-        QImage scaledImage = image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-        int columns = std::ceil(width / tileSize);
-        int rows = std::ceil(height / tileSize);
-        log(QStringLiteral("Creating images for level %1. width x height = %2 x %3").arg(level).arg(columns).arg(rows));
-        for (int row = 0; row < rows; row++) {
-            for (int col = 0; col < columns; col++) {
-                QImage subImage = scaledImage.copy(col * tileSize, row * tileSize, tileSize, tileSize);
-                writeImageToZip(zip, subImage, col, row, level);
-            }
-        }
-        if (width <= tileSize && height <= tileSize) {
-            break;
+    ImagePyramidBuilder builder(zip, image.width(), image.height());
+    for (int level = 0; level < builder.levelCount(); level++) {
+        log(QStringLiteral("Creating images for level %1. width x height = %2 x %3").arg(level).arg(builder.columns(level)).arg(builder.rows(level)));
+    }
+
+    // Each band of rows completes one row of level-0 tiles.
+    const int bandHeight = ImagePyramidBuilder::TileSize;
+    for (int y = 0; y < image.height(); y += bandHeight) {
+        QImage band = image.copy(0, y, image.width(), qMin(bandHeight, image.height() - y));
+        if (builder.addRows(band) == false) {
+            log(builder.errorString());
+            return;
         }
+        log(QStringLiteral("Added %1 tiles to ZIP").arg(builder.tilesWritten()));
     }
+    if (builder.finish() == false) {
+        log(builder.errorString());
+        return;
+    }
+    log(QStringLiteral("Added %1 tiles to ZIP").arg(builder.tilesWritten()));
 
     writePyramidTxt(zip);
 
@@ -128,43 +128,13 @@ void InGameMapImagePyramidWindow::createZip()
     log(QStringLiteral("FINISHED."));
 }
 
-void InGameMapImagePyramidWindow::writeImageToZip(QuaZip &zip, const QImage &image, int col, int row, int level)
-{
-    QString fileName = QStringLiteral("%1/tile%2x%3.png").arg(level).arg(col).arg(row);
-
-    log(QStringLiteral("Adding %1 to ZIP").arg(fileName));
-
-//    zip.setCurrentFile(fileName);
-
-    QuaZipFile file(&zip);
-    QuaZipNewInfo newInfo(fileName);
-    if (file.open(QIODevice::WriteOnly, newInfo) == false) {
-        log(QStringLiteral("Error opening %1 in ZIP file").arg(fileName));
-        return;
-    }
-    if (image.save(&file, "PNG") == false) {
-        log(QStringLiteral("ERROR writing %1 to ZIP file").arg(fileName));
-        file.close();
-        return;
-    }
-    file.close();
-}
-
 void InGameMapImagePyramidWindow::writePyramidTxt(QuaZip &zip)
 {
     QString fileName = QStringLiteral("pyramid.txt");
     log(QStringLiteral("Writing %1").arg(fileName));
-    QuaZipFile file(&zip);
-    QuaZipNewInfo newInfo(fileName);
-    if (file.open(QIODevice::WriteOnly, newInfo) == false) {
+    if (ImagePyramidBuilder::writePyramidTxt(zip, ui->xMin->value(), ui->yMin->value(), ui->xMax->value(), ui->yMax->value()) == false) {
         log(QStringLiteral("Error opening %1 in ZIP file").arg(fileName));
-        return;
     }
-    QTextStream ts(&file);
-    ts << "VERSION=1\n";
-    ts << QStringLiteral("bounds=%1 %2 %3 %4\n").arg(ui->xMin->value()).arg(ui->yMin->value()).arg(ui->xMax->value()).arg(ui->yMax->value());
-    ts.flush();
-    file.close();
 }
 
 void InGameMapImagePyramidWindow::log(const QString &str)
@@ -41,7 +41,6 @@ private slots:
     void createZip();
 
 private:
-    void writeImageToZip(QuaZip& zip, const QImage &image, int col, int row, int level);
     void writePyramidTxt(QuaZip& zip);
     void log(const QString& str);
 
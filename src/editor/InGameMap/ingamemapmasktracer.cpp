@@ -0,0 +1,130 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ingamemapmasktracer.h"
+
+#include <QtGlobal>
+
+std::vector<pzPolygon*> traceMask(const std::vector<char> &mask, int width, int height)
+{
+    auto filled = [&](int x, int y) {
+        return x >= 0 && y >= 0 && x < width && y < height && mask[x + y * width];
+    };
+
+    // Label each 4-connected group of squares.
+    std::vector<int> labels(mask.size(), -1);
+    std::vector<int> stack;
+    int labelCount = 0;
+    for (int i = 0; i < width * height; i++) {
+        if (!mask[i] || labels[i] != -1)
+            continue;
+        labels[i] = labelCount;
+        stack.push_back(i);
+        while (!stack.empty()) {
+            const int j = stack.back();
+            stack.pop_back();
+            const int x = j % width, y = j / width;
+            const int neighbours[4][2] = { { x - 1, y }, { x + 1, y }, { x, y - 1 }, { x, y + 1 } };
+            for (auto &n : neighbours) {
+                if (filled(n[0], n[1]) && labels[n[0] + n[1] * width] == -1) {
+                    labels[n[0] + n[1] * width] = labelCount;
+                    stack.push_back(n[0] + n[1] * width);
+                }
+            }
+        }
+        ++labelCount;
+    }
+
+    // The boundary edges leaving each grid point, directed so the filled
+    // square is on the right.  A grid point has two edges where two squares
+    // touch only at their corners.
+    enum { East = 1, South = 2, West = 4, North = 8 };
+    const int stride = width + 1;
+    std::vector<quint8> allEdges(stride * (height + 1), 0);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (!mask[x + y * width])
+                continue;
+            if (!filled(x, y - 1))
+                allEdges[x + y * stride] |= East;
+            if (!filled(x + 1, y))
+                allEdges[(x + 1) + y * stride] |= South;
+            if (!filled(x, y + 1))
+                allEdges[(x + 1) + (y + 1) * stride] |= West;
+            if (!filled(x - 1, y))
+                allEdges[x + (y + 1) * stride] |= North;
+        }
+    }
+    std::vector<quint8> unused = allEdges;
+
+    auto squareRightOf = [&](int x, int y, int dir) {
+        switch (dir) {
+        case East: return labels[x + y * width];
+        case South: return labels[(x - 1) + y * width];
+        case West: return labels[(x - 1) + (y - 1) * width];
+        default: return labels[x + (y - 1) * width];
+        }
+    };
+
+    std::vector<pzPolygon*> polygons(labelCount, nullptr);
+    std::vector<ClipperLib::Paths> holes(labelCount);
+    ClipperLib::Path ring;
+
+    for (int vy = 0; vy <= height; vy++) {
+        for (int vx = 0; vx <= width; vx++) {
+            while (quint8 edges = unused[vx + vy * stride]) {
+                const int startDir = edges & -edges;
+                const int label = squareRightOf(vx, vy, startDir);
+                ring.clear();
+                int x = vx, y = vy, dir = startDir;
+                for (;;) {
+                    unused[x + y * stride] &= ~dir;
+                    switch (dir) {
+                    case East: ++x; break;
+                    case South: ++y; break;
+                    case West: --x; break;
+                    default: --y; break;
+                    }
+                    // Turn right where squares touch at a corner, which
+                    // keeps diagonal neighbours in separate rings.
+                    const quint8 out = allEdges[x + y * stride];
+                    int next = out;
+                    if (out & (out - 1))
+                        next = (dir == North) ? East : (dir << 1);
+                    if (next != dir)
+                        ring.push_back(ClipperLib::IntPoint(x, y));
+                    if (x == vx && y == vy && next == startDir)
+                        break;
+                    dir = next;
+                }
+                if (ClipperLib::Orientation(ring)) {
+                    pzPolygon *poly = new pzPolygon();
+                    poly->outer = ring;
+                    polygons[label] = poly;
+                } else {
+                    holes[label].push_back(ring);
+                }
+            }
+        }
+    }
+
+    for (int label = 0; label < labelCount; label++) {
+        polygons[label]->inner = holes[label];
+    }
+    return polygons;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INGAMEMAPMASKTRACER_H
+#define INGAMEMAPMASKTRACER_H
+
+#include "clipper.hpp"
+
+#include <vector>
+
+struct pzPolygon
+{
+    ClipperLib::Path outer;
+    ClipperLib::Paths inner; // holes
+};
+
+/**
+  * Traces the outlines of the filled squares in a width x height mask in one
+  * pass, instead of having Clipper union one path per square.
+  *
+  * Each 4-connected group of squares becomes one pzPolygon.  Rings are
+  * oriented the way Clipper outputs them (outer rings have Orientation() true,
+  * holes false) and contain only the corner points.  The caller owns the
+  * returned polygons.
+  */
+std::vector<pzPolygon*> traceMask(const std::vector<char> &mask, int width, int height);
+
+#endif // INGAMEMAPMASKTRACER_H
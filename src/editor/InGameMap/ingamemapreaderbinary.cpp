@@ -0,0 +1,398 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ingamemapreaderbinary.h"
+
+#include "world.h"
+#include "worldcell.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+
+#define VERSION1 1
+#define VERSION2 2
+
+namespace {
+
+/**
+  * Bounds-checked little-endian reads from the mapped file.
+  */
+class Cursor
+{
+public:
+    Cursor(const uchar *start, const uchar *end)
+        : mPos(start)
+        , mEnd(end)
+    {
+    }
+
+    template<typename T>
+    T read()
+    {
+        if (mEnd - mPos < qint64(sizeof(T))) {
+            fail();
+            return T(0);
+        }
+        T value = qFromLittleEndian<T>(mPos);
+        mPos += sizeof(T);
+        return value;
+    }
+
+    float readFloat()
+    {
+        quint32 bits = read<quint32>();
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    QString readString()
+    {
+        const int length = read<quint16>();
+        if (mEnd - mPos < length) {
+            fail();
+            return QString();
+        }
+        QString str = QString::fromUtf8(reinterpret_cast<const char*>(mPos), length);
+        mPos += length;
+        return str;
+    }
+
+    bool ok() const { return mOK; }
+    const uchar *pos() const { return mPos; }
+
+private:
+    void fail()
+    {
+        mOK = false;
+        mPos = mEnd;
+    }
+
+    const uchar *mPos;
+    const uchar *mEnd;
+    bool mOK = true;
+};
+
+} // namespace
+
+class InGameMapReaderBinaryPrivate
+{
+    Q_DECLARE_TR_FUNCTIONS(InGameMapReaderBinary)
+
+public:
+    struct Chunk
+    {
+        QPoint cell; // includes the world origin
+        QRectF bounds;
+        quint32 featureCount;
+        quint64 offset;
+        quint32 size;
+    };
+
+    InGameMapReaderBinaryPrivate()
+        : mData(nullptr)
+        , mSize(0)
+        , mVersion(0)
+    {
+    }
+
+    bool open(const QString &fileName)
+    {
+        close();
+
+        mFile.setFileName(fileName);
+        if (!mFile.exists()) {
+            mError = tr("File not found: %1").arg(fileName);
+            return false;
+        }
+        if (!mFile.open(QIODevice::ReadOnly)) {
+            mError = tr("Unable to read file: %1").arg(fileName);
+            return false;
+        }
+
+        mSize = mFile.size();
+        mData = mFile.map(0, mSize);
+        if (mData == nullptr) {
+            mBuffer = mFile.readAll();
+            mData = reinterpret_cast<const uchar*>(mBuffer.constData());
+        }
+
+        if (!readHeader()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (mFile.isOpen()) {
+            if (mBuffer.isEmpty() && mData != nullptr)
+                mFile.unmap(const_cast<uchar*>(mData));
+            mFile.close();
+        }
+        mBuffer.clear();
+        mData = nullptr;
+        mSize = 0;
+        mVersion = 0;
+        mStrings.clear();
+        mChunks.clear();
+    }
+
+    bool readHeader()
+    {
+        Cursor r(mData, mData + mSize);
+        if (r.read<quint8>() != 'I' || r.read<quint8>() != 'G' || r.read<quint8>() != 'M' || r.read<quint8>() != 'B') {
+            mError = tr("This isn't an InGameMap binary file.");
+            return false;
+        }
+
+        mVersion = r.read<qint32>();
+        if (mVersion != VERSION1 && mVersion != VERSION2) {
+            mError = tr("Unsupported InGameMap binary version %1.").arg(mVersion);
+            return false;
+        }
+
+        mWidth = r.read<qint32>();
+        mHeight = r.read<qint32>();
+
+        if (mVersion == VERSION1) {
+            const int count = r.read<qint32>();
+            for (int i = 0; i < count && r.ok(); i++) {
+                mStrings += r.readString();
+            }
+            mBodyOffset = r.pos() - mData;
+            return checkCursor(r);
+        }
+
+        r.read<qint32>(); // cell size
+        const quint32 stringCount = r.read<quint32>();
+        for (quint32 i = 0; i < stringCount && r.ok(); i++) {
+            mStrings += r.readString();
+        }
+        const quint32 chunkCount = r.read<quint32>();
+        for (quint32 i = 0; i < chunkCount && r.ok(); i++) {
+            Chunk chunk;
+            const int x = r.read<qint32>();
+            const int y = r.read<qint32>();
+            chunk.cell = QPoint(x, y);
+            const float minX = r.readFloat();
+            const float minY = r.readFloat();
+            const float maxX = r.readFloat();
+            const float maxY = r.readFloat();
+            chunk.bounds = QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
+            chunk.featureCount = r.read<quint32>();
+            chunk.offset = r.read<quint64>();
+            chunk.size = r.read<quint32>();
+            if (chunk.offset > quint64(mSize) || chunk.size > quint64(mSize) - chunk.offset) {
+                mError = tr("Chunk %1,%2 is outside the file.").arg(x).arg(y);
+                return false;
+            }
+            mChunks += chunk;
+        }
+        return checkCursor(r);
+    }
+
+    bool readRegion(World *world, const QRect &cellRect)
+    {
+        const QPoint worldOrigin = world->getGenerateLotsSettings().worldOrigin;
+
+        if (mVersion == VERSION1) {
+            return readVersion1(world, cellRect);
+        }
+
+        for (const Chunk &chunk : qAsConst(mChunks)) {
+            const QPoint pos = chunk.cell - worldOrigin;
+            if (!cellRect.contains(pos) || !world->contains(pos.x(), pos.y()))
+                continue;
+            WorldCell *cell = world->cellAt(pos);
+            Cursor r(mData + chunk.offset, mData + chunk.offset + chunk.size);
+            for (quint32 i = 0; i < chunk.featureCount && r.ok(); i++) {
+                cell->inGameMap().mFeatures += readFeature2(r, cell);
+            }
+            if (!checkCursor(r))
+                return false;
+        }
+        return true;
+    }
+
+    InGameMapFeature *readFeature2(Cursor &r, WorldCell *cell)
+    {
+        InGameMapFeature* feature = new InGameMapFeature(&cell->inGameMap());
+        feature->mGeometry.mType = string(r.read<quint32>());
+        const quint32 ringCount = r.read<quint32>();
+        for (quint32 i = 0; i < ringCount && r.ok(); i++) {
+            InGameMapCoordinates coords;
+            const quint32 pointCount = r.read<quint32>();
+            for (quint32 j = 0; j < pointCount && r.ok(); j++) {
+                const float x = r.readFloat();
+                const float y = r.readFloat();
+                coords += InGameMapPoint(x, y);
+            }
+            feature->mGeometry.mCoordinates += coords;
+        }
+        const quint32 propertyCount = r.read<quint32>();
+        for (quint32 i = 0; i < propertyCount && r.ok(); i++) {
+            const quint32 key = r.read<quint32>();
+            const quint32 value = r.read<quint32>();
+            feature->mProperties += InGameMapProperty(string(key), string(value));
+        }
+        return feature;
+    }
+
+    bool readVersion1(World *world, const QRect &cellRect)
+    {
+        const QPoint worldOrigin = world->getGenerateLotsSettings().worldOrigin;
+        Cursor r(mData + mBodyOffset, mData + mSize);
+        for (int i = 0; i < mWidth * mHeight && r.ok(); i++) {
+            const int x = r.read<qint32>();
+            if (x == -1)
+                continue;
+            const int y = r.read<qint32>();
+            const int featureCount = r.read<qint32>();
+            const QPoint pos = QPoint(x, y) - worldOrigin;
+            WorldCell *cell = nullptr;
+            if (cellRect.contains(pos) && world->contains(pos.x(), pos.y()))
+                cell = world->cellAt(pos);
+            for (int j = 0; j < featureCount && r.ok(); j++) {
+                InGameMapFeature* feature = readFeature1(r, cell);
+                if (cell != nullptr)
+                    cell->inGameMap().mFeatures += feature;
+            }
+        }
+        return checkCursor(r);
+    }
+
+    // Returns nullptr when cell is nullptr, which skips the feature.
+    InGameMapFeature *readFeature1(Cursor &r, WorldCell *cell)
+    {
+        InGameMapFeature* feature = cell ? new InGameMapFeature(&cell->inGameMap()) : nullptr;
+        const QString type = string(r.read<qint16>());
+        const int ringCount = r.read<qint8>();
+        QList<InGameMapCoordinates> rings;
+        for (int i = 0; i < ringCount && r.ok(); i++) {
+            InGameMapCoordinates coords;
+            const int pointCount = r.read<qint16>();
+            for (int j = 0; j < pointCount && r.ok(); j++) {
+                const int x = r.read<qint16>();
+                const int y = r.read<qint16>();
+                if (feature)
+                    coords += InGameMapPoint(x, y);
+            }
+            rings += coords;
+        }
+        const int propertyCount = r.read<qint8>();
+        InGameMapProperties properties;
+        for (int i = 0; i < propertyCount && r.ok(); i++) {
+            const int key = r.read<qint16>();
+            const int value = r.read<qint16>();
+            if (feature)
+                properties += InGameMapProperty(string(key), string(value));
+        }
+        if (feature) {
+            feature->mGeometry.mType = type;
+            feature->mGeometry.mCoordinates = rings;
+            feature->mProperties = properties;
+        }
+        return feature;
+    }
+
+    QString string(quint32 index) const
+    {
+        return (index < quint32(mStrings.size())) ? mStrings[int(index)] : QString();
+    }
+
+    bool checkCursor(const Cursor &r)
+    {
+        if (!r.ok()) {
+            mError = tr("Unexpected end of file.");
+            return false;
+        }
+        return true;
+    }
+
+    QFile mFile;
+    QByteArray mBuffer; // used if the file can't be mapped
+    const uchar *mData;
+    qint64 mSize;
+    int mVersion;
+    int mWidth = 0;
+    int mHeight = 0;
+    qint64 mBodyOffset = 0; // VERSION1, the first cell
+    QVector<QString> mStrings;
+    QVector<Chunk> mChunks; // VERSION2
+    QString mError;
+};
+
+/////
+
+InGameMapReaderBinary::InGameMapReaderBinary()
+    : d(new InGameMapReaderBinaryPrivate)
+{
+}
+
+InGameMapReaderBinary::~InGameMapReaderBinary()
+{
+    d->close();
+    delete d;
+}
+
+bool InGameMapReaderBinary::open(const QString &fileName)
+{
+    return d->open(fileName);
+}
+
+void InGameMapReaderBinary::close()
+{
+    d->close();
+}
+
+int InGameMapReaderBinary::version() const
+{
+    return d->mVersion;
+}
+
+bool InGameMapReaderBinary::readWorld(World *world)
+{
+    return readRegion(world, QRect(0, 0, world->width(), world->height()));
+}
+
+bool InGameMapReaderBinary::readRegion(World *world, const QRect &cellRect)
+{
+    if (d->mData == nullptr) {
+        return false;
+    }
+    return d->readRegion(world, cellRect);
+}
+
+World *InGameMapReaderBinary::readWorld(const QString &fileName, World *world)
+{
+    if (!open(fileName))
+        return nullptr;
+    bool ok = readWorld(world);
+    close();
+    return ok ? world : nullptr;
+}
+
+QString InGameMapReaderBinary::errorString() const
+{
+    return d->mError;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INGAMEMAPREADERBINARY_H
+#define INGAMEMAPREADERBINARY_H
+
+#include <QRect>
+#include <QString>
+
+class World;
+
+class InGameMapReaderBinaryPrivate;
+
+/**
+  * Reads the features written by InGameMapWriterBinary.
+  *
+  * The file is memory-mapped.  For version 2 files only the header, string
+  * table and chunk directory are read by open(); readRegion() then decodes
+  * just the chunks for the requested cells.  Version 1 files have no
+  * directory and are decoded in full.
+  */
+class InGameMapReaderBinary
+{
+public:
+    InGameMapReaderBinary();
+    ~InGameMapReaderBinary();
+
+    bool open(const QString &fileName);
+    void close();
+
+    int version() const;
+
+    /**
+      * Adds the features in every cell of the file to \a world.
+      */
+    bool readWorld(World *world);
+
+    /**
+      * Adds the features in the cells of \a world within \a cellRect, in
+      * world coordinates (without the world origin).
+      */
+    bool readRegion(World *world, const QRect &cellRect);
+
+    World *readWorld(const QString &fileName, World *world);
+
+    QString errorString() const;
+
+private:
+    InGameMapReaderBinaryPrivate *d;
+};
+
+#endif // INGAMEMAPREADERBINARY_H
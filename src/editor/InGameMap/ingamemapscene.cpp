@@ -34,6 +34,7 @@
 #include <QGraphicsSceneMouseEvent>
 #include <QKeyEvent>
 #include <QPainter>
+#include <QStyleOptionGraphicsItem>
 #include <QtMath>
 
 InGameMapFeatureItem::InGameMapFeatureItem(InGameMapFeature* feature, CellScene *scene, QGraphicsItem *parent)
@@ -77,10 +78,18 @@ void InGameMapFeatureItem::paint(QPainter *painter, const QStyleOptionGraphicsIt
     pen.setWidth(2);
     pen.setCosmetic(true);
 
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+
+    // Don't draw features smaller than a pixel at this zoom level.
+    if (!isPoint() && mBoundingRect.width() * lod < 1 && mBoundingRect.height() * lod < 1)
+        return;
+
     painter->setPen(pen);
     painter->setRenderHint(QPainter::Antialiasing);
 
-    QPolygonF screenPolygon = mRenderer->tileToPixelCoords(mPolygon.translated(mDragOffset));
+    // The renderer's transform is affine, so dragging just offsets the cached polygons.
+    const QPointF dragOffset = mRenderer->tileToPixelCoords(mDragOffset) - mRenderer->tileToPixelCoords(QPointF());
+    QPolygonF screenPolygon = mSceneCoords.isEmpty() ? QPolygonF() : mSceneCoords.first().translated(dragOffset);
 
     switch (geometryType()) {
     case Type::INVALID:
@@ -89,24 +98,11 @@ void InGameMapFeatureItem::paint(QPainter *painter, const QStyleOptionGraphicsIt
         pen.setColor(color);
         painter->setPen(pen);
         painter->setBrush(brush);
-        painter->drawEllipse(screenPolygon[0], 10, 10);
+        painter->drawEllipse(mRenderer->tileToPixelCoords(mPolygon[0] + mDragOffset), 10, 10);
         break;
     case Type::Polygon:
     {
-        QPainterPath path;
-        if (screenPolygon.isClosed() == false) {
-            screenPolygon += screenPolygon.first();
-        }
-        path.addPolygon(screenPolygon);
-        QPainterPath path2;
-        for (auto& hole : mHoles) {
-            QPolygonF screenPolygon2 = mRenderer->tileToPixelCoords(hole.translated(mDragOffset));
-            if (screenPolygon2.isClosed() == false) {
-                screenPolygon2 += screenPolygon2.first();
-            }
-            path2.addPolygon(screenPolygon2);
-        }
-        path = path.subtracted(path2);
+        QPainterPath path = pathForLevelOfDetail(lod).translated(dragOffset);
         painter->drawPath(path);
 
         pen.setColor(color);
@@ -194,7 +190,7 @@ void InGameMapFeatureItem::hoverMoveEvent(QGraphicsSceneHoverEvent *event)
 
     qreal zoom = firstViewZoom();
 
-    QPolygonF poly = mRenderer->tileToPixelCoords(mPolygon, 0);
+    const QPolygonF poly = mSceneCoords.isEmpty() ? QPolygonF() : mSceneCoords.first();
 
     // Don't add points near other points
     for (int i = 0; i < poly.size(); i++) {
@@ -231,36 +227,33 @@ void InGameMapFeatureItem::hoverLeaveEvent(QGraphicsSceneHoverEvent *event)
 
 QPainterPath InGameMapFeatureItem::shape() const
 {
-    QPolygonF polygon = mRenderer->tileToPixelCoords(mPolygon, 0);
-
-    if (isPolygon())
-        polygon += polygon[0];
-
-    auto scene = static_cast<CellScene*>(this->scene());
-    auto view = static_cast<CellView*>(scene->views().first());
-    qreal zoom = view->zoomable()->scale();
-    zoom = qMin(zoom, 1.0);
+    // Hover events call this for every item under the mouse pointer, so the
+    // stroke is only recreated when the geometry or the zoom level changes.
+    const qreal zoom = firstViewZoom();
+    if (zoom == mShapeZoom) {
+        return mShape;
+    }
 
     QPainterPath path;
     if (isPoint()) {
-//        path.addEllipse(polygon[0], 10, 10);
-        path.addRect(polygon[0].x() - 10, polygon[0].y() - 10, 20, 20);
-        return path;
+        QPointF center = mRenderer->tileToPixelCoords(mPolygon[0]);
+//        path.addEllipse(center, 10, 10);
+        path.addRect(center.x() - 10, center.y() - 10, 20, 20);
+        mShape = path;
+        mShapeZoom = zoom;
+        return mShape;
     }
-    path.addPolygon(polygon);
-
-    if (isPolygon() && (mHoles.isEmpty() == false)) {
-        // Holes
-        QPainterPath path2;
-        for (int i = 0; i < mHoles.size(); i++) {
-            path2.addPolygon(mRenderer->tileToPixelCoords(mHoles[i]));
-        }
-        path = path.subtracted(path2);
+    if (isPolygon()) {
+        path = mScenePath;
+    } else if (mSceneCoords.isEmpty() == false) {
+        path.addPolygon(mSceneCoords.first());
     }
 
     QPainterPathStroker stroker;
     stroker.setWidth(20 / zoom);
-    return stroker.createStroke(path);
+    mShape = stroker.createStroke(path);
+    mShapeZoom = zoom;
+    return mShape;
 }
 
 bool InGameMapFeatureItem::contains(const QPointF &point) const
@@ -280,6 +273,11 @@ void InGameMapFeatureItem::synchWithFeature()
     case Type::Point: {
         InGameMapPoint center = mFeature->mGeometry.mCoordinates[0][0];
         mPolygon += { center.x , center.y };
+        mSceneCoords.clear();
+        mSceneCoords += mRenderer->tileToPixelCoords(mPolygon, 0);
+        mScenePath = QPainterPath();
+        mLodPaths.clear();
+        mShapeZoom = -1;
         QPointF scenePos = mRenderer->tileToPixelCoords(mPolygon[0] + mDragOffset);
         QRectF bounds(scenePos.x() - 10, scenePos.y() - 10, 20, 20);
         if (bounds != mBoundingRect) {
@@ -325,6 +323,30 @@ void InGameMapFeatureItem::synchWithFeature()
         break;
     }
 
+    mSceneCoords.clear();
+    for (auto& coords : mFeature->mGeometry.mCoordinates) {
+        mSceneCoords += makeScenePolygon(coords);
+    }
+    mScenePath = QPainterPath();
+    if (isPolygon() && (mPolygon.isEmpty() == false)) {
+        // Odd-even filling leaves the holes empty without QPainterPath::subtracted().
+        mScenePath.setFillRule(Qt::OddEvenFill);
+        QPolygonF polygon = mRenderer->tileToPixelCoords(mPolygon, 0);
+        if (polygon.isClosed() == false) {
+            polygon += polygon.first();
+        }
+        mScenePath.addPolygon(polygon);
+        for (auto& hole : mHoles) {
+            QPolygonF polygon2 = mRenderer->tileToPixelCoords(hole, 0);
+            if (polygon2.isClosed() == false) {
+                polygon2 += polygon2.first();
+            }
+            mScenePath.addPolygon(polygon2);
+        }
+    }
+    mLodPaths.clear();
+    mShapeZoom = -1;
+
     QRectF bounds = mRenderer->tileToPixelCoords(mPolygon.translated(mDragOffset)).boundingRect().adjusted(-2, -3, 2, 2);
     if (bounds != mBoundingRect) {
         prepareGeometryChange();
@@ -388,8 +410,12 @@ void InGameMapFeatureItem::hitTest(const QPointF &scenePos, int &coordIndex, int
     coordIndex = -1;
     pointIndex = -1;
     dist = 10000;
-    for (int i = 0; i < mFeature->mGeometry.mCoordinates.size(); i++) {
-        QPolygonF scenePoly = makeScenePolygon(mFeature->mGeometry.mCoordinates[i]);
+    const qreal tolerance = 10 / firstViewZoom();
+    for (int i = 0; i < mSceneCoords.size(); i++) {
+        const QPolygonF &scenePoly = mSceneCoords[i];
+        const QRectF bounds = scenePoly.boundingRect().adjusted(-tolerance, -tolerance, tolerance, tolerance);
+        if (!bounds.contains(scenePos))
+            continue;
         int pointIndex2;
         float dist2;
         hitTest(scenePos, scenePoly, pointIndex2, dist2);
@@ -430,6 +456,105 @@ qreal InGameMapFeatureItem::firstViewZoom() const
     return qMin(zoom, 1.0);
 }
 
+// Ramer-Douglas-Peucker simplification of a closed polygon.
+static QPolygonF simplifyPolygon(const QPolygonF &poly, qreal tolerance)
+{
+    const int last = poly.size() - 1;
+    if (last < 3)
+        return poly;
+
+    QVector<bool> keep(poly.size(), false);
+    keep[0] = keep[last] = true;
+
+    const float tolerance2 = float(tolerance * tolerance);
+    QVector<QPair<int,int>> stack;
+    if (poly.first() == poly.last()) {
+        // Split a closed ring at the point farthest from its start.
+        int farthest = 1;
+        qreal maxDist = 0;
+        for (int i = 1; i < last; i++) {
+            qreal d = QLineF(poly[0], poly[i]).length();
+            if (d > maxDist) {
+                maxDist = d;
+                farthest = i;
+            }
+        }
+        keep[farthest] = true;
+        stack += qMakePair(0, farthest);
+        stack += qMakePair(farthest, last);
+    } else {
+        stack += qMakePair(0, last);
+    }
+    while (stack.isEmpty() == false) {
+        const QPair<int,int> span = stack.takeLast();
+        const QVector2D p1(poly[span.first]);
+        const QVector2D p2(poly[span.second]);
+        float maxDist = 0;
+        int farthest = -1;
+        for (int i = span.first + 1; i < span.second; i++) {
+            float d = distanceOfPointToLineSegment(p1, p2, QVector2D(poly[i]));
+            if (d > maxDist) {
+                maxDist = d;
+                farthest = i;
+            }
+        }
+        if (farthest != -1 && maxDist > tolerance2) {
+            keep[farthest] = true;
+            stack += qMakePair(span.first, farthest);
+            stack += qMakePair(farthest, span.second);
+        }
+    }
+
+    QPolygonF result;
+    for (int i = 0; i <= last; i++) {
+        if (keep[i])
+            result += poly[i];
+    }
+    return result;
+}
+
+/**
+  * Returns mScenePath, or a simplified copy of it when each scene pixel is
+  * smaller than a screen pixel.  The simplified paths are created the first
+  * time they are needed after synchWithFeature().
+  */
+const QPainterPath &InGameMapFeatureItem::pathForLevelOfDetail(qreal lod) const
+{
+    // Tolerances in scene pixels, each twice the previous one.
+    const int LOD_COUNT = 4;
+    const qreal FIRST_TOLERANCE = 2.0;
+
+    int level = -1;
+    qreal tolerance = FIRST_TOLERANCE;
+    while ((level + 1 < LOD_COUNT) && (tolerance * lod <= 1.0)) {
+        ++level;
+        tolerance *= 2;
+    }
+    if (level == -1 || mScenePath.isEmpty()) {
+        return mScenePath;
+    }
+
+    if (mLodPaths.isEmpty()) {
+        mLodPaths.resize(LOD_COUNT);
+    }
+    QPainterPath &path = mLodPaths[level];
+    if (path.isEmpty()) {
+        path.setFillRule(Qt::OddEvenFill);
+        const qreal levelTolerance = FIRST_TOLERANCE * (1 << level);
+        for (const QPolygonF &polygon : mScenePath.toSubpathPolygons()) {
+            QPolygonF simple = simplifyPolygon(polygon, levelTolerance);
+            if (simple.size() >= 4) { // closed, so at least a triangle
+                path.addPolygon(simple);
+            }
+        }
+        if (path.isEmpty()) {
+            // Everything simplified away; keep the original.
+            path = mScenePath;
+        }
+    }
+    return path;
+}
+
 /////
 
 class FeatureHandle : public QGraphicsItem
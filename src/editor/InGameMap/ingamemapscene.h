@@ -92,6 +92,8 @@ public:
     qreal firstViewZoom() const;
 
 protected:
+    const QPainterPath &pathForLevelOfDetail(qreal lod) const;
+
     friend class FeatureHandle;
     friend class EditInGameMapFeatureTool;
 
@@ -99,6 +101,12 @@ protected:
     InGameMapFeature* mFeature;
     QPolygonF mPolygon;
     QList<QPolygonF> mHoles;
+    // Scene coordinates, rebuilt only by synchWithFeature().
+    QList<QPolygonF> mSceneCoords; // same order as mFeature's coordinates
+    QPainterPath mScenePath; // polygon outline and holes
+    mutable QVector<QPainterPath> mLodPaths; // mScenePath simplified for lower zoom levels
+    mutable QPainterPath mShape;
+    mutable qreal mShapeZoom = -1;
     Tiled::MapRenderer *mRenderer;
     bool mSyncing;
     bool mIsEditable;
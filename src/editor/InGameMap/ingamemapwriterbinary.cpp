@@ -20,6 +20,7 @@
 #include "world.h"
 #include "worldcell.h"
 
+#include <QBuffer>
 #include <QCoreApplication>
 #include <QDataStream>
 #include <QDir>
@@ -29,8 +30,11 @@
 #include <QTemporaryFile>
 #include <QXmlStreamWriter>
 
+#include <algorithm>
+#include <limits>
+
 #define VERSION1 1
-#define VERSION_LATEST 1
+#define VERSION2 2 // features grouped into one chunk per cell, with a chunk directory
 
 class InGameMapWriterBinaryPrivate
 {
@@ -39,6 +43,7 @@ class InGameMapWriterBinaryPrivate
 public:
     InGameMapWriterBinaryPrivate()
         : mWorld(nullptr)
+        , mVersion(VERSION1)
     {
     }
 
@@ -65,9 +70,14 @@ public:
 
     void writeWorld(QDataStream &w, World *world)
     {
+        if (mVersion == VERSION2) {
+            writeWorld2(w, world);
+            return;
+        }
+
         w << quint8('I') << quint8('G') << quint8('M') << quint8('B');
 
-        w << qint32(VERSION_LATEST);
+        w << qint32(VERSION1);
 
         w << qint32(world->width());
         w << qint32(world->height());
@@ -155,8 +165,142 @@ public:
     {
         QByteArray utf8 = str.toUtf8();
         w << qint16(utf8.length());
-        for (int i = 0; i < utf8.length(); i++) {
-            w << quint8(utf8.at(i));
+        w.writeRawData(utf8.constData(), utf8.length());
+    }
+
+    /////
+
+    // VERSION2 layout, all little-endian:
+    //   'IGMB' int32:version int32:width int32:height int32:cellSize
+    //   uint32:stringCount { uint16:length utf8 }...
+    //   uint32:chunkCount { int32:cellX int32:cellY float:minX float:minY
+    //                       float:maxX float:maxY uint32:featureCount
+    //                       uint64:offset uint32:size }...
+    //   chunk data at the given offsets from the start of the file.
+    // A chunk holds the features of one cell, in cell coordinates.  A reader
+    // only needs the header, the strings and the directory to find the
+    // chunks covering part of the world.
+
+    struct Chunk
+    {
+        QPoint cell;
+        float minX, minY, maxX, maxY;
+        quint32 featureCount;
+        QByteArray data;
+    };
+
+    void writeWorld2(QDataStream &w, World *world)
+    {
+        w.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+        buildStringTable(world);
+
+        const QPoint worldOrigin = world->getGenerateLotsSettings().worldOrigin;
+        QList<Chunk> chunks;
+        for (int y = 0; y < world->height(); y++) {
+            for (int x = 0; x < world->width(); x++) {
+                WorldCell *cell = world->cellAt(x, y);
+                if (cell->inGameMap().features().isEmpty())
+                    continue;
+                Chunk chunk;
+                chunk.cell = worldOrigin + QPoint(x, y);
+                writeChunk(chunk, cell);
+                chunks += chunk;
+            }
+        }
+
+        w << quint8('I') << quint8('G') << quint8('M') << quint8('B');
+        w << qint32(VERSION2);
+        w << qint32(world->width());
+        w << qint32(world->height());
+        w << qint32(300);
+
+        qint64 headerSize = 4 + 4 * 4;
+        w << quint32(mStrings.size());
+        headerSize += 4;
+        for (const QString &str : qAsConst(mStrings)) {
+            QByteArray utf8 = str.toUtf8();
+            w << quint16(utf8.length());
+            w.writeRawData(utf8.constData(), utf8.length());
+            headerSize += 2 + utf8.length();
+        }
+
+        const int directoryEntrySize = 4 * 2 + 4 * 4 + 4 + 8 + 4;
+        w << quint32(chunks.size());
+        headerSize += 4 + chunks.size() * directoryEntrySize;
+        qint64 offset = headerSize;
+        for (const Chunk &chunk : qAsConst(chunks)) {
+            w << qint32(chunk.cell.x()) << qint32(chunk.cell.y());
+            w << chunk.minX << chunk.minY << chunk.maxX << chunk.maxY;
+            w << quint32(chunk.featureCount);
+            w << quint64(offset);
+            w << quint32(chunk.data.size());
+            offset += chunk.data.size();
+        }
+
+        for (const Chunk &chunk : qAsConst(chunks)) {
+            w.writeRawData(chunk.data.constData(), chunk.data.size());
+        }
+    }
+
+    void buildStringTable(World *world)
+    {
+        mStrings.clear();
+        mStringTable.clear();
+
+        auto addString = [&](const QString& str)
+        {
+            if (mStringTable.contains(str))
+                return;
+            mStringTable.insert(str, mStrings.size());
+            mStrings += str;
+        };
+
+        for (WorldCell *cell : world->cells()) {
+            for (auto* feature : qAsConst(cell->inGameMap().mFeatures)) {
+                addString(feature->mGeometry.mType);
+                for (auto& property : feature->mProperties) {
+                    addString(property.mKey);
+                    addString(property.mValue);
+                }
+            }
+        }
+    }
+
+    void writeChunk(Chunk &chunk, WorldCell *cell)
+    {
+        QBuffer buffer(&chunk.data);
+        buffer.open(QIODevice::WriteOnly);
+        QDataStream w(&buffer);
+        w.setByteOrder(QDataStream::LittleEndian);
+        w.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+        chunk.minX = chunk.minY = std::numeric_limits<float>::max();
+        chunk.maxX = chunk.maxY = std::numeric_limits<float>::lowest();
+        chunk.featureCount = quint32(cell->inGameMap().mFeatures.size());
+
+        for (auto* feature : qAsConst(cell->inGameMap().mFeatures)) {
+            w << quint32(mStringTable[feature->mGeometry.mType]);
+            w << quint32(feature->mGeometry.mCoordinates.size());
+            for (auto& coords : feature->mGeometry.mCoordinates) {
+                w << quint32(coords.size());
+                for (auto& point : coords) {
+                    w << float(point.x) << float(point.y);
+                    chunk.minX = std::min(chunk.minX, float(point.x));
+                    chunk.minY = std::min(chunk.minY, float(point.y));
+                    chunk.maxX = std::max(chunk.maxX, float(point.x));
+                    chunk.maxY = std::max(chunk.maxY, float(point.y));
+                }
+            }
+            w << quint32(feature->mProperties.size());
+            for (auto& property : feature->mProperties) {
+                w << quint32(mStringTable[property.mKey]);
+                w << quint32(mStringTable[property.mValue]);
+            }
+        }
+
+        if (chunk.minX > chunk.maxX) {
+            chunk.minX = chunk.minY = chunk.maxX = chunk.maxY = 0;
         }
     }
 
@@ -166,9 +310,11 @@ public:
     }
 
     World *mWorld;
+    int mVersion;
     QString mError;
     QDir mMapDir;
     QMap<QString, int> mStringTable;
+    QStringList mStrings;
 };
 
 /////
@@ -244,6 +390,16 @@ void InGameMapWriterBinary::writeWorld(World *world, QIODevice *device, const QS
     d->writeWorld(world, device, absDirPath);
 }
 
+void InGameMapWriterBinary::setVersion(int version)
+{
+    d->mVersion = (version == VERSION2) ? VERSION2 : VERSION1;
+}
+
+int InGameMapWriterBinary::version() const
+{
+    return d->mVersion;
+}
+
 QString InGameMapWriterBinary::errorString() const
 {
     return d->mError;
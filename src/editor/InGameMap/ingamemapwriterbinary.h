@@ -34,6 +34,12 @@ public:
     bool writeWorld(World *world, const QString &filePath);
     void writeWorld(World *world, QIODevice *device, const QString &absDirPath);
 
+    // 1 is the per-cell format the game reads, and the default.
+    // 2 groups the features into chunks with a directory and is read by
+    // InGameMapReaderBinary.
+    void setVersion(int version);
+    int version() const;
+
     QString errorString() const;
 
 private:
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pngstreamwriter.h"
+
+#include <QtEndian>
+
+#include <cstdlib>
+#include <cstring>
+
+// Size of each IDAT chunk.
+static const int IDAT_SIZE = 256 * 1024;
+
+// Bytes per pixel.
+static const int BPP = 4;
+
+PngStreamWriter::PngStreamWriter() :
+    mStreamOpen(false),
+    mWidth(0),
+    mHeight(0),
+    mRow(0)
+{
+}
+
+PngStreamWriter::~PngStreamWriter()
+{
+    if (mStreamOpen)
+        deflateEnd(&mStream);
+}
+
+bool PngStreamWriter::open(const QString &fileName, int width, int height)
+{
+    mWidth = width;
+    mHeight = height;
+    mRow = 0;
+
+    mFile.setFileName(fileName);
+    if (!mFile.open(QFile::WriteOnly | QFile::Truncate)) {
+        mError = mFile.errorString();
+        return false;
+    }
+
+    static const uchar signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    if (mFile.write(reinterpret_cast<const char*>(signature), 8) != 8) {
+        mError = mFile.errorString();
+        return false;
+    }
+
+    uchar ihdr[13];
+    qToBigEndian<quint32>(quint32(width), ihdr);
+    qToBigEndian<quint32>(quint32(height), ihdr + 4);
+    ihdr[8] = 8; // bit depth
+    ihdr[9] = 6; // color type RGBA
+    ihdr[10] = 0; // compression
+    ihdr[11] = 0; // filter method
+    ihdr[12] = 0; // no interlace
+    if (!writeChunk("IHDR", ihdr, 13))
+        return false;
+
+    mStream.zalloc = Z_NULL;
+    mStream.zfree = Z_NULL;
+    mStream.opaque = Z_NULL;
+    if (deflateInit(&mStream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        mError = QStringLiteral("deflateInit failed");
+        return false;
+    }
+    mStreamOpen = true;
+
+    mIDAT.resize(IDAT_SIZE);
+    mStream.next_out = reinterpret_cast<Bytef*>(mIDAT.data());
+    mStream.avail_out = mIDAT.size();
+
+    const int stride = mWidth * BPP;
+    mPrevRow.fill(0, stride);
+    for (QByteArray &filtered : mFiltered)
+        filtered.resize(stride + 1);
+
+    return true;
+}
+
+static inline uchar paeth(uchar a, uchar b, uchar c)
+{
+    const int p = int(a) + int(b) - int(c);
+    const int pa = std::abs(p - int(a));
+    const int pb = std::abs(p - int(b));
+    const int pc = std::abs(p - int(c));
+    if (pa <= pb && pa <= pc)
+        return a;
+    if (pb <= pc)
+        return b;
+    return c;
+}
+
+bool PngStreamWriter::writeRow(const uchar *rgba)
+{
+    Q_ASSERT(mStreamOpen && mRow < mHeight);
+
+    const int stride = mWidth * BPP;
+    const uchar *prev = reinterpret_cast<const uchar*>(mPrevRow.constData());
+
+    // Try each filter type and keep the one with the smallest sum of
+    // absolute differences, which is the heuristic libpng uses.
+    int best = 0;
+    quint64 bestSum = ~quint64(0);
+    for (int type = 0; type < 5; type++) {
+        uchar *out = reinterpret_cast<uchar*>(mFiltered[type].data());
+        out[0] = uchar(type);
+        ++out;
+        quint64 sum = 0;
+        for (int i = 0; i < stride; i++) {
+            const uchar left = (i >= BPP) ? rgba[i - BPP] : 0;
+            const uchar upLeft = (i >= BPP) ? prev[i - BPP] : 0;
+            uchar v;
+            switch (type) {
+            case 0: v = rgba[i]; break;
+            case 1: v = uchar(rgba[i] - left); break;
+            case 2: v = uchar(rgba[i] - prev[i]); break;
+            case 3: v = uchar(rgba[i] - ((int(left) + int(prev[i])) >> 1)); break;
+            default: v = uchar(rgba[i] - paeth(left, prev[i], upLeft)); break;
+            }
+            out[i] = v;
+            sum += (v < 128) ? v : (256 - v);
+        }
+        if (sum < bestSum) {
+            bestSum = sum;
+            best = type;
+        }
+    }
+
+    std::memcpy(mPrevRow.data(), rgba, stride);
+    ++mRow;
+
+    return deflateData(reinterpret_cast<const uchar*>(mFiltered[best].constData()),
+                       stride + 1, Z_NO_FLUSH);
+}
+
+bool PngStreamWriter::close()
+{
+    if (!mStreamOpen)
+        return false;
+    if (mRow != mHeight) {
+        mError = QStringLiteral("Only %1 of %2 rows were written").arg(mRow).arg(mHeight);
+        abort();
+        return false;
+    }
+    if (!deflateData(nullptr, 0, Z_FINISH)) {
+        abort();
+        return false;
+    }
+    deflateEnd(&mStream);
+    mStreamOpen = false;
+    if (!writeChunk("IEND", nullptr, 0)) {
+        abort();
+        return false;
+    }
+    mFile.close();
+    return true;
+}
+
+void PngStreamWriter::abort()
+{
+    if (mStreamOpen) {
+        deflateEnd(&mStream);
+        mStreamOpen = false;
+    }
+    if (mFile.isOpen()) {
+        mFile.close();
+        mFile.remove();
+    }
+}
+
+bool PngStreamWriter::writeChunk(const char *type, const uchar *data, int length)
+{
+    uchar header[8];
+    qToBigEndian<quint32>(quint32(length), header);
+    std::memcpy(header + 4, type, 4);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, header + 4, 4);
+    if (length > 0)
+        crc = crc32(crc, data, uInt(length));
+    uchar trailer[4];
+    qToBigEndian<quint32>(quint32(crc), trailer);
+
+    if ((mFile.write(reinterpret_cast<const char*>(header), 8) != 8)
+            || (length > 0 && mFile.write(reinterpret_cast<const char*>(data), length) != length)
+            || (mFile.write(reinterpret_cast<const char*>(trailer), 4) != 4)) {
+        mError = mFile.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool PngStreamWriter::deflateData(const uchar *data, int length, int flush)
+{
+    mStream.next_in = const_cast<Bytef*>(data);
+    mStream.avail_in = uInt(length);
+
+    for (;;) {
+        const int ret = deflate(&mStream, flush);
+        if (ret == Z_STREAM_ERROR) {
+            mError = QStringLiteral("deflate failed");
+            return false;
+        }
+        if (mStream.avail_out == 0) {
+            if (!flushIDAT())
+                return false;
+            continue;
+        }
+        if (flush == Z_FINISH) {
+            if (ret == Z_STREAM_END)
+                return flushIDAT();
+            continue;
+        }
+        if (mStream.avail_in == 0)
+            return true;
+    }
+}
+
+bool PngStreamWriter::flushIDAT()
+{
+    const int length = mIDAT.size() - int(mStream.avail_out);
+    if (length > 0 && !writeChunk("IDAT", reinterpret_cast<const uchar*>(mIDAT.constData()), length))
+        return false;
+    mStream.next_out = reinterpret_cast<Bytef*>(mIDAT.data());
+    mStream.avail_out = mIDAT.size();
+    return true;
+}
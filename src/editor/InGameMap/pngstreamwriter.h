@@ -0,0 +1,79 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PNGSTREAMWRITER_H
+#define PNGSTREAMWRITER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <zlib.h>
+
+/**
+  * Writes an 8-bit RGBA PNG one row at a time, so the whole image never has
+  * to be in memory.  QImage::save() needs the complete image, which for
+  * a large world is many gigabytes.
+  */
+class PngStreamWriter
+{
+public:
+    PngStreamWriter();
+    ~PngStreamWriter();
+
+    bool open(const QString &fileName, int width, int height);
+
+    /**
+      * Writes the next row of the image.  \a rgba holds width() pixels in
+      * the same byte order as QImage::Format_RGBA8888.
+      */
+    bool writeRow(const uchar *rgba);
+
+    /**
+      * Finishes the file.  All the rows must have been written.
+      */
+    bool close();
+
+    /**
+      * Closes and removes a partially-written file.
+      */
+    void abort();
+
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+    int rowsWritten() const { return mRow; }
+
+    QString errorString() const { return mError; }
+
+private:
+    bool writeChunk(const char *type, const uchar *data, int length);
+    bool deflateData(const uchar *data, int length, int flush);
+    bool flushIDAT();
+
+    QFile mFile;
+    z_stream mStream;
+    bool mStreamOpen;
+    int mWidth;
+    int mHeight;
+    int mRow;
+    QByteArray mPrevRow;
+    QByteArray mFiltered[5];
+    QByteArray mIDAT;
+    QString mError;
+};
+
+#endif // PNGSTREAMWRITER_H
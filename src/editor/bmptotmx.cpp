@@ -97,11 +97,11 @@ bool BMPToTMX::generateWorld(WorldDocument *worldDoc, BMPToTMX::GenerateMode mod
         return false;
     }
 #endif
-    // At this point, TileMetaInfoMgr's tilesets are all marked missing and
-    // have imageSource() paths relative to the Tiles Directory.  This call
-    // will actually read in the tilesets and set the imageSource() paths.
-    // FIXME: I don't need to load the tileset images, I just need the imageSource() paths.
-    TileMetaInfoMgr::instance()->loadTilesets();
+    // The images aren't read to write the maps, but each tileset needs its
+    // size and the absolute path of its image so MapWriter can write the
+    // correct relative source.
+    TileMetaInfoMgr::instance()->sizeTilesets();
+    TileMetaInfoMgr::instance()->resolveImageSources();
 
     const BMPToTMXSettings &settings = world->getBMPToTMXSettings();
 
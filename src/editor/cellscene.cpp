@@ -4330,11 +4330,7 @@ ObjectItem *CellScene::itemForObject(WorldCellObject *obj)
 
 InGameMapFeatureItem *CellScene::itemForInGameMapFeature(InGameMapFeature *feature)
 {
-    foreach (auto* item, mFeatureItems) {
-        if (item->feature() == feature)
-            return item;
-    }
-    return nullptr;
+    return mFeatureItemByFeature.value(feature, nullptr);
 }
 
 void CellScene::setSelectedSubMapItems(const QSet<SubMapItem *> &selected)
@@ -4658,6 +4654,7 @@ void CellScene::loadMap()
         item->setZValue(ZVALUE_ROADITEM_UNSELECTED);
         addItem(item);
         mFeatureItems += item;
+        mFeatureItemByFeature[feature] = item;
     }
 
     // Explicitly set sceneRect, otherwise it will just be as large as is needed to display
@@ -4904,6 +4901,7 @@ void CellScene::inGameMapFeatureAdded(WorldCell *cell, int index)
     item->setZValue(ZVALUE_ROADITEM_UNSELECTED);
     addItem(item);
     mFeatureItems += item;
+    mFeatureItemByFeature[feature] = item;
     doLater(ZOrder);
 }
 
@@ -4915,6 +4913,7 @@ void CellScene::inGameMapFeatureAboutToBeRemoved(WorldCell *cell, int index)
     InGameMapFeature *feature = cell->inGameMap().mFeatures.at(index);
     if (auto* item = itemForInGameMapFeature(feature)) {
         mFeatureItems.removeAll(item);
+        mFeatureItemByFeature.remove(feature);
         mSelectedFeatureItems.remove(item);
         removeItem(item);
         delete item;
@@ -27,6 +27,7 @@
 #include "tile.h"
 
 #include <QGraphicsItem>
+#include <QHash>
 #include <QOpenGLBuffer>
 #include <QOpenGLFunctions_3_0>
 #include <QOpenGLTexture>
@@ -916,6 +917,7 @@ private:
     QList<CellRoadItem*> mRoadItems;
     QSet<CellRoadItem*> mSelectedRoadItems;
     QList<InGameMapFeatureItem*> mFeatureItems;
+    QHash<InGameMapFeature*, InGameMapFeatureItem*> mFeatureItemByFeature;
     QSet<InGameMapFeatureItem*> mSelectedFeatureItems;
     QGraphicsRectItem *mDarkRectangle;
     CellGridItem *mGridItem;
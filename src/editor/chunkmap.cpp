@@ -1,11 +1,18 @@
 #include "chunkmap.h"
 
+#include "lotpackreader.h"
+
 #include <qmath.h>
-#include <QBuffer>
 #include <QDataStream>
 #include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QtEndian>
 
 #if defined(Q_OS_WIN) && (_MSC_VER >= 1600)
 // Hmmmm.  libtiled.dll defines the MapRands class as so:
@@ -30,7 +37,9 @@ IsoGridSquare::IsoGridSquare(IsoCell *cell, SliceY *slice, int x, int y, int z)
     ID(++IDMax),
     x(x),
     y(y),
-    z(z)
+    z(z),
+    firstTile(0),
+    tileCount(0)
 {
 }
 
@@ -55,7 +64,8 @@ void IsoGridSquare::discard()
     room = 0;
     ID = 0;
 
-    tiles.clear();
+    firstTile = 0;
+    tileCount = 0;
 
     isoGridSquareCache += this;
 }
@@ -142,6 +152,8 @@ void IsoChunk::ClearGridsquares()
 
 void IsoChunk::reuseGridsquares()
 {
+    tileIndices.clear();
+
     for (int x = 0; x < squares.size(); x++) {
         for (int y = 0; y < squares[x].size(); y++) {
             for (int z = 0; z < squares[x][y].size(); z++) {
@@ -352,16 +364,35 @@ IsoLot::IsoLot(QString directory, int cX, int cY, int wX, int wY, IsoChunk *ch)
     wX = qFloor(fwx);
     wY = qFloor(fwy);
 
-    QString filenameheader = QString::fromLatin1("%1/%2_%3.lotheader").arg(directory).arg(wX).arg(wY);
-    if (!InfoHeaders.contains(filenameheader)) {
-        info = 0;
+    info = ch->Cell->World->MetaGrid->getHeader(wX, wY);
+    if (!info)
         return; // chunk not found on disk
-    }
-    Q_ASSERT(InfoHeaders.contains(filenameheader));
-    info = InfoHeaders[filenameheader];
 
     ch->lotheader = info;
 
+    QString filenamepack = QString::fromLatin1("%1/world_%2_%3.lotpack").arg(directory).arg(wX).arg(wY);
+    LotPackReader *fo = CellLoader::instance()->openLotPackFile(filenamepack);
+    if (!fo) {
+        allocate();
+        return; // exception!
+    }
+
+//    qDebug() << "reading chunk" << wX << wY << "from" << filenamepack;
+
+    load(*fo, wX, wY);
+}
+
+IsoLot::IsoLot(LotHeader *info, const LotPackReader &reader, int wX, int wY) :
+    info(info),
+    wx(wX),
+    wy(wY)
+{
+    load(reader, qFloor(wX / float(IsoChunkMap::ChunkGridWidth)),
+         qFloor(wY / float(IsoChunkMap::ChunkGridWidth)));
+}
+
+void IsoLot::allocate()
+{
     data.resize(IsoChunkMap::ChunksPerWidth);
     for (int x = 0; x < data.size(); x++) {
         data[x].resize(IsoChunkMap::ChunksPerWidth);
@@ -375,62 +406,26 @@ IsoLot::IsoLot(QString directory, int cX, int cY, int wX, int wY, IsoChunk *ch)
         for (int y = 0; y < data[x].size(); y++)
             roomIDs[x][y].fill(-1, info->levels);
     }
+}
 
-    {
-        QString filenamepack = QString::fromLatin1("%1/world_%2_%3.lotpack").arg(directory).arg(wX).arg(wY);
-        QBuffer *fo = CellLoader::instance()->openLotPackFile(filenamepack);
-        if (!fo)
-            return; // exception!
-
-        QDataStream in(fo);
-        in.setByteOrder(QDataStream::LittleEndian);
-
-//        qDebug() << "reading chunk" << wX << wY << "from" << filenamepack;
-
-        int skip = 0;
-
-        int lwx = this->wx - (wX * IsoChunkMap::ChunkGridWidth);
-        int lwy = this->wy - (wY * IsoChunkMap::ChunkGridWidth);
-        int index = lwx * IsoChunkMap::ChunkGridWidth + lwy;
-        fo->seek(4 + index * 8);
-        qint64 pos;
-        in >> pos;
-        fo->seek(pos);
-        for (int z = 0; z < info->levels; ++z) {
-            for (int x = 0; x < IsoChunkMap::ChunksPerWidth; ++x) {
-                for (int y = 0; y < IsoChunkMap::ChunksPerWidth; ++y) {
-                    if (skip > 0) {
-                        --skip;
-                    } else {
-                        int count = readInt(in);
-                        if (count == -1) {
-                            skip = readInt(in);
-                            if (skip > 0) {
-                                --skip;
-                            }
-                        }  else {
-#if 0
-                            if (count <= 1)
-                                continue;
-#endif
-                            int room = readInt(in);
-                            roomIDs[x][y][z] = room;
+void IsoLot::load(const LotPackReader &reader, int cellX, int cellY)
+{
+    allocate();
 
-                            if (count <= 1) {
-                                int brk = 1;
-                            }
+    int lwx = this->wx - (cellX * IsoChunkMap::ChunkGridWidth);
+    int lwy = this->wy - (cellY * IsoChunkMap::ChunkGridWidth);
+    int index = lwx * IsoChunkMap::ChunkGridWidth + lwy;
+    LotPackSquareIterator it = reader.chunk(index, info->levels);
+    while (it.next()) {
+        const int x = it.x(), y = it.y(), z = it.z();
+        roomIDs[x][y][z] = it.roomID();
 
-                            Q_ASSERT(count > 1 && count < 30);
+        Q_ASSERT(it.tileCount() > 0 && it.tileCount() < 29);
 
-                            for (int n = 1; n < count; ++n) {
-                                int d = readInt(in);
+        for (int n = 0; n < it.tileCount(); ++n) {
+            int d = it.tile(n);
 
-                                this->data[x][y][z] += d;
-                            }
-                        }
-                    }
-                }
-            }
+            this->data[x][y][z] += d;
         }
     }
 }
@@ -525,33 +520,31 @@ IsoCell *CellLoader::LoadCellBinaryChunk(IsoWorld *world, int wx, int wy)
     return cell;
 }
 
-QBuffer *CellLoader::openLotPackFile(const QString &name)
+LotPackReader *CellLoader::openLotPackFile(const QString &name)
 {
-    if (BufferByName.contains(name))
-        return BufferByName[name];
+    if (ReaderByName.contains(name))
+        return ReaderByName[name];
 
     while (OpenLotPackFiles.size() > 10) {
-        BufferByName.remove(BufferByName.key(OpenLotPackFiles.first()));
+        ReaderByName.remove(ReaderByName.key(OpenLotPackFiles.first()));
         delete OpenLotPackFiles.takeFirst();
     }
-    QFile f(name);
-    if (!f.open(QFile::ReadOnly))
-        return 0;
 
-    QBuffer *b = new QBuffer();
-    b->open(QBuffer::ReadWrite);
-    b->write(f.readAll());
-    b->seek(0);
-    OpenLotPackFiles += b;
-    BufferByName[name] = b;
-    return b;
+    LotPackReader *reader = new LotPackReader();
+    if (!reader->open(name)) {
+        delete reader;
+        return 0;
+    }
+    OpenLotPackFiles += reader;
+    ReaderByName[name] = reader;
+    return reader;
 }
 
 void CellLoader::reset()
 {
     qDeleteAll(OpenLotPackFiles);
     OpenLotPackFiles.clear();
-    BufferByName.clear();
+    ReaderByName.clear();
 }
 
 /////
@@ -660,10 +653,10 @@ void IsoCell::PlaceLot(IsoLot *lot, int sx, int sy, int sz, IsoChunk *ch, int WX
 #endif
 
 #if 1
-                    square->tiles.clear();
+                    square->firstTile = ch->tileIndices.size();
+                    square->tileCount = s;
                     for (n = 0; n < s; ++n) {
-                        QString tile = lot->info->tilesUsed[ints.at(n)];
-                        square->tiles += tile;
+                        ch->tileIndices += ints.at(n);
 #else
                     for (n = 0; n < s; ++n) {
                         QString tile = lot->info->tilesUsed[ints.at(n)];
@@ -770,138 +763,341 @@ IsoGridSquare *IsoCell::getGridSquare(int x, int y, int z)
 
 /////
 
+namespace {
+
+// Bounds-checked little-endian reads from a .lotheader in memory.
+class LotHeaderCursor
+{
+public:
+    LotHeaderCursor(const QByteArray &data) :
+        mPos(reinterpret_cast<const uchar*>(data.constData())),
+        mEnd(mPos + data.size()),
+        mError(false)
+    {
+    }
+
+    int readInt()
+    {
+        if (mEnd - mPos < 4) {
+            mError = true;
+            mPos = mEnd;
+            return 0;
+        }
+        int v = qFromLittleEndian<qint32>(mPos);
+        mPos += 4;
+        return v;
+    }
+
+    quint8 readByte()
+    {
+        if (mPos == mEnd) {
+            mError = true;
+            return 0;
+        }
+        return *mPos++;
+    }
+
+    // Same as IsoLot::readString(), but without copying the bytes.
+    QByteArray readLine()
+    {
+        const uchar *start = mPos;
+        while (mPos < mEnd && *mPos != '\n')
+            ++mPos;
+        QByteArray line = QByteArray::fromRawData(reinterpret_cast<const char*>(start), int(mPos - start));
+        if (mPos < mEnd)
+            ++mPos;
+        return line;
+    }
+
+    bool error() const
+    { return mError; }
+
+private:
+    const uchar *mPos;
+    const uchar *mEnd;
+    bool mError;
+};
+
+} // namespace
+
+/**
+  * Tile names shared by all the LotHeaders in a world.  Most cells use
+  * the same tiles, so each name is converted to a QString and parsed into a
+  * BuildingTile only once.
+  */
+class LotTileNameTable
+{
+public:
+    void resolve(const QList<QByteArray> &rawNames, LotHeader *info)
+    {
+        QMutexLocker locker(&mMutex);
+        for (const QByteArray &raw : rawNames) {
+            const QByteArray trimmed = raw.trimmed();
+            int index = mIndexByName.value(trimmed, -1);
+            if (index == -1) {
+                index = mNames.size();
+                // The key must not refer to the header's file data.
+                mIndexByName.insert(QByteArray(trimmed.constData(), trimmed.size()), index);
+                QString str = QString::fromLatin1(trimmed);
+                mNames += str;
+                QString tilesetName;
+                int tileID;
+                if (BuildingEditor::BuildingTilesMgr::parseTileName(str, tilesetName, tileID)) {
+                    mTiles += BuildingEditor::BuildingTile(tilesetName, tileID);
+                } else {
+                    mTiles += BuildingEditor::BuildingTile(str, -1);
+                }
+            }
+            info->tilesUsed += mNames[index];
+            info->buildingTiles += mTiles[index];
+        }
+    }
+
+private:
+    QMutex mMutex;
+    QHash<QByteArray,int> mIndexByName;
+    QStringList mNames;
+    QList<BuildingEditor::BuildingTile> mTiles;
+};
+
+/**
+  * Headers being read on worker threads.
+  */
+class IsoMetaGridLoader
+{
+public:
+    QThreadPool mThreadPool;
+    LotTileNameTable mTileNames;
+    QMutex mMutex;
+    QList<QPair<QString,LotHeader*> > mLoaded;
+    int mRemaining = 0;
+};
+
+class LotHeaderTask : public QRunnable
+{
+public:
+    LotHeaderTask(IsoMetaGridLoader *loader, const QString &fileName, int wX, int wY) :
+        mLoader(loader),
+        mFileName(fileName),
+        mWX(wX),
+        mWY(wY)
+    {
+    }
+
+    void run() override
+    {
+        LotHeader *info = IsoMetaGrid::ReadHeader(mFileName, mWX, mWY, mLoader->mTileNames);
+        QMutexLocker locker(&mLoader->mMutex);
+        mLoader->mLoaded += qMakePair(mFileName, info);
+    }
+
+private:
+    IsoMetaGridLoader *mLoader;
+    QString mFileName;
+    int mWX;
+    int mWY;
+};
+
 IsoMetaGrid::IsoMetaGrid() :
     minx(100000),
     miny(100000),
     maxx(-100000),
-    maxy(-100000)
+    maxy(-100000),
+    mLoader(new IsoMetaGridLoader)
+{
+}
+
+IsoMetaGrid::~IsoMetaGrid()
 {
+    mLoader->mThreadPool.clear();
+    mLoader->mThreadPool.waitForDone();
+    for (auto &loaded : mLoader->mLoaded)
+        delete loaded.second;
+    delete mLoader;
 }
 
 void IsoMetaGrid::Create(const QString &directory)
 {
+    CreateIndex(directory);
+    startLoadingHeaders();
+    mLoader->mThreadPool.waitForDone();
+    takeLoadedHeaders();
+}
+
+void IsoMetaGrid::CreateIndex(const QString &directory)
+{
+    mDirectory = directory;
+
     QDir fo(directory);
     QStringList filters(QString::fromLatin1("*.lotheader"));
     foreach (QFileInfo info, fo.entryInfoList(filters)) {
         QStringList split = info.baseName().split(QLatin1Char('_'));
+        if (split.size() != 2)
+            continue;
         int x = split[0].toInt();
         int y = split[1].toInt();
         if (x < minx) minx = x;
         if (x > maxx) maxx = x;
         if (y < miny) miny = y;
         if (y > maxy) maxy = y;
+        mCells += QPoint(x, y);
+        mCellKeys += cellKey(x, y);
     }
+}
 
-    for (int wX = minx; wX <= maxx; ++wX) {
-        for (int wY = miny; wY <= maxy; ++wY) {
-            QString filenameheader = QString::fromLatin1("%1/%2_%3.lotheader").arg(directory).arg(wX).arg(wY);
-            if (IsoLot::InfoHeaders.contains(filenameheader))
-                continue;
+bool IsoMetaGrid::hasCell(int wX, int wY) const
+{
+    return mCellKeys.contains(cellKey(wX, wY));
+}
 
-            QFile fo(filenameheader);
-            if (!fo.exists())
-                continue;
-            if (!fo.open(QFile::ReadOnly))
-                continue;
+LotHeader *IsoMetaGrid::getHeader(int wX, int wY)
+{
+    if (!hasCell(wX, wY))
+        return 0;
+    QString filenameheader = HeaderFileName(mDirectory, wX, wY);
+    if (LotHeader *info = IsoLot::InfoHeaders.value(filenameheader))
+        return info;
+    // Not read by a worker thread yet, so read it now.
+    LotHeader *info = ReadHeader(filenameheader, wX, wY, mLoader->mTileNames);
+    if (info) {
+        IsoLot::InfoHeaders[filenameheader] = info;
+        mNewHeaders += info;
+    }
+    return info;
+}
 
-            LotHeader *info = new LotHeader;
+void IsoMetaGrid::startLoadingHeaders()
+{
+    for (const QPoint &cell : qAsConst(mCells)) {
+        QString filenameheader = HeaderFileName(mDirectory, cell.x(), cell.y());
+        if (IsoLot::InfoHeaders.contains(filenameheader))
+            continue;
+        ++mLoader->mRemaining;
+        mLoader->mThreadPool.start(new LotHeaderTask(mLoader, filenameheader, cell.x(), cell.y()));
+    }
+}
 
-            QDataStream in(&fo);
-            in.setByteOrder(QDataStream::LittleEndian);
+bool IsoMetaGrid::isLoadingHeaders() const
+{
+    return mLoader->mRemaining > 0;
+}
 
-            info->version = IsoLot::readInt(in);
-            int tilecount = IsoLot::readInt(in);
+QList<LotHeader*> IsoMetaGrid::takeLoadedHeaders()
+{
+    QList<QPair<QString,LotHeader*> > loaded;
+    {
+        QMutexLocker locker(&mLoader->mMutex);
+        loaded.swap(mLoader->mLoaded);
+    }
+    mLoader->mRemaining -= loaded.size();
+
+    QList<LotHeader*> headers;
+    headers.swap(mNewHeaders);
+    for (auto &pair : loaded) {
+        if (pair.second == 0)
+            continue;
+        if (IsoLot::InfoHeaders.contains(pair.first)) {
+            // Already read by getHeader().
+            delete pair.second;
+            continue;
+        }
+        IsoLot::InfoHeaders[pair.first] = pair.second;
+        headers += pair.second;
+    }
+    return headers;
+}
 
-            for (int n = 0; n < tilecount; ++n) {
-                QString str = IsoLot::readString(in);
-                str = str.trimmed();
-                info->tilesUsed += str;
+QString IsoMetaGrid::HeaderFileName(const QString &directory, int wX, int wY)
+{
+    return QString::fromLatin1("%1/%2_%3.lotheader").arg(directory).arg(wX).arg(wY);
+}
 
-                QString tilesetName;
-                int tileID;
-                if (BuildingEditor::BuildingTilesMgr::parseTileName(str, tilesetName, tileID)) {
-                    info->buildingTiles += BuildingEditor::BuildingTile(tilesetName, tileID);
-                } else {
-                    info->buildingTiles += BuildingEditor::BuildingTile(str, -1);
-                }
-            }
+LotHeader *IsoMetaGrid::ReadHeader(const QString &filenameheader, int wX, int wY, LotTileNameTable &tileNames)
+{
+    QFile fo(filenameheader);
+    if (!fo.open(QFile::ReadOnly))
+        return 0;
+    const QByteArray data = fo.readAll();
+    fo.close();
 
-            IsoLot::readByte(in);
+    LotHeaderCursor in(data);
 
-            info->width = IsoLot::readInt(in);
-            info->height = IsoLot::readInt(in);
-            info->levels = IsoLot::readInt(in);
+    LotHeader *info = new LotHeader;
 
-            Q_ASSERT(info->width == IsoChunkMap::ChunksPerWidth);
-            Q_ASSERT(info->height == IsoChunkMap::ChunksPerWidth);
-            Q_ASSERT(info->levels == 15);
+    info->version = in.readInt();
+    int tilecount = in.readInt();
 
-            int numRooms = IsoLot::readInt(in);
+    QList<QByteArray> rawNames;
+    for (int n = 0; n < tilecount && !in.error(); ++n)
+        rawNames += in.readLine();
+    tileNames.resolve(rawNames, info);
 
-            for (int n = 0; n < numRooms; ++n) {
-                QString str = IsoLot::readString(in);
-                RoomDef *def = new RoomDef(n, str);
-                def->level = IsoLot::readInt(in);
+    in.readByte();
 
-                int rects = IsoLot::readInt(in);
-                for (int rc = 0; rc < rects; ++rc) {
-                    int x = IsoLot::readInt(in);
-                    int y = IsoLot::readInt(in);
-                    int w = IsoLot::readInt(in);
-                    int h = IsoLot::readInt(in);
-                    RoomRect *rect = new RoomRect(x + wX * IsoChunkMap::CellSize,
-                                                  y + wY * IsoChunkMap::CellSize,
-                                                  w, h);
+    info->width = in.readInt();
+    info->height = in.readInt();
+    info->levels = in.readInt();
 
-                    def->rects += rect;
-                }
+    Q_ASSERT(info->width == IsoChunkMap::ChunksPerWidth);
+    Q_ASSERT(info->height == IsoChunkMap::ChunksPerWidth);
+    Q_ASSERT(info->levels == 15);
 
-                def->CalculateBounds();
-
-                info->Rooms[def->ID] = def;
-                def->CalculateBounds();
-                int nObjects = IsoLot::readInt(in);
-                for (int m = 0; m < nObjects; ++m) {
-                    int e = IsoLot::readInt(in);
-                    int x = IsoLot::readInt(in);
-                    int y = IsoLot::readInt(in);
-                    Q_UNUSED(e) Q_UNUSED(x) Q_UNUSED(y)
-#if 0
-                    def->objects += new MetaObject(e,
-                                                   x + wX * 300 - def->x,
-                                                   y + wY * 300 - def->y,
-                                                   def);
-#endif
-                }
+    int numRooms = in.readInt();
 
-            }
+    for (int n = 0; n < numRooms && !in.error(); ++n) {
+        QString str = QString::fromLatin1(in.readLine());
+        RoomDef *def = new RoomDef(n, str);
+        def->level = in.readInt();
 
-            int numBuildings = IsoLot::readInt(in);
+        int rects = in.readInt();
+        for (int rc = 0; rc < rects && !in.error(); ++rc) {
+            int x = in.readInt();
+            int y = in.readInt();
+            int w = in.readInt();
+            int h = in.readInt();
+            RoomRect *rect = new RoomRect(x + wX * IsoChunkMap::CellSize,
+                                          y + wY * IsoChunkMap::CellSize,
+                                          w, h);
 
-            for (int n = 0; n < numBuildings; ++n) {
-                BuildingDef *def = new BuildingDef(n);
-                int numbRooms = IsoLot::readInt(in);
-                for (int x = 0; x < numbRooms; ++x) {
-                    RoomDef *rr = info->Rooms[IsoLot::readInt(in)];
-                    rr->building = def;
-                    def->rooms += rr;
-                }
+            def->rects += rect;
+        }
 
-                def->CalculateBounds();
-                info->Buildings += def;
+        def->CalculateBounds();
 
-            }
+        info->Rooms[def->ID] = def;
+        int nObjects = in.readInt();
+        for (int m = 0; m < nObjects && !in.error(); ++m) {
+            int e = in.readInt();
+            int x = in.readInt();
+            int y = in.readInt();
+            Q_UNUSED(e) Q_UNUSED(x) Q_UNUSED(y)
+        }
+    }
 
-            for (int x = 0; x < 30; ++x) {
-                for (int y = 0; y < 30; ++y) {
-                    int zombieDensity = IsoLot::readByte(in);
-                    Q_UNUSED(zombieDensity)
-//                    ch.getChunk(x, y).setZombieIntensity(zombieDensity);
-                }
-            }
-            IsoLot::InfoHeaders[filenameheader] = info;
+    int numBuildings = in.readInt();
+
+    for (int n = 0; n < numBuildings && !in.error(); ++n) {
+        BuildingDef *def = new BuildingDef(n);
+        int numbRooms = in.readInt();
+        for (int x = 0; x < numbRooms && !in.error(); ++x) {
+            RoomDef *rr = info->Rooms.value(in.readInt());
+            if (rr == 0)
+                continue;
+            rr->building = def;
+            def->rooms += rr;
         }
+
+        def->CalculateBounds();
+        info->Buildings += def;
     }
+
+    // The zombie density for each chunk follows; it isn't used.
+
+    if (in.error()) {
+        qWarning() << "IsoMetaGrid: truncated header" << filenameheader;
+    }
+
+    return info;
 }
 
 /////
@@ -923,7 +1119,9 @@ IsoWorld::~IsoWorld()
 
 void IsoWorld::init()
 {
-    MetaGrid->Create(Directory);
+    // Only the headers of the cells around the center are read here.  The
+    // rest are read on worker threads, see LotPackView.
+    MetaGrid->CreateIndex(Directory);
     CurrentCell = CellLoader::LoadCellBinaryChunk(this,
                                                   MetaGrid->cellBounds().center().x() * IsoChunkMap::ChunkGridWidth,
                                                   MetaGrid->cellBounds().center().y() * IsoChunkMap::ChunkGridWidth);
@@ -6,10 +6,13 @@
 #include <QMap>
 #include <QObject>
 #include <QRect>
+#include <QSet>
 #include <QStringList>
 #include <QVector>
 
-class QBuffer;
+namespace Tiled {
+class Tile;
+}
 
 class BuildingDef;
 class IsoCell;
@@ -18,6 +21,7 @@ class IsoChunkMap;
 class IsoRoom;
 class IsoWorld;
 class LotHeader;
+class LotPackReader;
 class RoomDef;
 class SliceY;
 
@@ -58,7 +62,10 @@ public:
     int y;
     int z;
 
-    QStringList tiles; // tnb
+    // tnb: this square's tiles are chunk->tileIndices[firstTile] and the
+    // tileCount entries after it, as indices into LotHeader::tilesUsed.
+    int firstTile;
+    int tileCount;
 
     IsoChunk *chunk;
     IsoRoom *room;
@@ -88,6 +95,7 @@ public:
     void Save(bool bSaveQuit);
 
     QVector<QVector<QVector<IsoGridSquare*> > > squares;
+    QVector<int> tileIndices;
     LotHeader *lotheader;
     int wx;
     int wy;
@@ -245,6 +253,7 @@ public:
 
     QStringList tilesUsed;
     QList<BuildingEditor::BuildingTile> buildingTiles;
+    QVector<Tiled::Tile*> tiles; // tilesUsed resolved by the lotpack viewer
     QMap<int,RoomDef*> Rooms;
     QList<BuildingDef*> Buildings;
 
@@ -259,11 +268,24 @@ class IsoLot
 public:
     IsoLot(QString directory, int cX, int cY, int wX, int wY, IsoChunk *ch);
 
+    /**
+      * Decodes chunk (wX,wY) from an already-open lotpack.  Unlike the
+      * constructor above this doesn't touch any IsoChunk or the CellLoader,
+      * so it may be called from a worker thread.
+      */
+    IsoLot(LotHeader *info, const LotPackReader &reader, int wX, int wY);
+
     static unsigned char readByte(QDataStream &in);
     static int readInt(QDataStream &in);
     static QString readString(QDataStream &in);
 
     static QMap<QString,LotHeader*> InfoHeaders;
+
+private:
+    void allocate();
+    void load(const LotPackReader &reader, int cellX, int cellY);
+
+public:
     QVector<QVector<QVector<int> > > roomIDs;
     QVector<QVector<QVector<QList<int> > > > data;
     LotHeader *info;
@@ -302,22 +324,58 @@ public:
     static void LoadCellBinaryChunkForLater(IsoCell *cell, int wx, int wy, IsoChunk *chunk);
     static IsoCell *LoadCellBinaryChunk(IsoWorld *world, /*IsoSpriteManager &spr, */int wx, int wy);
 
-    QBuffer *openLotPackFile(const QString &name);
+    LotPackReader *openLotPackFile(const QString &name);
     void reset();
 
-    QList<QBuffer*> OpenLotPackFiles;
-    QMap<QString,QBuffer*> BufferByName;
+    QList<LotPackReader*> OpenLotPackFiles;
+    QMap<QString,LotPackReader*> ReaderByName;
 
     static CellLoader *mInstance;
 };
 
+class IsoMetaGridLoader;
+class LotTileNameTable;
+
 class IsoMetaGrid
 {
 public:
     IsoMetaGrid();
+    ~IsoMetaGrid();
 
+    /**
+      * Finds the cells in \a directory and reads all their .lotheader files,
+      * several at once.
+      */
     void Create(const QString &directory);
 
+    /**
+      * Finds the cells in \a directory without reading any .lotheader files.
+      * The headers are then read by getHeader() as they are needed, or by
+      * worker threads after startLoadingHeaders().
+      */
+    void CreateIndex(const QString &directory);
+
+    bool hasCell(int wX, int wY) const;
+
+    /**
+      * Returns the header for cell (wX,wY), reading it now if no worker
+      * thread has read it yet.  Returns 0 if the cell doesn't exist.
+      */
+    LotHeader *getHeader(int wX, int wY);
+
+    void startLoadingHeaders();
+    bool isLoadingHeaders() const;
+
+    /**
+      * Adds the headers read since the last call to IsoLot::InfoHeaders and
+      * returns them, including any read by getHeader().
+      */
+    QList<LotHeader*> takeLoadedHeaders();
+
+    static QString HeaderFileName(const QString &directory, int wX, int wY);
+    static LotHeader *ReadHeader(const QString &filenameheader, int wX, int wY,
+                                 LotTileNameTable &tileNames);
+
     QRect cellBounds() const
     { return QRect(minx, miny, maxx - minx + 1, maxy - miny + 1); }
 
@@ -330,6 +388,16 @@ public:
     int miny;
     int maxx;
     int maxy;
+
+private:
+    static quint64 cellKey(int wX, int wY)
+    { return (quint64(quint32(wX)) << 32) | quint32(wY); }
+
+    QString mDirectory;
+    QVector<QPoint> mCells;
+    QSet<quint64> mCellKeys;
+    QList<LotHeader*> mNewHeaders;
+    IsoMetaGridLoader *mLoader;
 };
 
 class IsoWorld
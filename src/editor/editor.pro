@@ -66,16 +66,22 @@ SOURCES += main.cpp\
         mainwindow.cpp \
     InGameMap/clipper.cpp \
     InGameMap/ingamemapcell.cpp \
+    InGameMap/ingamemapcellimage.cpp \
     InGameMap/ingamemapdock.cpp \
     InGameMap/ingamemapfeaturegenerator.cpp \
+    InGameMap/ingamemapmasktracer.cpp \
+    InGameMap/imagepyramidbuilder.cpp \
     InGameMap/ingamemapimagepyramidwindow.cpp \
     InGameMap/ingamemappropertiesform.cpp \
     InGameMap/ingamemappropertydialog.cpp \
     InGameMap/ingamemapreader.cpp \
+    InGameMap/ingamemapreaderbinary.cpp \
     InGameMap/ingamemapscene.cpp \
     InGameMap/ingamemapundo.cpp \
     InGameMap/ingamemapwriter.cpp \
     InGameMap/ingamemapwriterbinary.cpp \
+    InGameMap/pngstreamwriter.cpp \
+    tilesetsizeindex.cpp \
     tilesetstxtfile.cpp \
     worldview.cpp \
     worldscene.cpp \
@@ -94,6 +100,8 @@ SOURCES += main.cpp\
     undoredo.cpp \
     undodock.cpp \
     mapmanager.cpp \
+    mapprefetcher.cpp \
+    memorystatsdialog.cpp \
     basegraphicsview.cpp \
     progress.cpp \
     zoomable.cpp \
@@ -137,6 +145,7 @@ SOURCES += main.cpp\
     BuildingEditor/buildingtiles.cpp \
     BuildingEditor/buildingobjects.cpp \
     BuildingEditor/buildingmap.cpp \
+    BuildingEditor/buildinglayers.cpp \
     BuildingEditor/buildingfloor.cpp \
     BuildingEditor/building.cpp \
     BuildingEditor/buildingwriter.cpp \
@@ -147,6 +156,8 @@ SOURCES += main.cpp\
     bmpblender.cpp \
     lotpackwindow.cpp \
     chunkmap.cpp \
+    lotpackchunkloader.cpp \
+    lotpackreader.cpp \
     fromtodialog.cpp \
     unknowncolorsdialog.cpp \
     gotodialog.cpp \
@@ -174,17 +185,23 @@ HEADERS  += mainwindow.h \
     generatelotsfailuredialog.h \
     InGameMap/clipper.hpp \
     InGameMap/ingamemapcell.h \
+    InGameMap/ingamemapcellimage.h \
     InGameMap/ingamemapdock.h \
     InGameMap/ingamemapfeaturegenerator.h \
+    InGameMap/ingamemapmasktracer.h \
+    InGameMap/imagepyramidbuilder.h \
     InGameMap/ingamemapimagepyramidwindow.h \
     InGameMap/ingamemappropertiesform.h \
     InGameMap/ingamemappropertydialog.h \
     InGameMap/ingamemapreader.h \
+    InGameMap/ingamemapreaderbinary.h \
     InGameMap/ingamemapscene.h \
     InGameMap/ingamemapundo.h \
     InGameMap/ingamemapwriter.h \
     InGameMap/ingamemapwriterbinary.h \
+    InGameMap/pngstreamwriter.h \
     loadthumbnailsdialog.h \
+    tilesetsizeindex.h \
     tilesetstxtfile.h \
     worldview.h \
     worldscene.h \
@@ -203,6 +220,8 @@ HEADERS  += mainwindow.h \
     undoredo.h \
     undodock.h \
     mapmanager.h \
+    mapprefetcher.h \
+    memorystatsdialog.h \
     basegraphicsview.h \
     progress.h \
     zoomable.h \
@@ -244,6 +263,7 @@ HEADERS  += mainwindow.h \
     BuildingEditor/buildingtiles.h \
     BuildingEditor/buildingobjects.h \
     BuildingEditor/buildingmap.h \
+    BuildingEditor/buildinglayers.h \
     BuildingEditor/buildingfloor.h \
     BuildingEditor/building.h \
     BuildingEditor/buildingwriter.h \
@@ -254,6 +274,8 @@ HEADERS  += mainwindow.h \
     bmpblender.h \
     lotpackwindow.h \
     chunkmap.h \
+    lotpackchunkloader.h \
+    lotpackreader.h \
     fromtodialog.h \
     unknowncolorsdialog.h \
     gotodialog.h \
@@ -284,6 +306,7 @@ FORMS    += mainwindow.ui \
     InGameMap/ingamemappropertiesform.ui \
     InGameMap/ingamemappropertydialog.ui \
     loadthumbnailsdialog.ui \
+    memorystatsdialog.ui \
     propertiesview.ui \
     propertiesdialog.ui \
     templatesdialog.ui \
@@ -28,22 +28,76 @@
 
 #include "filesystemwatcher.h"
 
+#include <QCryptographicHash>
 #include <QDebug>
+#include <QDateTime>
 #include <QFile>
+#include <QFileInfo>
 #include <QFileSystemWatcher>
+#include <QMutexLocker>
+#include <QRunnable>
 #include <QStringList>
 
 namespace Tiled {
 
 namespace Internal {
 
+/**
+ * Compares a batch of changed files with what was last seen of them.
+ */
+class FileChangeTask : public QRunnable
+{
+public:
+    FileChangeTask(FileSystemWatcher *watcher,
+                   const QList<FileSystemWatcher::Confirmed> &paths) :
+        mWatcher(watcher),
+        mPaths(paths)
+    {
+    }
+
+    void run() override
+    {
+        for (FileSystemWatcher::Confirmed &entry : mPaths) {
+            // Directories are passed through as they are.
+            if (entry.changed)
+                continue;
+            FileSystemWatcher::FileStamp old = entry.stamp;
+            entry.stamp = FileSystemWatcher::stamp(entry.path);
+            if (entry.stamp.size == -1) {
+                entry.changed = old.size != -1;
+                continue;
+            }
+            QFile file(entry.path);
+            if (file.open(QIODevice::ReadOnly)) {
+                QCryptographicHash hash(QCryptographicHash::Md5);
+                hash.addData(&file);
+                entry.stamp.hash = hash.result();
+            }
+            if (old.hash.isEmpty() || entry.stamp.hash.isEmpty())
+                entry.changed = old.size != entry.stamp.size
+                        || old.modified != entry.stamp.modified;
+            else
+                entry.changed = old.hash != entry.stamp.hash;
+        }
+        mWatcher->confirmed(mPaths);
+    }
+
+private:
+    FileSystemWatcher *mWatcher;
+    QList<FileSystemWatcher::Confirmed> mPaths;
+};
+
 FileSystemWatcher::FileSystemWatcher(QObject *parent) :
     QObject(parent),
-    mWatcher(new QFileSystemWatcher(this))
+    mWatcher(new QFileSystemWatcher(this)),
+    mProcessScheduled(false)
 {
     mChangedPathsTimer.setInterval(500);
     mChangedPathsTimer.setSingleShot(true);
 
+    // One thread keeps the batches in order.
+    mThreadPool.setMaxThreadCount(1);
+
     connect(mWatcher, &QFileSystemWatcher::fileChanged,
             this, &FileSystemWatcher::onFileChanged);
     connect(mWatcher, &QFileSystemWatcher::directoryChanged,
@@ -53,6 +107,12 @@ FileSystemWatcher::FileSystemWatcher(QObject *parent) :
             this, &FileSystemWatcher::pathsChangedTimeout);
 }
 
+FileSystemWatcher::~FileSystemWatcher()
+{
+    mThreadPool.clear();
+    mThreadPool.waitForDone();
+}
+
 void FileSystemWatcher::addPaths(const QStringList &paths)
 {
     QStringList pathsToAdd;
@@ -60,21 +120,35 @@ void FileSystemWatcher::addPaths(const QStringList &paths)
 
     for (const QString &path : paths) {
         // Just silently ignore the request when the file doesn't exist
-        if (!QFile::exists(path))
+        QFileInfo info(path);
+        if (!info.exists())
             continue;
 
-        QMap<QString, int>::iterator entry = mWatchCount.find(path);
+        QHash<QString, int>::iterator entry = mWatchCount.find(path);
         if (entry == mWatchCount.end()) {
-            pathsToAdd.append(path);
             mWatchCount.insert(path, 1);
+            if (info.isFile()) {
+                FileStamp &stamp = mStamps[path];
+                stamp.size = info.size();
+                stamp.modified = info.lastModified().toMSecsSinceEpoch();
+            }
+            // The directory may already be watched for other files.
+            if (!mFilesByDirectory.contains(path))
+                pathsToAdd.append(path);
         } else {
             // Path is already being watched, increment watch count
             ++entry.value();
         }
     }
 
-    if (!pathsToAdd.isEmpty())
-        mWatcher->addPaths(pathsToAdd);
+    if (pathsToAdd.isEmpty())
+        return;
+
+    const QStringList failed = mWatcher->addPaths(pathsToAdd);
+    for (const QString &path : failed) {
+        if (mStamps.contains(path))
+            watchDirectory(path);
+    }
 }
 
 void FileSystemWatcher::removePaths(const QStringList &paths)
@@ -83,7 +157,7 @@ void FileSystemWatcher::removePaths(const QStringList &paths)
     pathsToRemove.reserve(paths.size());
 
     for (const QString &path : paths) {
-        QMap<QString, int>::iterator entry = mWatchCount.find(path);
+        QHash<QString, int>::iterator entry = mWatchCount.find(path);
         if (entry == mWatchCount.end()) {
             if (QFile::exists(path))
                 qWarning() << "FileSystemWatcher: Path was never added:" << path;
@@ -95,7 +169,11 @@ void FileSystemWatcher::removePaths(const QStringList &paths)
 
         if (entry.value() == 0) {
             mWatchCount.erase(entry);
-            pathsToRemove.append(path);
+            mStamps.remove(path);
+            if (mWatchedByDirectory.contains(path))
+                unwatchDirectory(path);
+            else if (!mFilesByDirectory.contains(path))
+                pathsToRemove.append(path);
         }
     }
 
@@ -114,6 +192,20 @@ void FileSystemWatcher::clear()
         mWatcher->removePaths(directories);
 
     mWatchCount.clear();
+    mStamps.clear();
+    mFilesByDirectory.clear();
+    mWatchedByDirectory.clear();
+}
+
+FileSystemWatcher::FileStamp FileSystemWatcher::stamp(const QString &path)
+{
+    FileStamp stamp;
+    QFileInfo info(path);
+    if (info.exists()) {
+        stamp.size = info.size();
+        stamp.modified = info.lastModified().toMSecsSinceEpoch();
+    }
+    return stamp;
 }
 
 void FileSystemWatcher::onFileChanged(const QString &path)
@@ -126,6 +218,18 @@ void FileSystemWatcher::onFileChanged(const QString &path)
 
 void FileSystemWatcher::onDirectoryChanged(const QString &path)
 {
+    // Something in the directory of files that couldn't be watched themselves
+    // changed.  Which of them changed is found out in pathsChangedTimeout().
+    auto it = mFilesByDirectory.constFind(path);
+    if (it != mFilesByDirectory.constEnd()) {
+        for (const QString &file : it.value())
+            mChangedPaths.insert(file);
+        mChangedPathsTimer.start();
+    }
+
+    if (!mWatchCount.contains(path))
+        return;
+
     mChangedPaths.insert(path);
     mChangedPathsTimer.start();
 
@@ -135,21 +239,107 @@ void FileSystemWatcher::onDirectoryChanged(const QString &path)
 void FileSystemWatcher::pathsChangedTimeout()
 {
     const auto changedPaths = mChangedPaths.values();
+    mChangedPaths.clear();
 
-    // If the file was replaced, the watcher is automatically removed and needs
-    // to be re-added to keep watching it for changes. This happens commonly
-    // with applications that do atomic saving.
+    QSet<QString> watchedFiles;
+    const QStringList files = mWatcher->files();
+    for (const QString &path : files)
+        watchedFiles.insert(path);
+
+    QList<Confirmed> batch;
     for (const QString &path : changedPaths) {
-        if (mWatchCount.contains(path) && !mWatcher->files().contains(path)) {
-            if (QFile::exists(path))
-                mWatcher->addPath(path);
+        if (!mWatchCount.contains(path))
+            continue;
+
+        // If the file was replaced, the watcher is automatically removed and
+        // needs to be re-added to keep watching it for changes. This happens
+        // commonly with applications that do atomic saving.
+        auto stamp = mStamps.constFind(path);
+        if (stamp != mStamps.constEnd() && !mWatchedByDirectory.contains(path)
+                && !watchedFiles.contains(path)) {
+            if (QFile::exists(path) && !mWatcher->addPath(path))
+                watchDirectory(path);
+        }
+
+        Confirmed entry;
+        entry.path = path;
+        if (stamp != mStamps.constEnd()) {
+            entry.stamp = stamp.value();
+            entry.changed = false;
+        } else {
+            entry.changed = true; // a directory
         }
+        batch += entry;
     }
 
+    if (!batch.isEmpty())
+        mThreadPool.start(new FileChangeTask(this, batch));
+}
 
-    emit pathsChanged(changedPaths);
+void FileSystemWatcher::watchDirectory(const QString &path)
+{
+    const QString dir = QFileInfo(path).absolutePath();
+    QSet<QString> &files = mFilesByDirectory[dir];
+    if (files.isEmpty() && !mWatchCount.contains(dir)) {
+        if (!mWatcher->addPath(dir)) {
+            qWarning() << "FileSystemWatcher: Can't watch" << path;
+            mFilesByDirectory.remove(dir);
+            return;
+        }
+    }
+    files.insert(path);
+    mWatchedByDirectory.insert(path);
+}
 
-    mChangedPaths.clear();
+void FileSystemWatcher::unwatchDirectory(const QString &path)
+{
+    mWatchedByDirectory.remove(path);
+    const QString dir = QFileInfo(path).absolutePath();
+    auto it = mFilesByDirectory.find(dir);
+    if (it == mFilesByDirectory.end())
+        return;
+    it->remove(path);
+    if (it->isEmpty()) {
+        mFilesByDirectory.erase(it);
+        if (!mWatchCount.contains(dir))
+            mWatcher->removePath(dir);
+    }
+}
+
+void FileSystemWatcher::confirmed(const QList<Confirmed> &results)
+{
+    QMutexLocker locker(&mMutex);
+    mConfirmed += results;
+    if (!mProcessScheduled) {
+        mProcessScheduled = true;
+        QMetaObject::invokeMethod(this, "processConfirmed", Qt::QueuedConnection);
+    }
+}
+
+void FileSystemWatcher::processConfirmed()
+{
+    QList<QList<Confirmed> > batches;
+    {
+        QMutexLocker locker(&mMutex);
+        batches.swap(mConfirmed);
+        mProcessScheduled = false;
+    }
+
+    for (const QList<Confirmed> &batch : qAsConst(batches)) {
+        QStringList changedPaths;
+        for (const Confirmed &entry : batch) {
+            // Skip paths removed while the batch was being checked.
+            if (!mWatchCount.contains(entry.path))
+                continue;
+            auto stamp = mStamps.find(entry.path);
+            if (stamp != mStamps.end())
+                stamp.value() = entry.stamp;
+            if (entry.changed)
+                changedPaths += entry.path;
+        }
+        if (!changedPaths.isEmpty())
+            emit pathsChanged(changedPaths);
+    }
 }
 
 } // namespace Internal
@@ -30,9 +30,12 @@
 
 #include "tiled_global.h"
 
-#include <QMap>
+#include <QHash>
+#include <QList>
+#include <QMutex>
 #include <QObject>
 #include <QSet>
+#include <QThreadPool>
 #include <QTimer>
 
 class QFileSystemWatcher;
@@ -51,6 +54,17 @@ namespace Internal {
  * Optionally, the 'pathsChanged' signal can be used, which triggers at a delay
  * to avoid problems occurring when trying to reload only partially written
  * files, as well as avoiding fast consecutive reloads.
+ *
+ * Before 'pathsChanged' is emitted, each changed file is compared with what
+ * was last seen of it (size, modification time and a hash of the contents) on
+ * a worker thread, so files that were touched but not actually modified are
+ * left out.
+ *
+ * When the system refuses to watch any more files (inotify's per-user limit,
+ * for example) the file's directory is watched instead.  Such files are only
+ * reported through 'pathsChanged', and only when a file is added to or
+ * removed from the directory, which includes saving with a temporary file
+ * and rename.
  */
 class /*TILEDSHARED_EXPORT */FileSystemWatcher : public QObject
 {
@@ -58,6 +72,7 @@ class /*TILEDSHARED_EXPORT */FileSystemWatcher : public QObject
 
 public:
     explicit FileSystemWatcher(QObject *parent = nullptr);
+    ~FileSystemWatcher();
 
     void addPath(const QString &path);
     void addPaths(const QStringList &paths);
@@ -71,22 +86,61 @@ signals:
     void directoryChanged(const QString &path);
 
     /**
-     * Emitted only after a short delay.
+     * Emitted only after a short delay, once for each batch of changes.
      *
      * May includes both files and directories.
      */
     void pathsChanged(const QStringList &paths);
 
+private slots:
+    void processConfirmed();
+
 private:
+    friend class FileChangeTask;
+
+    struct FileStamp
+    {
+        FileStamp() : size(-1), modified(0) {}
+
+        qint64 size; // -1 if the file doesn't exist
+        qint64 modified;
+        QByteArray hash; // empty until a change was confirmed
+    };
+
+    struct Confirmed
+    {
+        QString path;
+        FileStamp stamp;
+        bool changed;
+    };
+
+    static FileStamp stamp(const QString &path);
+
     void onFileChanged(const QString &path);
     void onDirectoryChanged(const QString &path);
     void pathsChangedTimeout();
 
+    void watchDirectory(const QString &path);
+    void unwatchDirectory(const QString &path);
+    void confirmed(const QList<Confirmed> &results);
+
     QFileSystemWatcher *mWatcher;
-    QMap<QString, int> mWatchCount;
+    QHash<QString, int> mWatchCount;
+    QHash<QString, FileStamp> mStamps;
+
+    // Files that are watched through their directory.
+    QHash<QString, QSet<QString> > mFilesByDirectory;
+    QSet<QString> mWatchedByDirectory;
 
     QSet<QString> mChangedPaths;
     QTimer mChangedPathsTimer;
+
+    QThreadPool mThreadPool;
+
+    // These are shared with the worker thread.
+    QMutex mMutex;
+    QList<QList<Confirmed> > mConfirmed;
+    bool mProcessScheduled;
 };
 
 inline void FileSystemWatcher::addPath(const QString &path)
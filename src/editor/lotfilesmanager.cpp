@@ -22,6 +22,7 @@
 #include "mainwindow.h"
 #include "mapcomposite.h"
 #include "mapmanager.h"
+#include "mapprefetcher.h"
 #include "mapobject.h"
 #include "objectgroup.h"
 #include "preferences.h"
@@ -131,21 +132,19 @@ bool LotFilesManager::generateWorld(WorldDocument *worldDoc, GenerateMode mode)
 
     mFailures.clear();
 
-    if (mode == GenerateSelected) {
-        for (WorldCell *cell : worldDoc->selectedCells()) {
-            if (!generateCell(cell)) {
-//                return false;
-            }
-        }
-    } else {
-        for (int y = 0; y < world->height(); y++) {
-            for (int x = 0; x < world->width(); x++) {
-                WorldCell* cell = world->cellAt(x, y);
-                if (!generateCell(cell)) {
-//                    return false;
-                }
-            }
+    QList<WorldCell*> cells = (mode == GenerateSelected)
+            ? worldDoc->selectedCells()
+            : MapPrefetcher::allCells(world);
+
+    // Read the maps for the next cells while this one is being generated.
+    MapPrefetcher prefetcher(cells);
+
+    for (int i = 0; i < cells.size(); i++) {
+        prefetcher.cellStarted(i);
+        if (!generateCell(cells[i])) {
+//            return false;
         }
+        prefetcher.cellFinished(i);
     }
 
     progress.release();
@@ -232,13 +231,12 @@ bool LotFilesManager::generateCell(WorldCell *cell)
 
     // The cell map must be loaded before creating the MapComposite, which will
     // possibly load embedded lots.
-    while (mapInfo->isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+    MapManager::instance()->waitForMap(mapInfo);
 
     MapComposite staticMapComposite(mapInfo);
     MapComposite *mapComposite = &staticMapComposite;
     while (mapComposite->waitingForMapsToLoad() || mapLoader.isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        MapManager::instance()->waitForThreadResults();
     if (!mapLoader.errorString().isEmpty()) {
         mError = mapLoader.errorString();
         return false;
@@ -268,7 +266,7 @@ bool LotFilesManager::generateCell(WorldCell *cell)
     MapComposite staticMapComposite(mapInfo);
     MapComposite *mapComposite = &staticMapComposite;
     while (mapComposite->waitingForMapsToLoad())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        MapManager::instance()->waitForThreadResults();
     mapComposite->generateRoadLayers(QPoint(cell->x() * 300, cell->y() * 300),
                                      cell->world()->roads());
 
@@ -0,0 +1,236 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lotpackchunkloader.h"
+
+#include "chunkmap.h"
+#include "lotpackreader.h"
+
+#include <qmath.h>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+#include <algorithm>
+
+/**
+  * Decodes one chunk on a worker thread.
+  */
+class LotPackChunkTask : public QRunnable
+{
+public:
+    LotPackChunkTask(LotPackChunkLoader *loader, LotHeader *header,
+                     const QString &fileName, int wx, int wy) :
+        mLoader(loader),
+        mHeader(header),
+        mFileName(fileName),
+        mWX(wx),
+        mWY(wy),
+        mStarted(false)
+    {
+    }
+
+    ~LotPackChunkTask()
+    {
+        // QThreadPool::clear() deletes tasks that never started.
+        if (!mStarted)
+            mLoader->cancelled(LotPackChunkLoader::key(mWX, mWY));
+    }
+
+    void run() override
+    {
+        mStarted = true;
+        IsoLot *lot = nullptr;
+        QSharedPointer<LotPackReader> reader = mLoader->reader(mFileName);
+        if (reader)
+            lot = new IsoLot(mHeader, *reader, mWX, mWY);
+        mLoader->finished(LotPackChunkLoader::key(mWX, mWY), lot);
+    }
+
+private:
+    LotPackChunkLoader *mLoader;
+    LotHeader *mHeader;
+    QString mFileName;
+    int mWX;
+    int mWY;
+    bool mStarted;
+};
+
+/////
+
+LotPackChunkLoader::LotPackChunkLoader(QObject *parent) :
+    QObject(parent),
+    mWorld(nullptr),
+    mUseCounter(0),
+    mProcessScheduled(false)
+{
+    // Leave a thread for the GUI.
+    mThreadPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+LotPackChunkLoader::~LotPackChunkLoader()
+{
+    setWorld(nullptr);
+}
+
+void LotPackChunkLoader::setWorld(IsoWorld *world)
+{
+    mThreadPool.clear();
+    mThreadPool.waitForDone();
+
+    for (const CachedLot &cached : qAsConst(mLots))
+        delete cached.lot;
+    mLots.clear();
+    mPending.clear();
+
+    QMutexLocker locker(&mMutex);
+    for (auto &finished : mFinished)
+        delete finished.second;
+    mFinished.clear();
+    mReaders.clear();
+    mReaderOrder.clear();
+
+    mWorld = world;
+}
+
+IsoLot *LotPackChunkLoader::lot(int wx, int wy)
+{
+    auto it = mLots.find(key(wx, wy));
+    if (it == mLots.end())
+        return nullptr;
+    it->used = ++mUseCounter;
+    return it->lot;
+}
+
+void LotPackChunkLoader::request(int wx, int wy, int priority)
+{
+    if (mWorld == nullptr)
+        return;
+    quint64 k = key(wx, wy);
+    if (mLots.contains(k) || mPending.contains(k))
+        return;
+    int cellX, cellY;
+    LotHeader *info = header(wx, wy, cellX, cellY);
+    if (info == nullptr)
+        return;
+    QString fileName = QString::fromLatin1("%1/world_%2_%3.lotpack")
+            .arg(mWorld->Directory).arg(cellX).arg(cellY);
+    mPending += k;
+    mThreadPool.start(new LotPackChunkTask(this, info, fileName, wx, wy), priority);
+}
+
+void LotPackChunkLoader::cancelRequests()
+{
+    mThreadPool.clear();
+}
+
+LotHeader *LotPackChunkLoader::header(int wx, int wy, int &cellX, int &cellY)
+{
+    if (mWorld == nullptr)
+        return nullptr;
+    cellX = qFloor(wx / float(IsoChunkMap::ChunkGridWidth));
+    cellY = qFloor(wy / float(IsoChunkMap::ChunkGridWidth));
+    return mWorld->MetaGrid->getHeader(cellX, cellY);
+}
+
+QSharedPointer<LotPackReader> LotPackChunkLoader::reader(const QString &fileName)
+{
+    QMutexLocker locker(&mMutex);
+    QSharedPointer<LotPackReader> reader = mReaders.value(fileName);
+    if (reader) {
+        mReaderOrder.removeOne(reader);
+        mReaderOrder += reader;
+        return reader;
+    }
+    reader.reset(new LotPackReader());
+    if (!reader->open(fileName))
+        return QSharedPointer<LotPackReader>();
+    // Tasks still decoding from an evicted reader keep it alive.
+    while (mReaderOrder.size() >= 16)
+        mReaders.remove(mReaderOrder.takeFirst()->fileName());
+    mReaders[fileName] = reader;
+    mReaderOrder += reader;
+    return reader;
+}
+
+void LotPackChunkLoader::finished(quint64 key, IsoLot *lot)
+{
+    QMutexLocker locker(&mMutex);
+    mFinished += qMakePair(key, lot);
+    if (!mProcessScheduled) {
+        mProcessScheduled = true;
+        QMetaObject::invokeMethod(this, "processFinished", Qt::QueuedConnection);
+    }
+}
+
+void LotPackChunkLoader::cancelled(quint64 key)
+{
+    mPending.remove(key);
+}
+
+void LotPackChunkLoader::processFinished()
+{
+    QList<QPair<quint64,IsoLot*> > finished;
+    {
+        QMutexLocker locker(&mMutex);
+        finished.swap(mFinished);
+        mProcessScheduled = false;
+    }
+
+    QList<QPoint> chunks;
+    for (auto &pair : finished) {
+        if (!mPending.remove(pair.first)) {
+            // Not requested since the last setWorld().
+            delete pair.second;
+            continue;
+        }
+        if (pair.second == nullptr)
+            continue;
+        CachedLot cached;
+        cached.lot = pair.second;
+        cached.used = ++mUseCounter;
+        mLots[pair.first] = cached;
+        chunks += QPoint(pair.second->wx, pair.second->wy);
+    }
+
+    trimCache();
+
+    if (!chunks.isEmpty())
+        emit chunksLoaded(chunks);
+}
+
+void LotPackChunkLoader::trimCache()
+{
+    // Evict in batches so the sort isn't done for every new chunk.
+    if (mLots.size() <= MaxCachedChunks + MaxCachedChunks / 8)
+        return;
+    QVector<quint64> used;
+    used.reserve(mLots.size());
+    for (const CachedLot &cached : qAsConst(mLots))
+        used += cached.used;
+    auto nth = used.begin() + (used.size() - MaxCachedChunks);
+    std::nth_element(used.begin(), nth, used.end());
+    const quint64 oldest = *nth;
+    for (auto it = mLots.begin(); it != mLots.end(); ) {
+        if (it->used < oldest) {
+            delete it->lot;
+            it = mLots.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
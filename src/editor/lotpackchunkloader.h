@@ -0,0 +1,122 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOTPACKCHUNKLOADER_H
+#define LOTPACKCHUNKLOADER_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPoint>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVector>
+
+class IsoLot;
+class IsoWorld;
+class LotHeader;
+class LotPackReader;
+
+class LotPackChunkTask;
+
+/**
+  * Decodes lotpack chunks on worker threads for the lotpack viewer.
+  *
+  * Decoded chunks are kept in a cache that is larger than the 30x30 chunk
+  * window, so chunks that scroll out and back in again aren't decoded twice.
+  * All the public methods must be called from the GUI thread.
+  */
+class LotPackChunkLoader : public QObject
+{
+    Q_OBJECT
+public:
+    LotPackChunkLoader(QObject *parent = nullptr);
+    ~LotPackChunkLoader();
+
+    /**
+      * Cancels any pending requests and empties the cache.  This must be
+      * called before the world's LotHeaders are deleted.
+      */
+    void setWorld(IsoWorld *world);
+
+    /**
+      * Returns the decoded chunk (wx,wy) if it is in the cache, otherwise
+      * nullptr.  The cache keeps ownership of the IsoLot.
+      */
+    IsoLot *lot(int wx, int wy);
+
+    /**
+      * Queues chunk (wx,wy) for decoding unless it is already cached or
+      * pending.  Requests with a higher priority are decoded first.
+      */
+    void request(int wx, int wy, int priority);
+
+    /**
+      * Drops every request that hasn't started decoding yet.
+      */
+    void cancelRequests();
+
+    bool isPending(int wx, int wy) const
+    { return mPending.contains(key(wx, wy)); }
+
+    static quint64 key(int wx, int wy)
+    { return (quint64(quint32(wx)) << 32) | quint32(wy); }
+
+    // Chunks kept decoded: the 30x30 window plus a margin around it.
+    static const int MaxCachedChunks = 30 * 30 + 4 * 30 * 6;
+
+signals:
+    /**
+      * Emitted on the GUI thread after a batch of chunks was decoded.
+      */
+    void chunksLoaded(const QList<QPoint> &chunks);
+
+private slots:
+    void processFinished();
+
+private:
+    friend class LotPackChunkTask;
+
+    LotHeader *header(int wx, int wy, int &cellX, int &cellY);
+    QSharedPointer<LotPackReader> reader(const QString &fileName);
+    void finished(quint64 key, IsoLot *lot);
+    void cancelled(quint64 key);
+    void trimCache();
+
+    struct CachedLot
+    {
+        IsoLot *lot;
+        quint64 used;
+    };
+
+    IsoWorld *mWorld;
+    QThreadPool mThreadPool;
+    QHash<quint64,CachedLot> mLots;
+    quint64 mUseCounter;
+    QSet<quint64> mPending;
+
+    // These are shared with the worker threads.
+    QMutex mMutex;
+    QHash<QString,QSharedPointer<LotPackReader> > mReaders;
+    QList<QSharedPointer<LotPackReader> > mReaderOrder;
+    QList<QPair<quint64,IsoLot*> > mFinished;
+    bool mProcessScheduled;
+};
+
+#endif // LOTPACKCHUNKLOADER_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lotpackreader.h"
+
+LotPackSquareIterator::LotPackSquareIterator() :
+    mPos(nullptr),
+    mEnd(nullptr),
+    mTiles(nullptr),
+    mSquare(-1),
+    mNextSquare(0),
+    mSquareCount(0),
+    mRoomID(-1),
+    mTileCount(0),
+    mError(false)
+{
+}
+
+LotPackSquareIterator::LotPackSquareIterator(const uchar *begin, const uchar *end, int levels) :
+    mPos(begin),
+    mEnd(end),
+    mTiles(nullptr),
+    mSquare(-1),
+    mNextSquare(0),
+    mSquareCount(qMax(levels, 0) * SquaresPerLevel),
+    mRoomID(-1),
+    mTileCount(0),
+    mError(false)
+{
+}
+
+bool LotPackSquareIterator::next()
+{
+    while (mNextSquare < mSquareCount) {
+        if (mEnd - mPos < 4)
+            break;
+        qint32 count = qFromLittleEndian<qint32>(mPos);
+        mPos += 4;
+        if (count == -1) {
+            // A run of empty squares, including this one.
+            if (mEnd - mPos < 4)
+                break;
+            qint32 skip = qFromLittleEndian<qint32>(mPos);
+            mPos += 4;
+            mNextSquare += qMax(skip, 1);
+            continue;
+        }
+        // The count includes the room ID.
+        if (count < 1 || (mEnd - mPos) / 4 < count)
+            break;
+        mRoomID = qFromLittleEndian<qint32>(mPos);
+        mTiles = mPos + 4;
+        mTileCount = count - 1;
+        mPos += count * 4;
+        mSquare = mNextSquare++;
+        return true;
+    }
+    if (mNextSquare < mSquareCount) {
+        mError = true;
+        mNextSquare = mSquareCount;
+    }
+    mTileCount = 0;
+    return false;
+}
+
+/////
+
+LotPackReader::LotPackReader() :
+    mData(nullptr),
+    mSize(0),
+    mChunkCount(0)
+{
+}
+
+LotPackReader::~LotPackReader()
+{
+    close();
+}
+
+bool LotPackReader::open(const QString &fileName)
+{
+    close();
+
+    mFile.setFileName(fileName);
+    if (!mFile.open(QIODevice::ReadOnly)) {
+        mError = tr("Couldn't open the file for reading.\n%1").arg(fileName);
+        return false;
+    }
+
+    mSize = mFile.size();
+    mData = mFile.map(0, mSize);
+    if (mData == nullptr) {
+        mBuffer = mFile.readAll();
+        mData = reinterpret_cast<const uchar*>(mBuffer.constData());
+        mSize = mBuffer.size();
+    }
+
+    if (mSize < 4) {
+        mError = tr("The file is too small to be a lotpack.\n%1").arg(fileName);
+        close();
+        return false;
+    }
+    mChunkCount = qFromLittleEndian<qint32>(mData);
+    if (mChunkCount < 0 || 4 + qint64(mChunkCount) * 8 > mSize) {
+        mError = tr("The lotpack's chunk table is corrupt.\n%1").arg(fileName);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void LotPackReader::close()
+{
+    if (mFile.isOpen()) {
+        if (mBuffer.isEmpty() && mData != nullptr)
+            mFile.unmap(const_cast<uchar*>(mData));
+        mFile.close();
+    }
+    mBuffer.clear();
+    mData = nullptr;
+    mSize = 0;
+    mChunkCount = 0;
+}
+
+LotPackSquareIterator LotPackReader::chunk(int index, int levels) const
+{
+    if (mData == nullptr || index < 0 || index >= mChunkCount)
+        return LotPackSquareIterator();
+    qint64 offset = qFromLittleEndian<qint64>(mData + 4 + index * 8);
+    if (offset < 4 + qint64(mChunkCount) * 8 || offset >= mSize)
+        return LotPackSquareIterator();
+    return LotPackSquareIterator(mData + offset, mData + mSize, levels);
+}
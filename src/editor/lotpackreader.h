@@ -0,0 +1,122 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOTPACKREADER_H
+#define LOTPACKREADER_H
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QFile>
+#include <QString>
+#include <QtEndian>
+
+/**
+  * Iterates over the non-empty squares of one chunk in a .lotpack file.
+  *
+  * Squares are visited in file order: level, then x, then y.  Runs of empty
+  * squares are skipped without being visited.
+  */
+class LotPackSquareIterator
+{
+public:
+    LotPackSquareIterator();
+    LotPackSquareIterator(const uchar *begin, const uchar *end, int levels);
+
+    /**
+      * Advances to the next non-empty square.  Returns false at the end of
+      * the chunk or if the data is malformed (see hasError()).
+      */
+    bool next();
+
+    int x() const { return (mSquare / SquaresPerWidth) % SquaresPerWidth; }
+    int y() const { return mSquare % SquaresPerWidth; }
+    int z() const { return mSquare / SquaresPerLevel; }
+
+    int roomID() const { return mRoomID; }
+    int tileCount() const { return mTileCount; }
+
+    /**
+      * Returns the index of a tile name in the LotHeader.
+      */
+    int tile(int n) const
+    { return qFromLittleEndian<qint32>(mTiles + n * 4); }
+
+    bool hasError() const { return mError; }
+
+    static const int SquaresPerWidth = 10;
+    static const int SquaresPerLevel = SquaresPerWidth * SquaresPerWidth;
+
+private:
+    const uchar *mPos;
+    const uchar *mEnd;
+    const uchar *mTiles;
+    int mSquare;
+    int mNextSquare;
+    int mSquareCount;
+    int mRoomID;
+    int mTileCount;
+    bool mError;
+};
+
+/**
+  * Decodes a memory-mapped .lotpack file.
+  *
+  * A lotpack starts with the number of chunks followed by a table of 64-bit
+  * offsets to each chunk's data.  Values are read directly from the mapped
+  * file instead of through QDataStream.
+  */
+class LotPackReader
+{
+    Q_DECLARE_TR_FUNCTIONS(LotPackReader)
+
+public:
+    LotPackReader();
+    ~LotPackReader();
+
+    bool open(const QString &fileName);
+    void close();
+
+    bool isOpen() const
+    { return mData != nullptr; }
+
+    QString fileName() const
+    { return mFile.fileName(); }
+
+    int chunkCount() const
+    { return mChunkCount; }
+
+    /**
+      * Returns an iterator over the squares of the chunk at \a index, where
+      * index = chunkX * ChunkGridWidth + chunkY within the cell.  \a levels
+      * comes from the cell's LotHeader.  The iterator is empty if the chunk
+      * is missing.
+      */
+    LotPackSquareIterator chunk(int index, int levels) const;
+
+    QString errorString() const
+    { return mError; }
+
+private:
+    QFile mFile;
+    QByteArray mBuffer; // used if the file can't be mapped
+    const uchar *mData;
+    qint64 mSize;
+    int mChunkCount;
+    QString mError;
+};
+
+#endif // LOTPACKREADER_H
@@ -19,21 +19,27 @@
 #include "ui_lotpackwindow.h"
 
 #include "chunkmap.h"
+#include "lotpackchunkloader.h"
 #include "preferences.h"
 #include "progress.h"
 #include "tilemetainfomgr.h"
+#include "tilesetmanager.h"
 #include "zoomable.h"
 
 #include "BuildingEditor/buildingtiles.h"
 
 #include "map.h"
 #include "tilelayer.h"
+#include "tileset.h"
 #include "zlevelrenderer.h"
 
 #include <qmath.h>
 #include <QDebug>
 #include <QFileDialog>
+#include <QMutexLocker>
+#include <QRunnable>
 #include <QSettings>
+#include <QTimer>
 
 using namespace Tiled;
 
@@ -67,10 +73,16 @@ bool LotPackLayerGroup::orderedCellsAt(const QPoint &point,
     opacities.resize(0);
     int x = point.x() - mWorld->CurrentCell->ChunkMap->getWorldXMinTiles();
     int y = point.y() - mWorld->CurrentCell->ChunkMap->getWorldYMinTiles();
-    if (IsoGridSquare *sq = mWorld->CurrentCell->getGridSquare(point.x(), point.y(), level())) {
-        foreach (QString tileName, sq->tiles) {
-            if (!mScene->mTileByName.contains(tileName)) continue;
-            if (Tile *tile = mScene->mTileByName[tileName]) {
+    IsoGridSquare *sq = mWorld->CurrentCell->getGridSquare(point.x(), point.y(), level());
+    if (sq && sq->tileCount && sq->chunk && sq->chunk->lotheader) {
+        const QVector<Tile*> &tiles = sq->chunk->lotheader->tiles;
+        const int *indices = sq->chunk->tileIndices.constData() + sq->firstTile;
+        const int count = qMin(sq->tileCount, mGrids.size());
+        for (int n = 0; n < count; n++) {
+            const int index = indices[n];
+            if (index < 0 || index >= tiles.size())
+                continue;
+            if (Tile *tile = tiles[index]) {
                 mGrids[cells.size()]->replace(x, y, Cell(tile));
                 const Cell *cell = &mGrids[cells.size()]->at(x, y);
                 cells += cell;
@@ -115,7 +127,8 @@ void LotPackLayerGroupItem::paint(QPainter *painter,
 
 LotPackMiniMapItem::LotPackMiniMapItem(LotPackScene *scene) :
     mScene(scene),
-    mGridItem(0)
+    mGridItem(0),
+    mRoomsItem(0)
 {
     setFlag(ItemHasNoContents);
     setWorld(scene->world());
@@ -137,31 +150,12 @@ void LotPackMiniMapItem::paint(QPainter *painter,
 
 void LotPackMiniMapItem::setWorld(IsoWorld *world)
 {
-    QPen pen(Qt::blue);
-    pen.setCosmetic(true);
-
     if (mGridItem)
         mGridItem->setParentItem(0);
     qDeleteAll(childItems());
 
-    foreach (LotHeader *h, IsoLot::InfoHeaders) {
-        foreach (BuildingDef *bdef, h->Buildings) {
-            foreach (RoomDef *rdef, bdef->rooms) {
-                if (rdef->level) continue;
-                foreach (RoomRect *rr, rdef->rects) {
-                    QPolygonF p;
-                    p += mScene->renderer()->tileToPixelCoords(rr->x, rr->y, rdef->level);
-                    p += mScene->renderer()->tileToPixelCoords(rr->x + rr->w, rr->y, rdef->level);
-                    p += mScene->renderer()->tileToPixelCoords(rr->x + rr->w, rr->y + rr->h, rdef->level);
-                    p += mScene->renderer()->tileToPixelCoords(rr->x, rr->y + rr->h, rdef->level);
-                    QGraphicsPolygonItem *item = new QGraphicsPolygonItem(this);
-                    item->setPen(pen);
-                    item->setBrush(Qt::NoBrush);
-                    item->setPolygon(p);
-                }
-            }
-        }
-    }
+    // The room outlines are added by addHeader() as each header is read.
+    mRoomsItem = new LotPackMiniMapRoomsItem(mScene, this);
 
     if (!mGridItem) {
         mGridItem = new IsoWorldGridItem(mScene, this);
@@ -171,8 +165,173 @@ void LotPackMiniMapItem::setWorld(IsoWorld *world)
     }
 }
 
+void LotPackMiniMapItem::addHeader(LotHeader *h)
+{
+    mRoomsItem->addHeader(h);
+}
+
+/////
+
+/**
+  * Builds the path of one cell's room outlines on a worker thread.
+  */
+class MiniMapRoomsTask : public QRunnable
+{
+public:
+    MiniMapRoomsTask(LotPackMiniMapRoomsItem *item, LotHeader *header, const QTransform &transform) :
+        mItem(item),
+        mHeader(header),
+        mTransform(transform)
+    {
+    }
+
+    void run() override
+    {
+        LotPackMiniMapRoomsItem::CellPath cellPath;
+        foreach (BuildingDef *bdef, mHeader->Buildings) {
+            foreach (RoomDef *rdef, bdef->rooms) {
+                if (rdef->level) continue;
+                foreach (RoomRect *rr, rdef->rects)
+                    cellPath.path.addPolygon(mTransform.map(QPolygonF(QRectF(rr->x, rr->y, rr->w, rr->h))));
+            }
+        }
+        cellPath.bounds = cellPath.path.controlPointRect();
+
+        QMutexLocker locker(&mItem->mMutex);
+        mItem->mBuilt += cellPath;
+    }
+
+private:
+    LotPackMiniMapRoomsItem *mItem;
+    LotHeader *mHeader;
+    QTransform mTransform;
+};
+
+LotPackMiniMapRoomsItem::LotPackMiniMapRoomsItem(LotPackScene *scene, QGraphicsItem *parent) :
+    QGraphicsItem(parent),
+    mScene(scene),
+    mBuilding(0)
+{
+    setFlag(ItemUsesExtendedStyleOption);
+    mThreadPool.setMaxThreadCount(1);
+}
+
+LotPackMiniMapRoomsItem::~LotPackMiniMapRoomsItem()
+{
+    mThreadPool.clear();
+    mThreadPool.waitForDone();
+}
+
+QRectF LotPackMiniMapRoomsItem::boundingRect() const
+{
+    return mBoundingRect;
+}
+
+void LotPackMiniMapRoomsItem::paint(QPainter *painter,
+                                    const QStyleOptionGraphicsItem *option,
+                                    QWidget *widget)
+{
+    Q_UNUSED(widget)
+
+    QPen pen(Qt::blue);
+    pen.setCosmetic(true);
+    painter->setPen(pen);
+    painter->setBrush(Qt::NoBrush);
+
+    // The cosmetic pen extends past the path by a pixel.
+    const qreal margin = 1.0 / qMax(option->levelOfDetailFromTransform(painter->worldTransform()), 0.001);
+    const QRectF exposed = option->exposedRect.adjusted(-margin, -margin, margin, margin);
+    for (const CellPath &cellPath : qAsConst(mPaths)) {
+        if (cellPath.bounds.intersects(exposed))
+            painter->drawPath(cellPath.path);
+    }
+}
+
+void LotPackMiniMapRoomsItem::addHeader(LotHeader *h)
+{
+    // Tile to scene coordinates on level 0 is an affine mapping, so the
+    // worker threads don't need the renderer.
+    const MapRenderer *renderer = mScene->renderer();
+    const QPointF origin = renderer->tileToPixelCoords(0, 0, 0);
+    const QPointF dx = renderer->tileToPixelCoords(1, 0, 0) - origin;
+    const QPointF dy = renderer->tileToPixelCoords(0, 1, 0) - origin;
+    const QTransform transform(dx.x(), dx.y(), dy.x(), dy.y(), origin.x(), origin.y());
+
+    ++mBuilding;
+    mThreadPool.start(new MiniMapRoomsTask(this, h, transform));
+}
+
+void LotPackMiniMapRoomsItem::takeBuiltPaths()
+{
+    QVector<CellPath> built;
+    {
+        QMutexLocker locker(&mMutex);
+        built.swap(mBuilt);
+    }
+    if (built.isEmpty())
+        return;
+    mBuilding -= built.size();
+
+    QRectF changed;
+    for (const CellPath &cellPath : qAsConst(built)) {
+        if (cellPath.path.isEmpty())
+            continue;
+        changed |= cellPath.bounds;
+        mPaths += cellPath;
+    }
+    if (changed.isEmpty())
+        return;
+    prepareGeometryChange();
+    mBoundingRect |= changed;
+    update(changed);
+}
+
 ///// ///// ///// ///// /////
 
+LotPackPendingChunksItem::LotPackPendingChunksItem(LotPackScene *scene, LotPackChunkLoader *loader) :
+    QGraphicsItem(),
+    mScene(scene),
+    mLoader(loader)
+{
+    setFlag(ItemUsesExtendedStyleOption);
+}
+
+QRectF LotPackPendingChunksItem::boundingRect() const
+{
+    return mScene->sceneRect();
+}
+
+void LotPackPendingChunksItem::paint(QPainter *painter,
+                                     const QStyleOptionGraphicsItem *option,
+                                     QWidget *widget)
+{
+    Q_UNUSED(widget)
+
+    IsoWorld *world = mScene->world();
+    if (!world)
+        return;
+    IsoChunkMap *cm = world->CurrentCell->ChunkMap;
+
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(QColor(128, 128, 128, 128));
+    for (int x = 0; x < cm->ChunkGridWidth; x++) {
+        for (int y = 0; y < cm->ChunkGridWidth; y++) {
+            if (cm->getChunk(x, y))
+                continue;
+            int wx = cm->getWorldXMin() + x, wy = cm->getWorldYMin() + y;
+            if (!mLoader->isPending(wx, wy))
+                continue;
+            QPolygonF polygon = mScene->renderer()->tileToPixelCoords(
+                        QRect(wx * IsoChunkMap::ChunksPerWidth, wy * IsoChunkMap::ChunksPerWidth,
+                              IsoChunkMap::ChunksPerWidth, IsoChunkMap::ChunksPerWidth));
+            if (polygon.boundingRect().intersects(option->exposedRect))
+                painter->drawPolygon(polygon);
+        }
+    }
+}
+
+/////
+
 
 IsoWorldGridItem::IsoWorldGridItem(LotPackScene *scene, QGraphicsItem *parent) :
     QGraphicsItem(parent),
@@ -322,36 +481,6 @@ void LotPackScene::setWorld(IsoWorld *world)
         mRoomDefGroups += item2;
     }
 
-    QVector<QColor> roomDefColors;
-    roomDefColors << QColor(255, 128, 128, 128)
-                  << QColor(128, 255, 255, 128)
-                  << QColor(128, 255, 128, 128)
-                  << QColor(255, 128, 255, 128);
-
-    foreach (LotHeader *h, IsoLot::InfoHeaders) {
-        foreach (BuildingDef *bdef, h->Buildings) {
-            foreach (RoomDef *rdef, bdef->rooms) {
-//                if (rdef->level) continue;
-                foreach (RoomRect *rr, rdef->rects) {
-                    QPolygonF p;
-                    p += mRenderer->tileToPixelCoords(rr->x, rr->y, rdef->level);
-                    p += mRenderer->tileToPixelCoords(rr->x + rr->w, rr->y, rdef->level);
-                    p += mRenderer->tileToPixelCoords(rr->x + rr->w, rr->y + rr->h, rdef->level);
-                    p += mRenderer->tileToPixelCoords(rr->x, rr->y + rr->h, rdef->level);
-                    QGraphicsPolygonItem *item = new QGraphicsPolygonItem(mRoomDefGroups[rdef->level]);
-                    item->setPolygon(p);
-                    QColor color = roomDefColors[rdef->level % roomDefColors.size()];
-                    if (rdef->name.isEmpty()
-                            || rdef->name.contains(QLatin1String("newroom"))
-                             || rdef->name.startsWith(QLatin1String("room")))
-                        color = QColor(255, 0, 0, 200);
-                    item->setBrush(color);
-
-                }
-            }
-        }
-    }
-
     foreach (QGraphicsItem *item, mRoomDefGroups)
         addItem(item);
 
@@ -368,6 +497,39 @@ void LotPackScene::setWorld(IsoWorld *world)
     highlightCurrentLevel();
 }
 
+void LotPackScene::addHeader(LotHeader *h)
+{
+    QVector<QColor> roomDefColors;
+    roomDefColors << QColor(255, 128, 128, 128)
+                  << QColor(128, 255, 255, 128)
+                  << QColor(128, 255, 128, 128)
+                  << QColor(255, 128, 255, 128);
+
+    foreach (BuildingDef *bdef, h->Buildings) {
+        foreach (RoomDef *rdef, bdef->rooms) {
+//            if (rdef->level) continue;
+            if (rdef->level < 0 || rdef->level >= mRoomDefGroups.size())
+                continue;
+            foreach (RoomRect *rr, rdef->rects) {
+                QPolygonF p;
+                p += mRenderer->tileToPixelCoords(rr->x, rr->y, rdef->level);
+                p += mRenderer->tileToPixelCoords(rr->x + rr->w, rr->y, rdef->level);
+                p += mRenderer->tileToPixelCoords(rr->x + rr->w, rr->y + rr->h, rdef->level);
+                p += mRenderer->tileToPixelCoords(rr->x, rr->y + rr->h, rdef->level);
+                QGraphicsPolygonItem *item = new QGraphicsPolygonItem(mRoomDefGroups[rdef->level]);
+                item->setPolygon(p);
+                QColor color = roomDefColors[rdef->level % roomDefColors.size()];
+                if (rdef->name.isEmpty()
+                        || rdef->name.contains(QLatin1String("newroom"))
+                         || rdef->name.startsWith(QLatin1String("room")))
+                    color = QColor(255, 0, 0, 200);
+                item->setBrush(color);
+
+            }
+        }
+    }
+}
+
 void LotPackScene::setMaxLevel(int max)
 {
     Q_UNUSED(max)
@@ -422,10 +584,19 @@ LotPackView::LotPackView(QWidget *parent) :
     mScene(new LotPackScene(this)),
     mWorld(0),
     mMiniMapItem(0),
+    mChunkLoader(new LotPackChunkLoader(this)),
+    mPendingItem(0),
     mRecenterScheduled(false)
 {
     setScene(mScene);
 
+    connect(mChunkLoader, &LotPackChunkLoader::chunksLoaded, this, &LotPackView::chunksLoaded);
+    connect(Tiled::Internal::TilesetManager::instance(), &Tiled::Internal::TilesetManager::tilesetChanged,
+            this, &LotPackView::tilesetChanged);
+
+    mHeaderTimer.setInterval(100);
+    connect(&mHeaderTimer, &QTimer::timeout, this, &LotPackView::headersLoaded);
+
     QVector<qreal> factors;
     factors << 0.12 << 0.25 << 0.33 << 0.5 << 0.75 << 1.0 << 1.5 << 2.0;
     zoomable()->setZoomFactors(factors);
@@ -445,9 +616,17 @@ void LotPackView::setWorld(IsoWorld *world)
 
     mWorld = world;
 
+    // The scene deletes its items, including the placeholders.
+    mPendingItem = 0;
+    mHeaderTimer.stop();
+    mChunkLoader->setWorld(mWorld);
     mScene->setWorld(mWorld);
 
     if (mWorld) {
+        mPendingItem = new LotPackPendingChunksItem(mScene, mChunkLoader);
+        mPendingItem->setZValue(-1);
+        mScene->addItem(mPendingItem);
+
         if (!mMiniMapItem) {
             mMiniMapItem = new LotPackMiniMapItem(mScene);
             addMiniMapItem(mMiniMapItem);
@@ -455,6 +634,12 @@ void LotPackView::setWorld(IsoWorld *world)
             mMiniMapItem->setWorld(mWorld);
         }
 
+        // Read the remaining .lotheader files in the background and add their
+        // rooms as they arrive.
+        mWorld->MetaGrid->startLoadingHeaders();
+        headersLoaded();
+        mHeaderTimer.start();
+
         centerOn(mScene->sceneRect().center());
     } else {
         if (mMiniMapItem) {
@@ -465,6 +650,20 @@ void LotPackView::setWorld(IsoWorld *world)
     }
 }
 
+void LotPackView::headersLoaded()
+{
+    if (!mWorld)
+        return;
+    const QList<LotHeader*> headers = mWorld->MetaGrid->takeLoadedHeaders();
+    for (LotHeader *h : headers) {
+        mScene->addHeader(h);
+        mMiniMapItem->addHeader(h);
+    }
+    mMiniMapItem->mRoomsItem->takeBuiltPaths();
+    if (!mWorld->MetaGrid->isLoadingHeaders() && !mMiniMapItem->mRoomsItem->isBuilding())
+        mHeaderTimer.stop();
+}
+
 void LotPackView::scrollContentsBy(int dx, int dy)
 {
     if (!mRecenterScheduled) {
@@ -506,6 +705,10 @@ void LotPackView::recenter()
                 mWorld->MetaGrid->chunkBounds().bottom() + 1 - cm->ChunkGridWidth / 2);
 //    qDebug() << "LotPackView::scrollContentsBy" << wx << wy;
     if (wx != cm->WorldX || wy != cm->WorldY) {
+        // Prefetch ahead of the way the view is moving.
+        const QPoint direction((wx > cm->WorldX) - (wx < cm->WorldX),
+                               (wy > cm->WorldY) - (wy < cm->WorldY));
+
         QRegion current = QRect(cm->getWorldXMin(), cm->getWorldYMin(),
                                 cm->ChunkGridWidth, cm->ChunkGridWidth);
         QRegion updated = QRect(wx - cm->ChunkGridWidth / 2, wy - cm->ChunkGridWidth / 2,
@@ -547,13 +750,12 @@ void LotPackView::recenter()
             cm->setChunk(c->wx - cm->getWorldXMin(), c->wy - cm->getWorldYMin(), c);
         }
 
-        // Load new chunks;
+        // Place new chunks that are already decoded, and queue the rest.
         for (const QRect &r : (updated - current)) {
             for (int x = r.left(); x <= r.right(); x++) {
                 for (int y = r.top(); y <= r.bottom(); y++) {
-//                    if (x < mWorld->MetaGrid->minx || x > mWorld->MetaGrid->maxx) continue;
-//                    if (y < mWorld->MetaGrid->miny || y > mWorld->MetaGrid->maxy) continue;
-                    cm->LoadChunkForLater(x, y, x - cm->getWorldXMin(), y - cm->getWorldYMin());
+                    if (IsoLot *lot = mChunkLoader->lot(x, y))
+                        placeChunk(lot);
                 }
             }
         }
@@ -562,23 +764,143 @@ void LotPackView::recenter()
 
         for (int x = 0; x < cm->Chunks.size(); x++) {
             for (int y = 0; y < cm->Chunks[x].size(); y++) {
-                if (IsoChunk *chunk = cm->Chunks[x][y]) {
-                    if (chunk->lotheader && !mScene->mHeadersExamined.contains(chunk->lotheader)) {
-                        mScene->mHeadersExamined += chunk->lotheader;
-                        foreach (QString tileName, chunk->lotheader->tilesUsed) {
-                            if (!mScene->mTileByName.contains(tileName)) {
-                                if (Tile *tile = BuildingEditor::BuildingTilesMgr::instance()->tileFor(tileName)) {
-                                    mScene->mTileByName[tileName] = tile;
-                                }
-                            }
-                        }
-                    }
-                }
+                if (IsoChunk *chunk = cm->Chunks[x][y])
+                    examineHeader(chunk->lotheader);
             }
         }
 
         mScene->setMaxLevel(mWorld->CurrentCell->MaxHeight);
+
+        requestChunks(direction);
+        mPendingItem->update();
+    }
+}
+
+void LotPackView::chunksLoaded(const QList<QPoint> &chunks)
+{
+    if (!mWorld)
+        return;
+
+    IsoChunkMap *cm = mWorld->CurrentCell->ChunkMap;
+    const QRect window(cm->getWorldXMin(), cm->getWorldYMin(), cm->ChunkGridWidth, cm->ChunkGridWidth);
+    QRect changed;
+    for (const QPoint &p : chunks) {
+        if (!window.contains(p) || cm->getChunk(p.x() - window.left(), p.y() - window.top()))
+            continue;
+        if (IsoLot *lot = mChunkLoader->lot(p.x(), p.y()))
+            changed |= placeChunk(lot);
     }
+    if (changed.isEmpty())
+        return;
+
+    mScene->setMaxLevel(mWorld->CurrentCell->MaxHeight);
+
+    // Tiles on upper levels are drawn above their squares.
+    QRect bounds = mScene->renderer()->boundingRect(changed, 0)
+            | mScene->renderer()->boundingRect(changed, mWorld->CurrentCell->MaxHeight);
+    const QMargins margins(0, 128, 64, 0);
+    mScene->update(bounds.marginsAdded(margins));
+}
+
+/**
+  * Queues every chunk in the window that hasn't been placed yet, nearest to
+  * the center first, then the chunks just beyond the window in the direction
+  * the view is scrolling.
+  */
+void LotPackView::requestChunks(const QPoint &direction)
+{
+    IsoChunkMap *cm = mWorld->CurrentCell->ChunkMap;
+    const QRect window(cm->getWorldXMin(), cm->getWorldYMin(), cm->ChunkGridWidth, cm->ChunkGridWidth);
+
+    // Requests that haven't started yet may no longer be wanted.
+    mChunkLoader->cancelRequests();
+
+    for (int x = window.left(); x <= window.right(); x++) {
+        for (int y = window.top(); y <= window.bottom(); y++) {
+            if (cm->getChunk(x - window.left(), y - window.top()))
+                continue;
+            int dx = x - cm->WorldX, dy = y - cm->WorldY;
+            mChunkLoader->request(x, y, cm->ChunkGridWidth * cm->ChunkGridWidth - (dx * dx + dy * dy));
+        }
+    }
+
+    if (direction.isNull())
+        return;
+
+    const QRect bounds = mWorld->MetaGrid->chunkBounds();
+    QRegion requested = window;
+    for (int depth = 1; depth <= PrefetchDepth; depth++) {
+        QRegion region = QRegion(window.translated(direction * depth)) - requested;
+        for (const QRect &r : region) {
+            for (int x = r.left(); x <= r.right(); x++) {
+                for (int y = r.top(); y <= r.bottom(); y++) {
+                    if (bounds.contains(x, y))
+                        mChunkLoader->request(x, y, -depth);
+                }
+            }
+        }
+        requested += region;
+    }
+}
+
+/**
+  * Creates the IsoChunk for a decoded chunk inside the window.  Returns the
+  * chunk's bounds in tiles.
+  */
+QRect LotPackView::placeChunk(IsoLot *lot)
+{
+    IsoCell *cell = mWorld->CurrentCell;
+    IsoChunkMap *cm = cell->ChunkMap;
+
+    IsoChunk *chunk = new IsoChunk(cell);
+    chunk->wx = lot->wx;
+    chunk->wy = lot->wy;
+    chunk->lotheader = lot->info;
+    cm->setChunk(lot->wx - cm->getWorldXMin(), lot->wy - cm->getWorldYMin(), chunk);
+    cell->PlaceLot(lot, 0, 0, 0, chunk, lot->wx, lot->wy, true);
+
+    examineHeader(chunk->lotheader);
+
+    return QRect(lot->wx * IsoChunkMap::ChunksPerWidth, lot->wy * IsoChunkMap::ChunksPerWidth,
+                 IsoChunkMap::ChunksPerWidth, IsoChunkMap::ChunksPerWidth);
+}
+
+/**
+  * Resolves every tile used by a cell to a Tile once, so squares can be drawn
+  * straight from their tile indices.
+  */
+void LotPackView::examineHeader(LotHeader *header)
+{
+    if (!header || header->tiles.size() == header->buildingTiles.size())
+        return;
+    header->tiles.resize(header->buildingTiles.size());
+    QHash<QString,Tileset*> tilesets;
+    for (int i = 0; i < header->buildingTiles.size(); i++) {
+        const BuildingEditor::BuildingTile &btile = header->buildingTiles.at(i);
+        auto it = tilesets.find(btile.mTilesetName);
+        if (it == tilesets.end())
+            it = tilesets.insert(btile.mTilesetName, TileMetaInfoMgr::instance()->tileset(btile.mTilesetName));
+        Tileset *tileset = it.value();
+        if (tileset && btile.mIndex >= 0 && btile.mIndex < tileset->tileCount())
+            header->tiles[i] = tileset->tileAt(btile.mIndex);
+        else // the missing tile
+            header->tiles[i] = BuildingEditor::BuildingTilesMgr::instance()->tileFor(header->tilesUsed.at(i));
+    }
+
+    // Read the images of the tilesets this cell uses, the view is redrawn as
+    // each one is loaded.
+    QList<Tileset*> used;
+    for (Tileset *tileset : qAsConst(tilesets)) {
+        if (tileset)
+            used += tileset;
+    }
+    TileMetaInfoMgr::instance()->loadTilesets(used);
+}
+
+void LotPackView::tilesetChanged(Tileset *tileset)
+{
+    Q_UNUSED(tileset)
+    mScene->update();
 }
 
 /////
@@ -634,7 +956,7 @@ LotPackWindow::LotPackWindow(QWidget *parent) :
     ui->actionRecent->setVisible(false);
     setRecentMenu();
 
-    TileMetaInfoMgr::instance()->loadTilesets();
+    TileMetaInfoMgr::instance()->sizeTilesets();
 }
 
 LotPackWindow::~LotPackWindow()
@@ -723,6 +1045,9 @@ void LotPackWindow::open(const QString &directory)
 {
     PROGRESS progress(tr("Loading %1").arg(QFileInfo(directory).fileName()), this);
 
+    // Stop decoding chunks before their LotHeaders are deleted.
+    mView->setWorld(0);
+
     qDeleteAll(IsoLot::InfoHeaders);
     IsoLot::InfoHeaders.clear();
 
@@ -741,12 +1066,13 @@ void LotPackWindow::open(const QString &directory)
 
 void LotPackWindow::closeWorld()
 {
+    mView->setWorld(0);
+
     qDeleteAll(IsoLot::InfoHeaders);
     IsoLot::InfoHeaders.clear();
 
     CellLoader::instance()->reset();
 
-    mView->setWorld(0);
     if (mWorld) {
         delete mWorld;
         mWorld = 0;
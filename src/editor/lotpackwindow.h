@@ -27,14 +27,22 @@
 #include "ztilelayergroup.h"
 
 #include <QGraphicsItem>
+#include <QMutex>
+#include <QPainterPath>
+#include <QThreadPool>
+#include <QTimer>
 
+class IsoLot;
 class IsoWorld;
+class LotHeader;
+class LotPackChunkLoader;
 
 namespace Tiled {
 class Cell;
 class Map;
 class MapRenderer;
 class Tile;
+class Tileset;
 }
 
 namespace Ui {
@@ -96,6 +104,49 @@ private:
     QRectF mBoundingRect;
 };
 
+/**
+  * Item that draws the ground-floor room outlines on the minimap.  The
+  * outlines of each cell are one QPainterPath, built on a worker thread, and
+  * only the cells in the exposed area are drawn.
+  */
+class LotPackMiniMapRoomsItem : public QGraphicsItem
+{
+public:
+    LotPackMiniMapRoomsItem(LotPackScene *scene, QGraphicsItem *parent = 0);
+    ~LotPackMiniMapRoomsItem();
+
+    QRectF boundingRect() const;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+
+    void addHeader(LotHeader *h);
+
+    /**
+      * Adds the paths finished by the worker threads.
+      */
+    void takeBuiltPaths();
+
+    bool isBuilding() const
+    { return mBuilding > 0; }
+
+private:
+    friend class MiniMapRoomsTask;
+
+    struct CellPath
+    {
+        QRectF bounds;
+        QPainterPath path;
+    };
+
+    LotPackScene *mScene;
+    QRectF mBoundingRect;
+    QVector<CellPath> mPaths;
+    int mBuilding;
+
+    QThreadPool mThreadPool;
+    QMutex mMutex;
+    QVector<CellPath> mBuilt;
+};
+
 class LotPackMiniMapItem : public QGraphicsItem
 {
 public:
@@ -105,13 +156,30 @@ public:
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
 
     void setWorld(IsoWorld *world);
+    void addHeader(LotHeader *h);
 
     LotPackScene *mScene;
     QRectF mBoundingRect;
     IsoWorldGridItem *mGridItem;
+    LotPackMiniMapRoomsItem *mRoomsItem;
+};
+
+/**
+  * Item that draws a placeholder over each chunk that is still being decoded.
+  */
+class LotPackPendingChunksItem : public QGraphicsItem
+{
+public:
+    LotPackPendingChunksItem(LotPackScene *scene, LotPackChunkLoader *loader);
+
+    QRectF boundingRect() const;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+
+private:
+    LotPackScene *mScene;
+    LotPackChunkLoader *mLoader;
 };
 
-class LotHeader;
 #include <QSet>
 class LotPackScene : public BaseGraphicsScene
 {
@@ -127,8 +195,7 @@ public:
 
     void setMaxLevel(int max);
 
-    QMap<QString,Tiled::Tile*> mTileByName;
-    QSet<LotHeader*> mHeadersExamined;
+    void addHeader(LotHeader *h);
 
 public slots:
     void showRoomDefs(bool show);
@@ -169,13 +236,26 @@ signals:
 
 private slots:
     void recenter();
+    void chunksLoaded(const QList<QPoint> &chunks);
+    void headersLoaded();
+    void tilesetChanged(Tiled::Tileset *tileset);
 
 private:
+    void requestChunks(const QPoint &direction);
+    QRect placeChunk(IsoLot *lot);
+    void examineHeader(LotHeader *header);
+
     LotPackScene *mScene;
     IsoWorld *mWorld;
     LotPackMiniMapItem *mMiniMapItem;
+    LotPackChunkLoader *mChunkLoader;
+    LotPackPendingChunksItem *mPendingItem;
+    QTimer mHeaderTimer;
     QPoint mTilePos;
     bool mRecenterScheduled;
+
+    // Number of chunks beyond the window to prefetch in the scroll direction.
+    static const int PrefetchDepth = 6;
 };
 
 class LotPackWindow : public QMainWindow
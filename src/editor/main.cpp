@@ -24,7 +24,6 @@
 #include "preferences.h"
 #include "mapimagemanager.h"
 #include "mapmanager.h"
-#include "progress.h"
 #include "tilemetainfomgr.h"
 #include "tilesetmanager.h"
 using namespace Tiled;
@@ -69,10 +68,8 @@ int main(int argc, char *argv[])
                      &w, SLOT(openFile(QString)));
 #endif
 
-    PROGRESS progress(QStringLiteral("Loading Tilesets %1 / %2").arg(0).arg(TileMetaInfoMgr::instance()->tilesets().size()), &w);
-    TileMetaInfoMgr::instance()->loadTilesets(true);
-    TilesetManager::instance()->waitForTilesets(TilesetManager::instance()->tilesets(), &w);
-    progress.release();
+    // Tileset images are read when a map or view uses them.
+    TileMetaInfoMgr::instance()->sizeTilesets();
 
     w.openLastFiles();
 
@@ -39,6 +39,7 @@
 #include "mapimagemanager.h"
 #include "mapmanager.h"
 #include "mapsdock.h"
+#include "memorystatsdialog.h"
 #include "newworlddialog.h"
 #include "objectsdock.h"
 #include "objectgroupsdialog.h"
@@ -77,6 +78,7 @@
 #include "InGameMap/ingamemapimagedialog.h"
 #include "InGameMap/ingamemapimagepyramidwindow.h"
 #include "InGameMap/ingamemapreader.h"
+#include "InGameMap/ingamemapreaderbinary.h"
 #include "InGameMap/ingamemapscene.h"
 #include "InGameMap/ingamemapwriter.h"
 #include "InGameMap/ingamemapwriterbinary.h"
@@ -332,6 +334,7 @@ MainWindow::MainWindow(QWidget *parent)
 
     connect(ui->actionLotPackViewer, &QAction::triggered, this, &MainWindow::lotpackviewer);
     connect(ui->actionLootInspector, &QAction::triggered, this, &MainWindow::lootInspector);
+    connect(ui->actionMemoryUsage, &QAction::triggered, this, &MainWindow::memoryUsage);
 //    connect(ui->actionReadOldWaterDotLua, &QAction::triggered, this, &MainWindow::readOldWaterDotLua);
 
     connect(ui->actionAboutQt, &QAction::triggered, qApp, &QApplication::aboutQt);
@@ -1125,6 +1128,12 @@ void MainWindow::lootInspector()
     }
 }
 
+void MainWindow::memoryUsage()
+{
+    MemoryStatsDialog d(this);
+    d.exec();
+}
+
 #include "waterflow.h"
 void MainWindow::readOldWaterDotLua()
 {
@@ -2265,6 +2274,8 @@ void MainWindow::readInGameMapFeaturesXML()
 
     QString selectedFilter = tr("XML files (*.xml)");
     filter += selectedFilter;
+    filter += QLatin1String(";;");
+    filter += tr("Binary files (*.bin)");
 
     QString fileName = QFileDialog::getOpenFileName(this, tr("Read Features XML"),
                                                     Preferences::instance()->worldMapXMLFile(),
@@ -2273,21 +2284,46 @@ void MainWindow::readInGameMapFeaturesXML()
         return;
     }
 
-    Preferences::instance()->setWorldMapXMLFile(QFileInfo(fileName).absoluteFilePath());
+    // The XML file is the one the Overwrite action writes to.
+    const bool binary = fileName.endsWith(QLatin1String(".bin"), Qt::CaseInsensitive);
+    if (!binary) {
+        Preferences::instance()->setWorldMapXMLFile(QFileInfo(fileName).absoluteFilePath());
+    }
+
+    // With cells selected, only the cells within the selection are read from
+    // a binary file.  Version 2 files decode just the chunks for those cells.
+    QRect region(0, 0, world->width(), world->height());
+    if (binary && !worldDoc->selectedCells().isEmpty()) {
+        region = QRect();
+        for (WorldCell *cell : worldDoc->selectedCells())
+            region |= QRect(cell->pos(), QSize(1, 1));
+    }
+    QList<WorldCell*> cells;
+    for (auto* cell : world->cells()) {
+        if (region.contains(cell->pos()))
+            cells += cell;
+    }
 
     PROGRESS progress(QStringLiteral("Reading InGameMap XML"), this);
 
     worldDoc->undoStack()->beginMacro(tr("Read InGameMap XML"));
-    for (auto* cell : world->cells()) {
+    for (auto* cell : qAsConst(cells)) {
         for (int i = cell->inGameMap().features().size() - 1; i >= 0; i--) {
             worldDoc->removeInGameMapFeature(cell, i);
         }
     }
 
-    InGameMapReader mbreader;
-    mbreader.readWorld(fileName, world);
+    if (binary) {
+        InGameMapReaderBinary reader;
+        if (!reader.open(fileName) || !reader.readRegion(world, region)) {
+            qWarning() << "Failed to read InGameMap Binary:" << reader.errorString();
+        }
+    } else {
+        InGameMapReader mbreader;
+        mbreader.readWorld(fileName, world);
+    }
 
-    for (auto* cell : world->cells()) {
+    for (auto* cell : qAsConst(cells)) {
         InGameMapFeatures features = cell->inGameMap().features();
         cell->inGameMap().mFeatures.clear();
         for (int i = 0, n = features.size(); i < n; i++) {
@@ -2368,24 +2404,61 @@ void MainWindow::writeInGameMapFeaturesXML()
         }
     }
 
-    const QString fileName = QFileDialog::getSaveFileName(this, QString(), suggestedFileName, tr("XML files (*.xml)"));
+    const QString xmlFilter = tr("XML files (*.xml)");
+    const QString chunkedFilter = tr("Chunked binary files (*.chunks.bin)");
+    QString selectedFilter = xmlFilter;
+    QString filter = xmlFilter;
+    filter += QLatin1String(";;");
+    filter += chunkedFilter;
+
+    QString fileName = QFileDialog::getSaveFileName(this, QString(), suggestedFileName, filter, &selectedFilter);
     if (fileName.isEmpty()) {
         return;
     }
 
+    // The chunked binary format is only read by the editor, the game reads
+    // the version 1 .xml.bin file written next to the XML file.
+    if (selectedFilter == chunkedFilter) {
+        if (fileName.endsWith(QLatin1String(".xml.bin"), Qt::CaseInsensitive)) {
+            QMessageBox::warning(this, tr("Write Features"),
+                                 tr("%1 is the file the game reads and can't hold the chunked format.\n"
+                                    "Please choose a name ending in .chunks.bin.")
+                                 .arg(QDir::toNativeSeparators(fileName)));
+            return;
+        }
+        if (!fileName.endsWith(QLatin1String(".chunks.bin"), Qt::CaseInsensitive)) {
+            fileName += QLatin1String(".chunks.bin");
+            // The file dialog only asked about overwriting the name without the extension.
+            if (QFileInfo::exists(fileName) &&
+                    QMessageBox::question(this, tr("Write Features"),
+                                          tr("%1 already exists.\nDo you want to replace it?")
+                                          .arg(QDir::toNativeSeparators(fileName)),
+                                          QMessageBox::Yes | QMessageBox::No) != QMessageBox::Yes) {
+                return;
+            }
+        }
+        PROGRESS progress(QStringLiteral("Writing InGameMap Binary"), this);
+        InGameMapWriterBinary writerBinary;
+        writerBinary.setVersion(2);
+        if (!writerBinary.writeWorld(worldDoc->world(), fileName)) {
+            QMessageBox::warning(this, tr("Error writing InGameMap Binary"), writerBinary.errorString());
+        }
+        return;
+    }
+
     Preferences::instance()->setWorldMapXMLFile(QFileInfo(fileName).absoluteFilePath());
 
     PROGRESS progress(QStringLiteral("Writing InGameMap XML"), this);
 
     InGameMapWriter writer;
     if (!writer.writeWorld(worldDoc->world(), fileName)) {
-        qWarning("Failed to write InGameMap XML.");
+        QMessageBox::warning(this, tr("Error writing InGameMap XML"), writer.errorString());
         return;
     }
 
     InGameMapWriterBinary writerBinary;
     if (!writerBinary.writeWorld(worldDoc->world(), fileName + QStringLiteral(".bin"))) {
-        qWarning("Failed to write InGameMap Binary.");
+        QMessageBox::warning(this, tr("Error writing InGameMap Binary"), writerBinary.errorString());
         return;
     }
 }
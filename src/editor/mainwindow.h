@@ -168,6 +168,8 @@ public slots:
 
     void lootInspector();
 
+    void memoryUsage();
+
     void readOldWaterDotLua();
 
 private:
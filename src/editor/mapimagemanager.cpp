@@ -33,6 +33,7 @@
 #include "progress.h"
 #include "staggeredrenderer.h"
 #include "tilelayer.h"
+#include "tilemetainfomgr.h"
 #include "tilesetmanager.h"
 #include "zlevelrenderer.h"
 
@@ -44,6 +45,7 @@
 #include <QImageReader>
 #include <QMessageBox>
 #include <QPainterPath>
+#include <QSet>
 
 #ifdef QT_NO_DEBUG
 inline QNoDebug noise() { return QNoDebug(); }
@@ -96,8 +98,8 @@ MapImageManager::MapImageManager() :
             this, &MapImageManager::mapAboutToChange);
     connect(MapManager::instance(), &MapManager::mapChanged,
             this, &MapImageManager::mapChanged);
-    connect(MapManager::instance(), &MapManager::mapFileChanged,
-            this, &MapImageManager::mapFileChanged);
+    connect(MapManager::instance(), &MapManager::mapFilesChanged,
+            this, &MapImageManager::mapFilesChanged);
     connect(MapManager::instance(), &MapManager::mapLoaded,
             this, &MapImageManager::mapLoaded);
     connect(MapManager::instance(), &MapManager::mapFailedToLoad,
@@ -225,7 +227,7 @@ void MapImageManager::recreateMapImage(const QString &mapName, const QString &re
 
     for (auto *mapImage : qAsConst(mMapImages)) {
         if (mapImage->sources().contains(mapInfo)) {
-            mapFileChanged(mapInfo);
+            mapFilesChanged(QList<MapInfo*>() << mapInfo);
             return;
         }
     }
@@ -234,7 +236,7 @@ void MapImageManager::recreateMapImage(const QString &mapName, const QString &re
     if (mapImage != nullptr) {
         mapImage->mSources.clear();
         mapImage->mSources += mapInfo;
-        mapFileChanged(mapInfo);
+        mapFilesChanged(QList<MapInfo*>() << mapInfo);
     }
 }
 
@@ -619,33 +621,40 @@ void MapImageManager::mapChanged(MapInfo *mapInfo)
     }
 }
 
-void MapImageManager::mapFileChanged(MapInfo *mapInfo)
+void MapImageManager::mapFilesChanged(const QList<MapInfo*> &mapInfos)
 {
-    QMap<QString,MapImage*>::iterator it_begin = mMapImages.begin();
-    QMap<QString,MapImage*>::iterator it_end = mMapImages.end();
-    QMap<QString,MapImage*>::iterator it;
+    QSet<MapInfo*> changed;
+    for (MapInfo *mapInfo : mapInfos)
+        changed.insert(mapInfo);
 
     MapImageManagerDeferral deferral; // FIXME: optimized out?
 
-    for (it = it_begin; it != it_end; it++) {
-        MapImage *mapImage = it.value();
-        if (mapImage->sources().contains(mapInfo)) {
-            if (mapImage->mLoaded) {
-                bool force = true;
-                ImageData data = generateMapImage(mapImage->mapInfo()->path(), force);
-                paintDummyImage(data, mapInfo);
-                mapImage->mapFileChanged(data.image, data.scale,
-                                         data.levelZeroBounds,
-                                         data.mapSize, data.tileSize);
-                mapImage->mSources.clear();
-                mapImage->mSources += mapImage->mapInfo();
-                mapImage->mLoaded = false;
-                QMetaObject::invokeMethod(mImageRenderWorker,
-                                          "addJob", Qt::QueuedConnection,
-                                          Q_ARG(MapImage*,mapImage));
-                emit mapImageChanged(mapImage);
+    // One pass over the images for the whole batch of changed files.
+    for (MapImage *mapImage : qAsConst(mMapImages)) {
+        MapInfo *mapInfo = nullptr;
+        for (MapInfo *source : mapImage->sources()) {
+            if (changed.contains(source)) {
+                mapInfo = source;
+                break;
             }
         }
+        if (mapInfo == nullptr)
+            continue;
+        if (mapImage->mLoaded) {
+            bool force = true;
+            ImageData data = generateMapImage(mapImage->mapInfo()->path(), force);
+            paintDummyImage(data, mapInfo);
+            mapImage->mapFileChanged(data.image, data.scale,
+                                     data.levelZeroBounds,
+                                     data.mapSize, data.tileSize);
+            mapImage->mSources.clear();
+            mapImage->mSources += mapImage->mapInfo();
+            mapImage->mLoaded = false;
+            QMetaObject::invokeMethod(mImageRenderWorker,
+                                      "addJob", Qt::QueuedConnection,
+                                      Q_ARG(MapImage*,mapImage));
+            emit mapImageChanged(mapImage);
+        }
     }
 }
 
@@ -807,7 +816,7 @@ void MapImageManager::mapLoaded(MapInfo *mapInfo)
 #if 1
     QList<Tileset*> usedTilesets = mRenderMapComposite->usedTilesets();
     usedTilesets.removeAll(TilesetManager::instance()->missingTileset());
-    TilesetManager::instance()->waitForTilesets(usedTilesets);
+    TileMetaInfoMgr::instance()->waitForTilesets(usedTilesets);
 #else
     QSet<Tileset*> usedTilesets;
     foreach (MapComposite *mc, mRenderMapComposite->maps())
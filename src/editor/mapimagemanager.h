@@ -270,7 +270,7 @@ signals:
 private slots:
     void mapAboutToChange(MapInfo *mapInfo);
     void mapChanged(MapInfo *mapInfo);
-    void mapFileChanged(MapInfo *mapInfo);
+    void mapFilesChanged(const QList<MapInfo*> &mapInfos);
 
 private slots:
     void imageLoadedByThread(QImage *image, MapImage *mapImage);
@@ -35,16 +35,23 @@
 using namespace SharedTools;
 
 #include "BuildingEditor/building.h"
+#include "BuildingEditor/buildinglayers.h"
+#include "BuildingEditor/buildingfloor.h"
 #include "BuildingEditor/buildingreader.h"
 #include "BuildingEditor/buildingmap.h"
 #include "BuildingEditor/buildingobjects.h"
 #include "BuildingEditor/buildingtiles.h"
 #include "BuildingEditor/furnituregroups.h"
 
+#include <QCryptographicHash>
 #include <QDebug>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+
+#include <algorithm>
 
 #ifdef QT_NO_DEBUG
 inline QNoDebug noise() { return QNoDebug(); }
@@ -73,37 +80,39 @@ void MapManager::deleteInstance()
 
 MapManager::MapManager() :
     mFileSystemWatcher(new FileSystemWatcher(this)),
+    mHeadersScheduled(false),
     mDeferralDepth(0),
     mDeferralQueued(false),
     mWaitingForMapInfo(nullptr),
-    mNextThreadForJob(0)
+    mNextThreadForJob(0),
+    mBuildingLayersSignalsConnected(false)
 #ifdef WORLDED
     , mReferenceEpoch(0)
+    , mMemoryBudget(qint64(Preferences::instance()->memoryBudget()) * 1024 * 1024)
+    , mMapMemoryUsage(0)
+    , mEvictedMapCount(0)
 #endif
+    , mUseCounter(0)
 {
-    connect(mFileSystemWatcher, &FileSystemWatcher::fileChanged,
-            this, &MapManager::fileChanged);
+    // The watcher batches changes and drops files whose contents didn't
+    // change, so there's no need for another delay here.
+    connect(mFileSystemWatcher, &FileSystemWatcher::pathsChanged,
+            this, &MapManager::filesChanged);
 
-    mChangedFilesTimer.setInterval(500);
-    mChangedFilesTimer.setSingleShot(true);
-    connect(&mChangedFilesTimer, &QTimer::timeout,
-            this, &MapManager::fileChangedTimeout);
+    mHeaderThreadPool.setMaxThreadCount(1);
 
     qRegisterMetaType<MapInfo*>("BuildingEditor::Building*");
     qRegisterMetaType<MapInfo*>("MapInfo*");
+    qRegisterMetaType<QVector<QStringList> >("QVector<QStringList>");
 
     mMapReaderThread.resize(4);
     mMapReaderWorker.resize(mMapReaderThread.size());
     for (int i = 0; i < mMapReaderThread.size(); i++) {
         mMapReaderThread[i] = new InterruptibleThread;
-        mMapReaderWorker[i] = new MapReaderWorker(mMapReaderThread[i], i);
+        mMapReaderWorker[i] = new MapReaderWorker(this, mMapReaderThread[i], i);
         mMapReaderWorker[i]->moveToThread(mMapReaderThread[i]);
-        connect(mMapReaderWorker[i], qOverload<Map*,MapInfo*>(&MapReaderWorker::loaded),
-                this, &MapManager::mapLoadedByThread);
-        connect(mMapReaderWorker[i], qOverload<BuildingEditor::Building*,MapInfo*>(&MapReaderWorker::loaded),
-                this, &MapManager::buildingLoadedByThread);
-        connect(mMapReaderWorker[i], &MapReaderWorker::failedToLoad,
-                this, &MapManager::failedToLoadByThread);
+        connect(mMapReaderWorker[i], &MapReaderWorker::resultReady,
+                this, &MapManager::processThreadResults);
         mMapReaderThread[i]->start();
     }
 
@@ -111,10 +120,18 @@ MapManager::MapManager() :
             this, &MapManager::metaTilesetAdded);
     connect(TileMetaInfoMgr::instance(), &TileMetaInfoMgr::tilesetRemoved,
             this, &MapManager::metaTilesetRemoved);
+
+#ifdef WORLDED
+    connect(Preferences::instance(), &Preferences::memoryBudgetChanged,
+            this, &MapManager::memoryBudgetChanged);
+#endif
 }
 
 MapManager::~MapManager()
 {
+    mHeaderThreadPool.clear();
+    mHeaderThreadPool.waitForDone();
+
     for (int i = 0; i < mMapReaderThread.size(); i++) {
         mMapReaderThread[i]->interrupt(); // stop the long-running task
         mMapReaderThread[i]->quit(); // exit the event loop
@@ -192,6 +209,7 @@ MapInfo *MapManager::loadMap(const QString &mapName, const QString &relativeTo,
     }
 
     if (mMapInfo.contains(mapFilePath) && mMapInfo[mapFilePath]->map()) {
+        touch(mMapInfo[mapFilePath]);
         return mMapInfo[mapFilePath];
     }
 
@@ -207,26 +225,11 @@ MapInfo *MapManager::loadMap(const QString &mapName, const QString &relativeTo,
                                       Q_ARG(int,priority));
         if (!asynch) {
             noise() << "WAITING FOR MAP" << mapName << "with priority" << priority;
-            Q_ASSERT(mWaitingForMapInfo == nullptr);
-            mWaitingForMapInfo = mapInfo;
-            for (int i = 0; i < mDeferredMaps.size(); i++) {
-                MapDeferral md = mDeferredMaps[i];
-                if (md.mapInfo == mapInfo) {
-                    mDeferredMaps.removeAt(i);
-                    mapLoadedByThread(md.map, md.mapInfo);
-                    break;
-                }
-            }
-            while (mapInfo->mLoading) {
-                qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
-            }
-            mWaitingForMapInfo = nullptr;
-            if (!mapInfo->map())
-                return nullptr;
+            return waitForMap(mapInfo);
         }
         return mapInfo;
     }
-    mapInfo->mLoading = true;
+    setLoadingStarted(mapInfo);
     QMetaObject::invokeMethod(mMapReaderWorker[mNextThreadForJob], "addJob",
                               Qt::QueuedConnection, Q_ARG(MapInfo*,mapInfo),
                               Q_ARG(int,priority));
@@ -235,34 +238,157 @@ MapInfo *MapManager::loadMap(const QString &mapName, const QString &relativeTo,
     if (asynch)
         return mapInfo;
 
-    // Wow.  Had a map *finish loading* after the PROGRESS call below displayed
-    // the dialog and started processing events but before the qApp->processEvents()
-    // call below, resulting in a hang because mWaitingForMapInfo wasn't set until
-    // after the PROGRESS call.
-    Q_ASSERT(mWaitingForMapInfo == nullptr);
-    mWaitingForMapInfo = mapInfo;
-
+    // The PROGRESS call below processes events.  If the map finishes loading
+    // then, it is deferred and waitForMap() picks it up from mDeferredMaps.
     PROGRESS progress(tr("Reading %1").arg(fileInfoMap.completeBaseName()));
     foreach (MapReaderWorker *w, mMapReaderWorker)
         QMetaObject::invokeMethod(w, "possiblyRaisePriority",
                                   Qt::QueuedConnection, Q_ARG(MapInfo*,mapInfo),
                                   Q_ARG(int,priority));
     noise() << "WAITING FOR MAP" << mapName << "with priority" << priority;
+    return waitForMap(mapInfo);
+}
+
+MapLoadFuture MapManager::loadMapAsync(const QString &mapName, const QString &relativeTo,
+                                       LoadPriority priority)
+{
+    if (MapInfo *mapInfo = loadMap(mapName, relativeTo, true, priority))
+        return MapLoadFuture(mapInfo);
+    return MapLoadFuture();
+}
+
+MapInfo *MapManager::waitForMap(MapInfo *mapInfo)
+{
+    if (QThread::currentThread() != thread()) {
+        // The GUI thread finishes loading the map, all we can do is wait.
+        QMutexLocker locker(&mLoadingMutex);
+        while (mapInfo->mLoading)
+            mLoadingCondition.wait(&mLoadingMutex);
+        return mapInfo->mMap ? mapInfo : nullptr;
+    }
+
+    if (mapInfo->mLoading) {
+        // Handle the result for this map even if thread results are being
+        // deferred.  The caller may be nested inside another waitForMap().
+        MapInfo *waitingFor = mWaitingForMapInfo;
+        mWaitingForMapInfo = mapInfo;
+        while (mapInfo->mLoading) {
+            if (!takeDeferredMap(mapInfo))
+                waitForThreadResults();
+        }
+        mWaitingForMapInfo = waitingFor;
+    }
+
+    return mapInfo->mMap ? mapInfo : nullptr;
+}
+
+void MapManager::waitForThreadResults(unsigned long msecs)
+{
+    IN_APP_THREAD
+
+    {
+        QMutexLocker locker(&mThreadResultsMutex);
+        if (mThreadResults.isEmpty())
+            mThreadResultsCondition.wait(&mThreadResultsMutex, msecs);
+    }
+
+    processThreadResults();
+
+    // processDeferrals() was queued, but the caller isn't running the event loop.
+    if (mDeferralDepth == 0 && !mDeferredMaps.isEmpty())
+        processDeferrals();
+}
+
+void MapManager::whenLoaded(MapInfo *mapInfo, QObject *context,
+                            std::function<void(MapInfo*)> callback)
+{
+    IN_APP_THREAD
+
+    if (!mapInfo->mLoading) {
+        callback(mapInfo->mMap ? mapInfo : nullptr);
+        return;
+    }
+
+    LoadCallback lc;
+    lc.context = context;
+    lc.callback = callback;
+    mLoadCallbacks.insert(mapInfo, lc);
+}
+
+void MapManager::addThreadResult(const ThreadResult &result)
+{
+    QMutexLocker locker(&mThreadResultsMutex);
+    mThreadResults += result;
+    mThreadResultsCondition.wakeAll();
+}
+
+QSharedPointer<const BuildingLayers> MapManager::cachedBuildingLayers(const QByteArray &hash)
+{
+    QMutexLocker locker(&mBuildingLayersMutex);
+    return mBuildingLayers.value(hash);
+}
+
+void MapManager::addBuildingLayersToCache(const QByteArray &hash,
+                                          const QSharedPointer<const BuildingLayers> &layers)
+{
+    QMutexLocker locker(&mBuildingLayersMutex);
+    if (mBuildingLayers.contains(hash))
+        return;
+    while (mBuildingLayersOrder.size() >= MaxCachedBuildings)
+        mBuildingLayers.remove(mBuildingLayersOrder.takeFirst());
+    mBuildingLayers.insert(hash, layers);
+    mBuildingLayersOrder += hash;
+}
+
+void MapManager::clearBuildingLayersCache()
+{
+    QMutexLocker locker(&mBuildingLayersMutex);
+    mBuildingLayers.clear();
+    mBuildingLayersOrder.clear();
+}
+
+bool MapManager::isLoadingFinished(MapInfo *mapInfo)
+{
+    QMutexLocker locker(&mLoadingMutex);
+    return !mapInfo->mLoading;
+}
+
+bool MapManager::takeDeferredMap(MapInfo *mapInfo)
+{
     for (int i = 0; i < mDeferredMaps.size(); i++) {
         MapDeferral md = mDeferredMaps[i];
         if (md.mapInfo == mapInfo) {
             mDeferredMaps.removeAt(i);
             mapLoadedByThread(md.map, md.mapInfo);
-            break;
+            return true;
         }
     }
-    while (mapInfo->mLoading) {
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+    return false;
+}
+
+void MapManager::setLoadingStarted(MapInfo *mapInfo)
+{
+    QMutexLocker locker(&mLoadingMutex);
+    mapInfo->mLoading = true;
+}
+
+void MapManager::setLoadingFinished(MapInfo *mapInfo)
+{
+    QMutexLocker locker(&mLoadingMutex);
+    mapInfo->mLoading = false;
+    mLoadingCondition.wakeAll();
+}
+
+void MapManager::runCallbacks(MapInfo *mapInfo)
+{
+    // QMultiMap::values() returns the most-recently inserted value first.
+    const QList<LoadCallback> callbacks = mLoadCallbacks.values(mapInfo);
+    mLoadCallbacks.remove(mapInfo);
+    for (int i = callbacks.size() - 1; i >= 0; --i) {
+        const LoadCallback &lc = callbacks[i];
+        if (lc.context)
+            lc.callback(mapInfo->mMap ? mapInfo : nullptr);
     }
-    mWaitingForMapInfo = nullptr;
-    if (mapInfo->map())
-        return mapInfo;
-    return nullptr;
 }
 
 MapInfo *MapManager::newFromMap(Map *map, const QString &mapFilePath)
@@ -490,6 +616,41 @@ public:
     QString mError;
 };
 
+/**
+  * Re-reads the properties of a batch of changed map files.
+  */
+class MapHeaderTask : public QRunnable
+{
+public:
+    MapHeaderTask(MapManager *manager, const QStringList &paths) :
+        mManager(manager),
+        mPaths(paths)
+    {
+    }
+
+    void run() override
+    {
+        QList<MapManager::MapHeader> headers;
+        for (const QString &path : qAsConst(mPaths)) {
+            MapManager::MapHeader header;
+            header.path = path;
+            header.valid = false;
+            MapInfoReader reader;
+            if (MapInfo *mapInfo = reader.readMap(path)) {
+                header.valid = true;
+                header.properties = mapInfo->properties();
+                delete mapInfo;
+            }
+            headers += header;
+        }
+        mManager->mapHeadersRead(headers);
+    }
+
+private:
+    MapManager *mManager;
+    QStringList mPaths;
+};
+
 MapInfo *MapManager::mapInfo(const QString &mapFilePath)
 {
     if (mMapInfo.contains(mapFilePath))
@@ -576,6 +737,7 @@ void MapManager::addReferenceToMap(MapInfo *mapInfo)
     if (mapInfo->mMap) {
         mapInfo->mMapRefCount++;
         mapInfo->mReferenceEpoch = mReferenceEpoch;
+        touch(mapInfo);
         if (mapInfo->mMapRefCount == 1)
             ++mReferenceEpoch;
         noise() << "MapManager refCount++ =" << mapInfo->mMapRefCount << mapInfo->mFilePath;
@@ -588,6 +750,7 @@ void MapManager::removeReferenceToMap(MapInfo *mapInfo)
     if (mapInfo->mMap) {
         Q_ASSERT(mapInfo->mMapRefCount > 0);
         mapInfo->mMapRefCount--;
+        touch(mapInfo);
         noise() << "MapManager refCount-- =" << mapInfo->mMapRefCount << mapInfo->mFilePath;
         purgeUnreferencedMaps();
     }
@@ -602,15 +765,81 @@ void MapManager::purgeUnreferencedMaps()
                 ((bigMap && (mapInfo->mReferenceEpoch <= mReferenceEpoch - 10)) ||
                 (mapInfo->mReferenceEpoch <= mReferenceEpoch - 50))) {
             noise() << "MapManager purging" << mapInfo->mFilePath;
-            TilesetManager *tilesetMgr = TilesetManager::instance();
-            tilesetMgr->removeReferences(mapInfo->mMap->tilesets());
-            delete mapInfo->mMap;
-            mapInfo->mMap = 0;
+            purgeMap(mapInfo);
         }
         else if (mapInfo->mMap && mapInfo->mMapRefCount <= 0)
             unpurged++;
     }
     if (unpurged) noise() << "MapManager unpurged =" << unpurged;
+
+    enforceMemoryBudget();
+}
+
+void MapManager::purgeMap(MapInfo *mapInfo)
+{
+    TilesetManager *tilesetMgr = TilesetManager::instance();
+    tilesetMgr->removeReferences(mapInfo->mMap->tilesets());
+    delete mapInfo->mMap;
+    mapInfo->mMap = 0;
+    mMapMemoryUsage -= mapInfo->mMemoryUsage;
+    mapInfo->mMemoryUsage = 0;
+}
+
+bool MapManager::canEvict(MapInfo *mapInfo) const
+{
+    // A map loaded during the current epoch has no references yet because
+    // whoever asked for it hasn't had a chance to add one.
+    return mapInfo->mMap && (mapInfo->mMapRefCount <= 0)
+            && !mapInfo->mLoading && !mapInfo->mBeingEdited
+            && (mapInfo->mReferenceEpoch < mReferenceEpoch);
+}
+
+void MapManager::setMemoryBudget(qint64 bytes)
+{
+    mMemoryBudget = bytes;
+    enforceMemoryBudget();
+}
+
+void MapManager::enforceMemoryBudget()
+{
+    if (mMemoryBudget <= 0)
+        return;
+
+    TilesetManager *tilesetMgr = TilesetManager::instance();
+    // Both totals are kept up to date as maps and images are loaded and
+    // purged, so this is cheap when under budget.
+    qint64 excess = memoryUsage() + tilesetMgr->memoryUsage() - mMemoryBudget;
+    if (excess <= 0)
+        return;
+
+    QList<QPair<quint64,MapInfo*>> candidates;
+    foreach (MapInfo *mapInfo, mMapInfo) {
+        if (canEvict(mapInfo))
+            candidates += qMakePair(mapInfo->mLastUsed, mapInfo);
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (const QPair<quint64,MapInfo*> &candidate : qAsConst(candidates)) {
+        if (excess <= 0)
+            break;
+        MapInfo *mapInfo = candidate.second;
+        noise() << "MapManager evicting" << mapInfo->mFilePath << mapInfo->mMemoryUsage << "bytes";
+        excess -= mapInfo->mMemoryUsage;
+        purgeMap(mapInfo);
+        ++mEvictedMapCount;
+    }
+
+    // Evicting maps may have released the last reference to some tilesets.
+    if (excess > 0)
+        excess -= tilesetMgr->purgeUnusedImages(excess);
+
+    if (excess > 0)
+        noise() << "MapManager over budget by" << excess << "bytes";
+}
+
+void MapManager::memoryBudgetChanged(int megabytes)
+{
+    setMemoryBudget(qint64(megabytes) * 1024 * 1024);
 }
 
 void MapManager::newMapFileCreated(const QString &path)
@@ -618,14 +847,17 @@ void MapManager::newMapFileCreated(const QString &path)
     // If a cell view is open with a placeholder map and that map now exists,
     // read the new map and allow the cell-scene to update itself.
     // This code is 90% the same as fileChangedTimeout().
+    QStringList paths;
     foreach (MapInfo *mapInfo, mMapInfo) {
         if (!mapInfo->mPlaceholder || !mapInfo->mMap)
             continue;
         if (QFileInfo(mapInfo->path()) != QFileInfo(path))
             continue;
         mFileSystemWatcher->addPath(mapInfo->path()); // FIXME: make canonical?
-        fileChanged(mapInfo->path());
+        paths += mapInfo->path();
     }
+    if (!paths.isEmpty())
+        filesChanged(paths);
 
     emit mapFileCreated(path);
 }
@@ -667,10 +899,11 @@ Map *MapManager::convertOrientation(Map *map, Tiled::Map::Orientation orient)
     return map;
 }
 
-void MapManager::fileChanged(const QString &path)
+void MapManager::filesChanged(const QStringList &paths)
 {
-    mChangedFiles.insert(path);
-    mChangedFilesTimer.start();
+    for (const QString &path : paths)
+        mChangedFiles.insert(path);
+    fileChangedTimeout();
 }
 
 void MapManager::fileChangedTimeout()
@@ -679,57 +912,95 @@ void MapManager::fileChangedTimeout()
     PROGRESS progress(tr("Examining changed maps..."));
 #endif
 
+    QStringList changed;
     foreach (const QString &path, mChangedFiles) {
         if (mMapInfo.contains(path)) {
             noise() << "MapManager::fileChanged" << path;
-            mFileSystemWatcher->removePath(path);
+            // The watcher re-arms paths of replaced files itself.
             QFileInfo info(path);
             if (info.exists()) {
-                mFileSystemWatcher->addPath(path);
                 MapInfo *mapInfo = mMapInfo[path];
                 if (mapInfo->map()) {
                     Q_ASSERT(!mapInfo->isBeingEdited());
                     if (!mapInfo->isLoading()) {
-                        mapInfo->mLoading = true; // FIXME: seems weird to change this for a loaded map
+                        setLoadingStarted(mapInfo); // FIXME: seems weird to change this for a loaded map
                         QMetaObject::invokeMethod(mMapReaderWorker[mNextThreadForJob], "addJob",
                                                   Qt::QueuedConnection, Q_ARG(MapInfo*,mapInfo),
                                                   Q_ARG(int,PriorityLow));
                         mNextThreadForJob = (mNextThreadForJob + 1) % mMapReaderThread.size();
                     }
                 }
-                {
-                    MapInfoReader reader;
-                    if (MapInfo *mapInfo2 = reader.readMap(path)) {
-                        mapInfo->properties() = mapInfo2->properties();
-                        delete mapInfo2;
-                    }
-                }
-                emit mapFileChanged(mapInfo);
+                changed += path;
             }
         }
     }
 
     mChangedFiles.clear();
+
+    // The properties are read from the map headers on a worker thread,
+    // mapFilesChanged() is emitted once they are known.
+    if (!changed.isEmpty())
+        mHeaderThreadPool.start(new MapHeaderTask(this, changed));
+}
+
+void MapManager::mapHeadersRead(const QList<MapHeader> &headers)
+{
+    QMutexLocker locker(&mHeadersMutex);
+    mHeaders += headers;
+    if (!mHeadersScheduled) {
+        mHeadersScheduled = true;
+        QMetaObject::invokeMethod(this, "processMapHeaders", Qt::QueuedConnection);
+    }
+}
+
+void MapManager::processMapHeaders()
+{
+    QList<QList<MapHeader> > batches;
+    {
+        QMutexLocker locker(&mHeadersMutex);
+        batches.swap(mHeaders);
+        mHeadersScheduled = false;
+    }
+
+    for (const QList<MapHeader> &headers : qAsConst(batches)) {
+        QList<MapInfo*> mapInfos;
+        for (const MapHeader &header : headers) {
+            MapInfo *mapInfo = mMapInfo.value(header.path);
+            if (mapInfo == nullptr)
+                continue;
+            if (header.valid)
+                mapInfo->properties() = header.properties;
+            mapInfos += mapInfo;
+        }
+        if (!mapInfos.isEmpty())
+            emit mapFilesChanged(mapInfos);
+    }
 }
 
 void MapManager::metaTilesetAdded(Tileset *tileset)
 {
     Q_UNUSED(tileset)
+    QStringList paths;
     foreach (MapInfo *mapInfo, mMapInfo) {
         if (mapInfo->map() && mapInfo->path().endsWith(QLatin1String(".tbx"))
                 && mapInfo->map()->hasUsedMissingTilesets())
-            fileChanged(mapInfo->path());
+            paths += mapInfo->path();
     }
+    if (!paths.isEmpty())
+        filesChanged(paths);
 }
 
 void MapManager::metaTilesetRemoved(Tileset *tileset)
 {
     Q_UNUSED(tileset)
+    QStringList paths;
     foreach (MapInfo *mapInfo, mMapInfo) {
         if (mapInfo->map() && mapInfo->path().endsWith(QLatin1String(".tbx"))
                 && mapInfo->map()->usedTilesets().contains(tileset))
-            fileChanged(mapInfo->path());
+            paths += mapInfo->path();
     }
+    if (!paths.isEmpty())
+        filesChanged(paths);
 }
 
 void MapManager::mapLoadedByThread(Map *map, MapInfo *mapInfo)
@@ -776,7 +1047,15 @@ void MapManager::mapLoadedByThread(Map *map, MapInfo *mapInfo)
     mapInfo->mTileWidth = map->tileWidth();
     mapInfo->mTileHeight = map->tileHeight();
     mapInfo->mPlaceholder = false;
-    mapInfo->mLoading = false;
+    setLoadingFinished(mapInfo);
+#ifdef WORLDED
+    mMapMemoryUsage -= mapInfo->mMemoryUsage;
+#endif
+    mapInfo->mMemoryUsage = map->memoryUsage();
+#ifdef WORLDED
+    mMapMemoryUsage += mapInfo->mMemoryUsage;
+#endif
+    touch(mapInfo);
 
     if (replace)
         emit mapChanged(mapInfo);
@@ -788,29 +1067,45 @@ void MapManager::mapLoadedByThread(Map *map, MapInfo *mapInfo)
 #endif
 
     emit mapLoaded(mapInfo);
+    runCallbacks(mapInfo);
 }
 
-void MapManager::buildingLoadedByThread(Building *building, MapInfo *mapInfo)
+void MapManager::buildingLoadedByThread(const ThreadResult &result)
 {
-    MapManagerDeferral deferral;
-
     BuildingReader reader;
-    reader.fix(building);
+    reader.fix(result.building);
+
+    // The cached tile layers depend on Tiles.txt and furniture as well as
+    // the .tbx file.
+    if (!mBuildingLayersSignalsConnected) {
+        connect(BuildingTilesMgr::instance(), &BuildingTilesMgr::entryTileChanged,
+                this, &MapManager::clearBuildingLayersCache);
+        connect(FurnitureGroups::instance(), &FurnitureGroups::furnitureTileChanged,
+                this, &MapManager::clearBuildingLayersCache);
+        connect(FurnitureGroups::instance(), &FurnitureGroups::furnitureLayerChanged,
+                this, &MapManager::clearBuildingLayersCache);
+        mBuildingLayersSignalsConnected = true;
+    }
 
-    BuildingMap::loadNeededTilesets(building);
+    // Hand the building back to a reader thread to lay out its squares.
+    QVector<QStringList> layerNames = BuildingLayers::prepare(result.building);
+    QMetaObject::invokeMethod(mMapReaderWorker[mNextThreadForJob], "addBuildingJob",
+                              Qt::QueuedConnection, Q_ARG(MapInfo*,result.mapInfo),
+                              Q_ARG(BuildingEditor::Building*,result.building),
+                              Q_ARG(QVector<QStringList>,layerNames),
+                              Q_ARG(QByteArray,result.buildingHash),
+                              Q_ARG(int,result.priority));
+    mNextThreadForJob = (mNextThreadForJob + 1) % mMapReaderThread.size();
+}
 
-    BuildingMap bmap(building);
-    Map *map = bmap.mergedMap();
-    bmap.addRoomDefObjects(map);
+void MapManager::buildingConvertedByThread(const QSharedPointer<const BuildingLayers> &layers,
+                                           MapInfo *mapInfo)
+{
+    MapManagerDeferral deferral;
 
-#if 0
-    map->setProperty(QStringLiteral("Legend"), QStringLiteral("CommunityServices"));
-    map->setProperty(QStringLiteral("File"), QFileInfo(mapInfo->path()).fileName());
-#else
-    map->setProperties(building->properties());
-#endif
+    BuildingMap::loadNeededTilesets(layers->tilesetNames());
 
-    delete building;
+    Map *map = layers->toMap();
 
     QSet<Tileset*> usedTilesets = map->usedTilesets();
     usedTilesets.remove(TilesetManager::instance()->missingTileset());
@@ -826,9 +1121,30 @@ void MapManager::buildingLoadedByThread(Building *building, MapInfo *mapInfo)
 
 void MapManager::failedToLoadByThread(const QString error, MapInfo *mapInfo)
 {
-    mapInfo->mLoading = false;
+    setLoadingFinished(mapInfo);
     mError = error;
     emit mapFailedToLoad(mapInfo);
+    runCallbacks(mapInfo);
+}
+
+void MapManager::processThreadResults()
+{
+    QList<ThreadResult> results;
+    {
+        QMutexLocker locker(&mThreadResultsMutex);
+        results.swap(mThreadResults);
+    }
+
+    for (const ThreadResult &result : qAsConst(results)) {
+        if (result.map)
+            mapLoadedByThread(result.map, result.mapInfo);
+        else if (result.buildingLayers)
+            buildingConvertedByThread(result.buildingLayers, result.mapInfo);
+        else if (result.building)
+            buildingLoadedByThread(result);
+        else
+            failedToLoadByThread(result.error, result.mapInfo);
+    }
 }
 
 void MapManager::deferThreadResults(bool defer)
@@ -864,8 +1180,34 @@ void MapManager::processDeferrals()
 
 /////
 
-MapReaderWorker::MapReaderWorker(InterruptibleThread *thread, int id) :
+bool MapLoadFuture::isFinished() const
+{
+    return mMapInfo ? MapManager::instance()->isLoadingFinished(mMapInfo) : true;
+}
+
+MapInfo *MapLoadFuture::result() const
+{
+    return (mMapInfo && mMapInfo->map()) ? mMapInfo : nullptr;
+}
+
+MapInfo *MapLoadFuture::waitForFinished() const
+{
+    return mMapInfo ? MapManager::instance()->waitForMap(mMapInfo) : nullptr;
+}
+
+void MapLoadFuture::then(QObject *context, std::function<void(MapInfo*)> callback) const
+{
+    if (mMapInfo)
+        MapManager::instance()->whenLoaded(mMapInfo, context, callback);
+    else
+        callback(nullptr);
+}
+
+/////
+
+MapReaderWorker::MapReaderWorker(MapManager *manager, InterruptibleThread *thread, int id) :
     BaseWorker(thread),
+    mManager(manager),
     mID(id)
 {
 }
@@ -880,6 +1222,8 @@ void MapReaderWorker::work()
 
     if (mJobs.size()) {
         if (aborted()) {
+            foreach (const Job &job, mJobs)
+                delete job.building;
             mJobs.clear();
             return;
         }
@@ -887,21 +1231,25 @@ void MapReaderWorker::work()
         Job job = mJobs.takeFirst();
         debugJobs("take job");
 
-        if (job.mapInfo->path().endsWith(QLatin1String(".tbx"))) {
-            Building *building = loadBuilding(job.mapInfo);
-            if (building)
-                emit loaded(building, job.mapInfo);
-            else
-                emit failedToLoad(mError, job.mapInfo);
+        MapManager::ThreadResult result;
+        result.mapInfo = job.mapInfo;
+        result.priority = job.priority;
+        result.map = nullptr;
+        result.building = nullptr;
+        if (job.building) {
+            result.buildingLayers = convertBuilding(job);
+        } else if (job.mapInfo->path().endsWith(QLatin1String(".tbx"))) {
+            result.building = loadBuilding(job.mapInfo, result.buildingHash,
+                                           result.buildingLayers);
         } else {
 //            noise() << "READING STARTED" << job.mapInfo->path();
-            Map *map = loadMap(job.mapInfo);
+            result.map = loadMap(job.mapInfo);
 //            noise() << "READING FINISHED" << job.mapInfo->path();
-            if (map)
-                emit loaded(map, job.mapInfo);
-            else
-                emit failedToLoad(mError, job.mapInfo);
         }
+        if (!result.map && !result.building && !result.buildingLayers)
+            result.error = mError;
+        mManager->addThreadResult(result);
+        emit resultReady();
 
 //        QCoreApplication::processEvents(); // handle changing job priority
     }
@@ -913,11 +1261,29 @@ void MapReaderWorker::addJob(MapInfo *mapInfo, int priority)
 {
     IN_WORKER_THREAD
 
+    insertJob(Job(mapInfo, priority));
+}
+
+void MapReaderWorker::addBuildingJob(MapInfo *mapInfo, Building *building,
+                                     const QVector<QStringList> &layerNames,
+                                     const QByteArray &hash, int priority)
+{
+    IN_WORKER_THREAD
+
+    Job job(mapInfo, priority);
+    job.building = building;
+    job.layerNames = layerNames;
+    job.buildingHash = hash;
+    insertJob(job);
+}
+
+void MapReaderWorker::insertJob(const Job &job)
+{
     int index = 0;
-    while ((index < mJobs.size()) && (mJobs[index].priority >= priority))
+    while ((index < mJobs.size()) && (mJobs[index].priority >= job.priority))
         ++index;
 
-    mJobs.insert(index, Job(mapInfo, priority));
+    mJobs.insert(index, job);
     debugJobs("add job");
     scheduleWork();
 }
@@ -965,15 +1331,42 @@ Map *MapReaderWorker::loadMap(MapInfo *mapInfo)
     return map;
 }
 
-Building *MapReaderWorker::loadBuilding(MapInfo *mapInfo)
+Building *MapReaderWorker::loadBuilding(MapInfo *mapInfo, QByteArray &hash,
+                                       QSharedPointer<const BuildingLayers> &cached)
 {
     BuildingReader reader;
-    Building *building = reader.read(mapInfo->path());
+    QByteArray contents;
+    if (!reader.readFile(mapInfo->path(), contents)) {
+        mError = reader.errorString();
+        return nullptr;
+    }
+
+    // An unchanged file needn't be parsed or converted again.  The grime
+    // tiles depend on newtiledefinitions.tiles too, so its revision is part
+    // of the key.
+    QCryptographicHash sha1(QCryptographicHash::Sha1);
+    sha1.addData(contents);
+    const QByteArray tileDefRevision = QByteArray::number(BuildingEditor::tileDefRevision());
+    sha1.addData(tileDefRevision);
+    hash = sha1.result();
+    cached = mManager->cachedBuildingLayers(hash);
+    if (cached)
+        return nullptr;
+
+    Building *building = reader.read(contents, mapInfo->path());
     if (!building)
         mError = reader.errorString();
     return building;
 }
 
+QSharedPointer<const BuildingLayers> MapReaderWorker::convertBuilding(const Job &job)
+{
+    QSharedPointer<const BuildingLayers> layers(BuildingLayers::convert(job.building, job.layerNames));
+    delete job.building;
+    mManager->addBuildingLayersToCache(job.buildingHash, layers);
+    return layers;
+}
+
 void MapReaderWorker::debugJobs(const char *msg)
 {
     QStringList out;
@@ -23,49 +23,73 @@
 #include "threads.h"
 
 #include <QDateTime>
+#include <QHash>
 #include <QMap>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThreadPool>
 #include <QTimer>
 
+#include <functional>
+
 class MapInfo;
+class MapManager;
 
 namespace BuildingEditor {
 class Building;
+class BuildingLayers;
 }
 
 class MapReaderWorker : public BaseWorker
 {
     Q_OBJECT
 public:
-    MapReaderWorker(InterruptibleThread *thread, int id);
+    MapReaderWorker(MapManager *manager, InterruptibleThread *thread, int id);
     ~MapReaderWorker();
 
 signals:
-    void loaded(Tiled::Map *map, MapInfo *mapInfo);
-    void loaded(BuildingEditor::Building *building, MapInfo *mapInfo);
-    void failedToLoad(const QString error, MapInfo *mapInfo);
+    /**
+      * Emitted after a result was handed to MapManager::addThreadResult().
+      * The result may already have been consumed by MapManager::waitForMap().
+      */
+    void resultReady();
 
 public slots:
     void work();
     void addJob(MapInfo *mapInfo, int priority);
+    void addBuildingJob(MapInfo *mapInfo, BuildingEditor::Building *building,
+                        const QVector<QStringList> &layerNames,
+                        const QByteArray &hash, int priority);
     void possiblyRaisePriority(MapInfo *mapInfo, int priority);
 
 private:
-    Tiled::Map *loadMap(MapInfo *mapInfo);
-    BuildingEditor::Building *loadBuilding(MapInfo *mapInfo);
-
     class Job {
     public:
         Job(MapInfo *mapInfo, int priority) :
             mapInfo(mapInfo),
-            priority(priority)
+            priority(priority),
+            building(nullptr)
         {
         }
 
         MapInfo *mapInfo;
         int priority;
+
+        // A .tbx that was read and fixed, to be converted to tile layers.
+        BuildingEditor::Building *building;
+        QVector<QStringList> layerNames;
+        QByteArray buildingHash;
     };
+
+    Tiled::Map *loadMap(MapInfo *mapInfo);
+    BuildingEditor::Building *loadBuilding(MapInfo *mapInfo, QByteArray &hash,
+                                           QSharedPointer<const BuildingEditor::BuildingLayers> &cached);
+    QSharedPointer<const BuildingEditor::BuildingLayers> convertBuilding(const Job &job);
+    void insertJob(const Job &job);
     QList<Job> mJobs;
 
+    MapManager *mManager;
     int mID;
     void debugJobs(const char *msg);
 
@@ -91,6 +115,8 @@ public:
         , mReferenceEpoch(0)
 #endif
         , mLoading(false)
+        , mMemoryUsage(0)
+        , mLastUsed(0)
     {
 
     }
@@ -121,6 +147,17 @@ public:
     }
     Tiled::Properties &properties() { return mProperties; }
 
+#ifdef WORLDED
+    int referenceCount() const { return mMapRefCount; }
+#endif
+
+    /**
+      * The number of bytes used by the loaded map, as of when it was loaded.
+      */
+    qint64 memoryUsage() const { return mMemoryUsage; }
+
+    quint64 lastUsed() const { return mLastUsed; }
+
 private:
     Tiled::Map::Orientation mOrientation;
     int mWidth;
@@ -137,10 +174,58 @@ private:
 #endif
     bool mLoading;
     Tiled::Properties mProperties;
+    qint64 mMemoryUsage;
+    quint64 mLastUsed;
 
     friend class MapManager;
 };
 
+/**
+  * A handle to a map that is being loaded by MapManager's reader threads.
+  * MapManager::loadMapAsync() returns one of these.
+  */
+class MapLoadFuture
+{
+public:
+    MapLoadFuture() :
+        mMapInfo(nullptr)
+    {}
+
+    explicit MapLoadFuture(MapInfo *mapInfo) :
+        mMapInfo(mapInfo)
+    {}
+
+    bool isValid() const { return mMapInfo != nullptr; }
+    MapInfo *mapInfo() const { return mMapInfo; }
+
+    /**
+      * Returns true once the map has finished loading or failed to load.
+      */
+    bool isFinished() const;
+
+    /**
+      * Returns the MapInfo if its map was loaded, or nullptr if loading failed.
+      * Only meaningful once isFinished() returns true.
+      */
+    MapInfo *result() const;
+
+    /**
+      * Blocks until the map has finished loading, without processing events.
+      * May be called from any thread.
+      */
+    MapInfo *waitForFinished() const;
+
+    /**
+      * Calls \a callback on the GUI thread once the map has finished loading.
+      * The callback is called immediately if that has already happened, and
+      * is dropped if \a context is deleted first.
+      */
+    void then(QObject *context, std::function<void(MapInfo*)> callback) const;
+
+private:
+    MapInfo *mMapInfo;
+};
+
 class MapManager : public QObject
 {
     Q_OBJECT
@@ -165,6 +250,52 @@ public:
                      const QString &relativeTo = QString(),
                      bool asynch = false, LoadPriority priority = PriorityHigh);
 
+    /**
+      * Starts loading a map in a reader thread.  The returned future is
+      * invalid if the map file couldn't be found or read; see errorString().
+      */
+    MapLoadFuture loadMapAsync(const QString &mapName,
+                               const QString &relativeTo = QString(),
+                               LoadPriority priority = PriorityMedium);
+
+    /**
+      * Blocks until \a mapInfo has finished loading.  On the GUI thread this
+      * finishes the results of the reader threads itself; on any other thread
+      * it waits for the GUI thread to do so.  Returns nullptr if the map
+      * failed to load.
+      */
+    MapInfo *waitForMap(MapInfo *mapInfo);
+
+    /**
+      * GUI thread only.  Waits up to \a msecs for any reader thread to finish,
+      * then handles every available result as if the event loop had run.
+      * Use this instead of QCoreApplication::processEvents() when waiting for
+      * a MapComposite's sub-maps.
+      */
+    void waitForThreadResults(unsigned long msecs = 100);
+
+    void whenLoaded(MapInfo *mapInfo, QObject *context,
+                    std::function<void(MapInfo*)> callback);
+
+    // Called by MapReaderWorker in a reader thread.
+    struct ThreadResult
+    {
+        MapInfo *mapInfo;
+        int priority;
+        Tiled::Map *map;
+        BuildingEditor::Building *building; // read but not yet converted
+        QByteArray buildingHash;
+        QSharedPointer<const BuildingEditor::BuildingLayers> buildingLayers;
+        QString error;
+    };
+    void addThreadResult(const ThreadResult &result);
+
+    // Called by MapReaderWorker in a reader thread.  Converted buildings are
+    // cached by the SHA-1 hash of the .tbx file's contents.
+    QSharedPointer<const BuildingEditor::BuildingLayers> cachedBuildingLayers(const QByteArray &hash);
+    void addBuildingLayersToCache(const QByteArray &hash,
+                                  const QSharedPointer<const BuildingEditor::BuildingLayers> &layers);
+
     MapInfo *newFromMap(Tiled::Map *map, const QString &mapFilePath = QString());
 
     MapInfo *mapInfo(const QString &mapFilePath);
@@ -199,6 +330,29 @@ public:
     void purgeUnreferencedMaps();
 
     void newMapFileCreated(const QString &path);
+
+    /**
+      * Returns the number of bytes used by all loaded maps, as of when they
+      * were loaded.  Tileset images are accounted for by the TilesetManager.
+      */
+    qint64 memoryUsage() const
+    { return mMapMemoryUsage; }
+
+    /**
+      * When the combined size of loaded maps and tileset images exceeds
+      * the budget, unreferenced maps and then unused tileset images are
+      * discarded, least-recently used first.  A budget <= 0 means no limit.
+      */
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const
+    { return mMemoryBudget; }
+    void enforceMemoryBudget();
+
+    int evictedMapCount() const
+    { return mEvictedMapCount; }
+
+    QList<MapInfo*> mapInfos() const
+    { return mMapInfo.values(); }
 #endif
     QString errorString() const
     { return mError; }
@@ -206,7 +360,11 @@ public:
 signals:
     void mapAboutToChange(MapInfo *mapInfo);
     void mapChanged(MapInfo *mapInfo);
-    void mapFileChanged(MapInfo *mapInfo);
+    /**
+      * Emitted once for each batch of map files that changed on disk, after
+      * the properties of their MapInfos were re-read.
+      */
+    void mapFilesChanged(const QList<MapInfo*> &mapInfos);
 #ifdef WORLDED
     void mapFileCreated(const QString &path);
 #endif
@@ -214,29 +372,53 @@ signals:
     void mapFailedToLoad(MapInfo *mapInfo);
 
 private slots:
-    void fileChanged(const QString &path);
+    void filesChanged(const QStringList &paths);
     void fileChangedTimeout();
+    void processMapHeaders();
 
     void metaTilesetAdded(Tiled::Tileset *tileset);
     void metaTilesetRemoved(Tiled::Tileset *tileset);
 
+    void processThreadResults();
     void mapLoadedByThread(Tiled::Map *map, MapInfo *mapInfo);
-    void buildingLoadedByThread(BuildingEditor::Building *building, MapInfo *mapInfo);
     void failedToLoadByThread(const QString error, MapInfo *mapInfo);
 
     void processDeferrals();
 
+#ifdef WORLDED
+    void memoryBudgetChanged(int megabytes);
+#endif
+
+    void clearBuildingLayersCache();
+
 private:
     Q_DISABLE_COPY(MapManager)
     static MapManager *mInstance;
     MapManager();
     ~MapManager();
 
+    void buildingLoadedByThread(const ThreadResult &result);
+    void buildingConvertedByThread(const QSharedPointer<const BuildingEditor::BuildingLayers> &layers,
+                                   MapInfo *mapInfo);
+
     QMap<QString,MapInfo*> mMapInfo;
 
     Tiled::Internal::FileSystemWatcher *mFileSystemWatcher;
     QSet<QString> mChangedFiles;
-    QTimer mChangedFilesTimer;
+
+    // Re-reads the headers of changed map files.
+    friend class MapHeaderTask;
+    struct MapHeader
+    {
+        QString path;
+        bool valid;
+        Tiled::Properties properties;
+    };
+    void mapHeadersRead(const QList<MapHeader> &headers);
+    QThreadPool mHeaderThreadPool;
+    QMutex mHeadersMutex;
+    QList<QList<MapHeader> > mHeaders;
+    bool mHeadersScheduled;
 
     friend class MapManagerDeferral;
     void deferThreadResults(bool defer);
@@ -258,9 +440,42 @@ private:
     QVector<InterruptibleThread*> mMapReaderThread;
     QVector<MapReaderWorker*> mMapReaderWorker;
     int mNextThreadForJob;
+
+    QMutex mThreadResultsMutex;
+    QWaitCondition mThreadResultsCondition;
+    QList<ThreadResult> mThreadResults;
+
+    QMutex mBuildingLayersMutex;
+    QHash<QByteArray,QSharedPointer<const BuildingEditor::BuildingLayers> > mBuildingLayers;
+    QList<QByteArray> mBuildingLayersOrder;
+    bool mBuildingLayersSignalsConnected;
+    static const int MaxCachedBuildings = 256;
+
+    friend class MapLoadFuture;
+    bool isLoadingFinished(MapInfo *mapInfo);
+    bool takeDeferredMap(MapInfo *mapInfo);
+    void setLoadingStarted(MapInfo *mapInfo);
+    void setLoadingFinished(MapInfo *mapInfo);
+    void runCallbacks(MapInfo *mapInfo);
+    QMutex mLoadingMutex;
+    QWaitCondition mLoadingCondition;
+    struct LoadCallback
+    {
+        QPointer<QObject> context;
+        std::function<void(MapInfo*)> callback;
+    };
+    QMultiMap<MapInfo*,LoadCallback> mLoadCallbacks;
 #ifdef WORLDED
     int mReferenceEpoch;
+    void purgeMap(MapInfo *mapInfo);
+    bool canEvict(MapInfo *mapInfo) const;
+    qint64 mMemoryBudget;
+    qint64 mMapMemoryUsage;
+    int mEvictedMapCount;
 #endif
+    void touch(MapInfo *mapInfo)
+    { mapInfo->mLastUsed = ++mUseCounter; }
+    quint64 mUseCounter;
     QString mError;
 };
 
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mapprefetcher.h"
+
+#include "mapmanager.h"
+#include "world.h"
+#include "worldcell.h"
+
+#include "map.h"
+#include "mapobject.h"
+#include "objectgroup.h"
+
+#include <QDebug>
+#include <QFileInfo>
+
+using namespace Tiled;
+
+#ifdef QT_NO_DEBUG
+inline QNoDebug noise() { return QNoDebug(); }
+#else
+inline QDebug noise() { return QDebug(QtDebugMsg); }
+#endif
+
+MapPrefetcher::MapPrefetcher(const QList<WorldCell*> &cells,
+                             const QString &relativeTo, int lookAhead) :
+    QObject(),
+    mCells(cells),
+    mRelativeTo(relativeTo),
+    mLookAhead(lookAhead),
+    mMemoryCap(MapManager::instance()->memoryBudget() / 2),
+    mNextCell(0)
+{
+    connect(MapManager::instance(), &MapManager::mapLoaded,
+            this, &MapPrefetcher::mapLoaded);
+    connect(MapManager::instance(), &MapManager::mapFailedToLoad,
+            this, &MapPrefetcher::mapFailedToLoad);
+}
+
+MapPrefetcher::~MapPrefetcher()
+{
+    const QList<int> indices = mPins.keys();
+    for (int index : indices)
+        releaseCell(index);
+}
+
+QList<WorldCell *> MapPrefetcher::allCells(World *world)
+{
+    QList<WorldCell*> cells;
+    for (int y = 0; y < world->height(); y++) {
+        for (int x = 0; x < world->width(); x++) {
+            cells += world->cellAt(x, y);
+        }
+    }
+    return cells;
+}
+
+void MapPrefetcher::cellStarted(int index)
+{
+    // Cells that were skipped don't need their maps any longer.
+    const QList<int> indices = mPins.keys();
+    for (int i : indices) {
+        if (i < index)
+            releaseCell(i);
+    }
+
+    if (mNextCell <= index)
+        mNextCell = index + 1;
+
+    while (mNextCell <= index + mLookAhead && mNextCell < mCells.size()) {
+        if (overMemoryCap())
+            break;
+        prefetchCell(mNextCell);
+        ++mNextCell;
+    }
+}
+
+void MapPrefetcher::cellFinished(int index)
+{
+    releaseCell(index);
+}
+
+void MapPrefetcher::mapLoaded(MapInfo *mapInfo)
+{
+    QList<int> indices;
+    for (auto it = mPins.begin(); it != mPins.end(); ++it) {
+        for (Pin &pin : it.value()) {
+            if (pin.mapInfo == mapInfo && !pin.holdsReference) {
+                MapManager::instance()->addReferenceToMap(mapInfo);
+                pin.holdsReference = true;
+                indices += it.key();
+            }
+        }
+    }
+
+    // This adds pins, so it can't be done while iterating over mPins.
+    for (int index : qAsConst(indices))
+        prefetchEmbeddedLots(index, mapInfo);
+}
+
+void MapPrefetcher::mapFailedToLoad(MapInfo *mapInfo)
+{
+    for (auto it = mPins.begin(); it != mPins.end(); ++it) {
+        QList<Pin> &pins = it.value();
+        for (int i = 0; i < pins.size(); i++) {
+            if (pins[i].mapInfo == mapInfo && !pins[i].holdsReference) {
+                pins.removeAt(i);
+                --i;
+            }
+        }
+    }
+}
+
+void MapPrefetcher::prefetchCell(int index)
+{
+    WorldCell *cell = mCells[index];
+    if (!cell || cell->mapFilePath().isEmpty())
+        return;
+
+    noise() << "MapPrefetcher prefetching cell" << cell->x() << cell->y();
+
+    prefetchMap(index, cell->mapFilePath(), mRelativeTo);
+    for (WorldCellLot *lot : cell->lots())
+        prefetchMap(index, lot->mapName(), QString());
+}
+
+void MapPrefetcher::prefetchMap(int index, const QString &mapName, const QString &relativeTo)
+{
+    MapInfo *mapInfo = MapManager::instance()->loadMap(mapName, relativeTo, true,
+                                                       MapManager::PriorityLow);
+    if (!mapInfo || mRequested[index].contains(mapInfo))
+        return;
+    mRequested[index] += mapInfo;
+
+    Pin pin;
+    pin.mapInfo = mapInfo;
+    pin.holdsReference = false;
+    if (mapInfo->map() && !mapInfo->isLoading()) {
+        MapManager::instance()->addReferenceToMap(mapInfo);
+        pin.holdsReference = true;
+    }
+    mPins[index] += pin;
+
+    if (pin.holdsReference)
+        prefetchEmbeddedLots(index, mapInfo);
+}
+
+void MapPrefetcher::prefetchEmbeddedLots(int index, MapInfo *mapInfo)
+{
+    // Same as MapComposite, which loads these once the cell is processed.
+    if (mapInfo->isBeingEdited())
+        return;
+    const QString relativeTo = QFileInfo(mapInfo->path()).absolutePath();
+    for (ObjectGroup *objectGroup : mapInfo->map()->objectGroups()) {
+        for (MapObject *object : objectGroup->objects()) {
+            if (object->name() == QLatin1String("lot") && !object->type().isEmpty())
+                prefetchMap(index, object->type(), relativeTo);
+        }
+    }
+}
+
+void MapPrefetcher::releaseCell(int index)
+{
+    const QList<Pin> pins = mPins.take(index);
+    mRequested.remove(index);
+    for (const Pin &pin : pins) {
+        if (pin.holdsReference)
+            MapManager::instance()->removeReferenceToMap(pin.mapInfo);
+    }
+}
+
+bool MapPrefetcher::overMemoryCap()
+{
+    if (mMemoryCap <= 0)
+        return false;
+    return MapManager::instance()->memoryUsage() > mMemoryCap;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPPREFETCHER_H
+#define MAPPREFETCHER_H
+
+#include <QMap>
+#include <QObject>
+#include <QSet>
+
+class MapInfo;
+class World;
+class WorldCell;
+
+/**
+  * Loads the maps of upcoming cells while the current cell is being processed
+  * by one of the world-wide generators.
+  *
+  * The cell's map, the cell's lots and any lots embedded in those maps are
+  * requested from the MapManager at low priority.  Each map is referenced
+  * once it has loaded so it can't be purged before the cell that needs it is
+  * processed.  The references are removed by cellFinished(), after which the
+  * MapManager's memory budget decides what stays loaded.
+  */
+class MapPrefetcher : public QObject
+{
+    Q_OBJECT
+public:
+    MapPrefetcher(const QList<WorldCell*> &cells,
+                  const QString &relativeTo = QString(),
+                  int lookAhead = 2);
+    ~MapPrefetcher();
+
+    /**
+      * Returns every cell in the world in the order the generators visit them.
+      */
+    static QList<WorldCell*> allCells(World *world);
+
+    /**
+      * No new cells are prefetched while the loaded maps use more than this
+      * many bytes.  The default is half the MapManager's memory budget.
+      * A cap <= 0 means no limit.
+      */
+    void setMemoryCap(qint64 bytes)
+    { mMemoryCap = bytes; }
+
+    /**
+      * Call this before processing mCells[index].
+      */
+    void cellStarted(int index);
+
+    /**
+      * Call this after processing mCells[index].
+      */
+    void cellFinished(int index);
+
+private slots:
+    void mapLoaded(MapInfo *mapInfo);
+    void mapFailedToLoad(MapInfo *mapInfo);
+
+private:
+    void prefetchCell(int index);
+    void prefetchMap(int index, const QString &mapName, const QString &relativeTo);
+    void prefetchEmbeddedLots(int index, MapInfo *mapInfo);
+    void releaseCell(int index);
+    bool overMemoryCap();
+
+    struct Pin
+    {
+        MapInfo *mapInfo;
+        bool holdsReference;
+    };
+
+    QList<WorldCell*> mCells;
+    QString mRelativeTo;
+    int mLookAhead;
+    qint64 mMemoryCap;
+    int mNextCell;
+    QMap<int,QList<Pin>> mPins;
+    QMap<int,QSet<MapInfo*>> mRequested;
+};
+
+#endif // MAPPREFETCHER_H
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memorystatsdialog.h"
+#include "ui_memorystatsdialog.h"
+
+#include "mapmanager.h"
+#include "tilesetmanager.h"
+
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QTreeWidgetItem>
+
+using namespace Tiled::Internal;
+
+static QString megabytes(qint64 bytes)
+{
+    return QString::number(bytes / (1024.0 * 1024.0), 'f', 1);
+}
+
+MemoryStatsDialog::MemoryStatsDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::MemoryStatsDialog)
+{
+    ui->setupUi(this);
+
+    ui->maps->setHeaderLabels({ tr("Map"), tr("References"), tr("MB"), tr("Last Used") });
+    ui->maps->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    ui->maps->setSortingEnabled(true);
+
+    connect(ui->refreshButton, &QPushButton::clicked, this, &MemoryStatsDialog::refresh);
+    connect(ui->purgeButton, &QPushButton::clicked, this, &MemoryStatsDialog::purge);
+    connect(MapManager::instance(), &MapManager::mapLoaded, this, &MemoryStatsDialog::refresh);
+
+    refresh();
+}
+
+MemoryStatsDialog::~MemoryStatsDialog()
+{
+    delete ui;
+}
+
+void MemoryStatsDialog::refresh()
+{
+    MapManager *mapMgr = MapManager::instance();
+    TilesetManager *tilesetMgr = TilesetManager::instance();
+
+    qint64 mapBytes = mapMgr->memoryUsage();
+    qint64 tilesetBytes = tilesetMgr->memoryUsage();
+
+    ui->maps->clear();
+    int loaded = 0;
+    const QList<MapInfo*> mapInfos = mapMgr->mapInfos();
+    for (MapInfo *mapInfo : mapInfos) {
+        if (!mapInfo->map())
+            continue;
+        QTreeWidgetItem *item = new QTreeWidgetItem(ui->maps);
+        item->setText(0, QFileInfo(mapInfo->path()).fileName());
+        item->setToolTip(0, mapInfo->path());
+        item->setData(1, Qt::DisplayRole, mapInfo->referenceCount());
+        item->setData(2, Qt::DisplayRole, mapInfo->memoryUsage() / (1024.0 * 1024.0));
+        item->setData(3, Qt::DisplayRole, mapInfo->lastUsed());
+        ++loaded;
+    }
+
+    ui->mapsLabel->setText(tr("Maps: %1 loaded, %2 MB, %3 evicted")
+                           .arg(loaded).arg(megabytes(mapBytes))
+                           .arg(mapMgr->evictedMapCount()));
+    ui->tilesetsLabel->setText(tr("Tileset images: %1 cached (%2 unused), %3 MB")
+                               .arg(tilesetMgr->cachedImageCount())
+                               .arg(tilesetMgr->unusedCachedImageCount())
+                               .arg(megabytes(tilesetBytes)));
+    if (mapMgr->memoryBudget() > 0)
+        ui->budgetLabel->setText(tr("Total: %1 MB of %2 MB budget")
+                                 .arg(megabytes(mapBytes + tilesetBytes))
+                                 .arg(megabytes(mapMgr->memoryBudget())));
+    else
+        ui->budgetLabel->setText(tr("Total: %1 MB, no budget")
+                                 .arg(megabytes(mapBytes + tilesetBytes)));
+}
+
+void MemoryStatsDialog::purge()
+{
+    MapManager::instance()->purgeUnreferencedMaps();
+    refresh();
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORYSTATSDIALOG_H
+#define MEMORYSTATSDIALOG_H
+
+#include <QDialog>
+
+namespace Ui {
+class MemoryStatsDialog;
+}
+
+class MemoryStatsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit MemoryStatsDialog(QWidget *parent = nullptr);
+    ~MemoryStatsDialog();
+
+private slots:
+    void refresh();
+    void purge();
+
+private:
+    Ui::MemoryStatsDialog *ui;
+};
+
+#endif // MEMORYSTATSDIALOG_H
@@ -163,13 +163,12 @@ bool PNGBuildingDialog::generateCell(WorldCell *cell)
 
     // The cell map must be loaded before creating the MapComposite, which will
     // possibly load embedded lots.
-    while (mapInfo->isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+    MapManager::instance()->waitForMap(mapInfo);
 
     MapComposite staticMapComposite(mapInfo);
     MapComposite *mapComposite = &staticMapComposite;
     while (mapComposite->waitingForMapsToLoad() || mapLoader.isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        MapManager::instance()->waitForThreadResults();
     if (!mapLoader.errorString().isEmpty()) {
         mError = mapLoader.errorString();
         return false;
@@ -101,6 +101,8 @@ Preferences::Preferences()
     mShowAdjacentMaps = mSettings->value(QLatin1String("ShowAdjacentMaps"), true).toBool();
     mSettings->endGroup();
 
+    mMemoryBudget = mSettings->value(QLatin1String("MemoryBudget"), 4096).toInt();
+
     mSettings->beginGroup(QLatin1String("MapsDirectory"));
     mMapsDirectory = mSettings->value(QLatin1String("Current"), QString()).toString();
     mSettings->endGroup();
@@ -322,6 +324,19 @@ void Preferences::setShowAdjacentMaps(bool show)
     emit showAdjacentMapsChanged(mShowAdjacentMaps);
 }
 
+void Preferences::setMemoryBudget(int megabytes)
+{
+    megabytes = qMax(megabytes, 0);
+
+    if (mMemoryBudget == megabytes)
+        return;
+
+    mMemoryBudget = megabytes;
+    mSettings->setValue(QLatin1String("MemoryBudget"), mMemoryBudget);
+
+    emit memoryBudgetChanged(mMemoryBudget);
+}
+
 void Preferences::setShowObjects(bool show)
 {
     if (mShowObjects == show)
@@ -91,6 +91,9 @@ public:
     bool showAdjacentMaps() const { return mShowAdjacentMaps; }
     void setShowAdjacentMaps(bool show);
 
+    int memoryBudget() const { return mMemoryBudget; } // megabytes
+    void setMemoryBudget(int megabytes);
+
 signals:
     void snapToGridChanged(bool snapToGrid);
     void showCoordinatesChanged(bool showGrid);
@@ -119,6 +122,7 @@ signals:
     void showAdjacentMapsChanged(bool show);
     void highlightRoomUnderPointerChanged(bool highlight);
     void showOtherWorldsChanged(bool show);
+    void memoryBudgetChanged(int megabytes);
 
 public slots:
     void setSnapToGrid(bool snapToGrid);
@@ -169,6 +173,7 @@ private:
     bool mHighlightRoomUnderPointer;
     bool mShowOtherWorlds;
     QString mThumbnailsDirectory;
+    int mMemoryBudget;
 
     static Preferences *mInstance;
 };
@@ -50,6 +50,7 @@ PreferencesDialog::PreferencesDialog(WorldDocument *worldDoc, QWidget *parent)
     ui->thumbnails->setChecked(prefs->worldThumbnails());
     ui->showAdjacent->setChecked(prefs->showAdjacentMaps());
     ui->zombieSpawnImageOpacity->setValue(int(prefs->zombieSpawnImageOpacity() * 100));
+    ui->memoryBudget->setValue(prefs->memoryBudget());
 }
 
 void PreferencesDialog::browseTilesDirectory()
@@ -78,4 +79,5 @@ void PreferencesDialog::accept()
     prefs->setGridColor(mGridColor);
     prefs->setShowAdjacentMaps(ui->showAdjacent->isChecked());
     prefs->setZombieSpawnImageOpacity(ui->zombieSpawnImageOpacity->value() / 100.0);
+    prefs->setMemoryBudget(ui->memoryBudget->value());
 }
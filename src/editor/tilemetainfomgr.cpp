@@ -21,6 +21,7 @@
 #include "preferences.h"
 #include "simplefile.h"
 #include "tilesetmanager.h"
+#include "tilesetsizeindex.h"
 #include "tilesetstxtfile.h"
 
 #include "tile.h"
@@ -58,15 +59,13 @@ void TileMetaInfoMgr::changeTilesDirectory(const QString &path)
             continue; // keep the relative path
         QString imageSource, imageSource2x;
         TilesetManager::instance()->getTilesetFileName(ts->name(), imageSource, imageSource2x);
-        QImageReader reader2x(imageSource2x);
-        if (reader2x.size().isValid()) {
+        if (mSizeIndex->imageSize(imageSource2x).isValid()) {
             // can't use canonicalFilePath since the 1x tileset may not exist
             TilesetManager::instance()->changeTilesetSource(ts, imageSource, false);
             TilesetManager::instance()->loadTileset(ts, ts->imageSource());
             continue;
         }
-        QImageReader reader(imageSource);
-        if (reader.size().isValid()) {
+        if (mSizeIndex->imageSize(imageSource).isValid()) {
             QFileInfo finfo(imageSource);
             TilesetManager::instance()->changeTilesetSource(ts, finfo.canonicalFilePath(), false);
             TilesetManager::instance()->loadTileset(ts, ts->imageSource());
@@ -78,14 +77,19 @@ void TileMetaInfoMgr::changeTilesDirectory(const QString &path)
             TilesetManager::instance()->changeTilesetSource(ts, imageSource, true);
         }
     }
-    loadTilesets();
+    sizeTilesets();
 }
 
 TileMetaInfoMgr::TileMetaInfoMgr(QObject *parent) :
     QObject(parent),
     mRevision(0),
     mSourceRevision(0),
-    mHasReadTxt(false)
+    mHasReadTxt(false),
+    mSizeIndex(new TilesetSizeIndex(Preferences::instance()->configPath(QLatin1String("TilesetSizes.bin")))),
+    mMetaRevision(0),
+    mCompiledEnumsRevision(-1),
+    mLastTileset(nullptr),
+    mLastInfo(nullptr)
 {
     connect(TilesetManager::instance(), &TilesetManager::tilesetChanged,
             this, &TileMetaInfoMgr::tilesetChanged);
@@ -96,6 +100,8 @@ TileMetaInfoMgr::~TileMetaInfoMgr()
     TilesetManager::instance()->removeReferences(tilesets());
     TilesetManager::instance()->removeReferences(mRemovedTilesets);
     qDeleteAll(mTilesetInfo);
+    mSizeIndex->save();
+    delete mSizeIndex;
 }
 
 QString TileMetaInfoMgr::tilesDirectory() const
@@ -215,6 +221,7 @@ bool TileMetaInfoMgr::readTxt()
     }
 
     mHasReadTxt = true;
+    metaInfoChanged();
 
     return true;
 }
@@ -412,6 +419,7 @@ bool TileMetaInfoMgr::readTxt()
     }
 
     mHasReadTxt = true;
+    metaInfoChanged();
 
     return true;
 }
@@ -566,11 +574,11 @@ bool TileMetaInfoMgr::addNewTilesets()
         QString tilesetName = fileInfo.completeBaseName();
         if (mTilesetByName.contains(tilesetName))
             continue;
-        QImageReader ir(fileInfo.absoluteFilePath());
-        if (!ir.size().isValid())
+        QSize size = mSizeIndex->imageSize(fileInfo.absoluteFilePath());
+        if (!size.isValid())
             continue;
-        int columns = ir.size().width() / (64 * 2);
-        int rows = ir.size().height() / (64 * 2);
+        int columns = size.width() / (64 * 2);
+        int rows = size.height() / (64 * 2);
         Tileset *tileset = new Tileset(tilesetName, 64, 128);
         tileset->loadFromNothing(QSize(columns * 64, rows * 128), fileInfo.fileName());
         Tile *missingTile = TilesetManager::instance()->missingTile();
@@ -582,6 +590,8 @@ bool TileMetaInfoMgr::addNewTilesets()
         mTilesetInfo[tilesetName] = info;
     }
 
+    metaInfoChanged();
+
     return true;
 }
 
@@ -601,16 +611,16 @@ bool TileMetaInfoMgr::loadTilesetImage(Tileset *ts, const QString &source)
     QString imageSource, imageSource2x;
     TilesetManager::instance()->getTilesetFileName(ts->name(), imageSource, imageSource2x);
 
-    QImageReader ir2x(imageSource2x);
-    if (ir2x.size().isValid()) {
-        ts->loadFromNothing(ir2x.size() / 2, source);
+    QSize size = mSizeIndex->imageSize(imageSource2x);
+    if (size.isValid()) {
+        ts->loadFromNothing(size / 2, source);
         // can't use canonicalFilePath since the 1x tileset may not exist
         TilesetManager::instance()->loadTileset(ts, source);
         return true;
     }
-    QImageReader reader(imageSource);
-    if (reader.size().isValid()) {
-        ts->loadFromNothing(reader.size(), imageSource);
+    size = mSizeIndex->imageSize(imageSource);
+    if (size.isValid()) {
+        ts->loadFromNothing(size, imageSource);
         QFileInfo info(imageSource);
         TilesetManager::instance()->loadTileset(ts, info.canonicalFilePath());
         return true;
@@ -643,35 +653,80 @@ void TileMetaInfoMgr::removeTileset(Tileset *tileset)
     //    TilesetManager::instance()->removeReference(tileset);
 }
 
-void TileMetaInfoMgr::loadTilesets(const QList<Tileset *> &tilesets, bool processEvents)
+void TileMetaInfoMgr::sizeTilesets(const QList<Tileset *> &tilesets)
 {
-    QList<Tileset *> _tilesets = tilesets;
-    if (_tilesets.isEmpty())
-        _tilesets = this->tilesets();
+    const QList<Tileset*> _tilesets = tilesets.isEmpty() ? this->tilesets() : tilesets;
 
     foreach (Tileset *ts, _tilesets) {
-        if (ts->isMissing()) {
-            QString imageSource,imageSource2x;
-            TilesetManager::instance()->getTilesetFileName(ts->name(), imageSource, imageSource2x);
-            QImageReader ir2x(imageSource2x);
-            if (ir2x.size().isValid()) {
-                ts->loadFromNothing(ir2x.size() / 2, imageSource);
-                // can't use canonicalFilePath since the 1x tileset may not exist
-                TilesetManager::instance()->loadTileset(ts, imageSource);
-                if (processEvents)
-                    qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
-                continue;
-            }
-            QImageReader reader(imageSource);
-            if (reader.size().isValid()) {
-                ts->loadFromNothing(reader.size(), imageSource); // update the size now
-                QFileInfo info(imageSource);
-                TilesetManager::instance()->loadTileset(ts, info.canonicalFilePath());
-                if (processEvents)
-                    qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
-            }
+        if (!ts->isMissing())
+            continue;
+        QString imageSource, imageSource2x;
+        TilesetManager::instance()->getTilesetFileName(ts->name(), imageSource, imageSource2x);
+        QSize size = mSizeIndex->imageSize(imageSource2x);
+        if (size.isValid())
+            size /= 2;
+        else
+            size = mSizeIndex->imageSize(imageSource);
+        // Keep the relative path so TilesetManager::addReference() doesn't
+        // start reading the image.
+        if (size.isValid()) {
+            int tileCount = ts->tileCount();
+            ts->loadFromNothing(size, ts->imageSource());
+            if (ts->tileCount() != tileCount)
+                emit tilesetResized(ts);
         }
     }
+
+    mSizeIndex->save();
+
+#ifndef QT_NO_DEBUG
+    verifyCompiledEnums(_tilesets);
+#endif
+}
+
+void TileMetaInfoMgr::resolveImageSources()
+{
+    foreach (Tileset *ts, tilesets()) {
+        if (!ts->isMissing() || QDir::isAbsolutePath(ts->imageSource()))
+            continue;
+        QString imageSource, imageSource2x;
+        TilesetManager::instance()->getTilesetFileName(ts->name(), imageSource, imageSource2x);
+        ts->setImageSource(QFileInfo(imageSource).absoluteFilePath());
+    }
+}
+
+void TileMetaInfoMgr::loadTilesets(const QList<Tileset *> &tilesets)
+{
+    foreach (Tileset *ts, tilesets) {
+        if (!ts->isMissing() || tileset(ts->name()) != ts)
+            continue;
+        QString imageSource,imageSource2x;
+        TilesetManager::instance()->getTilesetFileName(ts->name(), imageSource, imageSource2x);
+        int tileCount = ts->tileCount();
+        QSize size = mSizeIndex->imageSize(imageSource2x);
+        if (size.isValid()) {
+            ts->loadFromNothing(size / 2, imageSource);
+            if (ts->tileCount() != tileCount)
+                emit tilesetResized(ts);
+            // can't use canonicalFilePath since the 1x tileset may not exist
+            TilesetManager::instance()->loadTileset(ts, imageSource);
+            continue;
+        }
+        size = mSizeIndex->imageSize(imageSource);
+        if (size.isValid()) {
+            ts->loadFromNothing(size, imageSource); // update the size now
+            if (ts->tileCount() != tileCount)
+                emit tilesetResized(ts);
+            QFileInfo info(imageSource);
+            TilesetManager::instance()->loadTileset(ts, info.canonicalFilePath());
+        }
+    }
+}
+
+void TileMetaInfoMgr::waitForTilesets(const QList<Tileset *> &tilesets)
+{
+    loadTilesets(tilesets);
+    TilesetManager::instance()->waitForTilesets(tilesets);
 }
 
 void TileMetaInfoMgr::tilesetChanged(Tileset *ts)
@@ -684,6 +739,7 @@ void TileMetaInfoMgr::setTileEnum(Tile *tile, const QString &enumName)
 {
     QString key = TilesetMetaInfo::key(tile);
     QString tilesetName = tile->tileset()->name();
+    metaInfoChanged();
     if (enumName.isEmpty()) {
         if (mTilesetInfo.contains(tilesetName))
             mTilesetInfo[tilesetName]->mInfo.remove(key);
@@ -693,38 +749,40 @@ void TileMetaInfoMgr::setTileEnum(Tile *tile, const QString &enumName)
         mTilesetInfo[tilesetName] = new TilesetMetaInfo;
     TilesetMetaInfo *info = mTilesetInfo[tilesetName];
     info->mInfo[key].mMetaGameEnum = enumName;
+
+#ifndef QT_NO_DEBUG
+    verifyCompiledEnums(QList<Tileset*>() << tile->tileset());
+#endif
 }
 
 QString TileMetaInfoMgr::tileEnum(Tile *tile)
 {
-    QString tilesetName = tile->tileset()->name();
-    if (!mTilesetInfo.contains(tilesetName))
+    int index = enumIndex(tile);
+    if (index == -1)
         return QString();
-    QString key = TilesetMetaInfo::key(tile);
-    TilesetMetaInfo *info = mTilesetInfo[tilesetName];
-    if (!info->mInfo.contains(key))
-        return QString();
-    return info->mInfo[key].mMetaGameEnum;
+    return mCompiledEnumNames.at(index);
 }
 
 int TileMetaInfoMgr::tileEnumValue(Tile *tile)
 {
-    QString enumName = tileEnum(tile);
-    if (!enumName.isEmpty())
-        return mEnums[enumName];
-    return -1;
+    int index = enumIndex(tile);
+    if (index == -1)
+        return -1;
+    return mCompiledEnumValues.at(index);
 }
 
 bool TileMetaInfoMgr::isEnumWest(int enumValue) const
 {
-    Q_ASSERT(mEnums.values().contains(enumValue));
-    return mEnums.key(enumValue).endsWith(QLatin1Char('W'));
+    if (enumValue < 0 || enumValue >= mEnumFlags.size())
+        return false;
+    return mEnumFlags.at(enumValue) & EnumWest;
 }
 
 bool TileMetaInfoMgr::isEnumNorth(int enumValue) const
 {
-    Q_ASSERT(mEnums.values().contains(enumValue));
-    return mEnums.key(enumValue).endsWith(QLatin1Char('N'));
+    if (enumValue < 0 || enumValue >= mEnumFlags.size())
+        return false;
+    return mEnumFlags.at(enumValue) & EnumNorth;
 }
 
 bool TileMetaInfoMgr::isEnumWest(const QString &enumName) const
@@ -751,6 +809,159 @@ bool TileMetaInfoMgr::parse2Ints(const QString &s, int *pa, int *pb)
     return true;
 }
 
+void TileMetaInfoMgr::metaInfoChanged()
+{
+    ++mMetaRevision;
+    mLastTileset = nullptr;
+    mLastInfo = nullptr;
+
+    // isEnumWest(int) and isEnumNorth(int) used to look up the first name
+    // with the given value.
+    mEnumFlags.clear();
+    QVector<bool> seen;
+    for (auto it = mEnums.constBegin(); it != mEnums.constEnd(); ++it) {
+        int value = it.value();
+        if (value < 0)
+            continue;
+        if (value >= mEnumFlags.size()) {
+            mEnumFlags.resize(value + 1);
+            seen.resize(value + 1);
+        }
+        if (seen[value])
+            continue;
+        seen[value] = true;
+        if (isEnumWest(it.key()))
+            mEnumFlags[value] |= EnumWest;
+        if (isEnumNorth(it.key()))
+            mEnumFlags[value] |= EnumNorth;
+    }
+}
+
+/**
+  * Returns the meta-info for \a tileset compiled into an array, or nullptr if
+  * the tileset has no meta-info.  The last tileset asked for is remembered,
+  * since callers usually ask about many tiles in the same tileset.
+  */
+TilesetMetaInfo *TileMetaInfoMgr::compiledInfo(const Tileset *tileset)
+{
+    if (mCompiledEnumsRevision != mMetaRevision) {
+        mCompiledEnumsRevision = mMetaRevision;
+        mCompiledEnumNames.clear();
+        mCompiledEnumValues.clear();
+        mCompiledEnumIndex.clear();
+    }
+
+    TilesetMetaInfo *info;
+    if (tileset == mLastTileset && tileset->name() == mLastTilesetName) {
+        info = mLastInfo;
+    } else {
+        info = mTilesetInfo.value(tileset->name());
+        mLastTileset = tileset;
+        mLastTilesetName = tileset->name();
+        mLastInfo = info;
+    }
+
+    if (info && info->mCompiledRevision != mMetaRevision)
+        compile(info);
+    return info;
+}
+
+void TileMetaInfoMgr::compile(TilesetMetaInfo *info)
+{
+    struct Entry
+    {
+        int column;
+        int row;
+        int index;
+    };
+    QVector<Entry> entries;
+    int columns = 0, rows = 0;
+
+    for (auto it = info->mInfo.constBegin(); it != info->mInfo.constEnd(); ++it) {
+        const QString &enumName = it->mMetaGameEnum;
+        if (enumName.isEmpty())
+            continue;
+        int column, row;
+        if (!parse2Ints(it.key(), &column, &row) || column < 0 || row < 0)
+            continue;
+        // TilesetMetaInfo::key() never matches any other form of the key.
+        if (it.key() != QString(QLatin1String("%1,%2")).arg(column).arg(row))
+            continue;
+        int index = mCompiledEnumIndex.value(enumName, -1);
+        if (index == -1) {
+            index = mCompiledEnumNames.size();
+            mCompiledEnumNames += enumName;
+            mCompiledEnumValues += mEnums.value(enumName);
+            mCompiledEnumIndex.insert(enumName, index);
+        }
+        Entry entry;
+        entry.column = column;
+        entry.row = row;
+        entry.index = index;
+        entries += entry;
+        columns = qMax(columns, column + 1);
+        rows = qMax(rows, row + 1);
+    }
+
+    info->mColumns = columns;
+    info->mRows = rows;
+    info->mEnumIndex.fill(-1, columns * rows);
+    for (const Entry &entry : qAsConst(entries))
+        info->mEnumIndex[entry.row * columns + entry.column] = qint16(entry.index);
+    info->mCompiledRevision = mMetaRevision;
+}
+
+int TileMetaInfoMgr::enumIndex(Tile *tile)
+{
+    const TilesetMetaInfo *info = compiledInfo(tile->tileset());
+    if (info == nullptr)
+        return -1;
+    int columns = tile->tileset()->columnCount();
+    if (columns <= 0)
+        return -1;
+    int column = tile->id() % columns;
+    int row = tile->id() / columns;
+    if (column >= info->mColumns || row >= info->mRows)
+        return -1;
+    return info->mEnumIndex.at(row * info->mColumns + column);
+}
+
+#ifndef QT_NO_DEBUG
+/**
+  * Checks every tile in \a tilesets gets the same meta-enum from the compiled
+  * arrays as from looking up its "column,row" key and then the enum name, the
+  * way tileEnum() and tileEnumValue() used to.
+  */
+void TileMetaInfoMgr::verifyCompiledEnums(const QList<Tileset *> &tilesets)
+{
+    for (Tileset *ts : tilesets) {
+        if (ts->columnCount() <= 0)
+            continue;
+        const TilesetMetaInfo *info = mTilesetInfo.value(ts->name());
+        for (int i = 0; i < ts->tileCount(); i++) {
+            Tile *tile = ts->tileAt(i);
+            QString enumName;
+            if (info)
+                enumName = info->mInfo.value(TilesetMetaInfo::key(tile)).mMetaGameEnum;
+            const int enumValue = enumName.isEmpty() ? -1 : mEnums.value(enumName);
+            Q_ASSERT_X(tileEnum(tile) == enumName, "TileMetaInfoMgr::tileEnum",
+                       qPrintable(ts->name() + QLatin1Char(' ') + TilesetMetaInfo::key(tile)));
+            Q_ASSERT_X(tileEnumValue(tile) == enumValue, "TileMetaInfoMgr::tileEnumValue",
+                       qPrintable(ts->name() + QLatin1Char(' ') + TilesetMetaInfo::key(tile)));
+        }
+    }
+
+    // isEnumWest(int) and isEnumNorth(int) used the first name with the value.
+    for (auto it = mEnums.constBegin(); it != mEnums.constEnd(); ++it) {
+        if (it.value() < 0)
+            continue;
+        const QString firstName = mEnums.key(it.value());
+        Q_ASSERT(isEnumWest(it.value()) == isEnumWest(firstName));
+        Q_ASSERT(isEnumNorth(it.value()) == isEnumNorth(firstName));
+    }
+}
+#endif
+
 /////
 
 QString TilesetMetaInfo::key(Tile *tile)
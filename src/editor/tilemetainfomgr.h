@@ -20,14 +20,17 @@
 #ifndef TILEMETAINFOMGR_H
 #define TILEMETAINFOMGR_H
 
+#include <QHash>
 #include <QMap>
 #include <QObject>
 #include <QStringList>
+#include <QVector>
 
 namespace Tiled {
 
 class Tile;
 class Tileset;
+class TilesetSizeIndex;
 
 class TileMetaInfo
 {
@@ -38,10 +41,27 @@ public:
 class TilesetMetaInfo
 {
 public:
+    TilesetMetaInfo() :
+        mColumns(0),
+        mRows(0),
+        mCompiledRevision(-1)
+    {}
+
     QString mTilesetName;
     QMap<QString,TileMetaInfo> mInfo; // index is "column,row"
 
     static QString key(Tile *tile);
+
+private:
+    friend class TileMetaInfoMgr;
+
+    // mInfo compiled by TileMetaInfoMgr, indexed by row * mColumns + column.
+    // Each value is an index into TileMetaInfoMgr's compiled enum names,
+    // or -1 if the tile has no meta-enum.
+    QVector<qint16> mEnumIndex;
+    int mColumns;
+    int mRows;
+    int mCompiledRevision;
 };
 
 class TileMetaInfoMgr : public QObject
@@ -109,10 +129,34 @@ public:
     void addTileset(Tileset *ts);
     void removeTileset(Tileset *ts);
 
-    void loadTilesets(bool processEvents)
-    { loadTilesets(QList<Tileset*>(), processEvents); }
-
-    void loadTilesets(const QList<Tileset*> &tilesets = QList<Tileset*>(), bool processEvents = false);
+    /**
+      * Sizes each missing tileset in \a tilesets (all of them if empty) from
+      * its image in the Tiles directory without reading the image.  The sizes
+      * are remembered between sessions.  The tilesets stay missing until
+      * loadTilesets() is called for them.
+      */
+    void sizeTilesets(const QList<Tileset*> &tilesets = QList<Tileset*>());
+
+    /**
+      * Points each missing tileset's image source at its image in the Tiles
+      * directory without reading the image, so maps that are written out
+      * without loading the tilesets still reference the right files.
+      * Note TilesetManager::addReference() will read images with an absolute
+      * source.
+      */
+    void resolveImageSources();
+
+    /**
+      * Starts reading the images of the missing tilesets in \a tilesets on
+      * TilesetManager's threads.  Call this only for the tilesets a map,
+      * building or view actually uses.
+      */
+    void loadTilesets(const QList<Tileset*> &tilesets);
+
+    /**
+      * Like loadTilesets(), but doesn't return until the images were read.
+      */
+    void waitForTilesets(const QList<Tileset*> &tilesets);
 
     void setTileEnum(Tile *tile, const QString &enumName);
     QString tileEnum(Tile *tile);
@@ -126,6 +170,7 @@ signals:
     void tilesetAdded(Tiled::Tileset *ts);
     void tilesetAboutToBeRemoved(Tiled::Tileset *ts);
     void tilesetRemoved(Tiled::Tileset *ts);
+    void tilesetResized(Tiled::Tileset *ts);
 
 private slots:
     void tilesetChanged(Tiled::Tileset *ts);
@@ -133,6 +178,14 @@ private slots:
 private:
     bool parse2Ints(const QString &s, int *pa, int *pb);
 
+    void metaInfoChanged();
+    TilesetMetaInfo *compiledInfo(const Tileset *tileset);
+    void compile(TilesetMetaInfo *info);
+    int enumIndex(Tile *tile);
+#ifndef QT_NO_DEBUG
+    void verifyCompiledEnums(const QList<Tileset*> &tilesets);
+#endif
+
 private:
     static TileMetaInfoMgr *mInstance;
     TileMetaInfoMgr(QObject *parent = nullptr);
@@ -149,6 +202,23 @@ private:
     int mSourceRevision;
     QString mError;
     bool mHasReadTxt;
+    TilesetSizeIndex *mSizeIndex;
+
+    // Tile meta-enums compiled into arrays, see compiledInfo().  Anything
+    // that changes mEnums or mTilesetInfo must call metaInfoChanged().
+    enum EnumFlag {
+        EnumWest = 0x01,
+        EnumNorth = 0x02
+    };
+    int mMetaRevision;
+    int mCompiledEnumsRevision;
+    QStringList mCompiledEnumNames;
+    QVector<int> mCompiledEnumValues;
+    QHash<QString,int> mCompiledEnumIndex;
+    QVector<quint8> mEnumFlags; // indexed by enum value
+    const Tileset *mLastTileset;
+    QString mLastTilesetName;
+    TilesetMetaInfo *mLastInfo;
 };
 
 } // namespace Tiled
@@ -33,6 +33,8 @@
 #include <QDir>
 #include <QImageReader>
 #include <QMetaType>
+
+#include <algorithm>
 #endif
 
 using namespace Tiled;
@@ -80,6 +82,8 @@ TilesetManager::TilesetManager():
     mImageReaderThreads.resize(8);
     mImageReaderWorkers.resize(mImageReaderThreads.size());
     mNextThreadForJob = 0;
+    mCachedImageUseCounter = 0;
+    mCachedImageBytesTotal = 0;
     for (int i = 0; i < mImageReaderWorkers.size(); i++) {
         mImageReaderThreads[i] = new InterruptibleThread;
         mImageReaderWorkers[i] = new TilesetImageReaderWorker(i, mImageReaderThreads[i]);
@@ -94,14 +98,8 @@ TilesetManager::TilesetManager():
 #endif
 #endif
 
-    connect(mWatcher, &FileSystemWatcher::fileChanged,
-            this, &TilesetManager::fileChanged);
-
-    mChangedFilesTimer.setInterval(500);
-    mChangedFilesTimer.setSingleShot(true);
-
-    connect(&mChangedFilesTimer, &QTimer::timeout,
-            this, &TilesetManager::fileChangedTimeout);
+    connect(mWatcher, &FileSystemWatcher::pathsChanged,
+            this, &TilesetManager::filesChanged);
 }
 
 TilesetManager::~TilesetManager()
@@ -275,7 +273,7 @@ bool TilesetManager::getTilesetFileName(const QString &tilesetName, QString &pat
     return false;
 }
 
-void TilesetManager::fileChanged(const QString &path)
+void TilesetManager::filesChanged(const QStringList &paths)
 {
 #ifndef ZOMBOID
     if (!mReloadTilesetsOnChange)
@@ -283,12 +281,14 @@ void TilesetManager::fileChanged(const QString &path)
 #endif
 
     /*
-     * Use a one-shot timer since GIMP (for example) seems to generate many
-     * file changes during a save, and some of the intermediate attempts to
-     * reload the tileset images actually fail (at least for .png files).
+     * pathsChanged is emitted after a delay since GIMP (for example) seems to
+     * generate many file changes during a save, and some of the intermediate
+     * attempts to reload the tileset images actually fail (at least for .png
+     * files).  Images whose contents didn't change aren't reported.
      */
-    mChangedFiles.insert(path);
-    mChangedFilesTimer.start();
+    for (const QString &path : paths)
+        mChangedFiles.insert(path);
+    fileChangedTimeout();
 }
 
 void TilesetManager::fileChangedTimeout()
@@ -308,6 +308,7 @@ void TilesetManager::fileChangedTimeout()
                 }
                 tileset->setMissing(true);
             }
+            updateCachedImageBytes(tileset);
         }
     }
     foreach (Tileset *tileset, tilesets()) {
@@ -352,6 +353,7 @@ void TilesetManager::imageLoaded(QImage *image, Tileset *tileset)
 
     // This updates a tileset in the cache.
     tileset->loadFromImage(*image, tileset->imageSource());
+    updateCachedImageBytes(tileset);
 
     // Watch the image file for changes.
     mWatcher->addPath(tileset->imageSource2x().isEmpty() ? tileset->imageSource() : tileset->imageSource2x());
@@ -382,6 +384,7 @@ void TilesetManager::imageLoaded(Tileset *fromThread, Tileset *tileset)
     // HACK - 'fromThread' is not in the cache, 'tileset' is
     tileset->loadFromCache(fromThread);
     delete fromThread;
+    updateCachedImageBytes(tileset);
 
     // Watch the image file for changes.
     mWatcher->addPath(tileset->imageSource2x().isEmpty() ? tileset->imageSource() : tileset->imageSource2x());
@@ -414,6 +417,7 @@ void TilesetManager::loadTileset(Tileset *tileset, const QString &imageSource_)
         QString imageSource, imageSource2x;
         getTilesetFileName(tileset->name(), imageSource, imageSource2x);
         if (Tileset *cached = mTilesetImageCache->findMatch(tileset, imageSource, imageSource2x)) {
+            touchCachedImage(cached);
             // If it !isLoaded(), a thread is reading the image.
             // FIXME: 1) load TMX with tilesets from not-TilesDirectory -> no 2x images loaded
             //        2) switch TilesDirectory to the same not-TilesDirectory in 1)
@@ -431,6 +435,7 @@ void TilesetManager::loadTileset(Tileset *tileset, const QString &imageSource_)
             changeTilesetSource(tileset, imageSource, false);
             tileset->setImageSource2x(imageSource2x);
             cached = mTilesetImageCache->addTileset(tileset);
+            touchCachedImage(cached);
 #if 1 /* QT_POINTER_SIZE == 8 */
             QMetaObject::invokeMethod(mImageReaderWorkers[mNextThreadForJob],
                                       "addJob", Qt::QueuedConnection,
@@ -445,6 +450,7 @@ void TilesetManager::loadTileset(Tileset *tileset, const QString &imageSource_)
             changeTilesetSource(tileset, imageSource, false);
             tileset->setImageSource2x(QString());
             cached = mTilesetImageCache->addTileset(tileset);
+            touchCachedImage(cached);
 #if 1 /* QT_POINTER_SIZE == 8 */
             QMetaObject::invokeMethod(mImageReaderWorkers[mNextThreadForJob],
                                       "addJob", Qt::QueuedConnection,
@@ -522,6 +528,85 @@ int TilesetManager::countLoadingTilesets(const QList<Tileset*> &tilesets) const
     return count;
 }
 
+qint64 TilesetManager::memoryUsage() const
+{
+    return mCachedImageBytesTotal;
+}
+
+int TilesetManager::cachedImageCount() const
+{
+    return mTilesetImageCache->mTilesets.size();
+}
+
+int TilesetManager::unusedCachedImageCount() const
+{
+    const QSet<QString> inUse = imageSourcesInUse();
+    int count = 0;
+    for (Tileset *cached : qAsConst(mTilesetImageCache->mTilesets)) {
+        if (cached->isLoaded() && !isCachedImageInUse(cached, inUse))
+            count++;
+    }
+    return count;
+}
+
+qint64 TilesetManager::purgeUnusedImages(qint64 bytesToFree)
+{
+    const QSet<QString> inUse = imageSourcesInUse();
+    QList<QPair<quint64,Tileset*>> candidates;
+    for (Tileset *cached : qAsConst(mTilesetImageCache->mTilesets)) {
+        // If it !isLoaded(), a thread is reading the image.
+        if (!cached->isLoaded() || isCachedImageInUse(cached, inUse))
+            continue;
+        candidates += qMakePair(mCachedImageLastUsed.value(cached), cached);
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    qint64 freed = 0;
+    for (const QPair<quint64,Tileset*> &candidate : qAsConst(candidates)) {
+        if (freed >= bytesToFree)
+            break;
+        Tileset *cached = candidate.second;
+        const qint64 bytes = mCachedImageBytes.take(cached);
+        mCachedImageBytesTotal -= bytes;
+        freed += bytes;
+        mTilesetImageCache->mTilesets.removeOne(cached);
+        mCachedImageLastUsed.remove(cached);
+        mWatcher->removePath(cached->imageSource2x().isEmpty() ? cached->imageSource() : cached->imageSource2x());
+        delete cached;
+    }
+    return freed;
+}
+
+QSet<QString> TilesetManager::imageSourcesInUse() const
+{
+    QSet<QString> inUse;
+    for (auto it = mTilesets.constBegin(); it != mTilesets.constEnd(); ++it) {
+        Tileset *ts = it.key();
+        inUse += ts->imageSource();
+        if (!ts->imageSource2x().isEmpty())
+            inUse += ts->imageSource2x();
+    }
+    return inUse;
+}
+
+bool TilesetManager::isCachedImageInUse(Tileset *cached, const QSet<QString> &inUse) const
+{
+    return inUse.contains(cached->imageSource())
+            || (!cached->imageSource2x().isEmpty() && inUse.contains(cached->imageSource2x()));
+}
+
+void TilesetManager::touchCachedImage(Tileset *cached)
+{
+    mCachedImageLastUsed[cached] = ++mCachedImageUseCounter;
+}
+
+void TilesetManager::updateCachedImageBytes(Tileset *cached)
+{
+    const qint64 bytes = cached->memoryUsage();
+    mCachedImageBytesTotal += bytes - mCachedImageBytes.value(cached);
+    mCachedImageBytes[cached] = bytes;
+}
+
 void TilesetManager::changeTilesetSource(Tileset *tileset, const QString &source,
                                          bool missing)
 {
@@ -30,7 +30,7 @@
 #include <QMap>
 #include <QString>
 #include <QSet>
-#include <QTimer>
+#include <QStringList>
 
 #ifdef ZOMBOID
 #include "threads.h"
@@ -197,6 +197,21 @@ public:
     void loadTileset(Tileset *tileset, const QString &imageSource);
     void waitForTilesets(const QList<Tileset *> &tilesets = QList<Tileset*>(), QWidget *parent = nullptr);
     int countLoadingTilesets(const QList<Tileset *> &tilesets) const;
+
+    /**
+     * Returns the number of bytes of pixel data held by the tileset image cache.
+     */
+    qint64 memoryUsage() const;
+
+    int cachedImageCount() const;
+    int unusedCachedImageCount() const;
+
+    /**
+     * Discards cached tileset images that no tileset refers to, least-recently
+     * used first, until at least \a bytesToFree bytes have been released.
+     * Returns the number of bytes actually released.
+     */
+    qint64 purgeUnusedImages(qint64 bytesToFree);
 #endif
 
 signals:
@@ -210,7 +225,7 @@ signals:
 #endif
 
 private slots:
-    void fileChanged(const QString &path);
+    void filesChanged(const QStringList &paths);
     void fileChangedTimeout();
 
 #ifdef ZOMBOID
@@ -245,6 +260,15 @@ private:
     QVector<InterruptibleThread*> mImageReaderThreads;
     QVector<TilesetImageReaderWorker*> mImageReaderWorkers;
     int mNextThreadForJob;
+
+    QSet<QString> imageSourcesInUse() const;
+    bool isCachedImageInUse(Tileset *cached, const QSet<QString> &inUse) const;
+    void touchCachedImage(Tileset *cached);
+    void updateCachedImageBytes(Tileset *cached);
+    QMap<Tileset*,quint64> mCachedImageLastUsed;
+    quint64 mCachedImageUseCounter;
+    QMap<Tileset*,qint64> mCachedImageBytes;
+    qint64 mCachedImageBytesTotal;
 #endif
 
 #ifdef ZOMBOID_TILE_LAYER_NAMES
@@ -264,7 +288,6 @@ private:
     QMap<Tileset*, int> mTilesets;
     FileSystemWatcher *mWatcher;
     QSet<QString> mChangedFiles;
-    QTimer mChangedFilesTimer;
     bool mReloadTilesetsOnChange;
 };
 
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tilesetsizeindex.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+
+using namespace Tiled;
+
+#define SIZE_INDEX_MAGIC 0x54535A49
+#define SIZE_INDEX_VERSION 1
+
+TilesetSizeIndex::TilesetSizeIndex(const QString &fileName) :
+    mFileName(fileName),
+    mRead(false),
+    mDirty(false)
+{
+}
+
+QSize TilesetSizeIndex::imageSize(const QString &path)
+{
+    if (!mRead)
+        read();
+
+    QFileInfo info(path);
+    if (!info.exists()) {
+        if (mEntries.remove(path))
+            mDirty = true;
+        return QSize();
+    }
+
+    qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    auto it = mEntries.constFind(path);
+    if (it != mEntries.constEnd() && it->modified == modified
+            && it->fileSize == info.size())
+        return it->imageSize;
+
+    Entry entry;
+    entry.modified = modified;
+    entry.fileSize = info.size();
+    entry.imageSize = QImageReader(path).size();
+    mEntries[path] = entry;
+    mDirty = true;
+    return entry.imageSize;
+}
+
+void TilesetSizeIndex::read()
+{
+    mRead = true;
+
+    QFile file(mFileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream in(&file);
+
+    quint32 magic;
+    in >> magic;
+    if (magic != SIZE_INDEX_MAGIC)
+        return;
+
+    quint32 version;
+    in >> version;
+    if (version != SIZE_INDEX_VERSION)
+        return;
+
+    in.setVersion(QDataStream::Qt_4_0);
+
+    qint32 count;
+    in >> count;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QString path;
+        Entry entry;
+        qint32 width, height;
+        in >> path >> entry.modified >> entry.fileSize >> width >> height;
+        entry.imageSize = QSize(width, height);
+        if (in.status() == QDataStream::Ok)
+            mEntries[path] = entry;
+    }
+}
+
+void TilesetSizeIndex::save()
+{
+    if (!mDirty)
+        return;
+
+    QFile file(mFileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream out(&file);
+    out << quint32(SIZE_INDEX_MAGIC);
+    out << quint32(SIZE_INDEX_VERSION);
+    out.setVersion(QDataStream::Qt_4_0);
+    out << qint32(mEntries.size());
+    for (auto it = mEntries.constBegin(); it != mEntries.constEnd(); ++it) {
+        out << it.key() << it->modified << it->fileSize
+            << qint32(it->imageSize.width()) << qint32(it->imageSize.height());
+    }
+
+    mDirty = false;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILESETSIZEINDEX_H
+#define TILESETSIZEINDEX_H
+
+#include <QHash>
+#include <QSize>
+#include <QString>
+
+namespace Tiled {
+
+/**
+  * Remembers the size of tileset images between sessions, so tilesets can be
+  * sized without reading every image's header.  An entry is only used while
+  * the image file's modification time and size are unchanged.
+  *
+  * Not thread-safe, only used by TileMetaInfoMgr on the GUI thread.
+  */
+class TilesetSizeIndex
+{
+public:
+    TilesetSizeIndex(const QString &fileName);
+
+    /**
+      * Returns the size of the image \a path, or an invalid size if the file
+      * doesn't exist or isn't an image.
+      */
+    QSize imageSize(const QString &path);
+
+    /**
+      * Writes the index if it changed since it was read.
+      */
+    void save();
+
+private:
+    void read();
+
+    struct Entry
+    {
+        qint64 modified;
+        qint64 fileSize;
+        QSize imageSize;
+    };
+
+    QString mFileName;
+    QHash<QString,Entry> mEntries;
+    bool mRead;
+    bool mDirty;
+};
+
+} // namespace Tiled
+
+#endif // TILESETSIZEINDEX_H
@@ -22,6 +22,7 @@
 #include "mainwindow.h"
 #include "mapcomposite.h"
 #include "mapmanager.h"
+#include "mapprefetcher.h"
 #include "progress.h"
 #include "world.h"
 #include "worldcell.h"
@@ -171,16 +172,19 @@ bool TMXToBMP::generateWorld(WorldDocument *worldDoc, TMXToBMP::GenerateMode mod
 
     mModifiedImages.clear();
 
-    if (mode == GenerateSelected) {
-        foreach (WorldCell *cell, worldDoc->selectedCells())
-            if (!generateCell(cell))
+    {
+        QList<WorldCell*> cells = (mode == GenerateSelected)
+                ? worldDoc->selectedCells()
+                : MapPrefetcher::allCells(world);
+
+        // Read the maps for the next cells while this one is being generated.
+        MapPrefetcher prefetcher(cells);
+
+        for (int i = 0; i < cells.size(); i++) {
+            prefetcher.cellStarted(i);
+            if (!generateCell(cells[i]))
                 goto errorExit;
-    } else {
-        for (int y = 0; y < world->height(); y++) {
-            for (int x = 0; x < world->width(); x++) {
-                if (!generateCell(world->cellAt(x, y)))
-                    goto errorExit;
-            }
+            prefetcher.cellFinished(i);
         }
     }
 
@@ -320,7 +324,7 @@ bool TMXToBMP::generateCell(WorldCell *cell)
     mapLoader.addMap(mapInfo);
 
     while (mapLoader.isLoading()) {
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        MapManager::instance()->waitForThreadResults();
     }
 
     QRgb black = qRgba(0, 0, 0, 255);
@@ -371,13 +375,12 @@ bool TMXToBMP::doBuildings(WorldCell *cell, MapInfo *mapInfo)
 
     // The cell map must be loaded before creating the MapComposite, which will
     // possibly load embedded lots.
-    while (mapInfo->isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+    MapManager::instance()->waitForMap(mapInfo);
 
     MapComposite staticMapComposite(mapInfo);
     MapComposite *mapComposite = &staticMapComposite;
     while (mapComposite->waitingForMapsToLoad() || mapLoader.isLoading())
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        MapManager::instance()->waitForThreadResults();
     if (!mapLoader.errorString().isEmpty()) {
         mError = mapLoader.errorString();
         return false;
@@ -31,6 +31,7 @@
 #include <zlib.h>
 #include <QByteArray>
 #include <QDebug>
+#include <QString>
 
 using namespace Tiled;
 
@@ -57,14 +58,32 @@ static void logZlibError(int error)
 QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
 {
     QByteArray out;
-    out.resize(expectedSize);
+    if (!decompress(data.constData(), data.length(), out, expectedSize))
+        return QByteArray();
+    return out;
+}
+
+QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
+{
+    QByteArray out;
+    if (!compress(data.constData(), data.length(), out, method))
+        return QByteArray();
+    return out;
+}
+
+bool Tiled::decompress(const char *data, int length, QByteArray &out,
+                       int expectedSize)
+{
+    // A few spare bytes let inflate() reach the end of the stream without
+    // having to grow a buffer that is exactly the expected size.
+    out.resize(qMax(expectedSize, 1024) + 16);
     z_stream strm;
 
     strm.zalloc = Z_NULL;
     strm.zfree = Z_NULL;
     strm.opaque = Z_NULL;
-    strm.next_in = (Bytef *) data.data();
-    strm.avail_in = data.length();
+    strm.next_in = (Bytef *) data;
+    strm.avail_in = length;
     strm.next_out = (Bytef *) out.data();
     strm.avail_out = out.size();
 
@@ -72,7 +91,7 @@ QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
 
     if (ret != Z_OK) {
         logZlibError(ret);
-        return QByteArray();
+        return false;
     }
 
     do {
@@ -86,7 +105,7 @@ QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
             case Z_MEM_ERROR:
                 inflateEnd(&strm);
                 logZlibError(ret);
-                return QByteArray();
+                return false;
         }
 
         if (ret != Z_STREAM_END) {
@@ -100,30 +119,28 @@ QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
     while (ret != Z_STREAM_END);
 
     if (strm.avail_in != 0) {
+        inflateEnd(&strm);
         logZlibError(Z_DATA_ERROR);
-        return QByteArray();
+        return false;
     }
 
     const int outLength = out.size() - strm.avail_out;
     inflateEnd(&strm);
 
     out.resize(outLength);
-    return out;
+    return true;
 }
 
-QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
+bool Tiled::compress(const char *data, int length, QByteArray &out,
+                     CompressionMethod method)
 {
-    QByteArray out;
-    out.resize(1024);
     int err;
     z_stream strm;
     strm.zalloc = Z_NULL;
     strm.zfree = Z_NULL;
     strm.opaque = Z_NULL;
-    strm.next_in = (Bytef *) data.data();
-    strm.avail_in = data.length();
-    strm.next_out = (Bytef *) out.data();
-    strm.avail_out = out.size();
+    strm.next_in = (Bytef *) data;
+    strm.avail_in = length;
 
     const int windowBits = (method == Gzip) ? 15 + 16 : 15;
 
@@ -131,9 +148,13 @@ QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
                        8, Z_DEFAULT_STRATEGY);
     if (err != Z_OK) {
         logZlibError(err);
-        return QByteArray();
+        return false;
     }
 
+    out.resize(int(deflateBound(&strm, length)));
+    strm.next_out = (Bytef *) out.data();
+    strm.avail_out = out.size();
+
     do {
         err = deflate(&strm, Z_FINISH);
         Q_ASSERT(err != Z_STREAM_ERROR);
@@ -151,12 +172,91 @@ QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
     if (err != Z_STREAM_END) {
         logZlibError(err);
         deflateEnd(&strm);
-        return QByteArray();
+        return false;
     }
 
     const int outLength = out.size() - strm.avail_out;
     deflateEnd(&strm);
 
     out.resize(outLength);
-    return out;
+    return true;
+}
+
+static const char base64Alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+namespace {
+
+struct Base64DecodeTable
+{
+    Base64DecodeTable()
+    {
+        for (int i = 0; i < 128; i++)
+            values[i] = -1;
+        for (int i = 0; i < 64; i++)
+            values[int(base64Alphabet[i])] = i;
+    }
+
+    signed char values[128];
+};
+
+} // namespace
+
+void Tiled::decodeBase64(QStringView text, QByteArray &out)
+{
+    static const Base64DecodeTable table;
+
+    out.resize((text.size() * 3) / 4 + 3);
+    uchar *dst = reinterpret_cast<uchar*>(out.data());
+    int count = 0;
+
+    uint buffer = 0;
+    int bits = 0;
+    for (const QChar c : text) {
+        const ushort u = c.unicode();
+        if (u >= 128)
+            continue;
+        const int value = table.values[u];
+        if (value < 0) {
+            if (u == '=')
+                break;
+            continue; // whitespace
+        }
+        buffer = (buffer << 6) | uint(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            dst[count++] = uchar(buffer >> bits);
+        }
+    }
+
+    out.resize(count);
+}
+
+void Tiled::encodeBase64(const char *data, int length, QString &out)
+{
+    out.resize(((length + 2) / 3) * 4);
+    QChar *dst = out.data();
+    const uchar *src = reinterpret_cast<const uchar*>(data);
+
+    int i = 0;
+    for (; i + 2 < length; i += 3) {
+        const uint n = (uint(src[i]) << 16) | (uint(src[i + 1]) << 8) | src[i + 2];
+        *dst++ = QLatin1Char(base64Alphabet[(n >> 18) & 63]);
+        *dst++ = QLatin1Char(base64Alphabet[(n >> 12) & 63]);
+        *dst++ = QLatin1Char(base64Alphabet[(n >> 6) & 63]);
+        *dst++ = QLatin1Char(base64Alphabet[n & 63]);
+    }
+
+    const int remaining = length - i;
+    if (remaining > 0) {
+        uint n = uint(src[i]) << 16;
+        if (remaining == 2)
+            n |= uint(src[i + 1]) << 8;
+        *dst++ = QLatin1Char(base64Alphabet[(n >> 18) & 63]);
+        *dst++ = QLatin1Char(base64Alphabet[(n >> 12) & 63]);
+        *dst++ = (remaining == 2) ? QLatin1Char(base64Alphabet[(n >> 6) & 63])
+                                  : QLatin1Char('=');
+        *dst++ = QLatin1Char('=');
+    }
 }
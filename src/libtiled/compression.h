@@ -31,7 +31,10 @@
 
 #include "tiled_global.h"
 
+#include <QStringView>
+
 class QByteArray;
+class QString;
 
 namespace Tiled {
 
@@ -67,6 +70,41 @@ QByteArray TILEDSHARED_EXPORT decompress(const QByteArray &data,
 QByteArray TILEDSHARED_EXPORT compress(const QByteArray &data,
                                        CompressionMethod method = Zlib);
 
+/**
+ * Decompresses zlib or gzip compressed memory into \a out, whose storage is
+ * reused between calls. \a out is sized for \a expectedSize bytes up front
+ * and only grows if the data turns out to be larger.
+ *
+ * @return true on success
+ */
+bool TILEDSHARED_EXPORT decompress(const char *data, int length,
+                                   QByteArray &out, int expectedSize);
+
+/**
+ * Compresses memory into \a out, whose storage is reused between calls.
+ * The output is sized with deflateBound() so deflate runs in a single pass.
+ * The result is identical to compress(const QByteArray&, CompressionMethod).
+ *
+ * @return true on success
+ */
+bool TILEDSHARED_EXPORT compress(const char *data, int length,
+                                 QByteArray &out,
+                                 CompressionMethod method = Zlib);
+
+/**
+ * Decodes base64 text straight from the XML reader into \a out, skipping
+ * whitespace. Equivalent to QByteArray::fromBase64(text.toLatin1()) without
+ * the two temporary buffers.
+ */
+void TILEDSHARED_EXPORT decodeBase64(QStringView text, QByteArray &out);
+
+/**
+ * Encodes memory as padded base64 into \a out, whose storage is reused
+ * between calls. Equivalent to QString::fromLatin1(data.toBase64()).
+ */
+void TILEDSHARED_EXPORT encodeBase64(const char *data, int length,
+                                     QString &out);
+
 } // namespace Tiled
 
 #endif // COMPRESSION_H
@@ -60,6 +60,12 @@ public:
      */
     bool isEmpty() const { return mFirstGidToTileset.isEmpty(); }
 
+    /**
+     * Returns the first global ID of each tileset known to this gid mapper.
+     */
+    const QMap<uint, Tileset*> &firstGidToTileset() const
+    { return mFirstGidToTileset; }
+
     /**
      * Returns the cell data matched by the given \a gid. The \a ok parameter
      * indicates whether an error occurred.
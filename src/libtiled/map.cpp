@@ -31,6 +31,7 @@
 #include "map.h"
 
 #include "layer.h"
+#include "mapobject.h"
 #include "objectgroup.h"
 #include "tile.h"
 #include "tilelayer.h"
@@ -295,6 +296,35 @@ MapNoBlend *Map::noBlend(const QString &layerName)
         mNoBlend[layerName] = new MapNoBlend(layerName, width(), height());
     return mNoBlend[layerName];
 }
+
+qint64 Map::memoryUsage() const
+{
+    qint64 bytes = sizeof(Map);
+    foreach (Layer *layer, mLayers) {
+        if (TileLayer *tl = layer->asTileLayer())
+            bytes += tl->memoryUsage();
+        else if (ObjectGroup *og = layer->asObjectGroup()) {
+            bytes += sizeof(ObjectGroup);
+            foreach (MapObject *mo, og->objects())
+                bytes += sizeof(MapObject) + mo->polygon().capacity() * sizeof(QPointF);
+        }
+    }
+    bytes += mBmpMain.memoryUsage() + mBmpVeg.memoryUsage();
+    foreach (MapNoBlend *noBlend, mNoBlend)
+        bytes += noBlend->memoryUsage();
+    bytes += mEncodingCache.memoryUsage();
+    return bytes;
+}
+
+qint64 MapEncodingCache::memoryUsage() const
+{
+    qint64 bytes = 0;
+    foreach (const LayerData &data, mLayers)
+        bytes += data.text.capacity() * sizeof(QChar);
+    for (const BmpData &data : mBmps)
+        bytes += data.text.capacity() * sizeof(QChar);
+    return bytes;
+}
 #endif // ZOMBOID
 
 Map *Map::clone() const
@@ -392,6 +422,14 @@ void MapRands::setSeed(uint seed)
     setSize(size(), at(0).size());
 }
 
+qint64 MapRands::memoryUsage() const
+{
+    qint64 bytes = qint64(capacity()) * sizeof(QVector<quint32>);
+    for (const QVector<quint32> &column : *this)
+        bytes += qint64(column.capacity()) * sizeof(quint32);
+    return bytes;
+}
+
 /////
 
 QString BmpBlend::dirAsString() const
@@ -36,6 +36,7 @@
 
 #ifdef ZOMBOID
 #include <QBitArray>
+#include <QHash>
 #endif
 #include <QList>
 #include <QMargins>
@@ -62,6 +63,7 @@ public:
     void setSize(int width, int height);
     void setSeed(uint seed);
     uint seed() const { return mSeed; }
+    qint64 memoryUsage() const;
 private:
     uint mSeed;
 };
@@ -91,6 +93,9 @@ public:
 
     QList<QRgb> colors() const;
 
+    qint64 memoryUsage() const
+    { return mImage.sizeInBytes() + mRands.memoryUsage(); }
+
     QImage mImage;
     MapRands mRands;
 };
@@ -117,6 +122,9 @@ public:
 
     MapNoBlend copy(const QRegion &rgn);
 
+    qint64 memoryUsage() const
+    { return mBits.size() / 8; }
+
 private:
     QString mLayerName;
     int mWidth;
@@ -265,6 +273,46 @@ private:
  *
  * It also keeps track of the list of referenced tilesets.
  */
+#ifdef ZOMBOID
+/**
+ * The encoded parts of a map from the last time it was written. MapWriter
+ * re-encodes only the tile layers and BMP images that changed since then.
+ */
+class TILEDSHARED_EXPORT MapEncodingCache
+{
+public:
+    class LayerData
+    {
+    public:
+        uint changeCount;
+        int format;
+        QMap<uint, Tileset*> firstGids;
+        QString text;
+    };
+
+    class BmpData
+    {
+    public:
+        BmpData() : imageKey(0) {}
+
+        qint64 imageKey;
+        QList<QRgb> colors;
+        QString text;
+    };
+
+    void clear()
+    {
+        mLayers.clear();
+        mBmps[0] = mBmps[1] = BmpData();
+    }
+
+    qint64 memoryUsage() const;
+
+    QHash<quint64, LayerData> mLayers; // TileLayer::serial() -> data
+    BmpData mBmps[2];
+};
+#endif
+
 class TILEDSHARED_EXPORT Map : public Object
 {
 public:
@@ -508,6 +556,18 @@ public:
 
     BmpSettings *rbmpSettings() { return &mBmpSettings; }
     const BmpSettings *bmpSettings() const { return &mBmpSettings; }
+
+    /**
+     * Returns an estimate of the number of bytes used by this map's tile
+     * layers, object groups, BMP images and random-number grids.
+     * Tileset images are not included, they are owned by the TilesetManager.
+     */
+    qint64 memoryUsage() const;
+
+    /**
+     * Used by MapWriter, which only sees a const Map.
+     */
+    MapEncodingCache &encodingCache() const { return mEncodingCache; }
 #endif
 
     Map *clone() const;
@@ -541,6 +601,7 @@ private:
     MapBmp mBmpVeg;
     QMap<QString,MapNoBlend*> mNoBlend;
     BmpSettings mBmpSettings;
+    mutable MapEncodingCache mEncodingCache;
 #endif
 };
 
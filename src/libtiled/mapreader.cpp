@@ -46,6 +46,7 @@
 #include <QFileInfo>
 #ifdef ZOMBOID
 #include <QImageReader>
+#include <QtEndian>
 #include "qtlockedfile.h"
 using namespace SharedTools;
 #endif
@@ -138,6 +139,9 @@ private:
     GidMapper mGidMapper;
     bool mReadingExternalTileset;
 
+    QByteArray mCompressedData;
+    QByteArray mTileData;
+
     QXmlStreamReader xml;
 };
 
@@ -504,45 +508,52 @@ void MapReaderPrivate::decodeBinaryLayerData(TileLayer *tileLayer,
                                              QStringView text,
                                              QStringView compression)
 {
-#if QT_VERSION < 0x040800
-    const QString textData = QString::fromRawData(text.unicode(), text.size());
-    const QByteArray latin1Text = textData.toLatin1();
-#else
-    const QByteArray latin1Text = text.toLatin1();
-#endif
-    QByteArray tileData = QByteArray::fromBase64(latin1Text);
     const int size = (tileLayer->width() * tileLayer->height()) * 4;
 
+    // The scratch buffers are reused for every layer in the map.
     if (compression == QLatin1String("zlib")
         || compression == QLatin1String("gzip")) {
-        tileData = decompress(tileData, size);
+        decodeBase64(text, mCompressedData);
+        if (!decompress(mCompressedData.constData(), mCompressedData.length(),
+                        mTileData, size))
+            mTileData.clear();
     } else if (!compression.isEmpty()) {
         xml.raiseError(tr("Compression method '%1' not supported")
                        .arg(compression.toString()));
         return;
+    } else {
+        decodeBase64(text, mTileData);
     }
 
-    if (size != tileData.length()) {
+    if (size != mTileData.length()) {
         xml.raiseError(tr("Corrupt layer data for layer '%1'")
                        .arg(tileLayer->name()));
         return;
     }
 
-    const unsigned char *data =
-            reinterpret_cast<const unsigned char*>(tileData.constData());
+    const uchar *data = reinterpret_cast<const uchar*>(mTileData.constData());
+    const int width = tileLayer->width();
     int x = 0;
     int y = 0;
 
+    // Most of a layer is empty or runs of the same tile, so avoid looking up
+    // the tileset for every square.  New layers are empty, so gid 0 is skipped.
+    uint lastGid = 0;
+    Cell lastCell;
+
     for (int i = 0; i < size - 3; i += 4) {
-        const uint gid = data[i] |
-                         data[i + 1] << 8 |
-                         data[i + 2] << 16 |
-                         data[i + 3] << 24;
+        const uint gid = qFromLittleEndian<quint32>(data + i);
 
-        tileLayer->setCell(x, y, cellForGid(gid));
+        if (gid != 0) {
+            if (gid != lastGid) {
+                lastCell = cellForGid(gid);
+                lastGid = gid;
+            }
+            tileLayer->setCell(x, y, lastCell);
+        }
 
         x++;
-        if (x == tileLayer->width()) {
+        if (x == width) {
             x = 0;
             y++;
         }
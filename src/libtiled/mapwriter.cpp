@@ -42,6 +42,9 @@
 
 #include <QCoreApplication>
 #include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QtEndian>
 #include <QXmlStreamWriter>
 #ifdef ZOMBOID
 #include "qtlockedfile.h"
@@ -82,6 +85,8 @@ private:
     void writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
                       uint firstGid);
     void writeTileLayer(QXmlStreamWriter &w, const TileLayer *tileLayer);
+    const QString &encodedLayerData(const TileLayer *tileLayer);
+    void encodeLayerData(const TileLayer *tileLayer, QString &out);
     void writeLayerAttributes(QXmlStreamWriter &w, const Layer *layer);
     void writeObjectGroup(QXmlStreamWriter &w, const ObjectGroup *objectGroup);
     void writeObject(QXmlStreamWriter &w, const MapObject *mapObject);
@@ -92,12 +97,21 @@ private:
     QString rgbString(QRgb rgb);
     void writeBmpSettings(QXmlStreamWriter &w, const BmpSettings *settings);
     void writeBmpImage(QXmlStreamWriter &w, int index, const MapBmp &bmp);
+    void encodeBmpPixels(const MapBmp &bmp, QList<QRgb> &colors, QString &out);
     void writeNoBlend(QXmlStreamWriter &w, MapNoBlend *noBlend);
 #endif
 
     QDir mMapDir;     // The directory in which the map is being saved
     GidMapper mGidMapper;
     bool mUseAbsolutePaths;
+
+    QByteArray mTileData;
+    QByteArray mCompressedData;
+    QString mBase64Data;
+#ifdef ZOMBOID
+    MapEncodingCache *mEncodingCache;
+    QSet<quint64> mEncodedLayers;
+#endif
 };
 
 } // namespace Internal
@@ -108,6 +122,9 @@ MapWriterPrivate::MapWriterPrivate()
     : mLayerDataFormat(MapWriter::Base64Gzip)
     , mDtdEnabled(false)
     , mUseAbsolutePaths(false)
+#ifdef ZOMBOID
+    , mEncodingCache(nullptr)
+#endif
 {
 }
 
@@ -204,6 +221,11 @@ void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
         firstGid += tileset->tileCount();
     }
 
+#ifdef ZOMBOID
+    mEncodingCache = &map->encodingCache();
+    mEncodedLayers.clear();
+#endif
+
     foreach (const Layer *layer, map->layers()) {
         const Layer::Type type = layer->type();
         if (type == Layer::TileLayerType)
@@ -215,11 +237,21 @@ void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
     }
 
 #ifdef ZOMBOID
+    // Forget layers that were removed from the map.
+    for (auto it = mEncodingCache->mLayers.begin(); it != mEncodingCache->mLayers.end(); ) {
+        if (mEncodedLayers.contains(it.key()))
+            ++it;
+        else
+            it = mEncodingCache->mLayers.erase(it);
+    }
+
     writeBmpSettings(w, map->bmpSettings());
     writeBmpImage(w, 0, map->bmpMain());
     writeBmpImage(w, 1, map->bmpVeg());
     foreach (MapNoBlend *noBlend, map->noBlends())
         writeNoBlend(w, noBlend);
+
+    mEncodingCache = nullptr;
 #endif
 
     w.writeEndElement();
@@ -358,47 +390,102 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
             }
         }
     } else if (mLayerDataFormat == MapWriter::CSV) {
-        QString tileData;
+        w.writeCharacters(QLatin1String("\n"));
+        w.writeCharacters(encodedLayerData(tileLayer));
+    } else {
+        w.writeCharacters(QLatin1String("\n   "));
+        w.writeCharacters(encodedLayerData(tileLayer));
+        w.writeCharacters(QLatin1String("\n  "));
+    }
+
+    w.writeEndElement(); // </data>
+    w.writeEndElement(); // </layer>
+}
+
+/**
+ * Returns the text of the <data> element of a CSV or base64 tile layer.
+ * When writing a map, the text is kept in the map's encoding cache and
+ * reused until the layer, the data format or the tileset gids change.
+ */
+const QString &MapWriterPrivate::encodedLayerData(const TileLayer *tileLayer)
+{
+#ifdef ZOMBOID
+    if (mEncodingCache) {
+        const quint64 serial = tileLayer->serial();
+        mEncodedLayers += serial;
+        auto it = mEncodingCache->mLayers.find(serial);
+        if (it != mEncodingCache->mLayers.end()
+                && it->changeCount == tileLayer->changeCount()
+                && it->format == mLayerDataFormat
+                && it->firstGids == mGidMapper.firstGidToTileset())
+            return it->text;
+
+        MapEncodingCache::LayerData data;
+        data.changeCount = tileLayer->changeCount();
+        data.format = mLayerDataFormat;
+        data.firstGids = mGidMapper.firstGidToTileset();
+        encodeLayerData(tileLayer, data.text);
+        it = mEncodingCache->mLayers.insert(serial, data);
+        return it->text;
+    }
+#endif
+    encodeLayerData(tileLayer, mBase64Data);
+    return mBase64Data;
+}
+
+void MapWriterPrivate::encodeLayerData(const TileLayer *tileLayer, QString &out)
+{
+    if (mLayerDataFormat == MapWriter::CSV) {
+        out.clear();
 
         for (int y = 0; y < tileLayer->height(); ++y) {
             for (int x = 0; x < tileLayer->width(); ++x) {
                 const uint gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
-                tileData.append(QString::number(gid));
+                out.append(QString::number(gid));
                 if (x != tileLayer->width() - 1
                     || y != tileLayer->height() - 1)
-                    tileData.append(QLatin1String(","));
+                    out.append(QLatin1String(","));
             }
-            tileData.append(QLatin1String("\n"));
+            out.append(QLatin1String("\n"));
         }
+        return;
+    }
 
-        w.writeCharacters(QLatin1String("\n"));
-        w.writeCharacters(tileData);
-    } else {
-        QByteArray tileData;
-        tileData.reserve(tileLayer->height() * tileLayer->width() * 4);
-
-        for (int y = 0; y < tileLayer->height(); ++y) {
-            for (int x = 0; x < tileLayer->width(); ++x) {
-                const uint gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
-                tileData.append((char) (gid));
-                tileData.append((char) (gid >> 8));
-                tileData.append((char) (gid >> 16));
-                tileData.append((char) (gid >> 24));
+    // The scratch buffers are reused for every layer in the map.
+    mTileData.resize(tileLayer->height() * tileLayer->width() * 4);
+    uchar *dst = reinterpret_cast<uchar*>(mTileData.data());
+
+    // Most of a layer is empty or runs of the same tile, so avoid looking
+    // up the tileset for every square.
+    Cell lastCell;
+    uint lastGid = 0;
+
+    for (int y = 0; y < tileLayer->height(); ++y) {
+        for (int x = 0; x < tileLayer->width(); ++x) {
+            const Cell &cell = tileLayer->cellAt(x, y);
+            if (cell != lastCell) {
+                lastCell = cell;
+                lastGid = mGidMapper.cellToGid(cell);
             }
+            qToLittleEndian<quint32>(lastGid, dst);
+            dst += 4;
         }
+    }
 
-        if (mLayerDataFormat == MapWriter::Base64Gzip)
-            tileData = compress(tileData, Gzip);
-        else if (mLayerDataFormat == MapWriter::Base64Zlib)
-            tileData = compress(tileData, Zlib);
+    const char *payload = mTileData.constData();
+    int payloadLength = mTileData.length();
 
-        w.writeCharacters(QLatin1String("\n   "));
-        w.writeCharacters(QString::fromLatin1(tileData.toBase64()));
-        w.writeCharacters(QLatin1String("\n  "));
+    if (mLayerDataFormat == MapWriter::Base64Gzip
+            || mLayerDataFormat == MapWriter::Base64Zlib) {
+        const CompressionMethod method =
+                (mLayerDataFormat == MapWriter::Base64Gzip) ? Gzip : Zlib;
+        if (!compress(payload, payloadLength, mCompressedData, method))
+            mCompressedData.clear();
+        payload = mCompressedData.constData();
+        payloadLength = mCompressedData.length();
     }
 
-    w.writeEndElement(); // </data>
-    w.writeEndElement(); // </layer>
+    encodeBase64(payload, payloadLength, out);
 }
 
 void MapWriterPrivate::writeLayerAttributes(QXmlStreamWriter &w,
@@ -670,20 +757,30 @@ void MapWriterPrivate::writeBmpSettings(QXmlStreamWriter &w,
 void MapWriterPrivate::writeBmpImage(QXmlStreamWriter &w,
                                      int index, const MapBmp &bmp)
 {
-    QList<QRgb> colors = bmp.colors();
-    if (colors.isEmpty())
-        return;
+    // Encoding the pixels is slow, reuse the last result if the image
+    // hasn't changed.  QImage::cacheKey() changes whenever the image does.
+    MapEncodingCache::BmpData *cached = mEncodingCache ? &mEncodingCache->mBmps[index] : nullptr;
+    const qint64 imageKey = bmp.image().cacheKey();
 
-    struct ColorCompare {
-        bool operator()(const QRgb& a, const QRgb& b) const {
-            if (qRed(a) < qRed(b)) return true;
-            if (qRed(a) > qRed(b)) return false;
-            if (qGreen(a) < qGreen(b)) return true;
-            if (qGreen(a) > qGreen(b)) return false;
-            return qBlue(a) < qBlue(b);
+    QList<QRgb> colors;
+    QString data;
+
+    if (cached && imageKey != 0 && cached->imageKey == imageKey) {
+        colors = cached->colors;
+        data = cached->text;
+    } else {
+        colors = bmp.colors();
+        if (!colors.isEmpty())
+            encodeBmpPixels(bmp, colors, data);
+        if (cached) {
+            cached->imageKey = imageKey;
+            cached->colors = colors;
+            cached->text = data;
         }
-    };
-    std::sort(colors.begin(), colors.end(), ColorCompare());
+    }
+
+    if (colors.isEmpty())
+        return;
 
     w.writeStartElement(QLatin1String("bmp-image"));
     w.writeAttribute(QLatin1String("index"), QString::number(index));
@@ -699,31 +796,52 @@ void MapWriterPrivate::writeBmpImage(QXmlStreamWriter &w,
     }
 
     w.writeStartElement(QLatin1String("pixels"));
-    QString data;
-    QByteArray tileData;
-    tileData.reserve(bmp.height() * bmp.width() * 4);
+    w.writeCharacters(QLatin1String("\n   "));
+    w.writeCharacters(data);
+    w.writeCharacters(QLatin1String("\n  "));
+    w.writeEndElement();
 
+    w.writeEndElement();
+}
+
+/**
+ * Sorts \a colors and encodes each pixel of \a bmp as an index into them.
+ */
+void MapWriterPrivate::encodeBmpPixels(const MapBmp &bmp, QList<QRgb> &colors,
+                                       QString &out)
+{
+    struct ColorCompare {
+        bool operator()(const QRgb& a, const QRgb& b) const {
+            if (qRed(a) < qRed(b)) return true;
+            if (qRed(a) > qRed(b)) return false;
+            if (qGreen(a) < qGreen(b)) return true;
+            if (qGreen(a) > qGreen(b)) return false;
+            return qBlue(a) < qBlue(b);
+        }
+    };
+    std::sort(colors.begin(), colors.end(), ColorCompare());
+
+    QHash<QRgb,int> colorIndex;
+    for (int i = colors.size() - 1; i >= 0; --i)
+        colorIndex[colors[i]] = i; // first occurrence wins, like indexOf()
+
+    mTileData.resize(bmp.height() * bmp.width() * 4);
+    uchar *dst = reinterpret_cast<uchar*>(mTileData.data());
+
+    const QImage image = bmp.image();
     const QRgb black = qRgb(0, 0, 0);
     for (int y = 0; y < bmp.height(); ++y) {
         for (int x = 0; x < bmp.width(); ++x) {
-            QRgb rgb = bmp.pixel(x, y);
-            quint32 n = (rgb == black) ? 0 : (colors.indexOf(rgb) + 1);
-            tileData.append((unsigned char) (n)); // FIXME: big/little endian
-            tileData.append((unsigned char) (n >> 8));
-            tileData.append((unsigned char) (n >> 16));
-            tileData.append((unsigned char) (n >> 24));
+            QRgb rgb = image.pixel(x, y);
+            quint32 n = (rgb == black) ? 0 : (colorIndex.value(rgb, -1) + 1);
+            qToLittleEndian<quint32>(n, dst);
+            dst += 4;
         }
     }
 
-    tileData = compress(tileData, Gzip);
-    data = QString::fromLatin1(tileData.toBase64());
-
-    w.writeCharacters(QLatin1String("\n   "));
-    w.writeCharacters(data);
-    w.writeCharacters(QLatin1String("\n  "));
-    w.writeEndElement();
-
-    w.writeEndElement();
+    if (!compress(mTileData.constData(), mTileData.length(), mCompressedData, Gzip))
+        mCompressedData.clear();
+    encodeBase64(mCompressedData.constData(), mCompressedData.length(), out);
 }
 
 void MapWriterPrivate::writeNoBlend(QXmlStreamWriter &w, MapNoBlend *noBlend)
@@ -34,8 +34,12 @@
 #include "tile.h"
 #include "tileset.h"
 
+#include <QAtomicInteger>
+
 using namespace Tiled;
 
+static QAtomicInteger<quint64> nextTileLayerSerial(1);
+
 TileLayer::TileLayer(const QString &name, int x, int y, int width, int height):
     Layer(TileLayerType, name, x, y, width, height),
     mMaxTileSize(0, 0),
@@ -47,6 +51,8 @@ TileLayer::TileLayer(const QString &name, int x, int y, int width, int height):
 #else
     mGrid(width * height)
 #endif
+    , mSerial(nextTileLayerSerial.fetchAndAddRelaxed(1))
+    , mChangeCount(0)
 {
     Q_ASSERT(width >= 0);
     Q_ASSERT(height >= 0);
@@ -127,6 +133,7 @@ void TileLayer::setCell(int x, int y, const Cell &cell)
 #else
     mGrid[x + y * mWidth] = cell;
 #endif
+    ++mChangeCount;
 }
 
 TileLayer *TileLayer::copy(const QRegion &region) const
@@ -202,6 +209,7 @@ void TileLayer::erase()
     mGrid.fill(emptyCell);
 #endif
     mUsedTilesets.clear();
+    ++mChangeCount;
 }
 #endif
 
@@ -247,6 +255,7 @@ void TileLayer::flip(FlipDirection direction)
 #endif
 
     mGrid = newGrid;
+    ++mChangeCount;
 }
 
 void TileLayer::rotate(RotateDirection direction)
@@ -301,6 +310,7 @@ void TileLayer::rotate(RotateDirection direction)
     mWidth = newWidth;
     mHeight = newHeight;
     mGrid = newGrid;
+    ++mChangeCount;
 }
 
 
@@ -362,6 +372,7 @@ void TileLayer::removeReferencesToTileset(Tileset *tileset)
             mGrid.replace(i, Cell());
 #endif
     }
+    ++mChangeCount;
 }
 
 void TileLayer::replaceReferencesToTileset(Tileset *oldTileset,
@@ -382,6 +393,7 @@ void TileLayer::replaceReferencesToTileset(Tileset *oldTileset,
             mGrid[i].tile = newTileset->tileAt(tile->id());
 #endif
     }
+    ++mChangeCount;
 }
 
 void TileLayer::resize(const QSize &size, const QPoint &offset)
@@ -419,6 +431,7 @@ void TileLayer::resize(const QSize &size, const QPoint &offset)
 
     mGrid = newGrid;
     Layer::resize(size, offset);
+    ++mChangeCount;
 }
 
 void TileLayer::offset(const QPoint &offset,
@@ -493,6 +506,7 @@ void TileLayer::offset(const QPoint &offset,
     }
 
     mGrid = newGrid;
+    ++mChangeCount;
 }
 
 bool TileLayer::canMergeWith(Layer *other) const
@@ -553,6 +567,17 @@ bool TileLayer::isEmpty() const
 #endif
 }
 
+#ifdef ZOMBOID
+qint64 TileLayer::memoryUsage() const
+{
+#if SPARSE_TILELAYER
+    return sizeof(TileLayer) + mGrid.memoryUsage();
+#else
+    return sizeof(TileLayer) + qint64(mGrid.capacity()) * sizeof(Cell);
+#endif
+}
+#endif
+
 /**
  * Returns a duplicate of this TileLayer.
  *
@@ -169,6 +169,18 @@ public:
             mCells.clear();
     }
 
+    /**
+      * Returns an estimate of the number of bytes used by this grid.
+      * QHash nodes are counted as key + value + next/hash overhead.
+      */
+    qint64 memoryUsage() const
+    {
+        if (mUseVector)
+            return qint64(mCellsVector.capacity()) * sizeof(Cell);
+        return qint64(mCells.capacity()) * sizeof(void*)
+                + qint64(mCells.size()) * (sizeof(int) + sizeof(Cell) + 2 * sizeof(void*));
+    }
+
 private:
     void swapToVector()
     {
@@ -376,9 +388,27 @@ public:
 
     virtual Layer *clone() const;
 
+    /**
+     * Returns a number that no other tile layer will have, even after this
+     * one is deleted.
+     */
+    quint64 serial() const { return mSerial; }
+
+    /**
+     * Returns a counter that is incremented whenever a cell changes.
+     * Together with serial() it identifies the contents of the layer, so
+     * the MapWriter can reuse the encoded data of unchanged layers.
+     */
+    uint changeCount() const { return mChangeCount; }
+
 #ifdef ZOMBOID
     void setGroup(ZTileLayerGroup *group) { mTileLayerGroup = group; }
     ZTileLayerGroup *group() const { return mTileLayerGroup; }
+
+    /**
+     * Returns an estimate of the number of bytes used by this layer's cells.
+     */
+    qint64 memoryUsage() const;
 #endif
 
 protected:
@@ -393,6 +423,8 @@ private:
 #else
     QVector<Cell> mGrid;
 #endif
+    quint64 mSerial;
+    uint mChangeCount;
 };
 
 } // namespace Tiled
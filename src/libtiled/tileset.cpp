@@ -270,6 +270,14 @@ bool Tileset::loadFromCache(Tileset *cached)
     return true;
 }
 
+qint64 Tileset::memoryUsage() const
+{
+    qint64 bytes = mImage.sizeInBytes();
+    foreach (Tile *tile, mTiles)
+        bytes += tile->image().sizeInBytes();
+    return bytes;
+}
+
 bool Tileset::loadFromNothing(const QSize &imageSize, const QString &fileName)
 {
     Q_ASSERT(mTileWidth > 0 && mTileHeight > 0);
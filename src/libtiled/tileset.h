@@ -283,6 +283,12 @@ public:
 
     int changeCount() const
     { return mChangeCount; }
+
+    /**
+     * Returns the number of bytes of pixel data held by this tileset's image
+     * and tiles.  Images shared with other tilesets are counted here too.
+     */
+    qint64 memoryUsage() const;
 #endif
 
 private:
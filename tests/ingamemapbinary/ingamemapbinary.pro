@@ -0,0 +1,25 @@
+include(../../PZWorldEd.pri)
+
+QT += testlib xml
+CONFIG += testcase console
+CONFIG -= app_bundle
+TEMPLATE = app
+TARGET = test_ingamemapbinary
+
+DEFINES += ZOMBOID WORLDED
+DEFINES += QT_NO_CAST_FROM_ASCII \
+    QT_NO_CAST_TO_ASCII
+
+EDITOR = $$PWD/../../src/editor
+INCLUDEPATH += $$EDITOR $$EDITOR/InGameMap
+
+SOURCES += test_ingamemapbinary.cpp \
+    $$EDITOR/properties.cpp \
+    $$EDITOR/world.cpp \
+    $$EDITOR/worldcell.cpp \
+    $$EDITOR/worldcellobject.cpp \
+    $$EDITOR/InGameMap/ingamemapcell.cpp \
+    $$EDITOR/InGameMap/ingamemapreader.cpp \
+    $$EDITOR/InGameMap/ingamemapreaderbinary.cpp \
+    $$EDITOR/InGameMap/ingamemapwriter.cpp \
+    $$EDITOR/InGameMap/ingamemapwriterbinary.cpp
@@ -0,0 +1,237 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ingamemapreader.h"
+#include "ingamemapreaderbinary.h"
+#include "ingamemapwriter.h"
+#include "ingamemapwriterbinary.h"
+#include "world.h"
+#include "worldcell.h"
+
+#include <QTemporaryDir>
+#include <QtTest>
+
+/**
+  * Writes a world's features to XML, then converts the XML to the chunked
+  * binary format and checks the binary reader gives back the same features.
+  */
+class test_InGameMapBinary : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void roundTripVersion2();
+    void readRegionVersion2();
+    void readRegionVersion1();
+
+private:
+    World *newWorld() const;
+    static void clearFeatures(World *world);
+    static void deleteWorld(World *world);
+    static QStringList describe(World *world);
+
+    QTemporaryDir mDir;
+    QString mXmlPath;
+    World *mFromXml = nullptr;
+};
+
+World *test_InGameMapBinary::newWorld() const
+{
+    World *world = new World(3, 2);
+    GenerateLotsSettings settings;
+    settings.worldOrigin = QPoint(10, 20);
+    world->setGenerateLotsSettings(settings);
+    return world;
+}
+
+void test_InGameMapBinary::clearFeatures(World *world)
+{
+    for (WorldCell *cell : world->cells())
+        cell->inGameMap().clear();
+}
+
+void test_InGameMapBinary::deleteWorld(World *world)
+{
+    if (world == nullptr)
+        return;
+    clearFeatures(world);
+    delete world;
+}
+
+// One line per feature, in cell and feature order.
+QStringList test_InGameMapBinary::describe(World *world)
+{
+    QStringList result;
+    for (WorldCell *cell : world->cells()) {
+        for (InGameMapFeature *feature : cell->inGameMap().features()) {
+            QString s = QStringLiteral("%1,%2 %3").arg(cell->x()).arg(cell->y()).arg(feature->mGeometry.mType);
+            for (const InGameMapCoordinates &coords : qAsConst(feature->mGeometry.mCoordinates)) {
+                s += QStringLiteral(" [");
+                for (const InGameMapPoint &point : coords)
+                    s += QStringLiteral(" %1,%2").arg(point.x, 0, 'g', 17).arg(point.y, 0, 'g', 17);
+                s += QStringLiteral(" ]");
+            }
+            for (const InGameMapProperty &property : qAsConst(feature->mProperties))
+                s += QStringLiteral(" %1=%2").arg(property.mKey, property.mValue);
+            result += s;
+        }
+    }
+    return result;
+}
+
+void test_InGameMapBinary::initTestCase()
+{
+    QVERIFY(mDir.isValid());
+
+    World *world = newWorld();
+
+    // Cell 0,0: a polygon with a hole, and properties that share strings.
+    {
+        WorldCell *cell = world->cellAt(0, 0);
+        InGameMapFeature *feature = new InGameMapFeature(&cell->inGameMap());
+        feature->mGeometry.mType = QStringLiteral("Polygon");
+        InGameMapCoordinates outer;
+        outer << InGameMapPoint(0, 0) << InGameMapPoint(300, 0) << InGameMapPoint(300, 300) << InGameMapPoint(0, 300);
+        InGameMapCoordinates hole;
+        hole << InGameMapPoint(10.5, 10.5) << InGameMapPoint(10.5, 20.25) << InGameMapPoint(20.75, 20.25);
+        feature->mGeometry.mCoordinates << outer << hole;
+        feature->mProperties << InGameMapProperty(QStringLiteral("water"), QStringLiteral("river"));
+        cell->inGameMap().mFeatures += feature;
+
+        feature = new InGameMapFeature(&cell->inGameMap());
+        feature->mGeometry.mType = QStringLiteral("Polygon");
+        InGameMapCoordinates square;
+        square << InGameMapPoint(50, 50) << InGameMapPoint(60, 50) << InGameMapPoint(60, 60) << InGameMapPoint(50, 60);
+        feature->mGeometry.mCoordinates << square;
+        feature->mProperties << InGameMapProperty(QStringLiteral("building"), QStringLiteral("yes"))
+                             << InGameMapProperty(QStringLiteral("water"), QStringLiteral("yes"));
+        cell->inGameMap().mFeatures += feature;
+    }
+
+    // Cell 2,0: a line and a point with no properties.
+    {
+        WorldCell *cell = world->cellAt(2, 0);
+        InGameMapFeature *feature = new InGameMapFeature(&cell->inGameMap());
+        feature->mGeometry.mType = QStringLiteral("LineString");
+        InGameMapCoordinates line;
+        line << InGameMapPoint(1, 2) << InGameMapPoint(150.5, 2) << InGameMapPoint(299, 298);
+        feature->mGeometry.mCoordinates << line;
+        feature->mProperties << InGameMapProperty(QStringLiteral("highway"), QStringLiteral("primary"));
+        cell->inGameMap().mFeatures += feature;
+
+        feature = new InGameMapFeature(&cell->inGameMap());
+        feature->mGeometry.mType = QStringLiteral("Point");
+        InGameMapCoordinates point;
+        point << InGameMapPoint(100, 200);
+        feature->mGeometry.mCoordinates << point;
+        cell->inGameMap().mFeatures += feature;
+    }
+
+    // Cell 1,1: a single feature, cells 1,0 0,1 and 2,1 are empty.
+    {
+        WorldCell *cell = world->cellAt(1, 1);
+        InGameMapFeature *feature = new InGameMapFeature(&cell->inGameMap());
+        feature->mGeometry.mType = QStringLiteral("Polygon");
+        InGameMapCoordinates triangle;
+        triangle << InGameMapPoint(0, 0) << InGameMapPoint(299.5, 0) << InGameMapPoint(0, 299.5);
+        feature->mGeometry.mCoordinates << triangle;
+        feature->mProperties << InGameMapProperty(QStringLiteral("natural"), QStringLiteral("forest"));
+        cell->inGameMap().mFeatures += feature;
+    }
+
+    mXmlPath = mDir.filePath(QStringLiteral("worldmap.xml"));
+    InGameMapWriter writer;
+    QVERIFY2(writer.writeWorld(world, mXmlPath), qPrintable(writer.errorString()));
+    deleteWorld(world);
+
+    // The features as read from the XML are what the binary files must match.
+    mFromXml = newWorld();
+    InGameMapReader reader;
+    QVERIFY(reader.readWorld(mXmlPath, mFromXml) != nullptr);
+    QCOMPARE(describe(mFromXml).size(), 5);
+}
+
+void test_InGameMapBinary::cleanupTestCase()
+{
+    deleteWorld(mFromXml);
+    mFromXml = nullptr;
+}
+
+void test_InGameMapBinary::roundTripVersion2()
+{
+    const QString binPath = mDir.filePath(QStringLiteral("roundtrip.chunks.bin"));
+    InGameMapWriterBinary writer;
+    writer.setVersion(2);
+    QVERIFY2(writer.writeWorld(mFromXml, binPath), qPrintable(writer.errorString()));
+
+    World *world = newWorld();
+    InGameMapReaderBinary reader;
+    QVERIFY2(reader.open(binPath), qPrintable(reader.errorString()));
+    QCOMPARE(reader.version(), 2);
+    QVERIFY2(reader.readWorld(world), qPrintable(reader.errorString()));
+    QCOMPARE(describe(world), describe(mFromXml));
+    deleteWorld(world);
+}
+
+void test_InGameMapBinary::readRegionVersion2()
+{
+    const QString binPath = mDir.filePath(QStringLiteral("region.chunks.bin"));
+    InGameMapWriterBinary writer;
+    writer.setVersion(2);
+    QVERIFY2(writer.writeWorld(mFromXml, binPath), qPrintable(writer.errorString()));
+
+    // Only the cells in the right-hand column.
+    const QRect region(2, 0, 1, 2);
+    World *world = newWorld();
+    InGameMapReaderBinary reader;
+    QVERIFY2(reader.open(binPath), qPrintable(reader.errorString()));
+    QVERIFY2(reader.readRegion(world, region), qPrintable(reader.errorString()));
+
+    QStringList expected;
+    for (const QString &s : describe(mFromXml)) {
+        if (s.startsWith(QLatin1String("2,")))
+            expected += s;
+    }
+    QCOMPARE(expected.size(), 2);
+    QCOMPARE(describe(world), expected);
+    deleteWorld(world);
+}
+
+void test_InGameMapBinary::readRegionVersion1()
+{
+    // Version 1 stores whole-number coordinates, so only check which cells
+    // a region read fills.
+    const QString binPath = mDir.filePath(QStringLiteral("worldmap.xml.bin"));
+    InGameMapWriterBinary writer;
+    QVERIFY2(writer.writeWorld(mFromXml, binPath), qPrintable(writer.errorString()));
+
+    World *world = newWorld();
+    InGameMapReaderBinary reader;
+    QVERIFY2(reader.open(binPath), qPrintable(reader.errorString()));
+    QCOMPARE(reader.version(), 1);
+    QVERIFY2(reader.readRegion(world, QRect(0, 0, 2, 2)), qPrintable(reader.errorString()));
+    QCOMPARE(world->cellAt(0, 0)->inGameMap().features().size(), 2);
+    QCOMPARE(world->cellAt(1, 1)->inGameMap().features().size(), 1);
+    QCOMPARE(world->cellAt(2, 0)->inGameMap().features().size(), 0);
+    deleteWorld(world);
+}
+
+QTEST_GUILESS_MAIN(test_InGameMapBinary)
+#include "test_ingamemapbinary.moc"
@@ -0,0 +1,17 @@
+include(../../PZWorldEd.pri)
+
+QT += testlib gui
+CONFIG += testcase console
+CONFIG -= app_bundle
+TEMPLATE = app
+TARGET = test_ingamemapcellimage
+
+DEFINES += QT_NO_CAST_FROM_ASCII \
+    QT_NO_CAST_TO_ASCII
+
+EDITOR = $$PWD/../../src/editor
+INCLUDEPATH += $$EDITOR $$EDITOR/InGameMap
+
+SOURCES += test_ingamemapcellimage.cpp \
+    $$EDITOR/lotpackreader.cpp \
+    $$EDITOR/InGameMap/ingamemapcellimage.cpp
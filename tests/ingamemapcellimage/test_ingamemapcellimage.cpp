@@ -0,0 +1,384 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ingamemapcellimage.h"
+#include "lotpackreader.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QFile>
+#include <QImage>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <cstring>
+
+namespace {
+
+struct TileName
+{
+    QString tilesetName;
+    int index;
+};
+
+// A small linear congruential generator, so every run writes the same lotpack.
+class Random
+{
+public:
+    explicit Random(quint32 seed) : mState(seed) {}
+
+    int bounded(int n)
+    {
+        mState = mState * 1664525u + 1013904223u;
+        return int((mState >> 8) % quint32(n));
+    }
+
+private:
+    quint32 mState;
+};
+
+const int FileLevels = 3;
+
+/**
+  * The hard-coded branches InGameMapImageDialog::tileToImage() used before
+  * the tile colors moved into a table.
+  */
+void oldTileToImage(QImage &image, const TileName &tile, int pixelX, int pixelY)
+{
+    if (tile.index == -1) {
+        return; // failed to parse the tile name
+    }
+    int tileIndex = tile.index;
+    if (tile.tilesetName.contains(QStringLiteral("_trees"))) {
+        image.setPixel(pixelX, pixelY, qRgb(38, 53, 22)); // normaltree
+    }
+    if (tile.tilesetName.contains(QStringLiteral("jumbo"))) {
+        image.setPixel(pixelX, pixelY, qRgb(38, 53, 22)); // jumbotree
+    }
+    if (tile.tilesetName.contains(QStringLiteral("_railroad"))) {
+        image.setPixel(pixelX, pixelY, qRgb(73, 58, 43)); // rails
+    }
+    if (tile.tilesetName.startsWith(QStringLiteral("vegetation"))) {
+        image.setPixel(pixelX, pixelY, qRgb(48, 73, 32)); // vegetation
+    }
+    if (tile.tilesetName.startsWith(QStringLiteral("blends_natural_01"))) {
+        if (tileIndex >= 0 && tileIndex <= 15) {
+            image.setPixel(pixelX, pixelY, qRgb(217, 207, 183)); // sand
+        }
+        if (tileIndex >= 16 && tileIndex <= 31) {
+            image.setPixel(pixelX, pixelY, qRgb(75, 88, 27)); // darkgrass
+        }
+        if (tileIndex >= 32 && tileIndex <= 47) {
+            image.setPixel(pixelX, pixelY, qRgb(97, 103, 36)); // medgrass
+        }
+        if (tileIndex >= 48 && tileIndex <= 63) {
+            image.setPixel(pixelX, pixelY, qRgb(127, 120, 45)); // litegrass
+        }
+        if (tileIndex >= 64 && tileIndex <= 79) {
+            image.setPixel(pixelX, pixelY, qRgb(91, 63, 21)); // dirt
+        }
+    }
+    if (tile.tilesetName.startsWith(QStringLiteral("blends_natural_02"))) {
+        image.setPixel(pixelX, pixelY, qRgb(108, 127, 131)); // water
+    }
+    if (tile.tilesetName.startsWith(QStringLiteral("blends_street_01"))) {
+        image.setPixel(pixelX, pixelY, qRgb(128, 128, 128)); // street
+    }
+    if (tile.tilesetName.startsWith(QStringLiteral("floors_exterior_tilesandstone"))) {
+        image.setPixel(pixelX, pixelY, qRgb(132, 81, 76)); // tilesand
+    }
+    if (tile.tilesetName.startsWith(QStringLiteral("floors_exterior_tilesandwood"))) {
+        image.setPixel(pixelX, pixelY, qRgb(132, 81, 76)); // tilesand
+    }
+    if (tile.tilesetName.startsWith(QStringLiteral("location_"))) {
+        image.setPixel(pixelX, pixelY, qRgb(132, 81, 76)); // tilesand
+    }
+    if (tile.tilesetName.startsWith(QStringLiteral("vegetation_farm"))) {
+        image.setPixel(pixelX, pixelY, qRgb(218, 165, 32)); // Corn
+    }
+    if (tile.tilesetName.startsWith(QStringLiteral("walls_"))) {
+        image.setPixel(pixelX, pixelY, qRgb(93, 44, 39)); // walls
+    }
+}
+
+int readInt(QDataStream &in)
+{
+    qint32 ret;
+    in >> ret;
+    return ret;
+}
+
+/**
+  * The QDataStream decoder InGameMapImageDialog::cellToImage() used before
+  * LotPackReader.  The old code stopped after the ground floor; here the
+  * upper floors and the footprint are drawn the way the new code documents.
+  */
+void oldCellToImage(QImage &image, QImage *footprint, const QString &fileName,
+                    int levels, bool upperFloors, const QList<TileName> &tiles)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        return;
+    }
+
+    QBuffer buffer;
+    buffer.open(QBuffer::ReadWrite);
+    buffer.write(file.readAll());
+    file.close();
+    buffer.seek(0);
+
+    QDataStream in(&buffer);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    for (int chunkY = 0; chunkY < 300 / 10; chunkY++) {
+        for (int chunkX = 0; chunkX < 300 / 10; chunkX++) {
+            int index = chunkX * 30 + chunkY;
+            buffer.seek(4 + index * 8);
+            qint64 pos;
+            in >> pos;
+            buffer.seek(pos);
+            int skip = 0;
+            for (int z = 0; z < levels; ++z) {
+                for (int x = 0; x < 10; ++x) {
+                    for (int y = 0; y < 10; ++y) {
+                        if (skip > 0) {
+                            --skip;
+                            continue;
+                        }
+                        int count = readInt(in);
+                        if (count == -1) {
+                            skip = readInt(in);
+                            if (skip > 0) {
+                                --skip;
+                            }
+                            continue;
+                        }
+                        int roomID = readInt(in);
+                        int pixelX = chunkX * 10 + x;
+                        int pixelY = chunkY * 10 + y;
+                        if (footprint && (roomID != -1 || z > 0)) {
+                            footprint->setPixel(pixelX, pixelY, qRgb(0, 0, 0));
+                        }
+                        for (int n = 1; n < count; ++n) {
+                            int tileNameIndex = readInt(in);
+                            if (z == 0 || upperFloors) {
+                                oldTileToImage(image, tiles[tileNameIndex], pixelX, pixelY);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+/**
+  * Checks the table-driven tile colors and the LotPackReader-based drawing
+  * give the same pixels as the hard-coded branches and the QDataStream
+  * decoder they replaced.
+  */
+class test_InGameMapCellImage : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void tileColor();
+    void drawCell_data();
+    void drawCell();
+
+private:
+    static QList<TileName> tileNames();
+    static QVector<quint32> tileColors(const QList<TileName> &tiles);
+    static QImage grayImage(int width, int height);
+    bool writeLotPack(const QString &fileName, int tileNameCount);
+
+    QTemporaryDir mDir;
+    QString mLotPackPath;
+};
+
+/**
+  * Returns tile names that hit every rule, including names matched by more
+  * than one rule, names matched by none, and a tile name that failed to parse.
+  */
+QList<TileName> test_InGameMapCellImage::tileNames()
+{
+    QList<TileName> tiles;
+    const char *names[] = {
+        "vegetation_trees_01",
+        "e_americanholly_1",
+        "jumbo_tree_01",
+        "industry_railroad_01",
+        "vegetation_ornamental_01",
+        "vegetation_farm_01",
+        "blends_natural_02",
+        "blends_street_01",
+        "floors_exterior_tilesandstone_01",
+        "floors_exterior_tilesandwood_01",
+        "location_shop_generic_01",
+        "walls_exterior_house_01",
+        "walls_jumbo_trees",
+        "floors_interior_tilesandwood_01",
+        "my_vegetation_01",
+        "furniture_railroad_jumbo_01",
+    };
+    for (const char *name : names) {
+        tiles += TileName { QLatin1String(name), 3 };
+    }
+    for (int index = 0; index < 96; index += 3) {
+        tiles += TileName { QStringLiteral("blends_natural_01"), index };
+    }
+    tiles += TileName { QStringLiteral("blends_natural_01"), 15 };
+    tiles += TileName { QStringLiteral("blends_natural_01"), 79 };
+    tiles += TileName { QStringLiteral("blends_natural_01"), 80 };
+    tiles += TileName { QStringLiteral("walls_exterior_house_01"), -1 };
+    return tiles;
+}
+
+QVector<quint32> test_InGameMapCellImage::tileColors(const QList<TileName> &tiles)
+{
+    QVector<quint32> colors;
+    for (const TileName &tile : tiles) {
+        colors += InGameMapCellImage::tileColor(tile.tilesetName, tile.index);
+    }
+    return colors;
+}
+
+QImage test_InGameMapCellImage::grayImage(int width, int height)
+{
+    QImage image(width, height, QImage::Format_RGBA8888);
+    image.fill(Qt::gray);
+    return image;
+}
+
+/**
+  * Writes a lotpack whose chunks mix runs of empty squares, squares inside
+  * and outside rooms, and squares with several tiles on every level.
+  */
+bool test_InGameMapCellImage::writeLotPack(const QString &fileName, int tileNameCount)
+{
+    const int chunkCount = 30 * 30;
+    const qint64 dataStart = 4 + chunkCount * 8;
+    const int squareCount = FileLevels * 10 * 10;
+
+    Random random(2026);
+    QVector<qint64> offsets;
+    QBuffer data;
+    data.open(QBuffer::WriteOnly);
+    QDataStream out(&data);
+    out.setByteOrder(QDataStream::LittleEndian);
+    for (int i = 0; i < chunkCount; i++) {
+        offsets += dataStart + data.pos();
+        int square = 0;
+        while (square < squareCount) {
+            if (random.bounded(4) == 0) {
+                const int skip = qMin(1 + random.bounded(40), squareCount - square);
+                out << qint32(-1) << qint32(skip);
+                square += skip;
+                continue;
+            }
+            const int count = 2 + random.bounded(4);
+            const int roomID = (random.bounded(3) == 0) ? random.bounded(5) : -1;
+            out << qint32(count) << qint32(roomID);
+            for (int n = 1; n < count; n++) {
+                out << qint32(random.bounded(tileNameCount));
+            }
+            square++;
+        }
+    }
+
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    QDataStream header(&file);
+    header.setByteOrder(QDataStream::LittleEndian);
+    header << qint32(chunkCount);
+    for (qint64 offset : qAsConst(offsets)) {
+        header << offset;
+    }
+    return file.write(data.data()) == data.size();
+}
+
+void test_InGameMapCellImage::initTestCase()
+{
+    QVERIFY(mDir.isValid());
+    mLotPackPath = mDir.filePath(QStringLiteral("world_0_0.lotpack"));
+    QVERIFY(writeLotPack(mLotPackPath, tileNames().size()));
+}
+
+void test_InGameMapCellImage::tileColor()
+{
+    const QList<TileName> tiles = tileNames();
+    for (const TileName &tile : tiles) {
+        QImage expected = grayImage(1, 1);
+        oldTileToImage(expected, tile, 0, 0);
+
+        QImage actual = grayImage(1, 1);
+        const quint32 color = InGameMapCellImage::tileColor(tile.tilesetName, tile.index);
+        if (color != 0) {
+            std::memcpy(actual.bits(), &color, 4);
+        }
+        QVERIFY2(actual == expected, qPrintable(QStringLiteral("%1 #%2").arg(tile.tilesetName).arg(tile.index)));
+    }
+}
+
+void test_InGameMapCellImage::drawCell_data()
+{
+    QTest::addColumn<int>("levels");
+    QTest::addColumn<bool>("upperFloors");
+    QTest::addColumn<bool>("withFootprint");
+
+    QTest::newRow("ground floor") << 1 << false << false;
+    QTest::newRow("footprint") << FileLevels << false << true;
+    QTest::newRow("upper floors") << FileLevels << true << true;
+}
+
+void test_InGameMapCellImage::drawCell()
+{
+    QFETCH(int, levels);
+    QFETCH(bool, upperFloors);
+    QFETCH(bool, withFootprint);
+
+    const QList<TileName> tiles = tileNames();
+    const int size = InGameMapCellImage::CellSize;
+
+    QImage expected = grayImage(size, size);
+    QImage expectedFootprint(size, size, QImage::Format_RGBA8888);
+    expectedFootprint.fill(Qt::transparent);
+    oldCellToImage(expected, withFootprint ? &expectedFootprint : nullptr,
+                   mLotPackPath, levels, upperFloors, tiles);
+
+    LotPackReader reader;
+    QVERIFY2(reader.open(mLotPackPath), qPrintable(reader.errorString()));
+    QImage actual = grayImage(size, size);
+    QImage actualFootprint(size, size, QImage::Format_RGBA8888);
+    actualFootprint.fill(Qt::transparent);
+    InGameMapCellImage::draw(reader, tileColors(tiles), levels, upperFloors,
+                             actual, withFootprint ? &actualFootprint : nullptr);
+
+    QVERIFY(expected != grayImage(size, size));
+    QCOMPARE(actual, expected);
+    QCOMPARE(actualFootprint, expectedFootprint);
+}
+
+QTEST_GUILESS_MAIN(test_InGameMapCellImage)
+#include "test_ingamemapcellimage.moc"
@@ -0,0 +1,18 @@
+include(../../PZWorldEd.pri)
+
+QT += testlib
+QT -= gui
+CONFIG += testcase console
+CONFIG -= app_bundle
+TEMPLATE = app
+TARGET = test_ingamemapmasktracer
+
+DEFINES += QT_NO_CAST_FROM_ASCII \
+    QT_NO_CAST_TO_ASCII
+
+EDITOR = $$PWD/../../src/editor
+INCLUDEPATH += $$EDITOR/InGameMap
+
+SOURCES += test_ingamemapmasktracer.cpp \
+    $$EDITOR/InGameMap/clipper.cpp \
+    $$EDITOR/InGameMap/ingamemapmasktracer.cpp
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2026, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "clipper.hpp"
+#include "ingamemapmasktracer.h"
+
+#include <QtTest>
+
+namespace {
+
+// A small linear congruential generator, so every run traces the same masks.
+class Random
+{
+public:
+    explicit Random(quint32 seed) : mState(seed) {}
+
+    int bounded(int n)
+    {
+        mState = mState * 1664525u + 1013904223u;
+        return int((mState >> 8) % quint32(n));
+    }
+
+private:
+    quint32 mState;
+};
+
+/**
+  * The polygons doWater() and doTrees() built before traceMask(): one Clipper
+  * path per filled square, unioned over the whole mask.
+  */
+ClipperLib::Paths unionOfSquares(const std::vector<char> &mask, int width, int height)
+{
+    ClipperLib::Clipper clipper;
+    ClipperLib::Path path;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (mask[x + y * width]) {
+                path.clear();
+                path << ClipperLib::IntPoint(x, y);
+                path << ClipperLib::IntPoint(x + 1, y);
+                path << ClipperLib::IntPoint(x + 1, y + 1);
+                path << ClipperLib::IntPoint(x, y + 1);
+                clipper.AddPath(path, ClipperLib::ptSubject, true);
+            }
+        }
+    }
+
+    ClipperLib::PolyTree polyTree;
+    clipper.Execute(ClipperLib::ctDifference, polyTree, ClipperLib::PolyFillType::pftPositive);
+    ClipperLib::Paths paths;
+    ClipperLib::PolyTreeToPaths(polyTree, paths);
+    return paths;
+}
+
+ClipperLib::Paths rings(const std::vector<pzPolygon*> &polygons)
+{
+    ClipperLib::Paths paths;
+    for (const pzPolygon *poly : polygons) {
+        paths.push_back(poly->outer);
+        paths.insert(paths.end(), poly->inner.begin(), poly->inner.end());
+    }
+    return paths;
+}
+
+// Holes have negative area, so this is the area covered by the paths.
+double area(const ClipperLib::Paths &paths)
+{
+    double sum = 0;
+    for (const ClipperLib::Path &path : paths) {
+        sum += ClipperLib::Area(path);
+    }
+    return sum;
+}
+
+double symmetricDifferenceArea(const ClipperLib::Paths &a, const ClipperLib::Paths &b)
+{
+    ClipperLib::Clipper clipper;
+    clipper.AddPaths(a, ClipperLib::ptSubject, true);
+    clipper.AddPaths(b, ClipperLib::ptClip, true);
+    ClipperLib::Paths paths;
+    clipper.Execute(ClipperLib::ctXor, paths, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+    return area(paths);
+}
+
+bool hasCollinearPoints(const ClipperLib::Path &ring)
+{
+    const size_t n = ring.size();
+    for (size_t i = 0; i < n; i++) {
+        const ClipperLib::IntPoint &a = ring[(i + n - 1) % n];
+        const ClipperLib::IntPoint &b = ring[i];
+        const ClipperLib::IntPoint &c = ring[(i + 1) % n];
+        if ((b.X - a.X) * (c.Y - b.Y) == (b.Y - a.Y) * (c.X - b.X)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+/**
+  * Checks traceMask() covers exactly the squares the old Clipper union of
+  * one path per square covered.
+  */
+class test_InGameMapMaskTracer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void traceMask_data();
+    void traceMask();
+
+private:
+    static QByteArray randomMask(int width, int height, int percent, quint32 seed);
+};
+
+/**
+  * Returns a mask with '#' for filled squares and '.' for empty ones.
+  */
+QByteArray test_InGameMapMaskTracer::randomMask(int width, int height, int percent, quint32 seed)
+{
+    Random random(seed);
+    QByteArray mask;
+    for (int i = 0; i < width * height; i++) {
+        mask += (random.bounded(100) < percent) ? '#' : '.';
+    }
+    return mask;
+}
+
+void test_InGameMapMaskTracer::traceMask_data()
+{
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+    QTest::addColumn<QByteArray>("mask");
+
+    QTest::newRow("empty") << 3 << 3 << QByteArray(".........");
+    QTest::newRow("single square") << 3 << 3 << QByteArray("....#....");
+    QTest::newRow("full") << 4 << 3 << QByteArray("############");
+    QTest::newRow("checkerboard") << 4 << 4 << QByteArray("#.#..#.##.#..#.#");
+    QTest::newRow("hole with island") << 5 << 5 << QByteArray("#####"
+                                                              "#...#"
+                                                              "#.#.#"
+                                                              "#...#"
+                                                              "#####");
+    QTest::newRow("hole behind corners") << 3 << 3 << QByteArray(".#."
+                                                                  "#.#"
+                                                                  ".#.");
+    QTest::newRow("corner-touching ring") << 4 << 4 << QByteArray("###."
+                                                                  "#..#"
+                                                                  "#.##"
+                                                                  ".##.");
+    for (int percent : { 20, 50, 80 }) {
+        for (quint32 seed = 1; seed <= 5; seed++) {
+            const QByteArray name = "random " + QByteArray::number(percent) + "% #" + QByteArray::number(seed);
+            QTest::newRow(name.constData()) << 60 << 45 << randomMask(60, 45, percent, seed);
+        }
+    }
+    QTest::newRow("cell") << 300 << 300 << randomMask(300, 300, 55, 2026);
+}
+
+void test_InGameMapMaskTracer::traceMask()
+{
+    QFETCH(int, width);
+    QFETCH(int, height);
+    QFETCH(QByteArray, mask);
+    QCOMPARE(mask.size(), width * height);
+
+    std::vector<char> squares(mask.size());
+    int filledCount = 0;
+    for (int i = 0; i < mask.size(); i++) {
+        squares[i] = (mask[i] == '#');
+        filledCount += squares[i];
+    }
+
+    const std::vector<pzPolygon*> polygons = ::traceMask(squares, width, height);
+    const ClipperLib::Paths actual = rings(polygons);
+    const ClipperLib::Paths expected = unionOfSquares(squares, width, height);
+
+    for (const pzPolygon *poly : polygons) {
+        QVERIFY(ClipperLib::Orientation(poly->outer));
+        QVERIFY(!hasCollinearPoints(poly->outer));
+        for (const ClipperLib::Path &hole : poly->inner) {
+            QVERIFY(!ClipperLib::Orientation(hole));
+            QVERIFY(!hasCollinearPoints(hole));
+        }
+    }
+    qDeleteAll(polygons);
+
+    QCOMPARE(area(expected), double(filledCount));
+    QCOMPARE(area(actual), double(filledCount));
+    QCOMPARE(symmetricDifferenceArea(actual, expected), 0.0);
+}
+
+QTEST_GUILESS_MAIN(test_InGameMapMaskTracer)
+#include "test_ingamemapmasktracer.moc"